@@ -115,3 +115,24 @@ void first_nonempty_ip(const void *src, void *dst)
    }
 }
 
+/* ================================================================= */
+/* ================== Count distinct function ====================== */
+/* ================================================================= */
+void count_distinct(const void *src, int size, void *state)
+{
+   hll_add((hll_sketch *) state, sketch_hash(src, size));
+}
+
+void count_distinct_result(const void *state, __attribute__((unused)) double param, void *dst)
+{
+   uint64_t count = hll_estimate((const hll_sketch *) state);
+   *((uint32_t *) dst) = count > UINT32_MAX ? UINT32_MAX : (uint32_t) count;
+}
+
+/* ================================================================= */
+/* ==================== Percentile function ======================== */
+/* ================================================================= */
+void percentile_result(const void *state, double param, void *dst)
+{
+   *((double *) dst) = quantile_estimate((const quantile_sketch *) state, param / 100);
+}
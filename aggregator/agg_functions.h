@@ -47,6 +47,8 @@
 #ifndef AGGREGATOR_AGG_FUNCTIONS_H
 #define AGGREGATOR_AGG_FUNCTIONS_H
 
+#include "sketch.h"
+
 /**
  * Makes sum of values stored on src and dst pointers from given type T.
  * @tparam T template type variable.
@@ -219,4 +221,41 @@ void bitwise_and(const void *src, void *dst)
    *((T*)dst) &= *((T*)src);
 }
 
+/**
+ * Add value of field to HyperLogLog sketch, value of any type is hashed as sequence of bytes.
+ * @param [in] src pointer to source of new data.
+ * @param [in] size size of source data (length of variable length field).
+ * @param [in,out] state pointer to hll_sketch of stored record.
+ */
+void count_distinct(const void *src, int size, void *state);
+
+/**
+ * Store estimated count of distinct values from HyperLogLog sketch to output field of type uint32.
+ * @param [in] state pointer to hll_sketch of stored record.
+ * @param [in] param unused.
+ * @param [out] dst pointer to output field.
+ */
+void count_distinct_result(const void *state, double param, void *dst);
+
+/**
+ * Add value of field of given type T to quantile sketch.
+ * @tparam T template type variable.
+ * @param [in] src pointer to source of new data.
+ * @param [in] size unused, size of T.
+ * @param [in,out] state pointer to quantile_sketch of stored record.
+ */
+template <typename T>
+void percentile(const void *src, __attribute__((unused)) int size, void *state)
+{
+   quantile_add((quantile_sketch *) state, (double) *((T*)src));
+}
+
+/**
+ * Store estimated percentile from quantile sketch to output field of type double.
+ * @param [in] state pointer to quantile_sketch of stored record.
+ * @param [in] param percentile (0 - 100).
+ * @param [out] dst pointer to output field.
+ */
+void percentile_result(const void *state, double param, void *dst);
+
 #endif //AGGREGATOR_AGG_FUNCTIONS_H
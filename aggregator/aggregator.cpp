@@ -47,6 +47,8 @@
 
 #include <cstdio>
 #include <csignal>
+#include <ctime>
+#include <string>
 #include <unistd.h>
 
 #include <getopt.h>
@@ -54,11 +56,14 @@
 #include <unirec/unirec.h>
 #include "fields.h"
 
-#include <unordered_map>
 #include <pthread.h>
 
 #include "output.h"
+#include "plan.h"
 #include "configuration.h"
+#include "storage.h"
+#include "state_file.h"
+#include "workers.h"
 
 //#define DEBUG
 #ifdef DEBUG
@@ -74,16 +79,22 @@
 //#define TRAP_RECV_TIMEOUT 4000000   // 4 seconds
 /** Timeout length value for trap_send() blocking function.*/
 #define TRAP_SEND_TIMEOUT 1000000   // 1 second
-/** Value (2^21) for default hash map space reservation before rehash needed.*/
-#define MAP_RESERVE 2097152
+/** Value (2^16) for default storage space reservation before resize needed.*/
+#define MAP_RESERVE 65536
+/** Expected size of variable length fields of stored record, used to estimate count of records fitting into memory limit.*/
+#define VAR_FIELDS_EXPECTED 64
+/** Flag set in AGG_FLAGS of record sent before its timeout because storage limit was reached.*/
+#define AGG_FLAG_EVICTED 1
 trap_module_info_t *module_info = NULL;
 /**
- * Statically defined fields COUNT, TIME_FIRST, TIME_LAST always used by module
+ * Statically defined fields COUNT, TIME_FIRST, TIME_LAST always used by module,
+ * AGG_FLAGS is added to output records when storage size is limited
  */
 UR_FIELDS (
         uint32 COUNT,
         time TIME_FIRST,
-        time TIME_LAST
+        time TIME_LAST,
+        uint8 AGG_FLAGS
 )
 
 /**
@@ -131,7 +142,25 @@ UR_FIELDS (
   PARAM('F', "firstne", "Keep first Non-Empty value of UniRec field identified by given name.", required_argument, "URFIELD") \
   PARAM('l', "last", "Keep first value of UniRec field identified by given name.", required_argument, "URFIELD") \
   PARAM('o', "or", "Make bitwise OR of UniRec field identified by given name.", required_argument, "URFIELD") \
-  PARAM('n', "and", "Make bitwise AND of UniRec field identified by given name.", required_argument, "URFIELD")
+  PARAM('n', "and", "Make bitwise AND of UniRec field identified by given name.", required_argument, "URFIELD") \
+  PARAM('d', "distinct", "Approximate count of distinct values of UniRec field identified by given name, " \
+        "stored to field NAME_DISTINCT.", required_argument, "URFIELD") \
+  PARAM('p', "percentile", "Approximate percentile of numeric UniRec field identified by given name, " \
+        "stored to field NAME_P<percentile> (e.g. BYTES:95 gives BYTES_P95).", required_argument, "URFIELD:PERCENT") \
+  PARAM('e', "median", "Approximate median of numeric UniRec field identified by given name, " \
+        "stored to field NAME_P50.", required_argument, "URFIELD") \
+  PARAM('T', "threads", "Count of worker threads processing received records (default 1 - records are " \
+        "processed by the receiving thread).", required_argument, "uint32") \
+  PARAM('b', "batch", "Send expired records in batches, output buffer is flushed after every batch " \
+        "of expired records instead of by its timeout.", no_argument, "none") \
+  PARAM('r', "max-records", "Maximal count of stored records. When reached, the least recently updated records " \
+        "are sent before their timeout with AGG_FLAGS field set to 1 (default 0 - not limited).", required_argument, "uint32") \
+  PARAM('B', "max-memory", "Maximal size of storage in MiB, when reached, records are sent early as with " \
+        "max-records (default 0 - not limited).", required_argument, "uint32") \
+  PARAM('S', "state-file", "Save stored records to given file when the module is stopped by signal and " \
+        "continue their aggregation when the module is started again.", required_argument, "string") \
+  PARAM('W', "watermark", "Event time mode, all timeouts are checked when the watermark (maximal TIME_LAST of received " \
+        "records minus given lateness in seconds) moves, instead of by the clock.", required_argument, "uint32")
 
 /**
  * To define positional parameter ("param" instead of "-m param" or "--mult param"), use the following definition:
@@ -140,29 +169,25 @@ UR_FIELDS (
  * This parameter will be listed in Additional parameters in module help output
  */
 
-/* ----------------------------------------------------------------- */
-#ifdef  AGGREGATOR_KEYWORD_H
-namespace std {
-   /**
-    * std::hash() specialization to use with class Key.
-    * Specialization needed by use class Key as key in std::unordered_map
-    */
-    template<>
-    struct hash<Key>
-    {
-        size_t operator()(const Key &k) const
-        {
-           return SuperFastHash(k.get_data(), k.get_size());
-        }
-    };
-}
-#endif
-/* ----------------------------------------------------------------- */
+/**
+ * Structure to pass data needed by record processing function (possibly running in worker thread).
+ */
+typedef struct {
+   ur_template_t *in_tmplt;      /*!< UniRec template of received records. */
+   Config *config;               /*!< Module configuration. */
+} process_params;
 
 static int stop = 0;
-static std::unordered_map<Key , void*> storage;                   // Need to be global because of trap_terminate
+static bool signal_stop = false;                       // Module was stopped by signal, not by end of input
+static bool event_time = false;                        // Timeouts are driven by watermark from record times
+static uint32_t lateness = 0;                          // Watermark delay after the maximal received TIME_LAST
+static uint32_t next_global = 0;                       // Watermark of the next global timeout in event time mode
+static bool batch_send = false;                        // Flush output buffer after every sent batch of records
+static Storage storage;                                // Need to be global because of trap_terminate
+static WorkerPool workers;                             // Threads processing records when more threads requested
+static AggPlan agg_plan;                               // Aggregation of records compiled for current templates
 time_t time_last_from_record = time(NULL);             // Passive timeout time info set due to records time
-pthread_mutex_t storage_mutex = PTHREAD_MUTEX_INITIALIZER;                 // For storage modifying sections
+pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;                    // Records are sent from more threads
 pthread_mutex_t time_last_from_record_mutex = PTHREAD_MUTEX_INITIALIZER;   // For modifying Passive timeout time info
 void flush_storage();
 
@@ -175,6 +200,7 @@ void my_signal_handler(int signal)
    if (signal == SIGTERM || signal == SIGINT) {
       fprintf(stderr, "Signal caught, exiting module\n");
       stop = 1;
+      signal_stop = true;
    }
 }
 
@@ -213,13 +239,9 @@ void print_template_fields(ur_template_t* tmplt)
  * Function to free memory allocated by module.
  * @param [in] in_tmplt input UniRec template to free.
  * @param [in] out_tmplt output UniRec template to free.
- * @param [in] storage Container with stored data to be freed.
  */
-void clean_memory(ur_template_t *in_tmplt, ur_template_t *out_tmplt, std::unordered_map<Key, void*> storage){
-   std::unordered_map<Key, void*>::iterator it;
-   for ( it = storage.begin(); it != storage.end(); it++) {
-      ur_free_record(it->second);
-   }
+void clean_memory(ur_template_t *in_tmplt, ur_template_t *out_tmplt){
+   workers.finish();
    storage.clear();
 
    TRAP_DEFAULT_FINALIZATION();
@@ -229,62 +251,18 @@ void clean_memory(ur_template_t *in_tmplt, ur_template_t *out_tmplt, std::unorde
    ur_finalize();
 }
 /* ----------------------------------------------------------------- */
-/**
- * Wrapper function for creating UniRec record of given template and size.
- * @param [in] tmplt UniRec template to generate record from.
- * @param [in] length Size of variable part of message.
- * @return Pointer to allocated block of memory which represents created record.
- */
-void * create_record(ur_template_t *tmplt, int length)
-{
-   return ur_create_record(tmplt, length);
-}
-/* ----------------------------------------------------------------- */
 /**
  * Function to update the record values with specified rules from user input.
  * Always increase count (aggregated records counter). Use minimal value of TIME_FIRST field
- * and maximal value of TIME_LAST.
- * @param [in] in_tmplt UniRec template of received record.
+ * and maximal value of TIME_LAST. Fields are processed by aggregation plan of current templates.
  * @param [in] src_rec pointer to received record.
- * @param [in] out_tmplt UniRec template of stored/updated record.
  * @param [in, out] dst_rec pointer to stored/updated record.
+ * @param [in, out] state pointer to sketch state of stored record.
  */
-void process_agg_functions(ur_template_t *in_tmplt, const void *src_rec, ur_template_t *out_tmplt, void *dst_rec)
+void process_agg_functions(const void *src_rec, void *dst_rec, void *state)
 {
-   // Always increase count when processing functions
-   ur_set(out_tmplt, dst_rec, F_COUNT, ur_get(out_tmplt, dst_rec, F_COUNT) + 1);
-
-   // Modify time attributes TIME_FIRST:min
-   uint64_t stored = ur_get(out_tmplt, dst_rec, F_TIME_FIRST);
-   uint64_t record = ur_get(in_tmplt, src_rec, F_TIME_FIRST);
-   if (record < stored)
-      ur_set(out_tmplt, dst_rec, F_TIME_FIRST, ur_get(in_tmplt, src_rec, F_TIME_FIRST));
-
-   // Modify time attributes TIME_LAST:max
-   stored = ur_get(out_tmplt, dst_rec, F_TIME_LAST);
-   record = ur_get(in_tmplt, src_rec, F_TIME_LAST);
-   if (record > stored)
-      ur_set(out_tmplt, dst_rec, F_TIME_LAST, ur_get(in_tmplt, src_rec, F_TIME_LAST));
-
-
-   void *ptr_dst;
-   void *ptr_src;
-   // Process all registered fields with their agg function
-   for (int i = 0; i < OutputTemplate::used_fields; i++) {
-      int field_id = OutputTemplate::indexes_to_record[i];
-      if (ur_is_fixlen(field_id)) {
-         ptr_dst = ur_get_ptr_by_id(out_tmplt, dst_rec, field_id);
-         ptr_src = ur_get_ptr_by_id(in_tmplt, src_rec, field_id);
-         OutputTemplate::process[i](ptr_src, ptr_dst);
-      }
-      else {
-         var_params params = {dst_rec, field_id, ur_get_var_len(in_tmplt, src_rec, field_id)};
-         ptr_src = ur_get_ptr_by_id(in_tmplt, src_rec, field_id);
-         OutputTemplate::process[i](ptr_src, (void *) &params);
-      }
-   }
+   agg_plan.update(src_rec, dst_rec, state);
 }
-
 /* ----------------------------------------------------------------- */
 /**
  * Set default (initial) values to from received to stored/output record.
@@ -293,22 +271,28 @@ void process_agg_functions(ur_template_t *in_tmplt, const void *src_rec, ur_temp
  * @param [in] src_rec pointer to received record.
  * @param [in] out_tmplt UniRec template of initialized (output) record.
  * @param [in,out] dst_rec pointer to initialized (output) record.
+ * @param [out] state pointer to sketch state of initialized record.
  */
-void init_record_data(ur_template_t * in_tmplt, const void *src_rec, ur_template_t *out_tmplt, void *dst_rec)
+void init_record_data(ur_template_t * in_tmplt, const void *src_rec, ur_template_t *out_tmplt, void *dst_rec, void *state)
 {
    ur_clear_varlen(out_tmplt, dst_rec);
    // Copy all fields which are part of output template
    ur_copy_fields(out_tmplt, dst_rec, in_tmplt, src_rec);
    // Set initial value of module field(s)
    ur_set(out_tmplt, dst_rec, F_COUNT, 1);
+   if (storage.is_bounded()) {
+      ur_set(out_tmplt, dst_rec, F_AGG_FLAGS, 0);
+   }
+   agg_plan.init_state(src_rec, state);
 }
 /* ----------------------------------------------------------------- */
 /**
  * Function to make all necessary post processing of output record before it is send.
  * There should be added all data modifications uncompleted during record live cycle.
  * @param [in,out] stored_rec pointer to stored record, which has to be processed.
+ * @param [in] state pointer to sketch state of stored record.
  */
-void prepare_to_send(void *stored_rec)
+void prepare_to_send(void *stored_rec, const void *state)
 {
    // Proces activities needed to be done before sending the record
 
@@ -319,6 +303,12 @@ void prepare_to_send(void *stored_rec)
       }
    }
 
+   // Store results of sketch functions
+   for (int i = 0; i < OutputTemplate::sketch_fields; i++) {
+      OutputTemplate::sketch_final[i]((const char *) state + OutputTemplate::sketch_offset[i], OutputTemplate::sketch_param[i],
+                                      ur_get_ptr_by_id(OutputTemplate::out_tmplt, stored_rec, OutputTemplate::sketch_dst[i]));
+   }
+
    /*
     * Add every new post processing of agg function here
     */
@@ -326,49 +316,426 @@ void prepare_to_send(void *stored_rec)
 }
 /* ----------------------------------------------------------------- */
 /**
- * Makes all necessary steps before record can be send to output interface.
- * @param [in] out_tmplt UniRec template of stored/output record.
- * @param [in] out_rec pointer to record which is going to be send
+ * Send data of one record to output interface 0, retried when timeout occurs. Caller has to hold send_mutex.
+ * @param [in] data pointer to record data.
+ * @param [in] size size of record data.
  * @return True if record successfully sent, false if record was not send.
  */
-bool send_record_out(ur_template_t *out_tmplt, void *out_rec)
+bool send_data(const void *data, uint16_t size)
 {
-
-   DBG((stderr, "Count of message to send is: %d\n", ur_get(out_tmplt, out_rec, F_COUNT)));
-
-   if(OutputTemplate::prepare_to_send) {
-      prepare_to_send(out_rec);
-   }
-
-   // Send record to interface 0.
-   int i = 0;
-   for (; i < MAX_TIMEOUT_RETRY; i++) {
+   for (int i = 0; i < MAX_TIMEOUT_RETRY; i++) {
       DBG((stderr, "Trying to send..\n"));
-      int ret = trap_send(0, out_rec, ur_rec_fixlen_size(out_tmplt) + ur_rec_varlen_size(out_tmplt, out_rec));
+      int ret = trap_send(0, data, size);
 
       // Handle possible errors
       TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, continue, break);
       return true;
    }
-
    fprintf(stderr, "Cannot send record due to error or time_out\n");
    return false;
 }
+/* ----------------------------------------------------------------- */
+/**
+ * Makes all necessary steps before record can be send and copy it to the batch of records to send.
+ * The stored record can be removed from storage then, batch is sent by send_batch().
+ * @param [in,out] batch batch of records to send.
+ * @param [in] out_rec pointer to stored record.
+ * @param [in] state pointer to sketch state of stored record.
+ */
+void collect_record(RecordBatch &batch, void *out_rec, const void *state)
+{
+   if(OutputTemplate::prepare_to_send) {
+      prepare_to_send(out_rec, state);
+   }
+   batch.add(out_rec, ur_rec_size(OutputTemplate::out_tmplt, out_rec), NULL, 0, 0);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Send all records of the batch to output interface and clear the batch. No storage lock is needed,
+ * so records can be processed while the batch is being sent.
+ * When batch send mode is set, output interface buffer is flushed after the batch.
+ * @param [in,out] batch batch of records to send.
+ * @return True if all records successfully sent, false otherwise.
+ */
+bool send_batch(RecordBatch &batch)
+{
+   bool sent = true;
+   if (batch.items.empty()) {
+      return sent;
+   }
+
+   pthread_mutex_lock(&send_mutex);
+   for (size_t i = 0; i < batch.items.size() && sent; i++) {
+      uint32_t end = (i + 1 < batch.items.size()) ? batch.items[i + 1].offset : batch.data.size();
+      sent = send_data(&batch.data[batch.items[i].offset], end - batch.items[i].offset);
+   }
+   if (batch_send) {
+      trap_send_flush(0);
+   }
+   pthread_mutex_unlock(&send_mutex);
 
+   batch.clear();
+   return sent;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Move all records stored in the shard to the batch of records to send and clear the shard.
+ * Caller has to hold the shard lock, batch is sent by send_batch() after the lock is released.
+ * @param [in,out] shard storage shard to flush.
+ * @param [in,out] batch batch of records to send.
+ */
+void flush_shard(StorageShard &shard, RecordBatch &batch)
+{
+   for (size_t i = 0; i < shard.table.get_capacity(); i++) {
+      StorageEntry *entry = shard.table.get_entry(i);
+      if (entry) {
+         collect_record(batch, entry->record, shard.table.get_state(entry));
+      }
+   }
+   storage.update_records(-(long) shard.table.size());
+   shard.table.clear();
+   shard.wheel.clear();
+}
 /* ----------------------------------------------------------------- */
 /**
  * Tries to send out all stored records, free their memory and clear the storage.
+ * Shards are locked one by one only while their records are moved out, records are sent without the lock.
  */
 void flush_storage()
 {
+   RecordBatch batch;
+
    // Send all stored data
-  
-   std::unordered_map<Key, void*>::iterator it;
-   for ( it = storage.begin(); it != storage.end(); it++) {
-      send_record_out(OutputTemplate::out_tmplt, it->second);
-      ur_free_record(it->second);
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      StorageShard &shard = storage.get_shard(i);
+
+      // Lock the shard -- CRITICAL SECTION START
+      pthread_mutex_lock(&shard.lock);
+      flush_shard(shard, batch);
+      // Unlock the shard -- CRITICAL SECTION END
+      pthread_mutex_unlock(&shard.lock);
+
+      send_batch(batch);
+   }
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Move the least recently updated record of the shard to the batch of records to send, flagged as evicted.
+ * Caller has to hold the shard lock, batch is sent by send_batch() after the lock is released.
+ * @param [in,out] shard storage shard with count of records over its limit.
+ * @param [in,out] batch batch of records to send.
+ * @return True if record was removed, false if the shard is empty.
+ */
+bool evict_record(StorageShard &shard, RecordBatch &batch)
+{
+   ExpiryNode *node = shard.wheel.pop_oldest(&shard.stats);
+   if (node) {
+      StorageEntry *entry = StorageEntry::from_node(node);
+      ur_set(OutputTemplate::out_tmplt, entry->record, F_AGG_FLAGS,
+             ur_get(OutputTemplate::out_tmplt, entry->record, F_AGG_FLAGS) | AGG_FLAG_EVICTED);
+      collect_record(batch, entry->record, shard.table.get_state(entry));
+      shard.table.erase(entry);
+      shard.evicted++;
+      storage.update_records(-1);
+      return true;
+   }
+   return false;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Fill the aggregation key with values of key fields from given record.
+ * @param [out] key empty key to be filled.
+ * @param [in] tmplt UniRec template of the record.
+ * @param [in] rec pointer to record.
+ */
+void fill_key(Key &key, ur_template_t *tmplt, const void *rec)
+{
+   for (uint i = 0; i < KeyTemplate::used_fields; i++) {
+      key.add_field(ur_get_ptr_by_id(tmplt, rec, KeyTemplate::indexes_to_record[i]),
+                    ur_get_size(KeyTemplate::indexes_to_record[i]));
+   }
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Get time when the stored record expires, the record is placed into the expiry wheel by this time.
+ * With clock driven timeouts, only the passive timeout is checked by the wheel (active timeout is checked
+ * when the key is received again). In event time mode, also active timeout is checked by the wheel,
+ * so records of idle keys are sent as soon as the watermark passes the end of their time window.
+ * @param [in] config module configuration.
+ * @param [in] stored_rec pointer to stored record.
+ * @return Expire time in seconds.
+ */
+uint32_t get_expire_time(Config *config, const void *stored_rec)
+{
+   uint32_t passive = ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, stored_rec, F_TIME_LAST)) +
+                      config->get_timeout(TIMEOUT_PASSIVE);
+   if (!event_time) {
+      return passive;
+   }
+
+   uint32_t active = ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, stored_rec, F_TIME_FIRST)) +
+                     config->get_timeout(TIMEOUT_ACTIVE);
+   switch (config->get_timeout_type()) {
+   case TIMEOUT_ACTIVE:
+      return active;
+   case TIMEOUT_ACTIVE_PASSIVE:
+      return active < passive ? active : passive;
+   default:
+      return passive;
    }
-   storage.clear();
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Aggregate received record into the storage. Locks the storage shard of record key.
+ * @param [in] in_tmplt UniRec template of received record.
+ * @param [in] in_rec pointer to received record.
+ * @param [in] key data of aggregation key of received record.
+ * @param [in] hash hash of the key.
+ * @param [in] config module configuration.
+ * @return True on success, false if record could not be processed and module has to stop.
+ */
+bool process_record(ur_template_t *in_tmplt, const void *in_rec, const char *key, uint32_t hash, Config *config)
+{
+   bool ok = true;
+   time_t record_first = ur_time_get_sec(ur_get(in_tmplt, in_rec, F_TIME_FIRST));
+   StorageShard &shard = storage.get_shard(Storage::get_shard_index(hash));
+
+   bool inserted, resized;
+   bool variable = config->is_variable();
+   RecordBatch evicted;
+   // Lock the shard -- CRITICAL SECTION START
+   pthread_mutex_lock(&shard.lock);
+   StorageEntry *entry = shard.table.find_or_insert(key, hash,
+                                                    variable ? agg_plan.init_size(in_rec) : 0, &inserted, &resized);
+   if (resized) {
+      // Entries were moved, their wheel nodes have to be linked again
+      shard.relink_wheel();
+   }
+
+   if (entry == NULL) {
+      fprintf(stderr, "Error: Memory allocation problem (output record).\n");
+      ok = false;
+   }
+   else if (inserted == false) {
+      // Element already exists
+      bool new_time_window = false;
+      void *stored_rec = entry->record;
+      // Main thread checks time window only when active timeout set
+      if ( (config->get_timeout_type() == TIMEOUT_ACTIVE) || (config->get_timeout_type() == TIMEOUT_ACTIVE_PASSIVE)) {
+         // Check time window for active timeout
+         time_t stored_first = ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, stored_rec, F_TIME_FIRST));
+         // Record is not in current time window
+         if (stored_first + config->get_timeout(TIMEOUT_ACTIVE) < record_first ) {
+            new_time_window = true;
+         }
+      }
+      if (new_time_window) {
+         // Finished record is copied to the batch and sent with evicted records after the lock is released
+         collect_record(evicted, stored_rec, shard.table.get_state(entry));
+         if (variable && !shard.table.reserve_record(entry, agg_plan.init_size(in_rec))) {
+            fprintf(stderr, "Error: Memory allocation problem (output record).\n");
+            ok = false;
+         }
+         else {
+            init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, entry->record, shard.table.get_state(entry));
+         }
+      }
+      else if (variable && !shard.table.reserve_record(entry, ur_rec_size(OutputTemplate::out_tmplt, stored_rec) +
+                                                              agg_plan.update_size(in_rec))) {
+         fprintf(stderr, "Error: Memory allocation problem (output record).\n");
+         ok = false;
+      }
+      else {
+         // Record with variable length fields could be moved to a larger chunk
+         process_agg_functions(in_rec, entry->record, shard.table.get_state(entry));
+      }
+      // Passive timeout is counted from updated TIME_LAST
+      shard.wheel.update(&entry->node, get_expire_time(config, entry->record));
+   }
+   else {
+      // New element, record memory is part of the table entry (or arena chunk fitting its variable length fields)
+      init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, entry->record, shard.table.get_state(entry));
+      entry->node.expire = get_expire_time(config, entry->record);
+      shard.wheel.insert(&entry->node);
+      storage.update_records(1);
+   }
+
+   // Make space for the new or grown record by sending the oldest ones early
+   while (ok && shard.over_limit()) {
+      if (!evict_record(shard, evicted)) {
+         break;
+      }
+   }
+   // Unlock the shard -- CRITICAL SECTION END
+   pthread_mutex_unlock(&shard.lock);
+
+   if (!evicted.items.empty() && !send_batch(evicted)) {
+      ok = false;
+   }
+   return ok;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Record handler of worker threads, aggregates record copy with the key built by receiving thread.
+ * @param [in] rec pointer to copy of received record.
+ * @param [in] key pointer to copy of record key data.
+ * @param [in] hash hash of record key computed by receiving thread.
+ * @param [in] arg pointer to process_params structure.
+ * @return True on success, false if record could not be processed.
+ */
+bool process_record_worker(const void *rec, const char *key, uint32_t hash, void *arg)
+{
+   process_params *params = (process_params *) arg;
+
+   return process_record(params->in_tmplt, rec, key, hash, params->config);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Load records saved by previous run of the module into the storage configured for current templates.
+ * State file is removed after it was loaded, so the same records are never restored twice.
+ * Caller has to hold all shard locks (or no other thread can use the storage).
+ * @param [in] path name of state file.
+ * @param [in] config module configuration.
+ * @return False if storage memory could not be allocated, true otherwise (also when there is no usable state file).
+ */
+bool restore_state(const char *path, Config *config)
+{
+   StateFile file;
+   if (!file.open(path, StateFile::layout(config, OutputTemplate::out_tmplt))) {
+      return true;
+   }
+
+   bool ok = true;
+   size_t restored = 0;
+   state_record rec;
+   RecordBatch evicted;
+   while (ok && file.next(&rec, OutputTemplate::out_tmplt, config->is_variable())) {
+      Key key;
+      key.add_field(rec.key, KeyTemplate::key_size);
+      StorageShard &shard = storage.get_shard(Storage::get_shard_index(key.get_hash()));
+
+      bool inserted, resized;
+      StorageEntry *entry = shard.table.find_or_insert(key.get_data(), key.get_hash(), rec.record_size, &inserted, &resized);
+      if (resized) {
+         shard.relink_wheel();
+      }
+      if (entry == NULL) {
+         fprintf(stderr, "Error: Memory allocation problem (output record).\n");
+         ok = false;
+         break;
+      }
+      if (!inserted) {
+         // Keys are unique in state file, damaged record is skipped
+         continue;
+      }
+      memcpy(entry->record, rec.record, rec.record_size);
+      memcpy(shard.table.get_state(entry), rec.state, OutputTemplate::state_size);
+      entry->node.expire = rec.expire;
+      shard.wheel.insert(&entry->node);
+      storage.update_records(1);
+      restored++;
+
+      // Storage can be limited more than in the previous run
+      while (shard.over_limit()) {
+         if (!evict_record(shard, evicted)) {
+            break;
+         }
+      }
+      if (!evicted.items.empty()) {
+         send_batch(evicted);
+      }
+   }
+
+   if (!file.finished()) {
+      fprintf(stderr, "Warning: State file %s is truncated, %lu records restored.\n", path, (unsigned long) restored);
+   }
+   else if (trap_get_verbose_level() >= 0) {
+      printf("State file %s: %lu records restored\n", path, (unsigned long) restored);
+   }
+   file.close();
+   unlink(path);
+   return ok;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Receive record from input interface 0 and update input template when format changes.
+ * Worker threads share templates and UniRec field definitions, so all their records
+ * have to be processed before fields are redefined.
+ * @param [out] in_rec pointer to received record.
+ * @param [out] in_rec_size size of received record.
+ * @param [in,out] in_tmplt UniRec template of input interface, updated on format change.
+ * @return Return value of trap_recv(), TRAP_E_FORMAT_MISMATCH if new template could not be created.
+ */
+int receive_record(const void **in_rec, uint16_t *in_rec_size, ur_template_t **in_tmplt)
+{
+   int ret = trap_recv(0, in_rec, in_rec_size);
+   if (ret == TRAP_E_FORMAT_CHANGED) {
+      workers.drain();
+
+      const char *spec = NULL;
+      uint8_t data_fmt;
+      if (trap_get_data_fmt(TRAPIFC_INPUT, 0, &data_fmt, &spec) != TRAP_E_OK) {
+         fprintf(stderr, "Error: Data format was not loaded.\n");
+         return TRAP_E_FORMAT_MISMATCH;
+      }
+      *in_tmplt = ur_define_fields_and_update_template(spec, *in_tmplt);
+      if (*in_tmplt == NULL) {
+         fprintf(stderr, "Error: Input template could not be updated.\n");
+         return TRAP_E_FORMAT_MISMATCH;
+      }
+   }
+   return ret;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Move all records of the shard with timeout elapsed to the batch of records to send
+ * and remove them. Caller has to hold the shard lock, batch is sent by send_batch() after the lock is released.
+ * @param [in,out] shard storage shard to check.
+ * @param [in] now current time in seconds, records with expire time (see get_expire_time()) < now are removed.
+ * @param [in,out] batch batch of records to send.
+ */
+void expire_shard(StorageShard &shard, uint32_t now, RecordBatch &batch)
+{
+   ExpiryNode expired;
+   ExpiryWheel::init_list(&expired);
+   shard.wheel.expire(now, &expired, &shard.stats);
+
+   long removed = 0;
+   ExpiryNode *node = expired.next;
+   while (node != &expired) {
+      StorageEntry *entry = StorageEntry::from_node(node);
+      node = node->next;
+
+      collect_record(batch, entry->record, shard.table.get_state(entry));
+      shard.table.erase(entry);
+      removed++;
+   }
+   storage.update_records(-removed);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Print statistics of passive timeout checks.
+ * @param [in] stats statistics to print.
+ * @param [in] duration duration of the check in seconds.
+ * @param [in] stored count of records remaining in storage.
+ */
+void print_expiry_stats(const expiry_stats *stats, double duration, size_t stored)
+{
+   printf("Passive timeout check: %.3f ms, %lu checked, %lu expired, %lu rescheduled, %lu stored\n",
+          duration * 1000, (unsigned long) stats->visited, (unsigned long) stats->expired,
+          (unsigned long) stats->rescheduled, (unsigned long) stored);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Print occupancy statistics of storage.
+ */
+void print_storage_stats()
+{
+   storage_stats stats;
+   storage.get_storage_stats(&stats);
+   printf("Storage: %lu records, %lu peak records, %lu bytes, %lu var-len bytes, %lu evicted\n",
+          (unsigned long) stats.records, (unsigned long) stats.peak_records,
+          (unsigned long) stats.bytes, (unsigned long) stats.var_bytes, (unsigned long) stats.evicted);
 }
 /* ----------------------------------------------------------------- */
 /**
@@ -387,11 +754,10 @@ void *check_timeouts(void *input)
       while (!stop) {
          time_t start = time(NULL);
 
-         // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock(&storage_mutex);
          flush_storage();
-         // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
+         if (trap_get_verbose_level() >= 0) {
+            print_storage_stats();
+         }
          time_t end = time(NULL);
 
          int elapsed = difftime(end, start);
@@ -410,27 +776,41 @@ void *check_timeouts(void *input)
       time_last_from_record += timeout;
       pthread_mutex_unlock(&time_last_from_record_mutex);
 
+      expiry_stats stats, last_stats;
+      memset(&last_stats, 0, sizeof(last_stats));
+      RecordBatch batch;
+      struct timespec check_start, check_end;
+
       while (!stop) {
          time_t start = time(NULL);
+         size_t stored = 0;
+         clock_gettime(CLOCK_MONOTONIC, &check_start);
+
+         /* Can happen that record accesed for timeout check is being processed by other thread, need to use lock
+          * Shards are checked one by one, so only one shard is blocked at a time */
+         for (int i = 0; i < STORAGE_SHARDS && !stop; i++) {
+            StorageShard &shard = storage.get_shard(i);
+
+            // Lock the shard -- CRITICAL SECTION START
+            pthread_mutex_lock(&shard.lock);
+            // Only records in wheel slots of elapsed seconds are checked
+            expire_shard(shard, time_last_from_record, batch);
+            stored += shard.table.size();
+            // Unlock the shard -- CRITICAL SECTION END
+            pthread_mutex_unlock(&shard.lock);
+
+            send_batch(batch);
+         }
 
-         /* Can happen that record accesed for timeout check is being processed by main thread, need to use lock
-          * Only accessing and modifying different elements is thread safe in stl map container */
-         // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock(&storage_mutex);
-
-         for (std::unordered_map<Key, void*>::iterator it = storage.begin(); it != storage.end(); ) {
-            if (ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, it->second, F_TIME_LAST)) < time_last_from_record - timeout) {
-               // Send record out
-               send_record_out(OutputTemplate::out_tmplt, it->second);
-               ur_free_record(it->second);
-               it = storage.erase(it);
-            }
-            else {
-               ++it;
-            }
+         if (trap_get_verbose_level() >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &check_end);
+            storage.get_expiry_stats(&stats);
+            expiry_stats diff = {stats.checks - last_stats.checks, stats.visited - last_stats.visited,
+                                 stats.expired - last_stats.expired, stats.rescheduled - last_stats.rescheduled};
+            print_expiry_stats(&diff, (check_end.tv_sec - check_start.tv_sec) + (check_end.tv_nsec - check_start.tv_nsec) / 1e9, stored);
+            print_storage_stats();
+            last_stats = stats;
          }
-         // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
 
          time_t end = time(NULL);
          int elapsed = difftime(end, start);
@@ -455,6 +835,84 @@ void *check_timeouts(void *input)
    return NULL;
 }
 /* ----------------------------------------------------------------- */
+/**
+ * Send records of storage shards whose timeout elapsed before the watermark, or all their records.
+ * Shards are locked one by one only while their records are moved out, records are sent without the lock.
+ * @param [in] watermark watermark in seconds, records with expire time < watermark are sent.
+ * @param [in] flush if set, all records are sent (global timeout).
+ * @param [in] worker index of worker whose shards are checked, -1 for all shards.
+ */
+void expire_storage(uint32_t watermark, bool flush, int worker)
+{
+   RecordBatch batch;
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      if (worker >= 0 && workers.get_worker(i) != worker) {
+         continue;
+      }
+      StorageShard &shard = storage.get_shard(i);
+
+      // Lock the shard -- CRITICAL SECTION START
+      pthread_mutex_lock(&shard.lock);
+      if (flush) {
+         flush_shard(shard, batch);
+      }
+      else {
+         expire_shard(shard, watermark, batch);
+      }
+      // Unlock the shard -- CRITICAL SECTION END
+      pthread_mutex_unlock(&shard.lock);
+
+      send_batch(batch);
+   }
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Watermark handler of worker threads, checks timeouts of shards of the worker.
+ * @param [in] watermark watermark in seconds.
+ * @param [in] flush if set, all records of the shards are sent.
+ * @param [in] worker index of the worker.
+ * @param [in] arg pointer to process_params structure (unused).
+ */
+void advance_watermark_worker(uint32_t watermark, bool flush, int worker, __attribute__((unused)) void *arg)
+{
+   expire_storage(watermark, flush, worker);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Event time mode replacement of the timeout thread, called by the main loop when the watermark moves.
+ * Records received before are processed first, so the expired records do not depend on the speed
+ * of the workers and the replay of stored records gives the same output. With worker threads,
+ * the watermark is queued after the records of every worker, which checks only its own shards
+ * when it gets to it, so the receiving thread does not wait for the workers.
+ * @param [in] watermark new watermark in seconds, records with expire time < watermark are sent.
+ * @param [in] config module configuration.
+ */
+void advance_watermark(uint32_t watermark, Config *config)
+{
+   bool flush = false;
+   if (config->get_timeout_type() == TIMEOUT_GLOBAL) {
+      uint32_t timeout = config->get_timeout(TIMEOUT_GLOBAL);
+      if (next_global == 0) {
+         next_global = watermark + timeout;
+         return;
+      }
+      if (watermark < next_global) {
+         return;
+      }
+      while (next_global <= watermark) {
+         next_global += timeout;
+      }
+      flush = true;
+   }
+
+   if (workers.size() > 0) {
+      workers.advance(watermark, flush);
+   }
+   else {
+      expire_storage(watermark, flush, -1);
+   }
+}
+/* ----------------------------------------------------------------- */
 
 /* ================================================================= */
 /* ========================= M A I N =============================== */
@@ -463,7 +921,7 @@ int main(int argc, char **argv)
 {
    int ret;
    signed char opt;
-   storage.reserve(MAP_RESERVE);        // Reserve enough space for records without need of rehash()
+   storage.reserve(MAP_RESERVE);        // Reserve enough space for records without need of resize
 
    /* **** TRAP initialization **** */
 
@@ -492,6 +950,10 @@ int main(int argc, char **argv)
    trap_ifcctl(TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_SEND_TIMEOUT);
 
    Config config;
+   int threads = 1;
+   unsigned long max_records = 0;
+   unsigned long max_memory = 0;
+   const char *state_file = NULL;
 
    /*
     * Parse program arguments defined by MODULE_PARAMS macro with getopt() function (getopt_long() if available)
@@ -532,6 +994,40 @@ int main(int argc, char **argv)
       case 'n':
          config.add_member(BIT_AND, optarg);
          break;
+      case 'd':
+         config.add_member(COUNT_DISTINCT, optarg);
+         break;
+      case 'p':
+         config.add_percentile(optarg);
+         break;
+      case 'e':
+         config.add_member(PERCENTILE, optarg, 50);
+         break;
+      case 'T':
+         threads = atoi(optarg);
+         if (threads < 1 || threads > MAX_WORKERS) {
+            fprintf(stderr, "Error: Count of threads has to be between 1 and %d.\n", MAX_WORKERS);
+            TRAP_DEFAULT_FINALIZATION();
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return 1;
+         }
+         break;
+      case 'b':
+         batch_send = true;
+         break;
+      case 'r':
+         max_records = strtoul(optarg, NULL, 10);
+         break;
+      case 'B':
+         max_memory = strtoul(optarg, NULL, 10);
+         break;
+      case 'S':
+         state_file = optarg;
+         break;
+      case 'W':
+         event_time = true;
+         lateness = strtoul(optarg, NULL, 10);
+         break;
       default:
          fprintf(stderr, "Invalid argument %c, skipped...\n", opt);
       }
@@ -542,6 +1038,13 @@ int main(int argc, char **argv)
    config.print();
 #endif
 
+   storage.set_limits(max_records, max_memory << 20);
+
+   if (batch_send) {
+      // Records are kept in output buffer until the whole batch is sent
+      trap_ifcctl(TRAPIFC_OUTPUT, 0, TRAPCTL_BUFFERSWITCH, 1);
+   }
+
 
    /* **** Create UniRec templates **** */
    ur_template_t *in_tmplt = ur_create_input_template(0, "TIME_FIRST,TIME_LAST", NULL);
@@ -552,23 +1055,42 @@ int main(int argc, char **argv)
       return -1;
    }
 
+   /* **** Start worker threads **** */
+   process_params params = {in_tmplt, &config};
+   if (threads > 1 && !workers.start(threads, STORAGE_SHARDS, &process_record_worker, &advance_watermark_worker, &params)) {
+      clean_memory(in_tmplt, NULL);
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return -1;
+   }
+
    /* **** Create new thread for checking timeouts **** */
+   // In event time mode, timeouts are checked by the main loop
    pthread_t timeout_thread;
-   pthread_create(&timeout_thread, NULL, &check_timeouts, (void*)&config);
+   if (!event_time) {
+      pthread_create(&timeout_thread, NULL, &check_timeouts, (void*)&config);
+   }
+   uint32_t watermark = 0;
 
    /* **** Main processing loop **** */
+   bool state_restored = false;
 
    // Read data from input, process them and write to output
    while (!stop) {
       const void *in_rec;
       uint16_t in_rec_size;
 
+      // Worker could not process its record, its records are dropped since then
+      if (workers.failed()) {
+         stop = 1;
+         break;
+      }
+
       // Receive data from input interface 0.
       // Block if data are not available immediately (unless a timeout occurs)
-      ret = TRAP_RECEIVE(0, in_rec, in_rec_size, in_tmplt);
+      ret = receive_record(&in_rec, &in_rec_size, &in_tmplt);
 
-      // Handle possible errors
-      TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
+      // Handle possible errors, pass waiting records to workers when no new records come
+      TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, workers.flush(); continue, break);
 
 
       // Check for end-of-stream message, close only when signal caught
@@ -581,16 +1103,18 @@ int main(int argc, char **argv)
       if (ret == TRAP_E_FORMAT_CHANGED ) {
          DBG((stderr, "Format change, setting new module configuration\n"));
          // Internal structures cleaning because of possible redefinition
-         std::unordered_map<Key, void*>::iterator it;
+         // Workers are already drained by receive_record()
+         params.in_tmplt = in_tmplt;
 
          // Lock the storage -- CRITICAL SECTION START
-         pthread_mutex_lock( &storage_mutex );
+         storage.lock_all();
 
-         for ( it = storage.begin(); it != storage.end(); it++) {
-            send_record_out(OutputTemplate::out_tmplt, it->second);
-            ur_free_record(it->second);
+         // Records have to be sent before the output template is changed
+         RecordBatch batch;
+         for (int i = 0; i < STORAGE_SHARDS; i++) {
+            flush_shard(storage.get_shard(i), batch);
+            send_batch(batch);
          }
-         storage.clear();
 
          OutputTemplate::reset();
          KeyTemplate::reset();
@@ -604,11 +1128,30 @@ int main(int argc, char **argv)
 
             if (id == UR_E_INVALID_NAME) {
                fprintf(stderr, "Requested field %s not in input records, cannot continue.\n", config.get_name(i));
-               clean_memory(in_tmplt, NULL, storage);
+               storage.unlock_all();
+               clean_memory(in_tmplt, NULL);
                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
                return 1;
             }
 
+            if (config.is_sketch(i)) {
+               // Result of sketch function is stored to its own output field, sketch is kept out of record
+               sketch_func update = config.get_sketch_ptr(i, ur_get_type(id));
+               int dst_id = ur_define_field(config.get_output_name(i), config.get_sketch_type(i));
+               if (update == NULL || dst_id < 0) {
+                  if (update != NULL) {
+                     fprintf(stderr, "Error: Output field %s could not be defined.\n", config.get_output_name(i));
+                  }
+                  storage.unlock_all();
+                  clean_memory(in_tmplt, NULL);
+                  FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                  return 1;
+               }
+               OutputTemplate::add_sketch(id, dst_id, update, config.get_sketch_result_ptr(i), config.get_param(i),
+                                          config.get_sketch_size(i));
+               continue;
+            }
+
             if (ur_is_varlen(id) && !config.is_variable())
                config.set_variable(true);
 
@@ -619,18 +1162,44 @@ int main(int argc, char **argv)
                OutputTemplate::add_field(id, config.get_function_ptr(i, ur_get_type(id)), config.is_func(i, AVG), config.get_avg_ptr(i, ur_get_type(id)));
             }
          }
-         char *tmplt_def = config.return_template_def();
-         OutputTemplate::out_tmplt = ur_create_output_template(0, tmplt_def, NULL);
-         delete [] tmplt_def;
+         char *config_def = config.return_template_def();
+         std::string tmplt_def(config_def);
+         delete [] config_def;
+         if (storage.is_bounded()) {
+            // Records sent early because of storage limit are flagged
+            tmplt_def += ",AGG_FLAGS";
+         }
+         OutputTemplate::out_tmplt = ur_create_output_template(0, tmplt_def.c_str(), NULL);
 
          if (OutputTemplate::out_tmplt == NULL){
             fprintf(stderr, "Error: Output template could not be created.\n");
-            clean_memory(in_tmplt, NULL, storage);
+            storage.unlock_all();
+            clean_memory(in_tmplt, NULL);
             FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
             return -1;
          }
+         agg_plan.build(in_tmplt);
+         // Stored keys and records have sizes given by the new templates
+         if (!storage.configure(KeyTemplate::key_size, OutputTemplate::state_size, ur_rec_fixlen_size(OutputTemplate::out_tmplt),
+                                config.is_variable() ? VAR_FIELDS_EXPECTED : 0)) {
+            fprintf(stderr, "Error: Memory allocation problem (storage).\n");
+            storage.unlock_all();
+            clean_memory(in_tmplt, OutputTemplate::out_tmplt);
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+         }
+         // Records of previous run are continued only with the first templates
+         if (state_file && !state_restored) {
+            state_restored = true;
+            if (!restore_state(state_file, &config)) {
+               storage.unlock_all();
+               clean_memory(in_tmplt, OutputTemplate::out_tmplt);
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+               return -1;
+            }
+         }
          // Unlock the storage -- CRITICAL SECTION END
-         pthread_mutex_unlock(&storage_mutex);
+         storage.unlock_all();
 
          // Lock the time variable -- CRITICAL SECTION START
          pthread_mutex_lock(&time_last_from_record_mutex);
@@ -643,68 +1212,52 @@ int main(int argc, char **argv)
       }
 
       /* Start message processing */
-      time_t record_first = ur_time_get_sec(ur_get(in_tmplt, in_rec, F_TIME_FIRST));
 
       // Generate key
       Key rec_key;
-      for (uint i = 0; i < KeyTemplate::used_fields; i++) {
-         rec_key.add_field(ur_get_ptr_by_id(in_tmplt, in_rec, KeyTemplate::indexes_to_record[i]),
-                           ur_get_size(KeyTemplate::indexes_to_record[i]));
-      }
-
-      void *init_ptr = NULL;
-      std::pair<std::unordered_map<Key, void*>::iterator, bool> inserted;
-      // Lock the storage -- CRITICAL SECTION START
-      pthread_mutex_lock( &storage_mutex );
-      inserted = storage.insert(std::make_pair(rec_key, init_ptr));
-
-      if (inserted.second == false) {
-         // Element already exists
-         bool new_time_window = false;
-         void *stored_rec = inserted.first->second;
-         // Main thread checks time window only when active timeout set
-         if ( (config.get_timeout_type() == TIMEOUT_ACTIVE) || (config.get_timeout_type() == TIMEOUT_ACTIVE_PASSIVE)) {
-            // Check time window for active timeout
-            time_t stored_first = ur_time_get_sec(ur_get(OutputTemplate::out_tmplt, stored_rec, F_TIME_FIRST));
-            // Record is not in current time window
-            if (stored_first + config.get_timeout(TIMEOUT_ACTIVE) < record_first ) {
-               new_time_window = true;
-            }
-         }
-         if (new_time_window) {
-            if(!send_record_out(OutputTemplate::out_tmplt, stored_rec)) {
-               break;
-            }
+      fill_key(rec_key, in_tmplt, in_rec);
 
-            init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, stored_rec);
-         }
-         else {
-            process_agg_functions(in_tmplt, in_rec, OutputTemplate::out_tmplt, stored_rec);
-         }
+      if (workers.size() > 0) {
+         // Record is copied together with its key and processed by worker responsible for the key
+         uint32_t hash = rec_key.get_hash();
+         workers.add(in_rec, in_rec_size, rec_key.get_data(), rec_key.get_size(), hash, Storage::get_shard_index(hash));
       }
-      else {
-         // New element
-         // If there should be place for variable length field in record reserve it
-         int var_length = config.is_variable() == false ? 0 : 2048;
-         void * out_rec = create_record(OutputTemplate::out_tmplt, var_length);
-         if (!out_rec) {
-            clean_memory(in_tmplt, OutputTemplate::out_tmplt, storage);
-            fprintf(stderr, "Error: Memory allocation problem (output record).\n");
-            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
-            return -1;
+      else if (!process_record(in_tmplt, in_rec, rec_key.get_data(), rec_key.get_hash(), &config)) {
+         stop = 1;
+         break;
+      }
+
+      if (event_time) {
+         // Watermark moves by whole seconds, wheel slots have one second
+         uint32_t record_last = ur_time_get_sec(ur_get(in_tmplt, in_rec, F_TIME_LAST));
+         if (record_last > lateness && record_last - lateness > watermark) {
+            watermark = record_last - lateness;
+            advance_watermark(watermark, &config);
          }
-         init_record_data(in_tmplt, in_rec, OutputTemplate::out_tmplt, out_rec);
-         inserted.first->second = out_rec;
       }
-      // Unlock the storage -- CRITICAL SECTION END
-      pthread_mutex_unlock( &storage_mutex );
    }
 
+   // Process records remaining in worker queues
+   workers.finish();
+
    DBG((stderr, "Module canceled, waiting for running threads.\n"));
-   pthread_join(timeout_thread, NULL);
+   if (!event_time) {
+      pthread_join(timeout_thread, NULL);
+   }
    DBG((stderr, "Other threads ended, cleaning storage and exiting.\n"));
    // All other threads not running now, no need to use mutexes there
 
+   if (trap_get_verbose_level() >= 0) {
+      print_storage_stats();
+   }
+   // When stopped by signal (e.g. restart), records are saved instead of being sent partially aggregated
+   if (state_file && signal_stop && OutputTemplate::out_tmplt &&
+       StateFile::save(state_file, storage, OutputTemplate::out_tmplt, StateFile::layout(&config, OutputTemplate::out_tmplt))) {
+      if (trap_get_verbose_level() >= 0) {
+         printf("State file %s: %lu records saved\n", state_file, (unsigned long) storage.size());
+      }
+      storage.clear();
+   }
    flush_storage();
    trap_send(0, "", 1);
    sleep(1);
@@ -712,7 +1265,7 @@ int main(int argc, char **argv)
 
    /* **** Cleanup **** */
    // Free unirec templates and stored records
-   clean_memory(in_tmplt, OutputTemplate::out_tmplt, storage);
+   clean_memory(in_tmplt, OutputTemplate::out_tmplt);
    // Release allocated memory for module_info structure
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
 
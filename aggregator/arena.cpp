@@ -0,0 +1,158 @@
+/**
+ * \file arena.cpp
+ * \brief Arena allocator of records with variable length fields.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstdlib>
+
+#include "arena.h"
+
+/* ================================================================= */
+/* =============== RecordArena class definitions =================== */
+/* ================================================================= */
+
+RecordArena::RecordArena() : free_list(NULL), chunk_size(sizeof(void *)), block_chunks(1), used(0)
+{
+}
+/* ----------------------------------------------------------------- */
+RecordArena::~RecordArena()
+{
+   release();
+}
+/* ----------------------------------------------------------------- */
+void RecordArena::init(size_t size)
+{
+   release();
+   // Chunk has to be able to hold the free list link and keep alignment of records
+   chunk_size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+   if (chunk_size < sizeof(void *)) {
+      chunk_size = sizeof(void *);
+   }
+   block_chunks = ARENA_BLOCK_SIZE / chunk_size > 0 ? ARENA_BLOCK_SIZE / chunk_size : 1;
+}
+/* ----------------------------------------------------------------- */
+void *RecordArena::alloc()
+{
+   if (!free_list) {
+      char *block = (char *) malloc(block_chunks * chunk_size);
+      if (!block) {
+         return NULL;
+      }
+      blocks.push_back(block);
+      for (size_t i = block_chunks; i > 0; i--) {
+         void *chunk = block + (i - 1) * chunk_size;
+         *(void **) chunk = free_list;
+         free_list = chunk;
+      }
+   }
+
+   void *chunk = free_list;
+   free_list = *(void **) chunk;
+   used++;
+   return chunk;
+}
+/* ----------------------------------------------------------------- */
+void RecordArena::free(void *chunk)
+{
+   *(void **) chunk = free_list;
+   free_list = chunk;
+   used--;
+}
+/* ----------------------------------------------------------------- */
+void RecordArena::release()
+{
+   for (size_t i = 0; i < blocks.size(); i++) {
+      ::free(blocks[i]);
+   }
+   blocks.clear();
+   free_list = NULL;
+   used = 0;
+}
+
+/* ================================================================= */
+/* ================= VarArena class definitions ==================== */
+/* ================================================================= */
+
+VarArena::VarArena()
+{
+   for (int i = 0; i < VAR_ARENA_CLASSES; i++) {
+      classes[i].init(class_size(i));
+   }
+}
+/* ----------------------------------------------------------------- */
+void *VarArena::alloc(size_t size, uint32_t *chunk_size)
+{
+   int index = size_class(size);
+   if (index < 0) {
+      return NULL;
+   }
+   *chunk_size = class_size(index);
+   return classes[index].alloc();
+}
+/* ----------------------------------------------------------------- */
+void VarArena::free(void *chunk, uint32_t chunk_size)
+{
+   classes[size_class(chunk_size)].free(chunk);
+}
+/* ----------------------------------------------------------------- */
+void VarArena::release()
+{
+   for (int i = 0; i < VAR_ARENA_CLASSES; i++) {
+      classes[i].release();
+   }
+}
+/* ----------------------------------------------------------------- */
+size_t VarArena::allocated() const
+{
+   size_t bytes = 0;
+   for (int i = 0; i < VAR_ARENA_CLASSES; i++) {
+      bytes += classes[i].allocated();
+   }
+   return bytes;
+}
+/* ----------------------------------------------------------------- */
+size_t VarArena::used_size() const
+{
+   size_t bytes = 0;
+   for (int i = 0; i < VAR_ARENA_CLASSES; i++) {
+      bytes += classes[i].used_size();
+   }
+   return bytes;
+}
@@ -0,0 +1,173 @@
+/**
+ * \file arena.h
+ * \brief Arena allocator of records with variable length fields.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_ARENA_H
+#define AGGREGATOR_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/** Size of memory block allocated at once by the arena, block holds at least one chunk.*/
+#define ARENA_BLOCK_SIZE 4096
+/** Size of the smallest chunk of variable length records arena.*/
+#define VAR_ARENA_MIN_SIZE 32
+/** Count of size classes of variable length records arena, the largest one holds any UniRec record.*/
+#define VAR_ARENA_CLASSES 24
+
+/**
+ * Class to represent arena of fixed-size memory chunks. Chunks are carved from large blocks
+ * and freed chunks are kept in free list for reuse, so no allocation is done per record.
+ */
+class RecordArena {
+private:
+   std::vector<char *> blocks;   /*!< Allocated blocks of chunks. */
+   void *free_list;              /*!< Singly linked list of free chunks. */
+   size_t chunk_size;            /*!< Size of one chunk. */
+   size_t block_chunks;          /*!< Count of chunks in one block. */
+   size_t used;                  /*!< Count of used chunks. */
+public:
+   RecordArena();
+   ~RecordArena();
+   /**
+    * Set size of chunks, all chunks have to be freed before.
+    * @param [in] size size of one chunk in bytes.
+    */
+   void init(size_t size);
+   /**
+    * Get free chunk.
+    * @return Pointer to chunk or NULL if memory could not be allocated.
+    */
+   void *alloc();
+   /**
+    * Return chunk to the arena.
+    * @param [in] chunk pointer returned by alloc().
+    */
+   void free(void *chunk);
+   /**
+    * Free all blocks of arena.
+    */
+   void release();
+   /**
+    * Get count of bytes allocated by arena.
+    * @return Size of all blocks in bytes.
+    */
+   size_t allocated() const
+   {
+      return blocks.size() * block_chunks * chunk_size;
+   }
+   /**
+    * Get count of bytes of used chunks.
+    * @return Size of used chunks in bytes.
+    */
+   size_t used_size() const
+   {
+      return used * chunk_size;
+   }
+};
+
+/**
+ * Class to represent arena of records with variable length fields. Every record is stored in chunk
+ * of the smallest size class which can hold it, sizes of classes are 32, 48, 64, 96, 128, ...
+ * so the chunk is at most a half larger than the record and memory use follows the real length
+ * of variable length fields. Record which outgrows its chunk has to be moved to a larger one.
+ */
+class VarArena {
+private:
+   RecordArena classes[VAR_ARENA_CLASSES];   /*!< Arenas of chunks of all size classes. */
+public:
+   VarArena();
+   /**
+    * Get the smallest size class with chunks of at least given size.
+    * @param [in] size required size in bytes.
+    * @return Index of size class or -1 if size is larger than the largest class.
+    */
+   static int size_class(size_t size)
+   {
+      if (size <= VAR_ARENA_MIN_SIZE) {
+         return 0;
+      }
+      // Size is in (2^bit, 2^(bit+1)], classes of the interval are 1.5 * 2^bit and 2^(bit+1)
+      int bit = 63 - __builtin_clzll((unsigned long long) size - 1);
+      int index = (bit - 5) * 2 + (size <= (size_t) 3 << (bit - 1) ? 1 : 2);
+      return index < VAR_ARENA_CLASSES ? index : -1;
+   }
+   /**
+    * Get size of chunks of given size class.
+    * @param [in] index of size class.
+    * @return Size of chunks in bytes.
+    */
+   static size_t class_size(int index)
+   {
+      return (size_t) ((index & 1) ? VAR_ARENA_MIN_SIZE * 3 / 2 : VAR_ARENA_MIN_SIZE) << (index / 2);
+   }
+   /**
+    * Get free chunk which can hold record of given size.
+    * @param [in] size size of record in bytes.
+    * @param [out] chunk_size size of returned chunk.
+    * @return Pointer to chunk or NULL if memory could not be allocated.
+    */
+   void *alloc(size_t size, uint32_t *chunk_size);
+   /**
+    * Return chunk to the arena.
+    * @param [in] chunk pointer returned by alloc().
+    * @param [in] chunk_size size of chunk returned by alloc().
+    */
+   void free(void *chunk, uint32_t chunk_size);
+   /**
+    * Free all blocks of all size classes.
+    */
+   void release();
+   /**
+    * Get count of bytes allocated by arena.
+    * @return Size of all blocks in bytes.
+    */
+   size_t allocated() const;
+   /**
+    * Get count of bytes of chunks used by records.
+    * @return Size of used chunks in bytes.
+    */
+   size_t used_size() const;
+};
+
+#endif //AGGREGATOR_ARENA_H
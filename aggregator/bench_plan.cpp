@@ -0,0 +1,194 @@
+/**
+ * \file bench_plan.cpp
+ * \brief Microbenchmark of aggregation plan compared to per-field function dispatch.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unirec/unirec.h>
+#include "fields.h"
+
+#include "output.h"
+#include "plan.h"
+
+/** Count of received records used by benchmark (power of 2).*/
+#define BENCH_IN_RECORDS 4096
+/** Count of stored records used by benchmark (power of 2).*/
+#define BENCH_STORED_RECORDS 1024
+/** Count of aggregated records in one measurement.*/
+#define BENCH_ITERATIONS 20000000
+
+/**
+ * Aggregate record the way it was done before the plan, by per-field function pointer
+ * dispatch with field pointers computed for every record.
+ * @param [in] in_tmplt UniRec template of received record.
+ * @param [in] src_rec pointer to received record.
+ * @param [in] out_tmplt UniRec template of stored record.
+ * @param [in,out] dst_rec pointer to stored record.
+ */
+void process_fields_dispatch(ur_template_t *in_tmplt, const void *src_rec, ur_template_t *out_tmplt, void *dst_rec)
+{
+   ur_set(out_tmplt, dst_rec, F_COUNT, ur_get(out_tmplt, dst_rec, F_COUNT) + 1);
+
+   uint64_t stored = ur_get(out_tmplt, dst_rec, F_TIME_FIRST);
+   uint64_t record = ur_get(in_tmplt, src_rec, F_TIME_FIRST);
+   if (record < stored)
+      ur_set(out_tmplt, dst_rec, F_TIME_FIRST, ur_get(in_tmplt, src_rec, F_TIME_FIRST));
+
+   stored = ur_get(out_tmplt, dst_rec, F_TIME_LAST);
+   record = ur_get(in_tmplt, src_rec, F_TIME_LAST);
+   if (record > stored)
+      ur_set(out_tmplt, dst_rec, F_TIME_LAST, ur_get(in_tmplt, src_rec, F_TIME_LAST));
+
+   for (int i = 0; i < OutputTemplate::used_fields; i++) {
+      int field_id = OutputTemplate::indexes_to_record[i];
+      OutputTemplate::process[i](ur_get_ptr_by_id(in_tmplt, src_rec, field_id),
+                                 ur_get_ptr_by_id(out_tmplt, dst_rec, field_id));
+   }
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Get time elapsed since given time.
+ * @param [in] start start of measurement.
+ * @return Elapsed time in seconds.
+ */
+double elapsed(const struct timespec *start)
+{
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Measure aggregation of given count of fields with both methods and compare results.
+ * Fields have types uint64 and uint32 in turns, half of them is summed and the rest uses max and min,
+ * like usual flow counters.
+ * @param [in] fields count of aggregated fields.
+ * @return True if both methods produced the same records.
+ */
+bool run_bench(int fields)
+{
+   static const ur_field_type_t types[] = {UR_TYPE_UINT64, UR_TYPE_UINT32};
+   static const agg_func funcs[2][4] = {
+      {&sum<uint64_t>, &sum<uint64_t>, &max<uint64_t>, &min<uint64_t>},
+      {&sum<uint32_t>, &sum<uint32_t>, &max<uint32_t>, &min<uint32_t>}
+   };
+   char name[32];
+   char spec[1024] = "TIME_FIRST,TIME_LAST";
+
+   OutputTemplate::reset();
+   for (int i = 0; i < fields; i++) {
+      snprintf(name, sizeof(name), "BENCH_FIELD_%d", i);
+      int id = ur_define_field(name, types[i % 2]);
+      OutputTemplate::add_field(id, funcs[i % 2][(i / 2) % 4], false, NULL);
+      strcat(spec, ",");
+      strcat(spec, name);
+   }
+   ur_template_t *in_tmplt = ur_create_template(spec, NULL);
+   strcat(spec, ",COUNT");
+   OutputTemplate::out_tmplt = ur_create_template(spec, NULL);
+   ur_template_t *out_tmplt = OutputTemplate::out_tmplt;
+   if (!in_tmplt || !out_tmplt) {
+      fprintf(stderr, "Error: Templates could not be created.\n");
+      return false;
+   }
+
+   size_t in_size = ur_rec_fixlen_size(in_tmplt);
+   size_t out_size = ur_rec_fixlen_size(out_tmplt);
+   char *in_recs = (char *) malloc(BENCH_IN_RECORDS * in_size);
+   char *old_recs = (char *) calloc(BENCH_STORED_RECORDS, out_size);
+   char *new_recs = (char *) calloc(BENCH_STORED_RECORDS, out_size);
+   for (size_t i = 0; i < BENCH_IN_RECORDS * in_size; i++) {
+      in_recs[i] = rand();
+   }
+   for (int i = 0; i < BENCH_STORED_RECORDS; i++) {
+      ur_copy_fields(out_tmplt, old_recs + i * out_size, in_tmplt, in_recs + i * in_size);
+      ur_set(out_tmplt, old_recs + i * out_size, F_COUNT, 1);
+   }
+   memcpy(new_recs, old_recs, BENCH_STORED_RECORDS * out_size);
+
+   AggPlan plan;
+   plan.build(in_tmplt);
+
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (int i = 0; i < BENCH_ITERATIONS; i++) {
+      process_fields_dispatch(in_tmplt, in_recs + (i & (BENCH_IN_RECORDS - 1)) * in_size, out_tmplt,
+                              old_recs + ((i * 7) & (BENCH_STORED_RECORDS - 1)) * out_size);
+   }
+   double old_time = elapsed(&start);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (int i = 0; i < BENCH_ITERATIONS; i++) {
+      plan.update(in_recs + (i & (BENCH_IN_RECORDS - 1)) * in_size,
+                  new_recs + ((i * 7) & (BENCH_STORED_RECORDS - 1)) * out_size, NULL);
+   }
+   double new_time = elapsed(&start);
+
+   bool same = memcmp(old_recs, new_recs, BENCH_STORED_RECORDS * out_size) == 0;
+   printf("%2d fields: dispatch %6.2f ns/record, plan %6.2f ns/record, speedup %.2fx%s\n", fields,
+          old_time * 1e9 / BENCH_ITERATIONS, new_time * 1e9 / BENCH_ITERATIONS, old_time / new_time,
+          same ? "" : ", RESULTS DIFFER");
+
+   free(in_recs);
+   free(old_recs);
+   free(new_recs);
+   ur_free_template(in_tmplt);
+   return same;
+}
+
+/* ================================================================= */
+/* ========================= M A I N =============================== */
+/* ================================================================= */
+int main()
+{
+   static const int field_counts[] = {8, 12, 16};
+   bool ok = true;
+
+   srand(1);
+   for (size_t i = 0; i < sizeof(field_counts) / sizeof(field_counts[0]); i++) {
+      ok = run_bench(field_counts[i]) && ok;
+   }
+   OutputTemplate::reset();
+   ur_finalize();
+   return ok ? 0 : 1;
+}
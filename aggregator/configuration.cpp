@@ -42,6 +42,8 @@
  *
  */
 
+#include <string>
+
 #include "configuration.h"
 
 Config::Config() : used_fields(0), timeout_type(TIMEOUT_ACTIVE), variable_flag(false)
@@ -55,20 +57,23 @@ Config::Config() : used_fields(0), timeout_type(TIMEOUT_ACTIVE), variable_flag(f
 Config::~Config()
 {
    for (int i = 0; i < used_fields; i++) {
+      if (output_names[i] != field_names[i]) {
+         delete [] output_names[i];
+      }
       delete [] field_names[i];
    }
 }
 
-bool Config::verify_field(const char *field_name)
+bool Config::verify_field(const char *field_name, const char *output_name)
 {
    // Time fields cannot be assigned
    if ((strcmp(field_name, "TIME_LAST") == 0) || (strcmp(field_name, "TIME_FIRST") == 0)) {
       return false;
    }
 
-   // Check if already assigned
+   // Check if already assigned, the same field can be used by sketch functions with different output fields
    for (int i = 0; i < used_fields; i++) {
-      if (strcmp(field_name, field_names[i]) == 0)
+      if (strcmp(output_name, output_names[i]) == 0)
          return false;
    }
    return true;
@@ -88,6 +93,29 @@ const char * Config::get_name(int index)
    return field_names[index];
 }
 
+const char * Config::get_output_name(int index)
+{
+   if ((index < 0) || (index > used_fields - 1)) {
+      return "";
+   }
+
+   return output_names[index];
+}
+
+double Config::get_param(int index)
+{
+   if ((index < 0) || (index > used_fields - 1)) {
+      return 0;
+   }
+
+   return params[index];
+}
+
+bool Config::is_sketch(int index)
+{
+   return is_func(index, COUNT_DISTINCT) || is_func(index, PERCENTILE);
+}
+
 bool Config::is_variable()
 {
    return variable_flag;
@@ -122,6 +150,15 @@ bool Config::is_func(int index, int func_id)
    return false;
 }
 
+int Config::get_function(int index)
+{
+   if ((index < 0) || (index > used_fields - 1)) {
+      return -1;
+   }
+
+   return functions[index];
+}
+
 agg_func Config::get_function_ptr(int index, ur_field_type_t field_type)
 {
    agg_func out = &nope;
@@ -546,12 +583,94 @@ final_avg Config::get_avg_ptr(int index, ur_field_type_t field_type)
    return out;
 }
 
+sketch_func Config::get_sketch_ptr(int index, ur_field_type_t field_type)
+{
+   sketch_func out = NULL;
+   if ((index < 0) || (index > used_fields - 1)) {
+      return out;
+   }
+
+   switch (functions[index]) {
+      case COUNT_DISTINCT:
+         // Any value is hashed as a sequence of bytes
+         out = &count_distinct;
+         break;
+      case PERCENTILE:
+         switch (field_type) {
+            case UR_TYPE_INT8:
+               out = &percentile<int8_t>;
+               break;
+            case UR_TYPE_INT16:
+               out = &percentile<int16_t>;
+               break;
+            case UR_TYPE_INT32:
+               out = &percentile<int32_t>;
+               break;
+            case UR_TYPE_INT64:
+               out = &percentile<int64_t>;
+               break;
+            case UR_TYPE_UINT8:
+               out = &percentile<uint8_t>;
+               break;
+            case UR_TYPE_UINT16:
+               out = &percentile<uint16_t>;
+               break;
+            case UR_TYPE_UINT32:
+               out = &percentile<uint32_t>;
+               break;
+            case UR_TYPE_UINT64:
+               out = &percentile<uint64_t>;
+               break;
+            case UR_TYPE_FLOAT:
+               out = &percentile<float>;
+               break;
+            case UR_TYPE_DOUBLE:
+               out = &percentile<double>;
+               break;
+            default:
+               fprintf(stderr, "Only int, uint, float and double can use percentile function, cannot continue.\n");
+               out = NULL;
+         }
+         break;
+      default:
+         out = NULL;
+   }
+   return out;
+}
+
+sketch_result Config::get_sketch_result_ptr(int index)
+{
+   if (is_func(index, COUNT_DISTINCT)) {
+      return &count_distinct_result;
+   }
+   if (is_func(index, PERCENTILE)) {
+      return &percentile_result;
+   }
+   return NULL;
+}
+
+ur_field_type_t Config::get_sketch_type(int index)
+{
+   return is_func(index, PERCENTILE) ? UR_TYPE_DOUBLE : UR_TYPE_UINT32;
+}
+
+size_t Config::get_sketch_size(int index)
+{
+   if (is_func(index, COUNT_DISTINCT)) {
+      return sizeof(hll_sketch);
+   }
+   if (is_func(index, PERCENTILE)) {
+      return sizeof(quantile_sketch);
+   }
+   return 0;
+}
+
 /**
  * This function adds field into configuration class of module
  * @param func [in] Identification of function to use as defined MACRO
  * @param field_name [in] string given by user to identify the field
  */
-void Config::add_member(int func, const char *field_name)
+void Config::add_member(int func, const char *field_name, double param)
 {
    if (!(used_fields < MAX_KEY_FIELDS)) {
       fprintf(stderr, "Cannot register the field \"%s\", maximum number of assigned fields reached. "
@@ -559,17 +678,57 @@ void Config::add_member(int func, const char *field_name)
       return;
    }
 
-   if (!verify_field(field_name)) {
-      fprintf(stderr, "Field \"%s\" already used or cannot be assigned.\n", field_name);
+   int name_length = strlen(field_name);
+   char *name = new char [name_length + 1];
+   strncpy(name, field_name, name_length + 1);
+
+   // Sketch functions store their result to new field named by the field and function
+   char *output_name = name;
+   if (func == COUNT_DISTINCT || func == PERCENTILE) {
+      output_name = new char [name_length + 32];
+      if (func == COUNT_DISTINCT) {
+         snprintf(output_name, name_length + 32, "%s" DISTINCT_SUFFIX, field_name);
+      }
+      else {
+         snprintf(output_name, name_length + 32, "%s" PERCENTILE_SUFFIX "%g", field_name, param);
+         // Field name cannot contain decimal point
+         for (char *c = output_name + name_length; *c; c++) {
+            if (*c == '.') {
+               *c = '_';
+            }
+         }
+      }
+   }
+
+   if (!verify_field(name, output_name)) {
+      fprintf(stderr, "Field \"%s\" already used or cannot be assigned.\n", output_name);
+      if (output_name != name) {
+         delete [] output_name;
+      }
+      delete [] name;
       return;
    }
 
-   int name_length = strlen(field_name);
-   field_names[used_fields] = new char [name_length + 1];
-   strncpy(field_names[used_fields], field_name, name_length + 1);
+   field_names[used_fields] = name;
+   output_names[used_fields] = output_name;
+   params[used_fields] = param;
    functions[used_fields] = func;
    used_fields++;
 }
+
+void Config::add_percentile(const char *input)
+{
+   const char *separator = strrchr(input, ':');
+   char *end = NULL;
+   double percent = separator ? strtod(separator + 1, &end) : 0;
+   if (!separator || separator == input || end == separator + 1 || *end != '\0' || percent < 0 || percent > 100) {
+      fprintf(stderr, "Wrong percentile definition \"%s\", use as -p FIELD_NAME:PERCENT (e.g. -p BYTES:95).\n", input);
+      return;
+   }
+
+   std::string field_name(input, separator - input);
+   add_member(PERCENTILE, field_name.c_str(), percent);
+}
 int Config::get_timeout(int type)
 {
    return timeout[type];
@@ -677,13 +836,13 @@ char* Config::return_template_def()
    size_t len = strlen(static_fields) + 1;
    for (int i = 0; i < used_fields; i++) {
       // +1 for every name -> ',' after every field and \0 at the end
-      len += strlen(field_names[i]) + 1;
+      len += strlen(output_names[i]) + 1;
    }
    char *tmplt_def = new char [len];
    // Because strcat needs to start replacing null terminated string
    tmplt_def[0] = '\0';
    for (int i = 0; i < used_fields; i++) {
-      strcat(tmplt_def, field_names[i]);
+      strcat(tmplt_def, output_names[i]);
       strcat(tmplt_def, ",");
    }
    strcat(tmplt_def, static_fields);
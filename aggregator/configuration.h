@@ -66,6 +66,15 @@
 #define BIT_AND   8
 /** Aggregation function type value defining first non-empty/non-zero value.*/
 #define FIRST_NONEMPTY     9
+/** Aggregation function type value defining approximate count of distinct values.*/
+#define COUNT_DISTINCT     10
+/** Aggregation function type value defining approximate percentile.*/
+#define PERCENTILE         11
+
+/** Suffix of name of output field with count of distinct values of the field.*/
+#define DISTINCT_SUFFIX "_DISTINCT"
+/** Prefix of suffix of name of output field with percentile of the field, followed by the percentile (e.g. BYTES_P95).*/
+#define PERCENTILE_SUFFIX "_P"
 
 /** Active timeout type value definition.*/
 #define TIMEOUT_ACTIVE           0
@@ -91,6 +100,8 @@ class Config {
 private:
    int functions[MAX_KEY_FIELDS];        /*!< Aggregation/Key function type definition. */
    char *field_names[MAX_KEY_FIELDS];    /*!< Names of fields to work with. */
+   char *output_names[MAX_KEY_FIELDS];   /*!< Names of output fields, differ from field names only for sketch functions. */
+   double params[MAX_KEY_FIELDS];        /*!< Parameters of aggregation functions (percentile). */
    int used_fields;                      /*!< Counter of fields to work with. */
    int timeout[TIMEOUT_TYPES_COUNT];     /*!< Lengths of various timeouts. */
    int timeout_type;                     /*!< Currently active timeout type to use. */
@@ -98,9 +109,10 @@ private:
    /**
     * Compare new field with fields already set in cofiguration.
     * @param [in] field_name to compare with others
+    * @param [in] output_name name of output field of the new field.
     * @return true if field is not already used by module, false if field is already configured.
     */
-   bool verify_field(const char* field_name);
+   bool verify_field(const char* field_name, const char *output_name);
 public:
     /**
      * Constructor with defaults values initialization.
@@ -122,6 +134,25 @@ public:
      * @return pointer to name of fields on given index, Empty string "" if index is not between 0-used_fields.
      */
    const char * get_name(int index);
+    /**
+     * Get name of output field of configured field on given index.
+     * @param [in] index to array of fields name.
+     * @return pointer to name of output field, Empty string "" if index is not between 0-used_fields.
+     */
+   const char * get_output_name(int index);
+    /**
+     * Get parameter of aggregation function of configured field on given index.
+     * @param [in] index to array of fields name.
+     * @return parameter value (percentile), 0 if function has no parameter or index is not between 0-used_fields.
+     */
+   double get_param(int index);
+    /**
+     * Get information whether field on given index has sketch function (count distinct, percentile) assigned.
+     * Sketch functions keep their state out of the output record and store the result to separate output field.
+     * @param [in] index of field.
+     * @return True if field has sketch function assigned, False if not or index is not between 0-used_fields.
+     */
+   bool is_sketch(int index);
     /**
      * Get information whether variable length field is presented in fields to work with.
      * @return True if is var length field presented, False otherwise.
@@ -145,6 +176,12 @@ public:
      * @return True if function from parameter is equal to one assigned on given index, false if not or index not between 0-used_fields.
      */
    bool is_func(int index, int func_id);
+    /**
+     * Get aggregation function type assigned to field on given index.
+     * @param [in] index of field to ask for the function type.
+     * @return Type of aggregation function, -1 if index is not between 0-used_fields.
+     */
+   int get_function(int index);
     /**
      * Return function implementation to assigned function type of field on given index.
      * @param [in] index of field to ask for function implementation.
@@ -159,12 +196,43 @@ public:
      * @return Pointer to function which implements the postprocessing function of specified field type.
      */
    final_avg get_avg_ptr(int index, ur_field_type_t field_type);
+    /**
+     * Return function adding value of field to the sketch of sketch function assigned to field on given index.
+     * @param [in] index of field to ask for function implementation.
+     * @param [in] field_type of field on given index (type returned from ur_get_type()).
+     * @return Pointer to function or NULL if the type is not supported by the function.
+     */
+   sketch_func get_sketch_ptr(int index, ur_field_type_t field_type);
+    /**
+     * Return function computing result of sketch function assigned to field on given index.
+     * @param [in] index of field to ask for function implementation.
+     * @return Pointer to function or NULL if field has no sketch function.
+     */
+   sketch_result get_sketch_result_ptr(int index);
+    /**
+     * Get UniRec type of output field of sketch function assigned to field on given index.
+     * @param [in] index of field.
+     * @return Type of output field.
+     */
+   ur_field_type_t get_sketch_type(int index);
+    /**
+     * Get size of sketch state of sketch function assigned to field on given index.
+     * @param [in] index of field.
+     * @return Size of sketch in bytes, 0 if field has no sketch function.
+     */
+   size_t get_sketch_size(int index);
     /**
      * Add field from user input to module configuration.
      * @param [in] func aggregation function type to be assigned to the field of given name.
      * @param [in] field_name name of given field .
+     * @param [in] param parameter of aggregation function (percentile), 0 if not used.
+     */
+   void add_member(int func, const char *field_name, double param = 0);
+    /**
+     * Add field with percentile function from user input to module configuration.
+     * @param [in] input field name and percentile separated by ':' (e.g. BYTES:95).
      */
-   void add_member(int func, const char *field_name);
+   void add_percentile(const char *input);
     /**
      * Get timeout value in seconds from given timeout type.
      * @param [in] type of timeout to ask for currently set value.
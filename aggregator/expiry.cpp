@@ -0,0 +1,240 @@
+/**
+ * \file expiry.cpp
+ * \brief Expiry wheel used to find records with elapsed timeout.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstddef>
+
+#include "expiry.h"
+
+/* ================================================================= */
+/* ============== ExpiryWheel class definitions ==================== */
+/* ================================================================= */
+
+ExpiryWheel::ExpiryWheel() : current(0), started(false), checked(false)
+{
+   for (int i = 0; i < EXPIRY_WHEEL_SLOTS; i++) {
+      init_list(&slots[i]);
+   }
+   init_list(&overdue);
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::append(ExpiryNode *head, ExpiryNode *node)
+{
+   node->prev = head->prev;
+   node->next = head;
+   head->prev->next = node;
+   head->prev = node;
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::link(uint32_t slot, ExpiryNode *node)
+{
+   append(&slots[slot & EXPIRY_WHEEL_MASK], node);
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::insert(ExpiryNode *node)
+{
+   if (!started) {
+      current = node->expire;
+      started = true;
+   }
+   else if (!checked && node->expire < current) {
+      // No check was done yet, start from the earliest expire time
+      current = node->expire;
+   }
+   if (node->expire < current) {
+      // Slot of node was already checked, node is expired by the next check
+      append(&overdue, node);
+   }
+   else {
+      link(node->expire, node);
+   }
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::remove(ExpiryNode *node)
+{
+   node->prev->next = node->next;
+   node->next->prev = node->prev;
+   node->prev = node;
+   node->next = node;
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::update(ExpiryNode *node, uint32_t expire)
+{
+   if (expire < node->expire) {
+      // Node would be checked too late in its current slot
+      remove(node);
+      node->expire = expire;
+      insert(node);
+   }
+   else {
+      node->expire = expire;
+   }
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::expire(uint32_t now, ExpiryNode *expired, expiry_stats *stats)
+{
+   stats->checks++;
+   if (!started) {
+      return;
+   }
+
+   // Nodes in overdue list were inserted with expire < current, but their expire time could be updated since
+   ExpiryNode *node = overdue.next;
+   while (node != &overdue) {
+      ExpiryNode *next = node->next;
+      stats->visited++;
+      if (node->expire < now) {
+         remove(node);
+         append(expired, node);
+         stats->expired++;
+      }
+      else if (node->expire >= current) {
+         remove(node);
+         link(node->expire, node);
+         stats->rescheduled++;
+      }
+      node = next;
+   }
+
+   if (now <= current) {
+      return;
+   }
+   checked = true;
+
+   uint32_t count = now - current;
+   if (count > EXPIRY_WHEEL_SLOTS) {
+      count = EXPIRY_WHEEL_SLOTS;
+   }
+
+   for (uint32_t i = 0; i < count; i++) {
+      uint32_t slot = (current + i) & EXPIRY_WHEEL_MASK;
+      ExpiryNode *head = &slots[slot];
+      node = head->next;
+      while (node != head) {
+         ExpiryNode *next = node->next;
+         stats->visited++;
+         if (node->expire < now) {
+            remove(node);
+            append(expired, node);
+            stats->expired++;
+         }
+         else if ((node->expire & EXPIRY_WHEEL_MASK) != slot) {
+            // Expire time was updated, move node to its slot
+            remove(node);
+            link(node->expire, node);
+            stats->rescheduled++;
+         }
+         node = next;
+      }
+   }
+   current = now;
+}
+/* ----------------------------------------------------------------- */
+ExpiryNode *ExpiryWheel::pop_oldest(expiry_stats *stats)
+{
+   // Nodes in overdue list are the oldest ones, unless their expire time was updated since
+   ExpiryNode *oldest = NULL;
+   ExpiryNode *node = overdue.next;
+   while (node != &overdue) {
+      ExpiryNode *next = node->next;
+      if (node->expire >= current) {
+         remove(node);
+         link(node->expire, node);
+         stats->rescheduled++;
+      }
+      else if (!oldest || node->expire < oldest->expire) {
+         oldest = node;
+      }
+      node = next;
+   }
+   if (oldest) {
+      remove(oldest);
+      return oldest;
+   }
+   if (!started) {
+      return NULL;
+   }
+
+   // Slots are searched from the current time, no node expires in the skipped ones during the current turn,
+   // so current moves past them also when the wheel is not checked (e.g. only the active timeout is set)
+   ExpiryNode *distant = NULL;
+   for (uint32_t i = 0; i < EXPIRY_WHEEL_SLOTS; i++) {
+      ExpiryNode *head = &slots[current & EXPIRY_WHEEL_MASK];
+      node = head->next;
+      while (node != head) {
+         ExpiryNode *next = node->next;
+         stats->visited++;
+         if (node->expire <= current) {
+            remove(node);
+            return node;
+         }
+         else if (node->expire - current < EXPIRY_WHEEL_SLOTS) {
+            // Expire time was updated, move node to its slot (it is searched later by this loop)
+            remove(node);
+            link(node->expire, node);
+            stats->rescheduled++;
+         }
+         else if (!distant || node->expire < distant->expire) {
+            // Node expires after the whole wheel turn, used only when there is no closer one
+            distant = node;
+         }
+         node = next;
+      }
+      current++;
+   }
+
+   if (distant) {
+      // All nodes expire after the searched turn, the search continues from the oldest one next time
+      current = distant->expire;
+      remove(distant);
+   }
+   return distant;
+}
+/* ----------------------------------------------------------------- */
+void ExpiryWheel::clear()
+{
+   for (int i = 0; i < EXPIRY_WHEEL_SLOTS; i++) {
+      init_list(&slots[i]);
+   }
+   init_list(&overdue);
+   started = false;
+   checked = false;
+}
@@ -0,0 +1,145 @@
+/**
+ * \file expiry.h
+ * \brief Expiry wheel used to find records with elapsed timeout.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_EXPIRY_H
+#define AGGREGATOR_EXPIRY_H
+
+#include <stdint.h>
+
+/** Count of slots (seconds) of expiry wheel, has to be power of 2.*/
+#define EXPIRY_WHEEL_SLOTS 4096
+/** Mask to get slot index from time in seconds.*/
+#define EXPIRY_WHEEL_MASK (EXPIRY_WHEEL_SLOTS - 1)
+
+/**
+ * Node of expiry wheel, has to be embedded into the stored entry.
+ */
+struct ExpiryNode {
+   ExpiryNode *prev;       /*!< Previous node in the slot list. */
+   ExpiryNode *next;       /*!< Next node in the slot list. */
+   uint32_t expire;        /*!< Time in seconds when the entry expires. */
+};
+
+/**
+ * Structure to hold statistics of expiry wheel checks.
+ */
+typedef struct {
+   uint64_t checks;        /*!< Count of performed checks. */
+   uint64_t visited;       /*!< Count of nodes visited in checked or searched slots. */
+   uint64_t expired;       /*!< Count of expired nodes. */
+   uint64_t rescheduled;   /*!< Count of nodes moved to slot of their updated expire time. */
+} expiry_stats;
+
+/**
+ * Class to represent timing wheel with one slot per second. Every node is placed into the slot of its expire time,
+ * so a check has to visit only the slots of seconds elapsed since the previous check.
+ * When the expire time of node is moved later, the node is left in its old slot and moved to
+ * the right slot when its old slot is checked (the update in record processing is O(1) without list operations).
+ */
+class ExpiryWheel {
+private:
+   ExpiryNode slots[EXPIRY_WHEEL_SLOTS];   /*!< Heads of circular lists of slots. */
+   ExpiryNode overdue;                     /*!< Head of list of nodes inserted with already elapsed expire time. */
+   uint32_t current;                       /*!< First second which was not checked yet. */
+   bool started;                           /*!< Flag whether current is set. */
+   bool checked;                           /*!< Flag whether wheel was checked since current was set. */
+   /**
+    * Append node to the list of slot.
+    * @param [in] slot index of slot.
+    * @param [in,out] node to be appended.
+    */
+   void link(uint32_t slot, ExpiryNode *node);
+   /**
+    * Append node to the circular list.
+    * @param [in,out] head of the list.
+    * @param [in,out] node to be appended.
+    */
+   static void append(ExpiryNode *head, ExpiryNode *node);
+public:
+   ExpiryWheel();
+   /**
+    * Insert node into wheel according to its expire time.
+    * @param [in,out] node to be inserted, expire has to be set.
+    */
+   void insert(ExpiryNode *node);
+   /**
+    * Remove node from wheel.
+    * @param [in,out] node to be removed.
+    */
+   static void remove(ExpiryNode *node);
+   /**
+    * Update expire time of node stored in wheel. Node is moved only when its time is moved earlier.
+    * @param [in,out] node stored in wheel.
+    * @param [in] expire new expire time in seconds.
+    */
+   void update(ExpiryNode *node, uint32_t expire);
+   /**
+    * Remove node with the earliest expire time from wheel, e.g. to make space for a new entry.
+    * Nodes found in slots of their old expire time are moved to their slots on the way. Current time
+    * moves to the removed node, so consecutive calls search every slot at most once per wheel turn.
+    * @param [in,out] stats statistics to be updated.
+    * @return Removed node or NULL if wheel is empty.
+    */
+   ExpiryNode *pop_oldest(expiry_stats *stats);
+   /**
+    * Remove all nodes which expire before given time and append them to the expired list.
+    * @param [in] now current time in seconds, nodes with expire < now are removed.
+    * @param [in,out] expired head of circular list to append expired nodes to.
+    * @param [in,out] stats statistics to be updated.
+    */
+   void expire(uint32_t now, ExpiryNode *expired, expiry_stats *stats);
+   /**
+    * Remove all nodes from wheel, nodes are not modified.
+    */
+   void clear();
+   /**
+    * Initialize node as empty circular list head.
+    * @param [out] head node to initialize.
+    */
+   static void init_list(ExpiryNode *head)
+   {
+      head->prev = head;
+      head->next = head;
+   }
+};
+
+#endif //AGGREGATOR_EXPIRY_H
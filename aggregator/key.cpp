@@ -74,21 +74,17 @@ void KeyTemplate::reset()
 
 Key::Key()
 {
-   data = new char [KeyTemplate::key_size + 1];
    data_length = 0;
-}
-/* ----------------------------------------------------------------- */
-Key::~Key()
-{
-   if (data)
-      delete [] data;
+   hash = 0;
+   hash_valid = false;
 }
 /* ----------------------------------------------------------------- */
 Key::Key(const Key &other)
 {
    data_length = other.data_length;
-   data = new char[KeyTemplate::key_size + 1];
    memcpy(data, other.data, data_length);
+   hash = other.hash;
+   hash_valid = other.hash_valid;
 }
 /* ----------------------------------------------------------------- */
 const char *Key::get_data() const
@@ -101,11 +97,21 @@ int Key::get_size() const
    return data_length;
 }
 /* ----------------------------------------------------------------- */
+uint32_t Key::get_hash()
+{
+   if (!hash_valid) {
+      hash = SuperFastHash(data, data_length);
+      hash_valid = true;
+   }
+   return hash;
+}
+/* ----------------------------------------------------------------- */
 
 void Key::add_field(const void *src, int size)
 {
    memcpy(data+data_length, src, size);
    data_length += size;
+   hash_valid = false;
 }
 /* ----------------------------------------------------------------- */
 bool operator< (const Key &a, const Key &b)
@@ -51,6 +51,8 @@
 
 /** Maximal supported value of fields used to have aggregation function assigned.*/
 #define MAX_KEY_FIELDS 64                 // Static maximal key members count
+/** Maximal size of key data, the largest fixed length UniRec field has 16 bytes.*/
+#define MAX_KEY_SIZE (MAX_KEY_FIELDS * 16)
 
 /**
  * Class to represent template for key class creation.
@@ -73,21 +75,19 @@ public:
 };
 
 /**
- * Class to represent key for aggregation (key used in map).
+ * Class to represent key for aggregation (key used to find the stored record).
  */
 class Key {
 private:
-   char* data;                   /*!< Raw data value copies of all registered fields. */
+   char data[MAX_KEY_SIZE];      /*!< Raw data value copies of all registered fields. */
    int data_length;              /*!< The length of written bytes into class data variable. */
+   uint32_t hash;                /*!< Cached hash value of key data (valid only when hash_valid is set). */
+   bool hash_valid;              /*!< Flag whether the hash value was already computed. */
 public:
    /**
-    * Constructor, allocates memory for storing the key values of KeyTemplate.key_size
+    * Constructor, key data are stored inline so no memory is allocated.
     */
    Key();
-   /**
-    * Destructor, free allocated memory.
-    */
-   ~Key();
    /**
     * Copy constructor, to make copies to map storage.
     * @param [in] other source of data to be copied.
@@ -103,6 +103,12 @@ public:
     * @return Length of written bytes.
     */
    int get_size() const;
+   /**
+    * Get hash value of key bytes array, the value is computed only once and cached.
+    * Add all fields before the first call.
+    * @return Hash value of the key.
+    */
+   uint32_t get_hash();
    /**
     * Add values from source pointer to class data variable.
     * @param [in] src pointer to source data to be appended to key bytes array.
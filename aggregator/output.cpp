@@ -59,6 +59,14 @@ agg_func OutputTemplate::process[MAX_KEY_FIELDS];
 int OutputTemplate::used_fields = 0;
 bool OutputTemplate::prepare_to_send = false;
 final_avg OutputTemplate::avg_fields[MAX_KEY_FIELDS];
+int OutputTemplate::sketch_fields = 0;
+int OutputTemplate::sketch_src[MAX_KEY_FIELDS];
+int OutputTemplate::sketch_dst[MAX_KEY_FIELDS];
+sketch_func OutputTemplate::sketch_update[MAX_KEY_FIELDS];
+sketch_result OutputTemplate::sketch_final[MAX_KEY_FIELDS];
+double OutputTemplate::sketch_param[MAX_KEY_FIELDS];
+size_t OutputTemplate::sketch_offset[MAX_KEY_FIELDS];
+size_t OutputTemplate::state_size = 0;
 
 /* ----------------------------------------------------------------- */
 void OutputTemplate::add_field(int record_id, agg_func foo, bool avg, final_avg foo2)
@@ -73,10 +81,27 @@ void OutputTemplate::add_field(int record_id, agg_func foo, bool avg, final_avg
    used_fields++;
 }
 /* ----------------------------------------------------------------- */
+void OutputTemplate::add_sketch(int src_id, int dst_id, sketch_func update, sketch_result result, double param, size_t size)
+{
+   sketch_src[sketch_fields] = src_id;
+   sketch_dst[sketch_fields] = dst_id;
+   sketch_update[sketch_fields] = update;
+   sketch_final[sketch_fields] = result;
+   sketch_param[sketch_fields] = param;
+   // Sketches are aligned to 8 bytes in the state
+   sketch_offset[sketch_fields] = state_size;
+   state_size += (size + 7) & ~((size_t) 7);
+   // Result of sketch is computed before sending
+   prepare_to_send = true;
+   sketch_fields++;
+}
+/* ----------------------------------------------------------------- */
 void OutputTemplate::reset()
 {
    prepare_to_send = false;
    used_fields = 0;
+   sketch_fields = 0;
+   state_size = 0;
    ur_free_template(out_tmplt);
 }
 /* ----------------------------------------------------------------- */
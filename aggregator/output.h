@@ -58,6 +58,16 @@ typedef void (*agg_func)(const void *src, void *dst);
  * Define pointer to make_avg function template.
  */
 typedef void (*final_avg)(void *record, uint32_t count);
+/**
+ * Sketch update function pointer type definition.
+ * Define pointer to function adding value of field to the sketch state of stored record.
+ */
+typedef void (*sketch_func)(const void *src, int size, void *state);
+/**
+ * Sketch result function pointer type definition.
+ * Define pointer to function storing result computed from sketch state to output field.
+ */
+typedef void (*sketch_result)(const void *state, double param, void *dst);
 
 /**
  * Class to represent template for output records and its fields processing.
@@ -70,6 +80,14 @@ public:
    static agg_func process[MAX_KEY_FIELDS];           /*!< Pointer to aggregation function of field data type. */
    static bool prepare_to_send;                       /*!< Flag is record postprocessing required by assigned aggregation function. */
    static final_avg avg_fields[MAX_KEY_FIELDS];       /*!< Pointer to postprocessing function for average function of field data type. */
+   static int sketch_fields;                          /*!< Count of fields with sketch function. */
+   static int sketch_src[MAX_KEY_FIELDS];             /*!< Field index (global unirec structure) of sketch function input. */
+   static int sketch_dst[MAX_KEY_FIELDS];             /*!< Field index (global unirec structure) of sketch function result. */
+   static sketch_func sketch_update[MAX_KEY_FIELDS];  /*!< Pointer to function adding value to sketch. */
+   static sketch_result sketch_final[MAX_KEY_FIELDS]; /*!< Pointer to postprocessing function storing sketch result. */
+   static double sketch_param[MAX_KEY_FIELDS];        /*!< Parameter of sketch result function (percentile). */
+   static size_t sketch_offset[MAX_KEY_FIELDS];       /*!< Offset of sketch in state of stored record. */
+   static size_t state_size;                          /*!< Size of state of stored record, sum of all sketches. */
 
    /**
     * Assign field with all required parameters to template.
@@ -79,6 +97,17 @@ public:
     * @param [in] foo2 pointer to postprocessing average function or NULL instead.
     */
    static void add_field(int record_id, agg_func foo, bool avg_flag, final_avg foo2);
+   /**
+    * Assign field with sketch function to template. Sketch is kept in state of stored record out of the output
+    * record, its result is stored to separate output field before the record is sent.
+    * @param [in] src_id index of aggregated field from global unirec structure.
+    * @param [in] dst_id index of result field from global unirec structure.
+    * @param [in] update pointer to function adding value to sketch.
+    * @param [in] result pointer to function storing result of sketch.
+    * @param [in] param parameter of result function.
+    * @param [in] size size of sketch in bytes.
+    */
+   static void add_sketch(int src_id, int dst_id, sketch_func update, sketch_result result, double param, size_t size);
    /**
     * Reset all fields to default (empty) state.
     */
@@ -0,0 +1,224 @@
+/**
+ * \file plan.cpp
+ * \brief Compiled aggregation plan of output template.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include "plan.h"
+#include "fields.h"
+
+/* ================================================================= */
+/* ===================== Aggregation kernels ======================= */
+/* ================================================================= */
+
+/**
+ * Kernel with aggregation function known at compile time, so the function is inlined into the loop.
+ * @tparam F aggregation function.
+ * @param [in] func unused, the function is given by template parameter.
+ * @param [in] ops operations of the group.
+ * @param [in] count count of operations.
+ * @param [in] src pointer to received record.
+ * @param [in,out] dst pointer to stored record.
+ */
+template <agg_func F>
+void static_kernel(__attribute__((unused)) agg_func func, const agg_op *ops, int count, const char *src, char *dst)
+{
+   for (int i = 0; i < count; i++) {
+      F(src + ops[i].src_offset, dst + ops[i].dst_offset);
+   }
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Kernel for aggregation functions without compiled kernel, calls the function by pointer.
+ * @param [in] func aggregation function.
+ * @param [in] ops operations of the group.
+ * @param [in] count count of operations.
+ * @param [in] src pointer to received record.
+ * @param [in,out] dst pointer to stored record.
+ */
+static void dynamic_kernel(agg_func func, const agg_op *ops, int count, const char *src, char *dst)
+{
+   for (int i = 0; i < count; i++) {
+      func(src + ops[i].src_offset, dst + ops[i].dst_offset);
+   }
+}
+
+/** Kernel table entry of given aggregation function.*/
+#define KERNEL(f) { &f, &static_kernel<&f> }
+/** Kernel table entries of aggregation function template for all integer types.*/
+#define INT_KERNELS(f) KERNEL(f<int8_t>), KERNEL(f<int16_t>), KERNEL(f<int32_t>), KERNEL(f<int64_t>), \
+                       KERNEL(f<uint8_t>), KERNEL(f<uint16_t>), KERNEL(f<uint32_t>), KERNEL(f<uint64_t>), \
+                       KERNEL(f<char>)
+/** Kernel table entries of aggregation function template for all numeric types.*/
+#define NUM_KERNELS(f) INT_KERNELS(f), KERNEL(f<float>), KERNEL(f<double>)
+
+/**
+ * Compiled kernels of aggregation functions used by configuration.
+ */
+static const struct {
+   agg_func func;
+   agg_kernel kernel;
+} kernels[] = {
+   NUM_KERNELS(sum), NUM_KERNELS(avg), NUM_KERNELS(min), NUM_KERNELS(max), NUM_KERNELS(last),
+   NUM_KERNELS(first_nonempty), INT_KERNELS(bitwise_or), INT_KERNELS(bitwise_and),
+   KERNEL(last<ip_addr_t>), KERNEL(min_ip), KERNEL(max_ip), KERNEL(first_nonempty_ip)
+};
+
+/* ================================================================= */
+/* ================== AggPlan class definitions ==================== */
+/* ================================================================= */
+
+AggPlan::AggPlan() : group_count(0), var_count(0), copy_count(0), sketch_count(0), count_offset(0), in_tmplt(NULL)
+{
+}
+/* ----------------------------------------------------------------- */
+void AggPlan::add_op(agg_func func, uint16_t src_offset, uint16_t dst_offset)
+{
+   int group = 0;
+   while (group < group_count && groups[group].func != func) {
+      group++;
+   }
+
+   if (group == group_count) {
+      groups[group].func = func;
+      groups[group].kernel = &dynamic_kernel;
+      for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+         if (kernels[i].func == func) {
+            groups[group].kernel = kernels[i].kernel;
+            break;
+         }
+      }
+      groups[group].first = group > 0 ? groups[group - 1].first + groups[group - 1].count : 0;
+      groups[group].count = 0;
+      group_count++;
+   }
+
+   // Keep operations of every group together, move operations of following groups
+   int pos = groups[group].first + groups[group].count;
+   for (int g = group_count - 1; g > group; g--) {
+      ops[groups[g].first + groups[g].count] = ops[groups[g].first];
+      groups[g].first++;
+   }
+   ops[pos].src_offset = src_offset;
+   ops[pos].dst_offset = dst_offset;
+   groups[group].count++;
+}
+/* ----------------------------------------------------------------- */
+void AggPlan::build(ur_template_t *tmplt)
+{
+   ur_template_t *out_tmplt = OutputTemplate::out_tmplt;
+
+   in_tmplt = tmplt;
+   group_count = 0;
+   var_count = 0;
+   copy_count = 0;
+   sketch_count = 0;
+   count_offset = out_tmplt->offset[F_COUNT];
+
+   // TIME_FIRST:min and TIME_LAST:max are always aggregated
+   add_op(&min<uint64_t>, in_tmplt->offset[F_TIME_FIRST], out_tmplt->offset[F_TIME_FIRST]);
+   add_op(&max<uint64_t>, in_tmplt->offset[F_TIME_LAST], out_tmplt->offset[F_TIME_LAST]);
+
+   for (int i = 0; i < OutputTemplate::used_fields; i++) {
+      int field_id = OutputTemplate::indexes_to_record[i];
+      if (!ur_is_present(in_tmplt, field_id) || OutputTemplate::process[i] == &nope) {
+         continue;
+      }
+      if (ur_is_varlen(field_id)) {
+         var_fields[var_count++] = i;
+      }
+      else {
+         add_op(OutputTemplate::process[i], in_tmplt->offset[field_id], out_tmplt->offset[field_id]);
+      }
+   }
+
+   for (int i = 0; i < OutputTemplate::sketch_fields; i++) {
+      int field_id = OutputTemplate::sketch_src[i];
+      if (ur_is_present(in_tmplt, field_id)) {
+         sketches[sketch_count].func = OutputTemplate::sketch_update[i];
+         sketches[sketch_count].field_id = field_id;
+         sketches[sketch_count].state_offset = OutputTemplate::sketch_offset[i];
+         sketch_count++;
+      }
+   }
+
+   // New record is a copy of all fields of output template present in received record
+   for (int i = 0; i < out_tmplt->count; i++) {
+      int field_id = out_tmplt->ids[i];
+      if (ur_is_varlen(field_id) && ur_is_present(in_tmplt, field_id)) {
+         copy_ids[copy_count++] = field_id;
+      }
+   }
+}
+/* ----------------------------------------------------------------- */
+void AggPlan::update_var(const void *src_rec, void *dst_rec) const
+{
+   for (int i = 0; i < var_count; i++) {
+      int field_id = OutputTemplate::indexes_to_record[var_fields[i]];
+      var_params params = {dst_rec, field_id, ur_get_var_len(in_tmplt, src_rec, field_id)};
+      OutputTemplate::process[var_fields[i]](ur_get_ptr_by_id(in_tmplt, src_rec, field_id), (void *) &params);
+   }
+}
+/* ----------------------------------------------------------------- */
+void AggPlan::update_sketches(const void *src_rec, void *state) const
+{
+   for (int i = 0; i < sketch_count; i++) {
+      int field_id = sketches[i].field_id;
+      int size = ur_is_varlen(field_id) ? ur_get_var_len(in_tmplt, src_rec, field_id) : ur_get_size(field_id);
+      sketches[i].func(ur_get_ptr_by_id(in_tmplt, src_rec, field_id), size, (char *) state + sketches[i].state_offset);
+   }
+}
+/* ----------------------------------------------------------------- */
+void AggPlan::init_state(const void *src_rec, void *state) const
+{
+   if (OutputTemplate::state_size) {
+      // Empty sketches are filled with zeros
+      memset(state, 0, OutputTemplate::state_size);
+      update_sketches(src_rec, state);
+   }
+}
+/* ----------------------------------------------------------------- */
+size_t AggPlan::init_size(const void *src_rec) const
+{
+   size_t size = ur_rec_fixlen_size(OutputTemplate::out_tmplt);
+   for (int i = 0; i < copy_count; i++) {
+      size += ur_get_var_len(in_tmplt, src_rec, copy_ids[i]);
+   }
+   return size;
+}
@@ -0,0 +1,181 @@
+/**
+ * \file plan.h
+ * \brief Compiled aggregation plan of output template.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_PLAN_H
+#define AGGREGATOR_PLAN_H
+
+#include <unirec/unirec.h>
+
+#include "output.h"
+
+/** Maximal count of operations in plan, all output fields and TIME_FIRST, TIME_LAST.*/
+#define PLAN_MAX_OPS (MAX_KEY_FIELDS + 2)
+
+/**
+ * Operation of the plan, aggregation of one fixed length field.
+ */
+typedef struct {
+   uint16_t src_offset;          /*!< Offset of field in received record. */
+   uint16_t dst_offset;          /*!< Offset of field in stored record. */
+} agg_op;
+
+/**
+ * Operation of the plan, update of sketch by one field.
+ */
+typedef struct {
+   sketch_func func;             /*!< Function adding value to the sketch. */
+   int field_id;                 /*!< UniRec id of field in received record. */
+   uint32_t state_offset;        /*!< Offset of sketch in state of stored record. */
+} sketch_op;
+
+/**
+ * Aggregation kernel type definition.
+ * Kernel applies one aggregation function to all operations of a group.
+ */
+typedef void (*agg_kernel)(agg_func func, const agg_op *ops, int count, const char *src, char *dst);
+
+/**
+ * Group of plan operations with the same aggregation function and field type.
+ */
+typedef struct {
+   agg_kernel kernel;            /*!< Kernel processing the operations. */
+   agg_func func;                /*!< Aggregation function of the operations. */
+   int first;                    /*!< Index of the first operation of the group. */
+   int count;                    /*!< Count of operations of the group. */
+} agg_group;
+
+/**
+ * Class to represent aggregation of received record into stored record compiled for the current
+ * input and output templates. Field offsets are computed once and the fixed length fields are grouped
+ * by aggregation function, every group is processed by kernel with the function inlined.
+ */
+class AggPlan {
+private:
+   agg_op ops[PLAN_MAX_OPS];                 /*!< Operations ordered by groups. */
+   agg_group groups[PLAN_MAX_OPS];           /*!< Groups of operations. */
+   int group_count;                          /*!< Count of used groups. */
+   int var_fields[MAX_KEY_FIELDS];           /*!< Indexes (to OutputTemplate) of variable length fields. */
+   int var_count;                            /*!< Count of variable length fields. */
+   int copy_ids[2 * MAX_KEY_FIELDS];         /*!< UniRec ids of variable length fields copied to new stored record. */
+   int copy_count;                           /*!< Count of variable length fields copied to new stored record. */
+   sketch_op sketches[MAX_KEY_FIELDS];       /*!< Operations updating sketches. */
+   int sketch_count;                         /*!< Count of sketch operations. */
+   uint16_t count_offset;                    /*!< Offset of COUNT field in stored record. */
+   ur_template_t *in_tmplt;                  /*!< Input template the plan was built for. */
+
+   /**
+    * Add operation into the group of its aggregation function.
+    * @param [in] func aggregation function.
+    * @param [in] src_offset offset of field in received record.
+    * @param [in] dst_offset offset of field in stored record.
+    */
+   void add_op(agg_func func, uint16_t src_offset, uint16_t dst_offset);
+public:
+   AggPlan();
+   /**
+    * Build plan for given input template and current OutputTemplate.
+    * Fields missing in the input template and fields with nothing to update (first) are skipped.
+    * @param [in] in_tmplt UniRec template of received records.
+    */
+   void build(ur_template_t *in_tmplt);
+   /**
+    * Aggregate received record into stored record, increase COUNT and update TIME_FIRST, TIME_LAST.
+    * @param [in] src_rec pointer to received record.
+    * @param [in,out] dst_rec pointer to stored record.
+    * @param [in,out] state pointer to sketch state of stored record.
+    */
+   void update(const void *src_rec, void *dst_rec, void *state) const
+   {
+      const char *src = (const char *) src_rec;
+      char *dst = (char *) dst_rec;
+
+      (*(uint32_t *) (dst + count_offset))++;
+      for (int i = 0; i < group_count; i++) {
+         groups[i].kernel(groups[i].func, ops + groups[i].first, groups[i].count, src, dst);
+      }
+      if (var_count) {
+         update_var(src_rec, dst_rec);
+      }
+      if (sketch_count) {
+         update_sketches(src_rec, state);
+      }
+   }
+   /**
+    * Aggregate variable length fields of received record into stored record.
+    * @param [in] src_rec pointer to received record.
+    * @param [in,out] dst_rec pointer to stored record.
+    */
+   void update_var(const void *src_rec, void *dst_rec) const;
+   /**
+    * Add fields of received record to sketches of stored record.
+    * @param [in] src_rec pointer to received record.
+    * @param [in,out] state pointer to sketch state of stored record.
+    */
+   void update_sketches(const void *src_rec, void *state) const;
+   /**
+    * Initialize sketch state of new stored record with fields of its first received record.
+    * @param [in] src_rec pointer to received record.
+    * @param [out] state pointer to sketch state of stored record.
+    */
+   void init_state(const void *src_rec, void *state) const;
+   /**
+    * Get size of stored record initialized from received record (with its variable length fields).
+    * @param [in] src_rec pointer to received record.
+    * @return Size of record in bytes.
+    */
+   size_t init_size(const void *src_rec) const;
+   /**
+    * Get maximal count of bytes the variable length fields of stored record can grow by aggregation of received record.
+    * @param [in] src_rec pointer to received record.
+    * @return Count of bytes.
+    */
+   size_t update_size(const void *src_rec) const
+   {
+      size_t size = 0;
+      for (int i = 0; i < var_count; i++) {
+         size += ur_get_var_len(in_tmplt, src_rec, OutputTemplate::indexes_to_record[var_fields[i]]);
+      }
+      return size;
+   }
+};
+
+#endif //AGGREGATOR_PLAN_H
@@ -0,0 +1,261 @@
+/**
+ * \file sketch.cpp
+ * \brief Fixed size mergeable sketches for approximate aggregation functions.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "sketch.h"
+
+/**
+ * Get index of bucket of quantile sketch for given value.
+ * @param [in] value value to add.
+ * @return Index of bucket.
+ */
+static int quantile_bucket(double value)
+{
+   // Also NaN and negative values go to the first bucket
+   if (!(value >= ldexp(1.0, QUANTILE_MIN_EXP))) {
+      return 0;
+   }
+   int exponent;
+   // Value is fraction (0.5 - 1) * 2^exponent
+   double fraction = frexp(value, &exponent);
+   int octave = exponent - 1 - QUANTILE_MIN_EXP;
+   if (octave >= QUANTILE_OCTAVES) {
+      return QUANTILE_BUCKETS - 1;
+   }
+   int sub = (int) ((fraction * 2 - 1) * (1 << QUANTILE_SUB_BITS));
+   return 1 + (octave << QUANTILE_SUB_BITS) + sub;
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Get value representing the bucket of quantile sketch, middle of its interval.
+ * @param [in] index of bucket.
+ * @return Value of bucket.
+ */
+static double quantile_bucket_value(int index)
+{
+   if (index == 0) {
+      return 0;
+   }
+   int octave = (index - 1) >> QUANTILE_SUB_BITS;
+   int sub = (index - 1) & ((1 << QUANTILE_SUB_BITS) - 1);
+   return ldexp(1 + (sub + 0.5) / (1 << QUANTILE_SUB_BITS), octave + QUANTILE_MIN_EXP);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Add values to bucket of quantile sketch, the window of kept buckets is moved to contain the bucket if needed.
+ * @param [in,out] sketch non-empty quantile sketch.
+ * @param [in] index of bucket.
+ * @param [in] n count of values.
+ */
+static void quantile_count(quantile_sketch *sketch, int index, uint32_t n)
+{
+   int first = sketch->offset;
+   int last = first + QUANTILE_WINDOW - 1;
+   if (index > last) {
+      // Window moves up, buckets falling out of it are folded into the first kept one
+      int shift = index - last;
+      uint32_t folded = 0;
+      for (int i = 0; i <= shift && i < QUANTILE_WINDOW; i++) {
+         folded += sketch->buckets[i];
+      }
+      if (shift < QUANTILE_WINDOW - 1) {
+         memmove(sketch->buckets + 1, sketch->buckets + shift + 1, (QUANTILE_WINDOW - 1 - shift) * sizeof(uint32_t));
+         memset(sketch->buckets + QUANTILE_WINDOW - shift, 0, shift * sizeof(uint32_t));
+      }
+      else {
+         memset(sketch->buckets + 1, 0, (QUANTILE_WINDOW - 1) * sizeof(uint32_t));
+      }
+      sketch->buckets[0] = folded;
+      sketch->offset += shift;
+   }
+   else if (index < first) {
+      // Window moves down only over its empty top buckets, the rest of smaller values is counted in the first one
+      int top = QUANTILE_WINDOW - 1;
+      while (top >= 0 && sketch->buckets[top] == 0) {
+         top--;
+      }
+      int shift = first - index;
+      if (shift > QUANTILE_WINDOW - 1 - top) {
+         shift = QUANTILE_WINDOW - 1 - top;
+      }
+      if (shift > 0) {
+         memmove(sketch->buckets + shift, sketch->buckets, (QUANTILE_WINDOW - shift) * sizeof(uint32_t));
+         memset(sketch->buckets, 0, shift * sizeof(uint32_t));
+         sketch->offset -= shift;
+      }
+      if (index < (int) sketch->offset) {
+         index = sketch->offset;
+      }
+   }
+   sketch->buckets[index - sketch->offset] += n;
+}
+/* ----------------------------------------------------------------- */
+uint64_t sketch_hash(const void *data, size_t size)
+{
+   // FNV-1a followed by finalizer of MurmurHash3, so all bits of hash are well mixed
+   const uint8_t *bytes = (const uint8_t *) data;
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+   }
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdULL;
+   hash ^= hash >> 33;
+   hash *= 0xc4ceb9fe1a85ec53ULL;
+   hash ^= hash >> 33;
+   return hash;
+}
+/* ----------------------------------------------------------------- */
+void hll_add(hll_sketch *sketch, uint64_t hash)
+{
+   int index = hash >> (64 - HLL_PRECISION);
+   // Guard bit limits the count of zeros when the remaining bits are all zero
+   uint64_t rest = (hash << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1));
+   uint8_t rank = __builtin_clzll(rest) + 1;
+   if (rank > sketch->registers[index]) {
+      sketch->registers[index] = rank;
+   }
+}
+/* ----------------------------------------------------------------- */
+void hll_merge(hll_sketch *dst, const hll_sketch *src)
+{
+   for (int i = 0; i < HLL_REGISTERS; i++) {
+      if (src->registers[i] > dst->registers[i]) {
+         dst->registers[i] = src->registers[i];
+      }
+   }
+}
+/* ----------------------------------------------------------------- */
+uint64_t hll_estimate(const hll_sketch *sketch)
+{
+   double sum = 0;
+   int zeros = 0;
+   for (int i = 0; i < HLL_REGISTERS; i++) {
+      sum += ldexp(1.0, -sketch->registers[i]);
+      if (sketch->registers[i] == 0) {
+         zeros++;
+      }
+   }
+
+   double m = HLL_REGISTERS;
+   double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+   if (estimate <= 2.5 * m && zeros > 0) {
+      estimate = m * log(m / zeros);
+   }
+   return (uint64_t) (estimate + 0.5);
+}
+/* ----------------------------------------------------------------- */
+void quantile_add(quantile_sketch *sketch, double value)
+{
+   int index = quantile_bucket(value);
+   if (sketch->count == 0) {
+      // The first value is placed in the middle of window, so the window can move both ways
+      int offset = index - QUANTILE_WINDOW / 2;
+      if (offset > QUANTILE_BUCKETS - QUANTILE_WINDOW) {
+         offset = QUANTILE_BUCKETS - QUANTILE_WINDOW;
+      }
+      sketch->offset = offset > 0 ? offset : 0;
+   }
+   if (sketch->count == 0 || value < sketch->min) {
+      sketch->min = value;
+   }
+   if (sketch->count == 0 || value > sketch->max) {
+      sketch->max = value;
+   }
+   sketch->count++;
+   quantile_count(sketch, index, 1);
+}
+/* ----------------------------------------------------------------- */
+void quantile_merge(quantile_sketch *dst, const quantile_sketch *src)
+{
+   if (src->count == 0) {
+      return;
+   }
+   if (dst->count == 0) {
+      *dst = *src;
+      return;
+   }
+   if (src->min < dst->min) {
+      dst->min = src->min;
+   }
+   if (src->max > dst->max) {
+      dst->max = src->max;
+   }
+   dst->count += src->count;
+   for (int i = 0; i < QUANTILE_WINDOW; i++) {
+      if (src->buckets[i]) {
+         quantile_count(dst, src->offset + i, src->buckets[i]);
+      }
+   }
+}
+/* ----------------------------------------------------------------- */
+double quantile_estimate(const quantile_sketch *sketch, double q)
+{
+   if (sketch->count == 0) {
+      return 0;
+   }
+   // Nearest rank, the first and the last one are known exactly
+   uint64_t rank = (uint64_t) ceil(q * sketch->count);
+   if (rank <= 1) {
+      return sketch->min;
+   }
+   if (rank >= sketch->count) {
+      return sketch->max;
+   }
+
+   uint64_t seen = 0;
+   int index = 0;
+   while (index < QUANTILE_WINDOW - 1 && seen + sketch->buckets[index] < rank) {
+      seen += sketch->buckets[index];
+      index++;
+   }
+   double value = quantile_bucket_value(sketch->offset + index);
+   if (value < sketch->min) {
+      return sketch->min;
+   }
+   if (value > sketch->max) {
+      return sketch->max;
+   }
+   return value;
+}
@@ -0,0 +1,141 @@
+/**
+ * \file sketch.h
+ * \brief Fixed size mergeable sketches for approximate aggregation functions.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_SKETCH_H
+#define AGGREGATOR_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Count of hash bits selecting the HyperLogLog register.*/
+#define HLL_PRECISION 8
+/** Count of HyperLogLog registers, standard error of estimate is 1.04 / sqrt(HLL_REGISTERS) (6.5 %).*/
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+/** Count of buckets per power of 2 of quantile sketch is 2^QUANTILE_SUB_BITS, relative error is at most 1/17.*/
+#define QUANTILE_SUB_BITS 3
+/** Exponent of the smallest value of quantile sketch, smaller values are counted as this one.*/
+#define QUANTILE_MIN_EXP (-16)
+/** Count of powers of 2 covered by quantile sketch (values from 2^-16 up to 2^48), larger values are counted as the largest one.*/
+#define QUANTILE_OCTAVES 64
+/** Count of buckets of quantile sketch, bucket 0 holds values below the covered range.*/
+#define QUANTILE_BUCKETS (1 + (QUANTILE_OCTAVES << QUANTILE_SUB_BITS))
+/** Count of buckets kept by quantile sketch (16 powers of 2), the window of kept buckets moves with added values.*/
+#define QUANTILE_WINDOW 128
+
+/**
+ * Structure of HyperLogLog sketch estimating count of distinct values.
+ * Sketch filled with zeros is empty, two sketches are merged by maximum of their registers.
+ */
+typedef struct {
+   uint8_t registers[HLL_REGISTERS];   /*!< Maximal count of leading zeros (+1) of hashes of the register. */
+} hll_sketch;
+
+/**
+ * Structure of log-linear histogram estimating quantiles of values. Every power of 2 is split into
+ * buckets of equal width, so the relative error does not depend on magnitude of values.
+ * Only QUANTILE_WINDOW consecutive buckets are kept, the window moves up when a larger value is added
+ * and the buckets falling out of it are added to its first bucket, so only low quantiles of values
+ * spread over more than 16 powers of 2 lose precision.
+ * Sketch filled with zeros is empty, two sketches are merged by sum of their buckets.
+ */
+typedef struct {
+   uint64_t count;                     /*!< Count of added values. */
+   double min;                         /*!< Minimal added value. */
+   double max;                         /*!< Maximal added value. */
+   uint32_t offset;                    /*!< Index of bucket kept in buckets[0]. */
+   uint32_t buckets[QUANTILE_WINDOW];  /*!< Count of added values in every kept bucket, the first one counts also all smaller values. */
+} quantile_sketch;
+
+/**
+ * Compute 64 bit hash of value to be added to HyperLogLog sketch.
+ * @param [in] data pointer to value.
+ * @param [in] size size of value in bytes.
+ * @return Hash value.
+ */
+uint64_t sketch_hash(const void *data, size_t size);
+
+/**
+ * Add hash of value to HyperLogLog sketch.
+ * @param [in,out] sketch HyperLogLog sketch.
+ * @param [in] hash hash of value computed by sketch_hash().
+ */
+void hll_add(hll_sketch *sketch, uint64_t hash);
+
+/**
+ * Merge HyperLogLog sketch into another one, result estimates count of distinct values added to any of them.
+ * @param [in,out] dst sketch to be updated.
+ * @param [in] src sketch to merge.
+ */
+void hll_merge(hll_sketch *dst, const hll_sketch *src);
+
+/**
+ * Estimate count of distinct values added to HyperLogLog sketch.
+ * Small counts are estimated by linear counting of empty registers.
+ * @param [in] sketch HyperLogLog sketch.
+ * @return Estimated count of distinct values.
+ */
+uint64_t hll_estimate(const hll_sketch *sketch);
+
+/**
+ * Add value to quantile sketch.
+ * @param [in,out] sketch quantile sketch.
+ * @param [in] value value to add.
+ */
+void quantile_add(quantile_sketch *sketch, double value);
+
+/**
+ * Merge quantile sketch into another one, result describes values added to any of them.
+ * @param [in,out] dst sketch to be updated.
+ * @param [in] src sketch to merge.
+ */
+void quantile_merge(quantile_sketch *dst, const quantile_sketch *src);
+
+/**
+ * Estimate quantile of values added to quantile sketch, minimum and maximum are exact.
+ * @param [in] sketch quantile sketch.
+ * @param [in] q quantile (0 - 1), e.g. 0.5 for median.
+ * @return Estimated value, 0 if sketch is empty.
+ */
+double quantile_estimate(const quantile_sketch *sketch, double q);
+
+#endif //AGGREGATOR_SKETCH_H
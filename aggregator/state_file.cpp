@@ -0,0 +1,222 @@
+/**
+ * \file state_file.cpp
+ * \brief Snapshot of stored records for restart of the module.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "key.h"
+#include "output.h"
+#include "state_file.h"
+
+/* ================================================================= */
+/* ================ StateFile class definitions ==================== */
+/* ================================================================= */
+
+StateFile::StateFile() : data(NULL), size(0), pos(0), records(0), read(0)
+{
+}
+/* ----------------------------------------------------------------- */
+StateFile::~StateFile()
+{
+   close();
+}
+/* ----------------------------------------------------------------- */
+std::string StateFile::layout(Config *config, ur_template_t *out_tmplt)
+{
+   std::string desc;
+   char buffer[256];
+
+   // Aggregation functions of fields, records of different function cannot be continued
+   for (int i = 0; i < config->get_used_fields(); i++) {
+      snprintf(buffer, sizeof(buffer), "%s:%d:%g;", config->get_name(i), config->get_function(i), config->get_param(i));
+      desc += buffer;
+   }
+   snprintf(buffer, sizeof(buffer), "key %u state %lu;", KeyTemplate::key_size, (unsigned long) OutputTemplate::state_size);
+   desc += buffer;
+   // Position of fields in stored record
+   for (int i = 0; i < out_tmplt->count; i++) {
+      int id = out_tmplt->ids[i];
+      snprintf(buffer, sizeof(buffer), "%s:%d:%u;", ur_get_name(id), (int) ur_get_type(id), (unsigned) out_tmplt->offset[id]);
+      desc += buffer;
+   }
+   return desc;
+}
+/* ----------------------------------------------------------------- */
+bool StateFile::save(const char *path, Storage &storage, ur_template_t *out_tmplt, const std::string &layout)
+{
+   // Snapshot is written to temporary file, so previous snapshot is never replaced by incomplete one
+   std::string tmp_path = std::string(path) + ".tmp";
+   FILE *file = fopen(tmp_path.c_str(), "wb");
+   if (file == NULL) {
+      fprintf(stderr, "Error: Cannot open state file %s: %s\n", tmp_path.c_str(), strerror(errno));
+      return false;
+   }
+   setvbuf(file, NULL, _IOFBF, STATE_FILE_BUFFER);
+
+   state_header header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, STATE_FILE_MAGIC, sizeof(header.magic));
+   header.version = STATE_FILE_VERSION;
+   header.layout_size = layout.size();
+   header.records = storage.size();
+
+   bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(layout.data(), 1, layout.size(), file) == layout.size();
+   for (int i = 0; i < STORAGE_SHARDS && ok; i++) {
+      AggTable &table = storage.get_shard(i).table;
+      for (size_t j = 0; j < table.get_capacity() && ok; j++) {
+         StorageEntry *entry = table.get_entry(j);
+         if (entry == NULL) {
+            continue;
+         }
+         state_entry item;
+         item.expire = entry->node.expire;
+         item.record_size = ur_rec_size(out_tmplt, entry->record);
+         ok = fwrite(&item, sizeof(item), 1, file) == 1 &&
+              fwrite(entry->get_key(), 1, KeyTemplate::key_size, file) == KeyTemplate::key_size &&
+              fwrite(table.get_state(entry), 1, OutputTemplate::state_size, file) == OutputTemplate::state_size &&
+              fwrite(entry->record, 1, item.record_size, file) == item.record_size;
+      }
+   }
+   ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+   ok = (fclose(file) == 0) && ok;
+
+   if (!ok || rename(tmp_path.c_str(), path) != 0) {
+      fprintf(stderr, "Error: Cannot write state file %s: %s\n", path, strerror(errno));
+      unlink(tmp_path.c_str());
+      return false;
+   }
+   return true;
+}
+/* ----------------------------------------------------------------- */
+bool StateFile::open(const char *path, const std::string &layout)
+{
+   close();
+
+   int fd = ::open(path, O_RDONLY);
+   if (fd < 0) {
+      // Missing file is not an error, module runs for the first time
+      if (errno != ENOENT) {
+         fprintf(stderr, "Warning: Cannot open state file %s: %s\n", path, strerror(errno));
+      }
+      return false;
+   }
+   struct stat st;
+   if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(state_header)) {
+      fprintf(stderr, "Warning: State file %s is damaged, not used.\n", path);
+      ::close(fd);
+      return false;
+   }
+   void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (map == MAP_FAILED) {
+      fprintf(stderr, "Warning: Cannot map state file %s: %s\n", path, strerror(errno));
+      return false;
+   }
+   data = (char *) map;
+   size = st.st_size;
+   // Records are read only once in the order they were written
+   madvise(data, size, MADV_SEQUENTIAL);
+
+   state_header header;
+   memcpy(&header, data, sizeof(header));
+   if (memcmp(header.magic, STATE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != STATE_FILE_VERSION ||
+       header.layout_size > size - sizeof(header)) {
+      fprintf(stderr, "Warning: State file %s is damaged or of unsupported version, not used.\n", path);
+      close();
+      return false;
+   }
+   if (layout.compare(0, std::string::npos, data + sizeof(header), header.layout_size) != 0) {
+      fprintf(stderr, "Warning: State file %s was saved with different configuration, not used.\n", path);
+      close();
+      return false;
+   }
+   pos = sizeof(header) + header.layout_size;
+   records = header.records;
+   read = 0;
+   return true;
+}
+/* ----------------------------------------------------------------- */
+bool StateFile::next(state_record *rec, ur_template_t *out_tmplt, bool variable)
+{
+   size_t fixed = sizeof(state_entry) + KeyTemplate::key_size + OutputTemplate::state_size;
+   if (read == records || size - pos < fixed) {
+      return false;
+   }
+
+   state_entry item;
+   memcpy(&item, data + pos, sizeof(item));
+   // Record is copied into storage slot of fixed size, or of at most UR_MAX_SIZE for variable length records
+   uint32_t fixlen = ur_rec_fixlen_size(out_tmplt);
+   if (variable ? (item.record_size < fixlen || item.record_size > UR_MAX_SIZE) : item.record_size != fixlen) {
+      return false;
+   }
+   if (size - pos - fixed < item.record_size) {
+      return false;
+   }
+   rec->expire = item.expire;
+   rec->record_size = item.record_size;
+   rec->key = data + pos + sizeof(item);
+   rec->state = rec->key + KeyTemplate::key_size;
+   rec->record = (const char *) rec->state + OutputTemplate::state_size;
+
+   pos += fixed + item.record_size;
+   read++;
+   return true;
+}
+/* ----------------------------------------------------------------- */
+void StateFile::close()
+{
+   if (data) {
+      munmap(data, size);
+   }
+   data = NULL;
+   size = 0;
+   pos = 0;
+   records = 0;
+   read = 0;
+}
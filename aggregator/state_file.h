@@ -0,0 +1,153 @@
+/**
+ * \file state_file.h
+ * \brief Snapshot of stored records for restart of the module.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_STATE_FILE_H
+#define AGGREGATOR_STATE_FILE_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <unirec/unirec.h>
+
+#include "configuration.h"
+#include "storage.h"
+
+/** Identification of state file at its beginning.*/
+#define STATE_FILE_MAGIC "AGGSTATE"
+/** Version of state file format, increase when the format is changed.*/
+#define STATE_FILE_VERSION 1
+/** Size of buffer used for writing of state file.*/
+#define STATE_FILE_BUFFER (1 << 20)
+
+/**
+ * Structure of state file header, followed by layout description and stored records.
+ */
+typedef struct {
+   char magic[8];          /*!< STATE_FILE_MAGIC. */
+   uint32_t version;       /*!< STATE_FILE_VERSION. */
+   uint32_t layout_size;   /*!< Size of layout description following the header. */
+   uint64_t records;       /*!< Count of stored records. */
+} state_header;
+
+/**
+ * Structure of one stored record in state file, followed by key, state and record data.
+ */
+typedef struct {
+   uint32_t expire;        /*!< Passive timeout expire time of record in seconds. */
+   uint32_t record_size;   /*!< Size of record with its variable length fields. */
+} state_entry;
+
+/**
+ * Structure to represent one record read from state file, pointers point to mapped file.
+ */
+typedef struct {
+   const char *key;        /*!< Key data of size KeyTemplate::key_size. */
+   const void *state;      /*!< State of aggregation functions of size OutputTemplate::state_size. */
+   const void *record;     /*!< Stored record in output template. */
+   uint32_t record_size;   /*!< Size of record with its variable length fields. */
+   uint32_t expire;        /*!< Passive timeout expire time of record in seconds. */
+} state_record;
+
+/**
+ * Class to represent snapshot of storage saved when the module is stopped and loaded on its next start,
+ * so aggregation continues with the same records instead of sending partial aggregates on restart.
+ * Records are saved with layout of keys, states and output records, snapshot is used only when
+ * the layout of current configuration and templates is the same.
+ */
+class StateFile {
+private:
+   char *data;             /*!< Mapped state file. */
+   size_t size;            /*!< Size of mapped state file. */
+   size_t pos;             /*!< Offset of next record in mapped state file. */
+   uint64_t records;       /*!< Count of records in mapped state file. */
+   uint64_t read;          /*!< Count of records already read. */
+public:
+   StateFile();
+   ~StateFile();
+   /**
+    * Describe layout of keys, states and records of given configuration and output template.
+    * @param [in] config module configuration.
+    * @param [in] out_tmplt UniRec template of stored records.
+    * @return Layout description.
+    */
+   static std::string layout(Config *config, ur_template_t *out_tmplt);
+   /**
+    * Write all records of storage to the file, file is replaced only when whole snapshot was written.
+    * Storage is not locked, no other thread can use it.
+    * @param [in] path name of state file.
+    * @param [in] storage storage of records to save.
+    * @param [in] out_tmplt UniRec template of stored records.
+    * @param [in] layout layout description of current configuration returned by layout().
+    * @return True on success, false if the file could not be written.
+    */
+   static bool save(const char *path, Storage &storage, ur_template_t *out_tmplt, const std::string &layout);
+   /**
+    * Map state file and check its header and layout, use next() to read its records then.
+    * @param [in] path name of state file.
+    * @param [in] layout layout description of current configuration returned by layout().
+    * @return True if file can be used, false if it does not exist, is damaged or has different layout.
+    */
+   bool open(const char *path, const std::string &layout);
+   /**
+    * Read next record of opened state file.
+    * @param [out] rec read record, valid until the file is closed.
+    * @param [in] out_tmplt UniRec template of stored records.
+    * @param [in] variable true if records are stored with variable length fields, false if only fixed part is stored.
+    * @return True if record was read, false at the end of file or when the file is damaged.
+    */
+   bool next(state_record *rec, ur_template_t *out_tmplt, bool variable);
+   /**
+    * Check whether all records of opened state file were read.
+    * @return True if all records were read.
+    */
+   bool finished() const
+   {
+      return read == records;
+   }
+   /**
+    * Unmap state file.
+    */
+   void close();
+};
+
+#endif //AGGREGATOR_STATE_FILE_H
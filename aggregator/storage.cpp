@@ -0,0 +1,178 @@
+/**
+ * \file storage.cpp
+ * \brief Sharded storage of aggregated records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstring>
+
+#include "storage.h"
+
+/* ================================================================= */
+/* ============== StorageShard class definitions =================== */
+/* ================================================================= */
+
+StorageShard::StorageShard() : limit(0), byte_limit(0), evicted(0)
+{
+   pthread_mutex_init(&lock, NULL);
+   memset(&stats, 0, sizeof(stats));
+}
+/* ----------------------------------------------------------------- */
+StorageShard::~StorageShard()
+{
+   pthread_mutex_destroy(&lock);
+}
+/* ----------------------------------------------------------------- */
+void StorageShard::relink_wheel()
+{
+   wheel.clear();
+   for (size_t i = 0; i < table.get_capacity(); i++) {
+      StorageEntry *entry = table.get_entry(i);
+      // Entry inserted by the resizing call is not linked yet (its node points to itself)
+      if (entry && entry->node.next != &entry->node) {
+         wheel.insert(&entry->node);
+      }
+   }
+}
+
+/* ================================================================= */
+/* ================ Storage class definitions ====================== */
+/* ================================================================= */
+
+Storage::Storage() : expected_records(0), max_records(0), max_bytes(0), records(0), peak_records(0)
+{
+}
+/* ----------------------------------------------------------------- */
+void Storage::reserve(size_t records)
+{
+   expected_records = records;
+}
+/* ----------------------------------------------------------------- */
+void Storage::set_limits(size_t records, size_t bytes)
+{
+   max_records = records;
+   max_bytes = bytes;
+}
+/* ----------------------------------------------------------------- */
+bool Storage::configure(size_t key_size, size_t state_size, size_t record_size, size_t var_size)
+{
+   // Limits are split evenly among shards, keys are distributed uniformly by their hash
+   size_t limit = 0;
+   size_t byte_limit = max_bytes / STORAGE_SHARDS;
+   if (max_records) {
+      limit = max_records / STORAGE_SHARDS > 0 ? max_records / STORAGE_SHARDS : 1;
+   }
+   if (max_bytes) {
+      // Count of records is only estimated when their variable length fields are not known yet
+      size_t entry = AggTable::entry_size(key_size, state_size, record_size, var_size);
+      size_t slots = TABLE_MIN_CAPACITY;
+      while (slots * 2 * entry <= byte_limit) {
+         slots *= 2;
+      }
+      if (!limit || AggTable::max_entries(slots) < limit) {
+         limit = AggTable::max_entries(slots);
+      }
+   }
+
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      shards[i].wheel.clear();
+      shards[i].limit = limit;
+      shards[i].byte_limit = var_size ? byte_limit : 0;
+      if (!shards[i].table.configure(key_size, state_size, record_size, var_size,
+                                     limit ? limit + 1 : expected_records / STORAGE_SHARDS, limit != 0)) {
+         return false;
+      }
+   }
+   return true;
+}
+/* ----------------------------------------------------------------- */
+void Storage::lock_all()
+{
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      pthread_mutex_lock(&shards[i].lock);
+   }
+}
+/* ----------------------------------------------------------------- */
+void Storage::unlock_all()
+{
+   for (int i = STORAGE_SHARDS - 1; i >= 0; i--) {
+      pthread_mutex_unlock(&shards[i].lock);
+   }
+}
+/* ----------------------------------------------------------------- */
+size_t Storage::size()
+{
+   size_t records = 0;
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      records += shards[i].table.size();
+   }
+   return records;
+}
+/* ----------------------------------------------------------------- */
+void Storage::clear()
+{
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      shards[i].table.clear();
+      shards[i].wheel.clear();
+   }
+   records = 0;
+}
+/* ----------------------------------------------------------------- */
+void Storage::get_expiry_stats(expiry_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      stats->checks += shards[i].stats.checks;
+      stats->visited += shards[i].stats.visited;
+      stats->expired += shards[i].stats.expired;
+      stats->rescheduled += shards[i].stats.rescheduled;
+   }
+}
+/* ----------------------------------------------------------------- */
+void Storage::get_storage_stats(storage_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   stats->records = records;
+   stats->peak_records = peak_records;
+   for (int i = 0; i < STORAGE_SHARDS; i++) {
+      stats->bytes += shards[i].table.memory_size();
+      stats->var_bytes += shards[i].table.var_size();
+      stats->evicted += shards[i].evicted;
+   }
+}
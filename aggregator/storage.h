@@ -0,0 +1,203 @@
+/**
+ * \file storage.h
+ * \brief Sharded storage of aggregated records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_STORAGE_H
+#define AGGREGATOR_STORAGE_H
+
+#include <pthread.h>
+
+#include "key.h"
+#include "expiry.h"
+#include "table.h"
+
+/** Number of bits of key hash used to select the storage shard.*/
+#define STORAGE_SHARD_BITS 6
+/** Count of storage shards, every shard has its own lock.*/
+#define STORAGE_SHARDS (1 << STORAGE_SHARD_BITS)
+
+/**
+ * Class to represent one part of storage with its own lock.
+ */
+class StorageShard {
+public:
+   pthread_mutex_t lock;         /*!< Lock of the shard, needs to be held when accessing the table. */
+   AggTable table;               /*!< Stored records of keys belonging to the shard. */
+   ExpiryWheel wheel;            /*!< Index of entries by their passive timeout expire time. */
+   expiry_stats stats;           /*!< Statistics of passive timeout checks of the shard. */
+   size_t limit;                 /*!< Maximal count of records in the shard, 0 if not limited. */
+   size_t byte_limit;            /*!< Maximal count of bytes used by the shard, 0 if not limited. */
+   uint64_t evicted;             /*!< Count of records removed before their timeout because of the limit. */
+
+   StorageShard();
+   ~StorageShard();
+   /**
+    * Insert all entries of the table into the expiry wheel again, has to be called
+    * after the table was resized, because entries (and their wheel nodes) were moved.
+    * New entries which were not inserted into the wheel yet are skipped.
+    */
+   void relink_wheel();
+   /**
+    * Check whether the shard holds more records or uses more memory than allowed.
+    * The only record of shard is never over the limit.
+    * @return True if some record has to be removed.
+    */
+   bool over_limit() const
+   {
+      return table.size() > 1 && ((limit && table.size() > limit) || (byte_limit && table.used_size() > byte_limit));
+   }
+};
+
+/**
+ * Structure of storage occupancy statistics.
+ */
+typedef struct {
+   uint64_t records;       /*!< Count of stored records. */
+   uint64_t peak_records;  /*!< Maximal count of stored records. */
+   uint64_t bytes;         /*!< Count of bytes allocated by storage. */
+   uint64_t var_bytes;     /*!< Count of bytes used by records with variable length fields. */
+   uint64_t evicted;       /*!< Count of records removed before their timeout because of the limit. */
+} storage_stats;
+
+/**
+ * Class to represent storage of aggregated records split into shards by the key hash.
+ * Records of one key are always stored in the same shard, so different shards can be
+ * modified by different threads at the same time and timeout checks lock only one shard at a time.
+ */
+class Storage {
+private:
+   StorageShard shards[STORAGE_SHARDS];    /*!< Shards of storage. */
+   size_t expected_records;                /*!< Count of records the shards are prepared for. */
+   size_t max_records;                     /*!< Maximal count of stored records, 0 if not limited. */
+   size_t max_bytes;                       /*!< Maximal count of bytes allocated by storage, 0 if not limited. */
+   volatile size_t records;                /*!< Count of stored records, updated atomically. */
+   volatile size_t peak_records;           /*!< Maximal value of records. */
+public:
+   Storage();
+   /**
+    * Set count of records the storage is prepared for without resize, applied by configure().
+    * @param [in] records expected count of all stored records.
+    */
+   void reserve(size_t records);
+   /**
+    * Set limits of storage size, applied by configure(). When the limit is reached, the oldest record
+    * of the shard has to be removed for every new one.
+    * @param [in] records maximal count of stored records, 0 if not limited.
+    * @param [in] bytes maximal count of bytes allocated by storage, 0 if not limited.
+    */
+   void set_limits(size_t records, size_t bytes);
+   /**
+    * Check whether the storage size is limited.
+    * @return True if limit is set.
+    */
+   bool is_bounded() const
+   {
+      return max_records || max_bytes;
+   }
+   /**
+    * Set size of keys and records of all shards, storage has to be empty (flushed). Shards are not locked.
+    * @param [in] key_size size of key data.
+    * @param [in] state_size size of state of aggregation functions of every record.
+    * @param [in] record_size size of fixed part of stored records.
+    * @param [in] var_size expected size of variable length fields of records, 0 if there are none.
+    * @return True on success, false if memory could not be allocated.
+    */
+   bool configure(size_t key_size, size_t state_size, size_t record_size, size_t var_size);
+   /**
+    * Get index of shard where the key with given hash is stored.
+    * @param [in] hash hash value of the key.
+    * @return Index of shard.
+    */
+   static int get_shard_index(uint32_t hash)
+   {
+      return hash >> (32 - STORAGE_SHARD_BITS);
+   }
+   /**
+    * Get shard on given index.
+    * @param [in] index of shard (0 - STORAGE_SHARDS-1).
+    * @return Reference to the shard.
+    */
+   StorageShard &get_shard(int index)
+   {
+      return shards[index];
+   }
+   /**
+    * Lock all shards, e.g. to change the templates.
+    */
+   void lock_all();
+   /**
+    * Unlock all shards locked by lock_all().
+    */
+   void unlock_all();
+   /**
+    * Get count of all stored records, shards are not locked.
+    * @return Count of stored records.
+    */
+   size_t size();
+   /**
+    * Update count of stored records after records were added or removed.
+    * @param [in] change count of added (positive) or removed (negative) records.
+    */
+   void update_records(long change)
+   {
+      size_t now = __sync_add_and_fetch(&records, change);
+      size_t peak = peak_records;
+      while (now > peak && !__sync_bool_compare_and_swap(&peak_records, peak, now)) {
+         peak = peak_records;
+      }
+   }
+   /**
+    * Free all stored records and clear the storage, shards are not locked.
+    */
+   void clear();
+   /**
+    * Sum statistics of passive timeout checks of all shards, shards are not locked.
+    * @param [out] stats sum of statistics.
+    */
+   void get_expiry_stats(expiry_stats *stats);
+   /**
+    * Get occupancy statistics of storage, shards are not locked.
+    * @param [out] stats storage statistics.
+    */
+   void get_storage_stats(storage_stats *stats);
+};
+
+#endif //AGGREGATOR_STORAGE_H
@@ -0,0 +1,363 @@
+/**
+ * \file table.cpp
+ * \brief Open addressing hash table of aggregated records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "table.h"
+
+/** Mask of control bytes in group, one bit per slot.*/
+typedef uint32_t group_mask;
+
+/**
+ * Get hash bits stored in control byte of full slot.
+ * @param [in] hash hash of the key.
+ * @return Control byte value (0 - 127).
+ */
+static inline uint8_t hash_ctrl(uint32_t hash)
+{
+   return (uint8_t) (((uint64_t) hash * 0x9E3779B97F4A7C15ULL) >> 57);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Get position where the probing for the key starts.
+ * @param [in] hash hash of the key.
+ * @return Position (not masked by capacity).
+ */
+static inline size_t hash_pos(uint32_t hash)
+{
+   return (size_t) (((uint64_t) hash * 0x9E3779B97F4A7C15ULL) >> 7);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Find slots of group with given control byte.
+ * @param [in] group pointer to first control byte of group.
+ * @param [in] value control byte to find.
+ * @return Mask of slots with matching control byte.
+ */
+static inline group_mask group_match(const uint8_t *group, uint8_t value)
+{
+#ifdef __SSE2__
+   __m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) value)));
+#else
+   group_mask mask = 0;
+   for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+      if (group[i] == value) {
+         mask |= 1U << i;
+      }
+   }
+   return mask;
+#endif
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Find empty or deleted slots of group.
+ * @param [in] group pointer to first control byte of group.
+ * @return Mask of slots without entry.
+ */
+static inline group_mask group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+   // Empty and deleted slots are the only ones with the highest bit set
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+   group_mask mask = 0;
+   for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+      if (group[i] & CTRL_EMPTY) {
+         mask |= 1U << i;
+      }
+   }
+   return mask;
+#endif
+}
+
+/* ================================================================= */
+/* ================= AggTable class definitions ==================== */
+/* ================================================================= */
+
+AggTable::AggTable() : ctrl(NULL), slots(NULL), capacity(0), count(0), growth_left(0), slot_size(0),
+                       key_size(0), state_offset(0), record_offset(0), record_size(0), initial_capacity(0), bounded(false),
+                       inline_records(true)
+{
+}
+/* ----------------------------------------------------------------- */
+AggTable::~AggTable()
+{
+   free(ctrl);
+   free(slots);
+}
+/* ----------------------------------------------------------------- */
+bool AggTable::allocate(size_t new_capacity)
+{
+   uint8_t *new_ctrl = (uint8_t *) malloc(new_capacity + TABLE_GROUP_WIDTH);
+   char *new_slots = (char *) malloc(new_capacity * slot_size);
+   if (!new_ctrl || !new_slots) {
+      free(new_ctrl);
+      free(new_slots);
+      return false;
+   }
+   memset(new_ctrl, CTRL_EMPTY, new_capacity + TABLE_GROUP_WIDTH);
+
+   ctrl = new_ctrl;
+   slots = new_slots;
+   capacity = new_capacity;
+   count = 0;
+   // Maximal load factor is 7/8
+   growth_left = new_capacity - new_capacity / 8;
+   return true;
+}
+/* ----------------------------------------------------------------- */
+size_t AggTable::find_free(uint32_t hash)
+{
+   size_t mask = capacity - 1;
+   size_t pos = hash_pos(hash) & mask;
+   size_t step = 0;
+
+   while (true) {
+      group_mask free_slots = group_match_free(ctrl + pos);
+      if (free_slots) {
+         return (pos + __builtin_ctz(free_slots)) & mask;
+      }
+      // Triangular probing visits every group when capacity is power of 2
+      step += TABLE_GROUP_WIDTH;
+      pos = (pos + step) & mask;
+   }
+}
+/* ----------------------------------------------------------------- */
+size_t AggTable::entry_size(size_t key_length, size_t state_length, size_t record_length, size_t var_length)
+{
+   size_t offset = ((sizeof(StorageEntry) + key_length + 7) & ~((size_t) 7)) + ((state_length + 7) & ~((size_t) 7));
+   if (var_length == 0) {
+      return 1 + ((offset + record_length + 7) & ~((size_t) 7));
+   }
+   int index = VarArena::size_class(record_length + var_length);
+   return 1 + offset + VarArena::class_size(index >= 0 ? index : VAR_ARENA_CLASSES - 1);
+}
+/* ----------------------------------------------------------------- */
+bool AggTable::configure(size_t key_length, size_t state_length, size_t record_length, size_t var_length, size_t expected, bool bound)
+{
+   clear();
+   free(ctrl);
+   free(slots);
+   ctrl = NULL;
+   slots = NULL;
+   capacity = 0;
+
+   key_size = key_length;
+   record_size = record_length;
+   inline_records = (var_length == 0);
+   // State and records are aligned to 8 bytes after the entry header and key
+   state_offset = (sizeof(StorageEntry) + key_size + 7) & ~((size_t) 7);
+   record_offset = state_offset + ((state_length + 7) & ~((size_t) 7));
+   slot_size = inline_records ? (record_offset + record_size + 7) & ~((size_t) 7) : record_offset;
+
+   bounded = bound;
+   initial_capacity = TABLE_MIN_CAPACITY;
+   while ((bounded ? max_entries(initial_capacity) : initial_capacity - initial_capacity / 8) < expected) {
+      initial_capacity *= 2;
+   }
+   return allocate(initial_capacity);
+}
+/* ----------------------------------------------------------------- */
+StorageEntry *AggTable::find_or_insert(const char *key, uint32_t hash, size_t record_length, bool *inserted, bool *resized)
+{
+   *inserted = false;
+   *resized = false;
+   if (!ctrl) {
+      return NULL;
+   }
+
+   uint8_t h2 = hash_ctrl(hash);
+   size_t mask = capacity - 1;
+   size_t pos = hash_pos(hash) & mask;
+   size_t step = 0;
+
+   while (true) {
+      const uint8_t *group = ctrl + pos;
+      group_mask match = group_match(group, h2);
+      while (match) {
+         StorageEntry *entry = slot((pos + __builtin_ctz(match)) & mask);
+         if (entry->hash == hash && memcmp(entry->get_key(), key, key_size) == 0) {
+            return entry;
+         }
+         match &= match - 1;
+      }
+      // Key would be inserted to the first empty slot, so it is not stored behind it
+      if (group_match(group, CTRL_EMPTY)) {
+         break;
+      }
+      step += TABLE_GROUP_WIDTH;
+      pos = (pos + step) & mask;
+   }
+
+   if (growth_left == 0) {
+      // Rehash to the same capacity only drops deleted slots, grow when the table is really full
+      if (!resize((bounded || count * 2 < capacity - capacity / 8) ? capacity : capacity * 2)) {
+         return NULL;
+      }
+      *resized = true;
+   }
+
+   void *record = NULL;
+   uint32_t record_capacity = 0;
+   if (!inline_records && (record = arena.alloc(record_length, &record_capacity)) == NULL) {
+      return NULL;
+   }
+
+   size_t index = find_free(hash);
+   if (ctrl[index] == CTRL_EMPTY) {
+      growth_left--;
+   }
+   set_ctrl(index, h2);
+   count++;
+
+   StorageEntry *entry = slot(index);
+   entry->hash = hash;
+   entry->record = inline_records ? (char *) entry + record_offset : record;
+   entry->record_capacity = record_capacity;
+   ExpiryWheel::init_list(&entry->node);
+   entry->node.expire = 0;
+   memcpy(entry->get_key(), key, key_size);
+
+   *inserted = true;
+   return entry;
+}
+/* ----------------------------------------------------------------- */
+bool AggTable::resize(size_t new_capacity)
+{
+   uint8_t *old_ctrl = ctrl;
+   char *old_slots = slots;
+   size_t old_capacity = capacity;
+   size_t old_count = count;
+
+   if (!allocate(new_capacity)) {
+      return false;
+   }
+
+   for (size_t i = 0; i < old_capacity; i++) {
+      if (old_ctrl[i] & CTRL_EMPTY) {
+         continue;
+      }
+      StorageEntry *old_entry = (StorageEntry *) (old_slots + i * slot_size);
+      size_t index = find_free(old_entry->hash);
+      set_ctrl(index, old_ctrl[i]);
+
+      StorageEntry *entry = slot(index);
+      memcpy(entry, old_entry, slot_size);
+      if (inline_records) {
+         entry->record = (char *) entry + record_offset;
+      }
+   }
+   count = old_count;
+   growth_left -= old_count;
+
+   free(old_ctrl);
+   free(old_slots);
+   return true;
+}
+/* ----------------------------------------------------------------- */
+bool AggTable::grow_record(StorageEntry *entry, size_t record_length)
+{
+   uint32_t record_capacity;
+   void *record = arena.alloc(record_length, &record_capacity);
+   if (!record) {
+      return false;
+   }
+   memcpy(record, entry->record, entry->record_capacity);
+   arena.free(entry->record, entry->record_capacity);
+   entry->record = record;
+   entry->record_capacity = record_capacity;
+   return true;
+}
+/* ----------------------------------------------------------------- */
+void AggTable::erase(StorageEntry *entry)
+{
+   size_t index = ((char *) entry - slots) / slot_size;
+   size_t mask = capacity - 1;
+
+   if (!inline_records) {
+      arena.free(entry->record, entry->record_capacity);
+   }
+   count--;
+
+   // Slot can be marked empty only when no probe sequence could have seen full group around it
+   group_mask empty_before = group_match(ctrl + ((index - TABLE_GROUP_WIDTH) & mask), CTRL_EMPTY);
+   group_mask empty_after = group_match(ctrl + index, CTRL_EMPTY);
+   if (empty_before && empty_after &&
+       (size_t) (__builtin_ctz(empty_after) + __builtin_clz(empty_before << (32 - TABLE_GROUP_WIDTH))) < TABLE_GROUP_WIDTH) {
+      set_ctrl(index, CTRL_EMPTY);
+      growth_left++;
+   }
+   else {
+      set_ctrl(index, CTRL_DELETED);
+   }
+}
+/* ----------------------------------------------------------------- */
+void AggTable::clear()
+{
+   if (!inline_records) {
+      arena.release();
+   }
+   if (!ctrl) {
+      return;
+   }
+   if (capacity > initial_capacity) {
+      free(ctrl);
+      free(slots);
+      ctrl = NULL;
+      slots = NULL;
+      if (!allocate(initial_capacity)) {
+         capacity = 0;
+         count = 0;
+         growth_left = 0;
+      }
+      return;
+   }
+   memset(ctrl, CTRL_EMPTY, capacity + TABLE_GROUP_WIDTH);
+   count = 0;
+   growth_left = capacity - capacity / 8;
+}
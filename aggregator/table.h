@@ -0,0 +1,290 @@
+/**
+ * \file table.h
+ * \brief Open addressing hash table of aggregated records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_TABLE_H
+#define AGGREGATOR_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "expiry.h"
+#include "arena.h"
+
+/** Count of control bytes checked at once during the lookup.*/
+#define TABLE_GROUP_WIDTH 16
+/** Minimal capacity of the table, has to be power of 2 and at least TABLE_GROUP_WIDTH.*/
+#define TABLE_MIN_CAPACITY 64
+
+/** Control byte of empty slot.*/
+#define CTRL_EMPTY ((uint8_t) 0x80)
+/** Control byte of slot with removed entry.*/
+#define CTRL_DELETED ((uint8_t) 0xFE)
+
+/**
+ * Class to represent header of entry stored in the table. Header is followed by the key data
+ * and by the inline (fixed length) record.
+ */
+class StorageEntry {
+public:
+   ExpiryNode node;              /*!< Node of expiry wheel, has to be the first member. */
+   void *record;                 /*!< Stored (output) record, inline or allocated from arena. */
+   uint32_t hash;                /*!< Hash of the key. */
+   uint32_t record_capacity;     /*!< Size of arena chunk of record, 0 for inline record. */
+
+   /**
+    * Get key data stored in the entry.
+    * @return Pointer to key data.
+    */
+   char *get_key()
+   {
+      return (char *) (this + 1);
+   }
+   /**
+    * Get entry which contains given expiry wheel node.
+    * @param [in] node pointer to node member of entry.
+    * @return Pointer to entry.
+    */
+   static StorageEntry *from_node(ExpiryNode *node)
+   {
+      return reinterpret_cast<StorageEntry *>(node);
+   }
+};
+
+/**
+ * Class to represent open addressing hash table with keys and records stored inline in one slab.
+ * Every slot has one control byte, which is either empty, deleted or 7 bits of key hash.
+ * Lookup compares the hash bits of TABLE_GROUP_WIDTH slots at once (with SSE2 when available)
+ * and compares keys only of slots with matching hash bits.
+ * Records with variable length fields cannot be stored inline, they are allocated from the arena
+ * in chunks fitting their current size.
+ */
+class AggTable {
+private:
+   uint8_t *ctrl;                /*!< Control bytes, capacity + TABLE_GROUP_WIDTH (mirror of first group). */
+   char *slots;                  /*!< Slab of entries. */
+   size_t capacity;              /*!< Count of slots, power of 2. */
+   size_t count;                 /*!< Count of stored entries. */
+   size_t growth_left;           /*!< Count of entries which can be inserted before resize. */
+   size_t slot_size;             /*!< Size of one slot. */
+   size_t key_size;              /*!< Size of key data. */
+   size_t state_offset;          /*!< Offset of state of aggregation functions in slot. */
+   size_t record_offset;         /*!< Offset of inline record in slot. */
+   size_t record_size;           /*!< Size of (fixed part of) record. */
+   size_t initial_capacity;      /*!< Capacity allocated by configure(). */
+   bool bounded;                 /*!< Flag whether the table never grows over initial capacity. */
+   bool inline_records;          /*!< Flag whether records are stored inline. */
+   VarArena arena;               /*!< Storage of records with variable length fields. */
+
+   /**
+    * Set control byte of slot (and its mirror).
+    * @param [in] index of slot.
+    * @param [in] value control byte.
+    */
+   void set_ctrl(size_t index, uint8_t value)
+   {
+      ctrl[index] = value;
+      if (index < TABLE_GROUP_WIDTH) {
+         ctrl[capacity + index] = value;
+      }
+   }
+   /**
+    * Get entry in slot on given index.
+    * @param [in] index of slot.
+    * @return Pointer to entry.
+    */
+   StorageEntry *slot(size_t index)
+   {
+      return (StorageEntry *) (slots + index * slot_size);
+   }
+   /**
+    * Allocate arrays for given capacity, all slots are empty.
+    * @param [in] new_capacity count of slots, power of 2.
+    * @return True on success, false if memory could not be allocated.
+    */
+   bool allocate(size_t new_capacity);
+   /**
+    * Find empty or deleted slot for key with given hash.
+    * @param [in] hash of the key.
+    * @return Index of slot.
+    */
+   size_t find_free(uint32_t hash);
+   /**
+    * Move all entries to newly allocated arrays, deleted slots are dropped.
+    * @param [in] new_capacity count of slots, power of 2.
+    * @return True on success, false if memory could not be allocated (table is unchanged).
+    */
+   bool resize(size_t new_capacity);
+   /**
+    * Move record of entry to a larger arena chunk.
+    * @param [in,out] entry stored entry with record allocated from arena.
+    * @param [in] record_length required size of record.
+    * @return True on success, false if memory could not be allocated (record is unchanged).
+    */
+   bool grow_record(StorageEntry *entry, size_t record_length);
+public:
+   AggTable();
+   ~AggTable();
+   /**
+    * Set sizes of keys and records, table has to be empty (cleared).
+    * @param [in] key_length size of key data.
+    * @param [in] state_length size of state of aggregation functions kept in slot, 0 if there is none.
+    * @param [in] record_length size of fixed part of record.
+    * @param [in] var_length expected size of variable length fields, 0 when records are stored inline.
+    * @param [in] expected count of entries to be stored without resize.
+    * @param [in] bound if set, table never grows and caller keeps at most max_entries(capacity) entries.
+    * @return True on success, false if memory could not be allocated.
+    */
+   bool configure(size_t key_length, size_t state_length, size_t record_length, size_t var_length, size_t expected, bool bound);
+   /**
+    * Get count of memory bytes used by one entry for given sizes, including its control byte and record.
+    * @param [in] key_length size of key data.
+    * @param [in] state_length size of state of aggregation functions.
+    * @param [in] record_length size of fixed part of record.
+    * @param [in] var_length expected size of variable length fields, 0 when records are stored inline.
+    * @return Size of one entry in bytes.
+    */
+   static size_t entry_size(size_t key_length, size_t state_length, size_t record_length, size_t var_length);
+   /**
+    * Get maximal count of entries of bounded table with given capacity. Quarter of slots is kept free,
+    * so removed entries do not cause rehash too often.
+    * @param [in] slots capacity of table.
+    * @return Count of entries.
+    */
+   static size_t max_entries(size_t slots)
+   {
+      return slots - slots / 4;
+   }
+   /**
+    * Get count of bytes allocated by the table and its arena.
+    * @return Size of used memory in bytes.
+    */
+   size_t memory_size() const
+   {
+      return capacity + TABLE_GROUP_WIDTH + capacity * slot_size + arena.allocated();
+   }
+   /**
+    * Get count of bytes used by the table and its records, free chunks of arena are not counted.
+    * @return Size of used memory in bytes.
+    */
+   size_t used_size() const
+   {
+      return capacity + TABLE_GROUP_WIDTH + capacity * slot_size + arena.used_size();
+   }
+   /**
+    * Get count of bytes of arena chunks used by records with variable length fields.
+    * @return Size of used chunks in bytes.
+    */
+   size_t var_size() const
+   {
+      return arena.used_size();
+   }
+   /**
+    * Find entry of given key or insert new one. New entry has record allocated but not initialized.
+    * Inserting can resize the table, all pointers to entries are invalidated then.
+    * @param [in] key key data.
+    * @param [in] hash hash of key data.
+    * @param [in] record_length size of new record with its variable length fields, not used for inline records.
+    * @param [out] inserted set to true when new entry was inserted.
+    * @param [out] resized set to true when table was resized.
+    * @return Pointer to entry or NULL if memory could not be allocated.
+    */
+   StorageEntry *find_or_insert(const char *key, uint32_t hash, size_t record_length, bool *inserted, bool *resized);
+   /**
+    * Make sure the record of entry can hold given size, e.g. before variable length fields are updated.
+    * Record with variable length fields is moved to a larger chunk when needed, entry->record is changed then.
+    * @param [in,out] entry stored entry.
+    * @param [in] record_length required size of record.
+    * @return True on success, false if memory could not be allocated (record is unchanged).
+    */
+   bool reserve_record(StorageEntry *entry, size_t record_length)
+   {
+      if (record_length <= entry->record_capacity || inline_records) {
+         return true;
+      }
+      return grow_record(entry, record_length);
+   }
+   /**
+    * Get state of aggregation functions of entry (e.g. sketches), it is moved together with the entry.
+    * @param [in] entry stored entry.
+    * @return Pointer to state, aligned to 8 bytes.
+    */
+   void *get_state(StorageEntry *entry) const
+   {
+      return (char *) entry + state_offset;
+   }
+   /**
+    * Remove entry from the table and free its record. Other entries are not moved.
+    * @param [in] entry pointer to stored entry.
+    */
+   void erase(StorageEntry *entry);
+   /**
+    * Remove all entries and free their records, capacity is shrunk to the initial one.
+    */
+   void clear();
+   /**
+    * Get count of slots, use with get_entry() to iterate over all entries.
+    * @return Count of slots.
+    */
+   size_t get_capacity() const
+   {
+      return capacity;
+   }
+   /**
+    * Get entry in slot on given index.
+    * @param [in] index of slot.
+    * @return Pointer to entry or NULL if slot is empty.
+    */
+   StorageEntry *get_entry(size_t index)
+   {
+      return (ctrl[index] & CTRL_EMPTY) ? NULL : slot(index);
+   }
+   /**
+    * Get count of stored entries.
+    * @return Count of entries.
+    */
+   size_t size() const
+   {
+      return count;
+   }
+};
+
+#endif //AGGREGATOR_TABLE_H
@@ -0,0 +1,95 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include <set>
+#include <vector>
+
+#include "expiry.h"
+
+/** Count of nodes used by the tests. */
+#define NODES 4000
+/** Maximal count of nodes stored in the wheel at once. */
+#define LIMIT 2000
+
+/*
+ * Only the active timeout is set: the wheel is never checked, records are removed only by pop_oldest()
+ * when the storage is full, while the record time runs for several wheel turns.
+ */
+static void test_pop_oldest_unchecked(void **state)
+{
+   ExpiryWheel wheel;
+   expiry_stats stats = {0, 0, 0, 0};
+   std::vector<ExpiryNode> nodes(NODES);
+   std::vector<bool> stored(NODES, false);
+   std::multiset<uint32_t> times;
+   size_t count = 0;
+   long ops = 0;
+   uint32_t now = 1000000;
+
+   srand(1);
+   // 5 wheel turns of record time
+   while (now < 1000000 + 5 * EXPIRY_WHEEL_SLOTS) {
+      if (++ops % 20 == 0) {
+         now++;
+      }
+      int i = rand() % NODES;
+      uint32_t expire = now + 10 - rand() % 3;
+      if (stored[i]) {
+         times.erase(times.find(nodes[i].expire));
+         wheel.update(&nodes[i], expire);
+         times.insert(expire);
+         continue;
+      }
+      ExpiryWheel::init_list(&nodes[i]);
+      nodes[i].expire = expire;
+      wheel.insert(&nodes[i]);
+      times.insert(expire);
+      stored[i] = true;
+      count++;
+
+      while (count > LIMIT) {
+         ExpiryNode *node = wheel.pop_oldest(&stats);
+         assert_non_null(node);
+         assert_true(stored[node - &nodes[0]]);
+         assert_int_equal(node->expire, *times.begin());
+         times.erase(times.begin());
+         stored[node - &nodes[0]] = false;
+         count--;
+      }
+   }
+   // Every node is visited at most once per its slot search, not once per removed node
+   assert_true(stats.visited < (uint64_t) ops * 2);
+}
+
+/*
+ * Node with the earliest expire time is removed also when all nodes expire after the whole wheel turn.
+ */
+static void test_pop_oldest_distant(void **state)
+{
+   ExpiryWheel wheel;
+   expiry_stats stats = {0, 0, 0, 0};
+   ExpiryNode nodes[3];
+   uint32_t times[3] = {100, 100 + 3 * EXPIRY_WHEEL_SLOTS + 5, 100 + 2 * EXPIRY_WHEEL_SLOTS + 7};
+
+   for (int i = 0; i < 3; i++) {
+      ExpiryWheel::init_list(&nodes[i]);
+      nodes[i].expire = times[i];
+      wheel.insert(&nodes[i]);
+   }
+   assert_true(wheel.pop_oldest(&stats) == &nodes[0]);
+   assert_true(wheel.pop_oldest(&stats) == &nodes[2]);
+   assert_true(wheel.pop_oldest(&stats) == &nodes[1]);
+   assert_null(wheel.pop_oldest(&stats));
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_pop_oldest_unchecked),
+      cmocka_unit_test(test_pop_oldest_distant),
+   };
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}
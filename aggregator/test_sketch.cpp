@@ -0,0 +1,143 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+#include <math.h>
+
+#include "sketch.h"
+
+/**
+ * Get sum of all kept buckets of quantile sketch.
+ * @param [in] sketch quantile sketch.
+ * @return Sum of bucket counts.
+ */
+static uint64_t bucket_sum(const quantile_sketch *sketch)
+{
+   uint64_t sum = 0;
+   for (int i = 0; i < QUANTILE_WINDOW; i++) {
+      sum += sketch->buckets[i];
+   }
+   return sum;
+}
+
+/**
+ * Check that estimated value is within relative error of the sketch.
+ * @param [in] estimate estimated value.
+ * @param [in] value exact value.
+ */
+static void assert_close(double estimate, double value)
+{
+   assert_true(fabs(estimate - value) <= value / 16);
+}
+
+/*
+ * Window moves up for large values, buckets falling out of it are folded into its first bucket.
+ */
+static void test_quantile_shift_up(void **state)
+{
+   quantile_sketch sketch;
+   memset(&sketch, 0, sizeof(sketch));
+
+   for (int i = 0; i < 10; i++) {
+      quantile_add(&sketch, 1.0);
+   }
+   uint32_t offset = sketch.offset;
+   // 12 powers of 2 above the first value, window keeps only 8 of them above its middle
+   for (int i = 0; i < 30; i++) {
+      quantile_add(&sketch, 4096.0);
+   }
+   assert_true(sketch.offset > offset);
+   assert_int_equal(sketch.count, 40);
+   assert_int_equal(bucket_sum(&sketch), 40);
+   assert_close(quantile_estimate(&sketch, 0.5), 4096.0);
+   assert_true(quantile_estimate(&sketch, 0) == 1.0);
+   assert_true(quantile_estimate(&sketch, 1) == 4096.0);
+
+   // Window moves over the whole kept range, all previous values are folded
+   quantile_add(&sketch, ldexp(1.0, 40));
+   assert_int_equal(bucket_sum(&sketch), 41);
+   assert_int_equal(sketch.buckets[0], 40);
+}
+
+/*
+ * Window moves down for small values only over its empty top buckets.
+ */
+static void test_quantile_shift_down(void **state)
+{
+   quantile_sketch sketch;
+   memset(&sketch, 0, sizeof(sketch));
+
+   quantile_add(&sketch, 1.0);
+   uint32_t offset = sketch.offset;
+   // 10 powers of 2 below the first value, window keeps only 8 of them below its middle
+   for (int i = 0; i < 3; i++) {
+      quantile_add(&sketch, ldexp(1.0, -10));
+   }
+   assert_true(sketch.offset < offset);
+   assert_int_equal(bucket_sum(&sketch), 4);
+   assert_close(quantile_estimate(&sketch, 0.5), ldexp(1.0, -10));
+   assert_true(quantile_estimate(&sketch, 1) == 1.0);
+
+   // Only 7 top buckets are empty after 2^5 is added, smaller value is counted in the first bucket
+   offset = sketch.offset;
+   quantile_add(&sketch, ldexp(1.0, 5));
+   assert_int_equal(sketch.offset, offset);
+   quantile_add(&sketch, ldexp(1.0, -15));
+   assert_int_equal(sketch.offset, offset - 7);
+   assert_int_equal(sketch.buckets[0], 1);
+   assert_int_equal(sketch.buckets[QUANTILE_WINDOW - 1], 1);
+   assert_int_equal(bucket_sum(&sketch), 6);
+   assert_true(quantile_estimate(&sketch, 0) == ldexp(1.0, -15));
+}
+
+/*
+ * Merge of sketches whose windows do not overlap keeps counts of both of them.
+ */
+static void test_quantile_merge_disjoint(void **state)
+{
+   quantile_sketch low, high, merged;
+   memset(&low, 0, sizeof(low));
+   memset(&high, 0, sizeof(high));
+
+   for (int i = 0; i < 20; i++) {
+      quantile_add(&low, 1.0 + i / 20.0);
+   }
+   for (int i = 0; i < 10; i++) {
+      quantile_add(&high, ldexp(1.0 + i / 10.0, 30));
+   }
+   assert_true(high.offset >= low.offset + QUANTILE_WINDOW);
+
+   // Window of low values moves up to the high ones
+   merged = low;
+   quantile_merge(&merged, &high);
+   assert_int_equal(merged.count, 30);
+   assert_int_equal(bucket_sum(&merged), 30);
+   assert_true(merged.min == 1.0);
+   assert_true(merged.max == high.max);
+   assert_close(quantile_estimate(&merged, 0.9), ldexp(1.6, 30));
+
+   // Low values are counted in the first bucket of the high window
+   merged = high;
+   quantile_merge(&merged, &low);
+   assert_int_equal(merged.count, 30);
+   assert_int_equal(bucket_sum(&merged), 30);
+   assert_true(merged.min == 1.0);
+   assert_true(merged.max == high.max);
+   assert_close(quantile_estimate(&merged, 0.9), ldexp(1.6, 30));
+
+   // Merge into empty sketch copies the source
+   memset(&merged, 0, sizeof(merged));
+   quantile_merge(&merged, &low);
+   assert_memory_equal(&merged, &low, sizeof(low));
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_quantile_shift_up),
+      cmocka_unit_test(test_quantile_shift_down),
+      cmocka_unit_test(test_quantile_merge_disjoint),
+   };
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}
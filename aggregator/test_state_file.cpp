@@ -0,0 +1,192 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "key.h"
+#include "output.h"
+#include "state_file.h"
+#include "storage.h"
+
+/** Count of records saved by the tests. */
+#define RECORDS 50
+/** Size of state of every record. */
+#define STATE_SIZE 16
+/** Name of state file written by the tests. */
+#define STATE_PATH "test_state_file.state"
+/** Layout description of saved records. */
+#define LAYOUT "BYTES:sum;PACKETS:sum;"
+
+/** Storage is too large for the stack of test. */
+static Storage storage;
+
+/**
+ * Get hash of key, keys are spread over all shards.
+ * @param [in] key key value.
+ * @return Hash of key.
+ */
+static uint32_t key_hash(uint64_t key)
+{
+   return (uint32_t) (key * 0x9E3779B1U);
+}
+
+/**
+ * Fill record of given key.
+ * @param [in] tmplt UniRec template of record.
+ * @param [out] rec record with enough space for variable length fields.
+ * @param [in] key key value.
+ */
+static void fill_record(ur_template_t *tmplt, void *rec, uint64_t key)
+{
+   *(uint64_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("BYTES")) = key * 100;
+   *(uint32_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("PACKETS")) = key;
+   int host = ur_get_id_by_name("HOST");
+   if (host >= 0 && ur_is_present(tmplt, host)) {
+      char name[32];
+      int length = snprintf(name, sizeof(name), "host-%lu", (unsigned long) key);
+      ur_set_var(tmplt, rec, host, name, length);
+   }
+}
+
+/**
+ * Store records of RECORDS keys into the storage and save them to the state file.
+ * @param [in] tmplt UniRec template of stored records.
+ * @param [in] variable true if records have variable length fields.
+ */
+static void save_records(ur_template_t *tmplt, bool variable)
+{
+   KeyTemplate::key_size = sizeof(uint64_t);
+   OutputTemplate::state_size = STATE_SIZE;
+   assert_true(storage.configure(KeyTemplate::key_size, STATE_SIZE, ur_rec_fixlen_size(tmplt), variable ? 64 : 0));
+
+   void *rec = ur_create_record(tmplt, variable ? UR_MAX_SIZE : 0);
+   for (uint64_t key = 0; key < RECORDS; key++) {
+      fill_record(tmplt, rec, key);
+      StorageShard &shard = storage.get_shard(Storage::get_shard_index(key_hash(key)));
+      bool inserted, resized;
+      StorageEntry *entry = shard.table.find_or_insert((const char *) &key, key_hash(key), ur_rec_size(tmplt, rec),
+                                                       &inserted, &resized);
+      assert_non_null(entry);
+      assert_true(inserted);
+      memcpy(entry->record, rec, ur_rec_size(tmplt, rec));
+      memset(shard.table.get_state(entry), (int) key, STATE_SIZE);
+      entry->node.expire = 1000 + key;
+   }
+   ur_free_record(rec);
+
+   assert_true(StateFile::save(STATE_PATH, storage, tmplt, LAYOUT));
+   storage.clear();
+}
+
+/**
+ * Read all records of the state file and compare them with the saved ones.
+ * @param [in] tmplt UniRec template of stored records.
+ * @param [in] variable true if records have variable length fields.
+ */
+static void load_records(ur_template_t *tmplt, bool variable)
+{
+   StateFile file;
+   state_record rec;
+   bool loaded[RECORDS] = {false};
+   void *expected = ur_create_record(tmplt, variable ? UR_MAX_SIZE : 0);
+
+   assert_false(file.open(STATE_PATH, "BYTES:max;PACKETS:sum;"));
+   assert_true(file.open(STATE_PATH, LAYOUT));
+   for (int i = 0; i < RECORDS; i++) {
+      assert_true(file.next(&rec, tmplt, variable));
+      uint64_t key;
+      memcpy(&key, rec.key, sizeof(key));
+      assert_true(key < RECORDS && !loaded[key]);
+      loaded[key] = true;
+
+      fill_record(tmplt, expected, key);
+      assert_int_equal(rec.record_size, ur_rec_size(tmplt, expected));
+      assert_memory_equal(rec.record, expected, rec.record_size);
+      for (int j = 0; j < STATE_SIZE; j++) {
+         assert_int_equal(((const uint8_t *) rec.state)[j], (uint8_t) key);
+      }
+      assert_int_equal(rec.expire, 1000 + key);
+   }
+   assert_false(file.next(&rec, tmplt, variable));
+   assert_true(file.finished());
+   file.close();
+   ur_free_record(expected);
+}
+
+/*
+ * Records with fixed length fields are loaded as they were saved.
+ */
+static void test_save_load_fixed(void **state)
+{
+   ur_template_t *tmplt = ur_create_template_from_ifc_spec("uint64 BYTES,uint32 PACKETS");
+   assert_non_null(tmplt);
+
+   save_records(tmplt, false);
+   load_records(tmplt, false);
+   unlink(STATE_PATH);
+   ur_free_template(tmplt);
+}
+
+/*
+ * Records with variable length fields are loaded as they were saved.
+ */
+static void test_save_load_variable(void **state)
+{
+   ur_template_t *tmplt = ur_create_template_from_ifc_spec("uint64 BYTES,uint32 PACKETS,string HOST");
+   assert_non_null(tmplt);
+
+   save_records(tmplt, true);
+   load_records(tmplt, true);
+   unlink(STATE_PATH);
+   ur_free_template(tmplt);
+}
+
+/*
+ * Record whose size does not fit the storage slot is not read.
+ */
+static void test_load_damaged(void **state)
+{
+   ur_template_t *tmplt = ur_create_template_from_ifc_spec("uint64 BYTES,uint32 PACKETS,string HOST");
+   assert_non_null(tmplt);
+   save_records(tmplt, true);
+
+   // Records with variable length fields cannot be stored inline
+   StateFile file;
+   state_record rec;
+   assert_true(file.open(STATE_PATH, LAYOUT));
+   assert_false(file.next(&rec, tmplt, false));
+   file.close();
+
+   // Record larger than UniRec record
+   FILE *f = fopen(STATE_PATH, "r+b");
+   assert_non_null(f);
+   uint32_t size = UR_MAX_SIZE + 1;
+   assert_int_equal(fseek(f, sizeof(state_header) + strlen(LAYOUT) + offsetof(state_entry, record_size), SEEK_SET), 0);
+   assert_int_equal(fwrite(&size, sizeof(size), 1, f), 1);
+   assert_int_equal(fclose(f), 0);
+   assert_true(file.open(STATE_PATH, LAYOUT));
+   assert_false(file.next(&rec, tmplt, true));
+   assert_false(file.finished());
+   file.close();
+
+   unlink(STATE_PATH);
+   ur_free_template(tmplt);
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_save_load_fixed),
+      cmocka_unit_test(test_save_load_variable),
+      cmocka_unit_test(test_load_damaged),
+   };
+   int ret = cmocka_run_group_tests(tests, NULL, NULL);
+   ur_finalize();
+   return ret;
+}
@@ -0,0 +1,170 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "table.h"
+
+/** Count of keys inserted before the erase. */
+#define KEYS 2000
+/** Count of different hashes of keys, keys with one hash are found only by comparing the key data. */
+#define HASHES 97
+
+/**
+ * Get hash of key, many keys share one hash, so their probe sequences are long.
+ * @param [in] key key value.
+ * @return Hash of key.
+ */
+static uint32_t key_hash(uint64_t key)
+{
+   return (uint32_t) ((key % HASHES) * 0x9E3779B1U);
+}
+
+/**
+ * Find entry of key or insert it, record of inserted entry is set to the key value.
+ * @param [in,out] table table to use.
+ * @param [in] key key value.
+ * @param [out] inserted set to true when new entry was inserted.
+ * @param [out] resized set to true when table was resized (only set, never cleared).
+ * @return Pointer to entry.
+ */
+static StorageEntry *insert(AggTable &table, uint64_t key, bool *inserted, bool *resized)
+{
+   bool table_resized;
+   StorageEntry *entry = table.find_or_insert((const char *) &key, key_hash(key), 2 * sizeof(key), inserted, &table_resized);
+   assert_non_null(entry);
+   if (*inserted) {
+      memcpy(entry->record, &key, sizeof(key));
+   }
+   *resized = *resized || table_resized;
+   return entry;
+}
+
+/**
+ * Check that the table holds exactly the keys flagged as stored and their records.
+ * @param [in] table table to check.
+ * @param [in] stored flags of stored keys.
+ */
+static void check_keys(AggTable &table, const std::vector<bool> &stored)
+{
+   size_t count = 0;
+   for (size_t i = 0; i < table.get_capacity(); i++) {
+      StorageEntry *entry = table.get_entry(i);
+      if (entry == NULL) {
+         continue;
+      }
+      uint64_t key, value;
+      memcpy(&key, entry->get_key(), sizeof(key));
+      memcpy(&value, entry->record, sizeof(value));
+      assert_true(key < stored.size() && stored[key]);
+      assert_int_equal(value, key);
+      assert_int_equal(entry->hash, key_hash(key));
+      count++;
+   }
+   assert_int_equal(count, table.size());
+}
+
+/**
+ * Insert keys, erase half of them, grow the table by more keys and insert the erased keys again.
+ * @param [in] var_length expected size of variable length fields, 0 for inline records.
+ */
+static void erase_reinsert(size_t var_length)
+{
+   AggTable table;
+   std::vector<bool> stored(3 * KEYS, false);
+   bool inserted, resized = false;
+
+   assert_true(table.configure(sizeof(uint64_t), 0, sizeof(uint64_t), var_length, 0, false));
+   for (uint64_t key = 0; key < KEYS; key++) {
+      insert(table, key, &inserted, &resized);
+      assert_true(inserted);
+      stored[key] = true;
+   }
+   for (uint64_t key = 1; key < KEYS; key += 2) {
+      StorageEntry *entry = insert(table, key, &inserted, &resized);
+      assert_false(inserted);
+      table.erase(entry);
+      stored[key] = false;
+   }
+   check_keys(table, stored);
+
+   // Erased slots are dropped when the table grows
+   resized = false;
+   for (uint64_t key = KEYS; key < 3 * KEYS; key++) {
+      insert(table, key, &inserted, &resized);
+      assert_true(inserted);
+      stored[key] = true;
+   }
+   assert_true(resized);
+   check_keys(table, stored);
+
+   for (uint64_t key = 1; key < KEYS; key += 2) {
+      insert(table, key, &inserted, &resized);
+      assert_true(inserted);
+      stored[key] = true;
+   }
+   for (uint64_t key = 0; key < 3 * KEYS; key++) {
+      insert(table, key, &inserted, &resized);
+      assert_false(inserted);
+   }
+   assert_int_equal(table.size(), 3 * KEYS);
+   check_keys(table, stored);
+}
+
+/*
+ * Entries with inline records are found after erase and resize.
+ */
+static void test_erase_reinsert_inline(void **state)
+{
+   erase_reinsert(0);
+}
+
+/*
+ * Entries with records allocated from arena are found after erase and resize.
+ */
+static void test_erase_reinsert_arena(void **state)
+{
+   erase_reinsert(64);
+}
+
+/*
+ * Bounded table does not grow when the oldest key is replaced by a new one, slots of erased entries are reused.
+ */
+static void test_bounded_replace(void **state)
+{
+   AggTable table;
+   size_t limit = AggTable::max_entries(TABLE_MIN_CAPACITY);
+   std::vector<bool> stored(100 * limit, false);
+   bool inserted, resized = false;
+
+   assert_true(table.configure(sizeof(uint64_t), 0, sizeof(uint64_t), 0, limit, true));
+   for (uint64_t key = 0; key < stored.size(); key++) {
+      if (key >= limit) {
+         // The oldest key is removed for every new one
+         StorageEntry *entry = insert(table, key - limit, &inserted, &resized);
+         assert_false(inserted);
+         table.erase(entry);
+         stored[key - limit] = false;
+      }
+      insert(table, key, &inserted, &resized);
+      assert_true(inserted);
+      stored[key] = true;
+   }
+   assert_int_equal(table.get_capacity(), TABLE_MIN_CAPACITY);
+   assert_int_equal(table.size(), limit);
+   check_keys(table, stored);
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_erase_reinsert_inline),
+      cmocka_unit_test(test_erase_reinsert_arena),
+      cmocka_unit_test(test_bounded_replace),
+   };
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}
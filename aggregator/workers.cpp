@@ -0,0 +1,277 @@
+/**
+ * \file workers.cpp
+ * \brief Worker threads processing batches of received records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "workers.h"
+
+/* ================================================================= */
+/* =============== RecordBatch class definitions =================== */
+/* ================================================================= */
+
+RecordBatch::RecordBatch() : watermark(0), flush(false)
+{
+}
+/* ----------------------------------------------------------------- */
+void RecordBatch::add(const void *rec, uint16_t size, const char *key, int key_size, uint32_t hash)
+{
+   batch_item item = {hash, (uint32_t) data.size(), (uint32_t) data.size() + size};
+   data.resize(item.key_offset + (key ? key_size : 0));
+   memcpy(&data[item.offset], rec, size);
+   if (key) {
+      memcpy(&data[item.key_offset], key, key_size);
+   }
+   items.push_back(item);
+}
+/* ----------------------------------------------------------------- */
+void RecordBatch::clear()
+{
+   data.clear();
+   items.clear();
+   watermark = 0;
+   flush = false;
+}
+
+/* ================================================================= */
+/* ================== Worker class definitions ===================== */
+/* ================================================================= */
+
+Worker::Worker() : pending(NULL), busy(false), quit(false), failed(false), pool_failed(NULL), handler(NULL),
+                   on_watermark(NULL), arg(NULL), index(0)
+{
+   pthread_mutex_init(&lock, NULL);
+   pthread_cond_init(&work_cond, NULL);
+   pthread_cond_init(&space_cond, NULL);
+}
+/* ----------------------------------------------------------------- */
+Worker::~Worker()
+{
+   delete pending;
+   for (size_t i = 0; i < queue.size(); i++) {
+      delete queue[i];
+   }
+   for (size_t i = 0; i < free_batches.size(); i++) {
+      delete free_batches[i];
+   }
+   pthread_cond_destroy(&space_cond);
+   pthread_cond_destroy(&work_cond);
+   pthread_mutex_destroy(&lock);
+}
+/* ----------------------------------------------------------------- */
+/**
+ * Main function of worker thread, processes batches from the queue until quit is requested.
+ * When record handler fails, the worker stops processing and only returns the next batches for reuse.
+ * @param [in] input pointer to Worker instance.
+ * @return nothing valuable, always NULL.
+ */
+static void *worker_thread(void *input)
+{
+   Worker *w = (Worker *) input;
+
+   pthread_mutex_lock(&w->lock);
+   while (true) {
+      while (w->queue.empty() && !w->quit) {
+         pthread_cond_wait(&w->work_cond, &w->lock);
+      }
+      if (w->queue.empty()) {
+         break;
+      }
+      RecordBatch *batch = w->queue.front();
+      w->queue.pop_front();
+      w->busy = true;
+      pthread_cond_signal(&w->space_cond);
+      pthread_mutex_unlock(&w->lock);
+
+      for (size_t i = 0; i < batch->items.size() && !w->failed; i++) {
+         const batch_item &item = batch->items[i];
+         if (!w->handler(&batch->data[item.offset], &batch->data[item.key_offset], item.hash, w->arg)) {
+            w->failed = true;
+            __atomic_store_n(w->pool_failed, 1, __ATOMIC_RELEASE);
+         }
+      }
+      if (batch->watermark && !w->failed) {
+         w->on_watermark(batch->watermark, batch->flush, w->index, w->arg);
+      }
+      batch->clear();
+
+      pthread_mutex_lock(&w->lock);
+      w->free_batches.push_back(batch);
+      w->busy = false;
+      pthread_cond_signal(&w->space_cond);
+   }
+   pthread_mutex_unlock(&w->lock);
+
+   return NULL;
+}
+
+/* ================================================================= */
+/* ================ WorkerPool class definitions =================== */
+/* ================================================================= */
+
+WorkerPool::WorkerPool() : workers(NULL), count(0), shards(1), error(0)
+{
+}
+/* ----------------------------------------------------------------- */
+WorkerPool::~WorkerPool()
+{
+   finish();
+}
+/* ----------------------------------------------------------------- */
+bool WorkerPool::start(int threads, int shard_count, record_handler handler, watermark_handler on_watermark, void *arg)
+{
+   if (threads <= 0 || threads > MAX_WORKERS) {
+      fprintf(stderr, "Error: Count of worker threads has to be between 1 and %d.\n", MAX_WORKERS);
+      return false;
+   }
+
+   shards = shard_count;
+   error = 0;
+   workers = new Worker[threads];
+   for (int i = 0; i < threads; i++) {
+      workers[i].handler = handler;
+      workers[i].on_watermark = on_watermark;
+      workers[i].arg = arg;
+      workers[i].index = i;
+      workers[i].pool_failed = &error;
+      if (pthread_create(&workers[i].thread, NULL, &worker_thread, (void *) &workers[i]) != 0) {
+         fprintf(stderr, "Error: Worker thread could not be created.\n");
+         finish();
+         return false;
+      }
+      count++;
+   }
+   return true;
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::submit(Worker &w)
+{
+   pthread_mutex_lock(&w.lock);
+   while (w.queue.size() >= WORKER_QUEUE_SIZE) {
+      pthread_cond_wait(&w.space_cond, &w.lock);
+   }
+   w.queue.push_back(w.pending);
+   pthread_cond_signal(&w.work_cond);
+   pthread_mutex_unlock(&w.lock);
+   w.pending = NULL;
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::prepare(Worker &w)
+{
+   if (w.pending) {
+      return;
+   }
+   pthread_mutex_lock(&w.lock);
+   if (!w.free_batches.empty()) {
+      w.pending = w.free_batches.back();
+      w.free_batches.pop_back();
+   }
+   pthread_mutex_unlock(&w.lock);
+   if (!w.pending) {
+      w.pending = new RecordBatch;
+      w.pending->items.reserve(BATCH_RECORDS);
+   }
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::add(const void *rec, uint16_t size, const char *key, int key_size, uint32_t hash, int shard)
+{
+   Worker &w = workers[get_worker(shard)];
+
+   prepare(w);
+   w.pending->add(rec, size, key, key_size, hash);
+   if (w.pending->items.size() >= BATCH_RECORDS) {
+      submit(w);
+   }
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::advance(uint32_t watermark, bool flush)
+{
+   for (int i = 0; i < count; i++) {
+      prepare(workers[i]);
+      workers[i].pending->watermark = watermark;
+      workers[i].pending->flush = flush;
+      submit(workers[i]);
+   }
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::flush()
+{
+   for (int i = 0; i < count; i++) {
+      if (workers[i].pending && !workers[i].pending->items.empty()) {
+         submit(workers[i]);
+      }
+   }
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::drain()
+{
+   flush();
+   for (int i = 0; i < count; i++) {
+      pthread_mutex_lock(&workers[i].lock);
+      while (!workers[i].queue.empty() || workers[i].busy) {
+         pthread_cond_wait(&workers[i].space_cond, &workers[i].lock);
+      }
+      pthread_mutex_unlock(&workers[i].lock);
+   }
+}
+/* ----------------------------------------------------------------- */
+void WorkerPool::finish()
+{
+   if (!workers) {
+      return;
+   }
+
+   flush();
+   for (int i = 0; i < count; i++) {
+      pthread_mutex_lock(&workers[i].lock);
+      workers[i].quit = true;
+      pthread_cond_signal(&workers[i].work_cond);
+      pthread_mutex_unlock(&workers[i].lock);
+   }
+   for (int i = 0; i < count; i++) {
+      pthread_join(workers[i].thread, NULL);
+   }
+
+   delete [] workers;
+   workers = NULL;
+   count = 0;
+}
@@ -0,0 +1,231 @@
+/**
+ * \file workers.h
+ * \brief Worker threads processing batches of received records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AGGREGATOR_WORKERS_H
+#define AGGREGATOR_WORKERS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+/** Count of records copied into one batch before the batch is passed to the worker.*/
+#define BATCH_RECORDS 256
+/** Maximal count of batches waiting in queue of one worker, receiving thread blocks when reached.*/
+#define WORKER_QUEUE_SIZE 16
+/** Maximal supported count of worker threads.*/
+#define MAX_WORKERS 64
+
+/**
+ * Handler of record processing called by worker thread.
+ * @param [in] rec pointer to copy of received record.
+ * @param [in] key pointer to copy of the record aggregation key data.
+ * @param [in] hash precomputed hash of the record aggregation key.
+ * @param [in] arg user argument passed to WorkerPool::start().
+ * @return True if record was processed, false on error (the worker stops processing records then).
+ */
+typedef bool (*record_handler)(const void *rec, const char *key, uint32_t hash, void *arg);
+
+/**
+ * Handler of watermark called by worker thread after it processed all records added before the watermark.
+ * @param [in] watermark watermark passed to WorkerPool::advance().
+ * @param [in] flush flag passed to WorkerPool::advance().
+ * @param [in] worker index of the worker, it handles only its own shards (see WorkerPool::get_worker()).
+ * @param [in] arg user argument passed to WorkerPool::start().
+ */
+typedef void (*watermark_handler)(uint32_t watermark, bool flush, int worker, void *arg);
+
+/**
+ * Structure to represent one record stored in the batch.
+ */
+typedef struct {
+   uint32_t hash;       /*!< Hash of the record aggregation key. */
+   uint32_t offset;     /*!< Offset of record copy in batch data. */
+   uint32_t key_offset; /*!< Offset of copy of the aggregation key data, it follows the record copy. */
+} batch_item;
+
+/**
+ * Class to represent batch of copied records passed from receiving thread to worker
+ * (or of expired records waiting to be sent).
+ */
+class RecordBatch {
+public:
+   std::vector<char> data;           /*!< Copies of received records. */
+   std::vector<batch_item> items;    /*!< Records stored in data. */
+   uint32_t watermark;               /*!< Watermark passed to the worker after the records, 0 if there is none. */
+   bool flush;                       /*!< Flag passed to the worker together with the watermark. */
+
+   RecordBatch();
+   /**
+    * Append copy of record and of its aggregation key to the batch.
+    * @param [in] rec pointer to record.
+    * @param [in] size size of record in bytes.
+    * @param [in] key pointer to aggregation key data, NULL if the key is not copied.
+    * @param [in] key_size size of key data in bytes.
+    * @param [in] hash hash of the record aggregation key.
+    */
+   void add(const void *rec, uint16_t size, const char *key, int key_size, uint32_t hash);
+   /**
+    * Remove all records and the watermark from the batch, allocated memory is kept for reuse.
+    */
+   void clear();
+};
+
+/**
+ * Class to represent one worker thread with its queue of batches.
+ */
+class Worker {
+public:
+   pthread_t thread;                       /*!< Worker thread. */
+   pthread_mutex_t lock;                   /*!< Lock of the queue and state variables. */
+   pthread_cond_t work_cond;               /*!< Signaled when batch is added to the queue or on quit. */
+   pthread_cond_t space_cond;              /*!< Signaled when batch is taken from the queue or worker gets idle. */
+   std::deque<RecordBatch *> queue;        /*!< Batches waiting for processing. */
+   std::vector<RecordBatch *> free_batches;/*!< Processed batches available for reuse. */
+   RecordBatch *pending;                   /*!< Batch being filled by receiving thread (not locked). */
+   bool busy;                              /*!< Flag whether the worker is processing a batch. */
+   bool quit;                              /*!< Flag to end the thread when the queue is empty. */
+   bool failed;                            /*!< Flag whether record handler failed, next batches are dropped. */
+   int *pool_failed;                       /*!< Flag of the pool set when the handler failed (see WorkerPool::failed()). */
+   record_handler handler;                 /*!< Record processing function. */
+   watermark_handler on_watermark;         /*!< Watermark processing function. */
+   void *arg;                              /*!< Argument of record and watermark processing functions. */
+   int index;                              /*!< Index of the worker in the pool. */
+
+   Worker();
+   ~Worker();
+};
+
+/**
+ * Class to represent pool of worker threads. Records are distributed among workers by the receiving thread,
+ * records with the same key hash are always processed by the same worker in the order they were received.
+ */
+class WorkerPool {
+private:
+   Worker *workers;           /*!< Array of workers. */
+   int count;                 /*!< Count of running workers. */
+   int shards;                /*!< Count of storage shards split among workers. */
+   int error;                 /*!< Set by worker whose record handler failed, read atomically. */
+   /**
+    * Pass the pending batch of worker to its queue, block while the queue is full.
+    * @param [in] w worker to submit batch to.
+    */
+   void submit(Worker &w);
+   /**
+    * Prepare the pending batch of worker, a processed batch is reused when available.
+    * @param [in] w worker to prepare batch for.
+    */
+   void prepare(Worker &w);
+public:
+   WorkerPool();
+   ~WorkerPool();
+   /**
+    * Start worker threads.
+    * @param [in] threads count of workers to start.
+    * @param [in] shard_count count of storage shards, every worker gets a contiguous range of them.
+    * @param [in] handler function called by workers for every record.
+    * @param [in] on_watermark function called by every worker for the watermark passed by advance().
+    * @param [in] arg argument passed to handlers.
+    * @return True on success, false if threads could not be started.
+    */
+   bool start(int threads, int shard_count, record_handler handler, watermark_handler on_watermark, void *arg);
+   /**
+    * Get count of running workers.
+    * @return Count of workers, 0 when the pool is not started.
+    */
+   int size() const
+   {
+      return count;
+   }
+   /**
+    * Check whether record handler of some worker failed. Such worker drops all batches passed to it
+    * since then, so the receiving thread never blocks on its queue, and the module should stop.
+    * @return True if some worker failed.
+    */
+   bool failed() const
+   {
+      return __atomic_load_n(&error, __ATOMIC_ACQUIRE) != 0;
+   }
+   /**
+    * Get index of worker responsible for given shard. Shards are split into contiguous ranges
+    * whose sizes differ at most by one.
+    * @param [in] shard index of storage shard.
+    * @return Index of worker.
+    */
+   int get_worker(int shard) const
+   {
+      return shard * count / shards;
+   }
+   /**
+    * Add record to worker which is responsible for given shard. Record and its key are copied,
+    * so the worker does not build the key again.
+    * @param [in] rec pointer to record.
+    * @param [in] size size of record.
+    * @param [in] key pointer to data of record aggregation key.
+    * @param [in] key_size size of key data.
+    * @param [in] hash hash of record aggregation key.
+    * @param [in] shard index of storage shard of the record.
+    */
+   void add(const void *rec, uint16_t size, const char *key, int key_size, uint32_t hash, int shard);
+   /**
+    * Pass all partially filled batches to workers followed by the watermark. Every worker calls its
+    * watermark handler after it processed the records added before, no thread waits for the others.
+    * @param [in] watermark watermark to pass, has to be non-zero.
+    * @param [in] flush flag to pass together with the watermark.
+    */
+   void advance(uint32_t watermark, bool flush);
+   /**
+    * Pass all partially filled batches to workers.
+    */
+   void flush();
+   /**
+    * Pass all partially filled batches to workers and wait until all batches are processed.
+    */
+   void drain();
+   /**
+    * Process all remaining batches and stop all worker threads.
+    */
+   void finish();
+};
+
+#endif //AGGREGATOR_WORKERS_H
@@ -48,10 +48,7 @@
 #include <signal.h>
 #include <getopt.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <ctime>
-#include <queue>
-#include <unordered_map>
 #include "natpair.h"
 #include "fields.h"
 
@@ -73,17 +70,21 @@ UR_FIELDS (
 )
 
 trap_module_info_t *module_info = NULL;      ///< Module info for libtrap.
-queue<Flow> q;                               ///< Shared queue which contains partially filled Flow objects.
+SpscRing<Flow> ring[THREAD_CNT];             ///< Queues of partially filled Flow objects, one for each input interface.
 static int stop = 0;                         ///< Indicates whether the module should stop.
 pthread_t th[THREAD_CNT];                    ///< Array of PIDs of threads handling input interfaces.
-pthread_mutex_t q_mut;                       ///< Mutex used for locking the shared queue.
+pthread_mutex_t q_mut;                       ///< Mutex used by the main thread waiting for Flow objects in empty queues.
+pthread_cond_t q_cond;                       ///< Condition signalled when a Flow object is inserted while the main thread waits.
+atomic<bool> q_waiting(false);               ///< Indicates whether the main thread waits (or is about to wait) on q_cond.
+uint64_t q_waits = 0;                        ///< Number of times the main thread waited for Flow objects.
 pthread_mutex_t l_mut;                       ///< Mutex used for locking UniRec parts during initialization and finalization.
-sem_t q_empty;                               ///< Semaphore indicating whether the shared queue contains any objects which need processing.
+uint32_t g_ring_size = DEFAULT_RING_SIZE;    ///< Number of partial flows which can wait in the queue of one input interface.
 uint64_t g_check_time = DEFAULT_CHECK_TIME;  ///< Frequency of flow cache cleaning.
 uint64_t g_free_time = DEFAULT_FREE_TIME;    ///< Maximum time for which unpaired flows can remain in flow cache.
 uint32_t g_cache_size = DEFAULT_CACHE_SIZE;  ///< Number of elements in the flow cache which triggers cache cleaning.
 uint32_t g_router_ip;                        ///< IP address of the WAN interface of the router performing NAT process.
-uint8_t th_alive = THREAD_CNT;               ///< Number of alive threads.
+atomic<int> th_alive(THREAD_CNT);            ///< Number of alive threads.
+int verbose = 0;                             ///< Verbosity level of the module.
 
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1)
 
@@ -93,6 +94,7 @@ TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1)
 #define MODULE_PARAMS(PARAM) \
    PARAM('c', "checktime", "Frequency of flow cache cleaning. [sec] (default: 600s)", required_argument, "uint32") \
    PARAM('f', "freetime", "Maximum time for which unpaired flows can remain in flow cache. [sec] (default: 5s)", required_argument, "uint32") \
+   PARAM('q', "queue", "Number of partial flows which can wait for pairing for each input interface, flows are dropped when it is full. (default: 65536)", required_argument, "uint32") \
    PARAM('r', "router", "IPv4 address of WAN interface of the router which performs the NAT process.", required_argument, "string") \
    PARAM('s', "size", "Number of elements in the flow cache which triggers chache cleaning. (default: 2000)", required_argument, "uint32")
 
@@ -420,6 +422,375 @@ ostream& operator<<(ostream& str, const Flow &f)
    return str;
 }
 
+/**
+ * \brief Convert UniRec time to milliseconds.
+ *
+ * \param[in] t  UniRec time.
+ *
+ * \return Number of milliseconds since the epoch.
+ */
+static inline uint64_t time_ms(ur_time_t t)
+{
+   return (uint64_t) ur_time_get_sec(t) * 1000 + ur_time_get_msec(t);
+}
+
+/**
+ * \brief Basic constructor.
+ *
+ * \param[in] free_time  Maximum time for which unpaired flows can remain in flow cache. [ms]
+ */
+ExpiryWheel::ExpiryWheel(uint64_t free_time) : slots(WHEEL_SLOTS), cursor(0), started(false), entries(0)
+{
+   slot_time = free_time / (WHEEL_SLOTS / 4);
+   if (slot_time == 0) {
+      slot_time = 1;
+   }
+}
+
+/**
+ * \brief Insert key of a flow.
+ *
+ * \param[in] key   Key of the flow.
+ * \param[in] time  Time of the flow. [ms]
+ */
+void ExpiryWheel::insert(uint64_t key, uint64_t time)
+{
+   uint64_t slot = time / slot_time;
+   if (!started) {
+      cursor = slot;
+      started = true;
+   }
+
+   /* Flows older than the already expired slots are checked with the first slot which has not been expired yet. */
+   if (slot < cursor) {
+      slot = cursor;
+   }
+
+   entry_t e = { key, time };
+   slots[slot % WHEEL_SLOTS].push_back(e);
+   entries++;
+}
+
+/**
+ * \brief Remove keys of flows older than limit from all slots which lie completely before the limit.
+ *
+ * \param[in]     limit  Flows with time lower than limit are old. [ms]
+ * \param[in,out] keys   Vector where the keys of old flows are appended.
+ *
+ * \return True if some slots were checked, false if the limit did not reach a new slot.
+ */
+bool ExpiryWheel::expire(uint64_t limit, vector<uint64_t> &keys)
+{
+   uint64_t target = limit / slot_time;
+   if (!started || target <= cursor) {
+      return false;
+   }
+
+   /* Every slot is visited at most once, even if the time jumped by more than the whole wheel. */
+   uint64_t cnt = (target - cursor < WHEEL_SLOTS) ? target - cursor : WHEEL_SLOTS;
+   for (uint64_t i = 0; i < cnt; i++) {
+      vector<entry_t> &slot = slots[(cursor + i) % WHEEL_SLOTS];
+      size_t kept = 0;
+
+      /* Keys of flows from later turns of the wheel stay in the slot. */
+      for (size_t j = 0; j < slot.size(); j++) {
+         if (slot[j].time < limit) {
+            keys.push_back(slot[j].key);
+         } else {
+            slot[kept++] = slot[j];
+         }
+      }
+
+      entries -= slot.size() - kept;
+      slot.resize(kept);
+   }
+
+   cursor = target;
+   return true;
+}
+
+/**
+ * \brief Remove keys of flows which are no longer stored in the cache.
+ *
+ * \param[in] cache  Flow cache which owns the wheel.
+ */
+void ExpiryWheel::retain(const FlowCache &cache)
+{
+   for (size_t i = 0; i < WHEEL_SLOTS; i++) {
+      vector<entry_t> &slot = slots[i];
+      size_t kept = 0;
+
+      for (size_t j = 0; j < slot.size(); j++) {
+         if (cache.contains(slot[j].key, slot[j].time)) {
+            slot[kept++] = slot[j];
+         }
+      }
+
+      entries -= slot.size() - kept;
+      slot.resize(kept);
+   }
+}
+
+/**
+ * \brief Basic constructor.
+ *
+ * \param[in] free_time  Maximum time for which unpaired flows can remain in flow cache. [ms]
+ */
+FlowCache::FlowCache(uint64_t free_time) : mask(CACHE_INIT_SLOTS - 1), shift(64), wheel(free_time), free_time(free_time),
+                                           flows(0), peak(0), stored(0), paired(0), evicted(0), expired(0),
+                                           retain_limit(CACHE_INIT_SLOTS)
+{
+   Flow empty;
+   empty.direction = NONE;
+   slots.assign(CACHE_INIT_SLOTS, empty);
+   for (size_t i = CACHE_INIT_SLOTS; i > 1; i >>= 1) {
+      shift--;
+   }
+}
+
+/**
+ * \brief Remove flow from the slot and move following flows of the run into the gap.
+ *
+ * \param[in] pos  Index of the slot.
+ */
+void FlowCache::erase(size_t pos)
+{
+   size_t next = pos;
+
+   while (true) {
+      next = (next + 1) & mask;
+      if (!used(next)) {
+         break;
+      }
+
+      /* The flow can fill the gap, if the gap is not before its home slot. */
+      size_t h = home(slots[next].hashKey());
+      if (((next - h) & mask) >= ((next - pos) & mask)) {
+         slots[pos] = slots[next];
+         pos = next;
+      }
+   }
+
+   slots[pos].direction = NONE;
+   flows--;
+}
+
+/**
+ * \brief Double the number of slots of the table.
+ */
+void FlowCache::grow()
+{
+   vector<Flow> old;
+   Flow empty;
+   empty.direction = NONE;
+
+   old.swap(slots);
+   slots.assign(old.size() * 2, empty);
+   mask = slots.size() - 1;
+   shift--;
+
+   /* Start after a free slot, so the flows of every run are inserted in their original order. */
+   size_t start = 0;
+   while (old[start].direction != NONE) {
+      start++;
+   }
+
+   for (size_t i = 1; i <= old.size(); i++) {
+      const Flow &f = old[(start + i) & (old.size() - 1)];
+      if (f.direction == NONE) {
+         continue;
+      }
+
+      size_t pos = home(f.hashKey());
+      while (used(pos)) {
+         pos = (pos + 1) & mask;
+      }
+
+      slots[pos] = f;
+   }
+}
+
+/**
+ * \brief Pair the flow with a stored flow, or store it if there is none.
+ *
+ * \param[in,out] f  Partial flow, it is completed with the data of the stored flow when they are paired.
+ *
+ * \return True if the flow was paired and removed from the cache, false if it was stored.
+ */
+bool FlowCache::pair(Flow &f)
+{
+   /* Generate key of the partial Flow object which can be used to find similar partial Flow objects. */
+   uint64_t key = f.hashKey();
+   size_t pos = home(key);
+
+   /* Attempt to pair this partial Flow object to a similar one stored before, the first free slot ends the search. */
+   while (used(pos)) {
+      if (slots[pos].hashKey() == key && slots[pos] == f) {
+         /* Complete one of the partial Flow objects with the information from the second. */
+         f.complete(slots[pos]);
+         erase(pos);
+         paired++;
+         return true;
+      }
+
+      pos = (pos + 1) & mask;
+   }
+
+   /* Keep at least a quarter of the slots free, so the runs stay short. */
+   if ((flows + 1) * 4 > slots.size() * 3) {
+      grow();
+      pos = home(key);
+      while (used(pos)) {
+         pos = (pos + 1) & mask;
+      }
+   }
+
+   slots[pos] = f;
+   wheel.insert(key, time_ms(f.getTime()));
+   stored++;
+   if (++flows > peak) {
+      peak = flows;
+   }
+
+   /* Keys of paired flows stay in the wheel until they expire, drop them before they outnumber the stored flows.
+    * The next retain waits until the wheel doubles, so the whole wheel is visited at most once per that many stores. */
+   if (wheel.size() > retain_limit && wheel.size() > 2 * flows + CACHE_INIT_SLOTS) {
+      wheel.retain(*this);
+      retain_limit = 2 * wheel.size() + CACHE_INIT_SLOTS;
+   }
+
+   return false;
+}
+
+/**
+ * \brief Check whether a flow with the key and time is stored in the cache.
+ *
+ * \param[in] key   Key of a flow.
+ * \param[in] time  Time of the flow. [ms]
+ *
+ * \return True if at least one flow with the key and time is stored.
+ */
+bool FlowCache::contains(uint64_t key, uint64_t time) const
+{
+   for (size_t pos = home(key); used(pos); pos = (pos + 1) & mask) {
+      if (slots[pos].hashKey() == key && time_ms(slots[pos].getTime()) == time) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+/**
+ * \brief Evict flows which are in the cache for too long.
+ *
+ * Only flows older than the free time are visited, so the cost does not depend on the size of the cache.
+ *
+ * \param[in] now  Current time.
+ */
+void FlowCache::expire(ur_time_t now)
+{
+   uint64_t now_ms = time_ms(now);
+   if (now_ms < free_time) {
+      return;
+   }
+
+   /* Flows are evicted when they are at least free time older than now. */
+   uint64_t limit = now_ms - free_time + 1;
+   old_keys.clear();
+   if (!wheel.expire(limit, old_keys)) {
+      return;
+   }
+   expired++;
+
+   for (size_t i = 0; i < old_keys.size(); i++) {
+      uint64_t key = old_keys[i];
+      size_t pos = home(key);
+
+      /* Erasing moves the next flow of the run to the current slot, so the position advances only when nothing was erased. */
+      while (used(pos)) {
+         if (slots[pos].hashKey() == key && time_ms(slots[pos].getTime()) < limit) {
+            erase(pos);
+            evicted++;
+         } else {
+            pos = (pos + 1) & mask;
+         }
+      }
+   }
+}
+
+/**
+ * \brief Wake up the main thread if it waits for Flow objects.
+ *
+ * Must be called after a Flow object is inserted into a queue or after an input thread ends.
+ */
+void wake_main()
+{
+   /* Pairs with the fence in fetch_batch(), either the main thread sees the new state, or this thread sees it waiting. */
+   atomic_thread_fence(memory_order_seq_cst);
+   if (q_waiting.load(memory_order_relaxed)) {
+      pthread_mutex_lock(&q_mut);
+      pthread_cond_signal(&q_cond);
+      pthread_mutex_unlock(&q_mut);
+   }
+}
+
+/**
+ * \brief Decrease the number of alive input threads. The last one causes the main thread to end when the queues are empty.
+ */
+void input_finished()
+{
+   th_alive.fetch_sub(1);
+   wake_main();
+}
+
+/**
+ * \brief Take a batch of partially filled Flow objects from the queues of input interfaces.
+ *
+ * Queues are read in turns. The calling thread blocks only when all queues are empty.
+ *
+ * \param[out] batch  Array of RING_BATCH Flow objects to be filled.
+ *
+ * \return Number of Flow objects taken, 0 if all input threads ended and their queues are empty.
+ */
+size_t fetch_batch(Flow *batch)
+{
+   static int next = 0;
+
+   while (true) {
+      for (int i = 0; i < THREAD_CNT; i++) {
+         size_t cnt = ring[next].pop(batch, RING_BATCH);
+         next = (next + 1) % THREAD_CNT;
+         if (cnt > 0) {
+            return cnt;
+         }
+      }
+
+      pthread_mutex_lock(&q_mut);
+      q_waiting.store(true, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+
+      bool idle = true;
+      for (int i = 0; i < THREAD_CNT; i++) {
+         idle = idle && ring[i].empty();
+      }
+
+      if (idle && th_alive.load() == 0) {
+         q_waiting.store(false, memory_order_relaxed);
+         pthread_mutex_unlock(&q_mut);
+         return 0;
+      }
+
+      if (idle) {
+         q_waits++;
+         pthread_cond_wait(&q_cond, &q_mut);
+      }
+
+      q_waiting.store(false, memory_order_relaxed);
+      pthread_mutex_unlock(&q_mut);
+   }
+}
+
 /**
  * \brief Main function for processing network flows from input interfaces.
  *
@@ -444,8 +815,9 @@ void* process_incoming_data(void *arg)
    ur_template_t *tmplt = ur_create_input_template((int)scope, UNIREC_INPUT_TEMPLATE, NULL);
    if (!tmplt){
       fprintf(stderr, "Error: Input template %d could not be created.\n", scope);
-      sem_post(&q_empty);
       pthread_mutex_unlock(&l_mut);
+      stop = 1;
+      input_finished();
       return NULL;
    }
 
@@ -465,6 +837,7 @@ void* process_incoming_data(void *arg)
          uint8_t data_fmt;
          if (trap_ctx_get_data_fmt(trap_get_global_ctx(), TRAPIFC_INPUT, (int) scope, &data_fmt, &spec) != TRAP_E_OK) {
             fprintf(stderr, "Data format was not loaded.\n");
+            input_finished();
             return NULL;
          } else {
             pthread_mutex_lock(&l_mut);
@@ -472,6 +845,7 @@ void* process_incoming_data(void *arg)
             if (tmplt == NULL) {
                fprintf(stderr, "Template could not be edited.\n");
                pthread_mutex_unlock(&l_mut);
+               input_finished();
                return NULL;
             } else {
                if (tmplt->direction == UR_TMPLT_DIRECTION_BI) {
@@ -480,6 +854,7 @@ void* process_incoming_data(void *arg)
                      fprintf(stderr, "Memory allocation problem.\n");
                      ur_free_template(tmplt);
                      pthread_mutex_unlock(&l_mut);
+                     input_finished();
                      return NULL;
                   } else {
                      trap_ctx_set_data_fmt(trap_get_global_ctx(), tmplt->ifc_out, TRAP_FMT_UNIREC, spec_cpy);
@@ -506,23 +881,16 @@ void* process_incoming_data(void *arg)
       /* Attempt to create a partial Flow object from the received network flow. */
       Flow f;
       if (f.prepare(tmplt, data, scope)) {
-         /* Insert the partial Flow object to  the shared queue. */
-         pthread_mutex_lock(&q_mut);
-         q.push(f);
-         pthread_mutex_unlock(&q_mut);
-         /* Signal the main thread that it has work that needs to be done. */
-         sem_post(&q_empty);
+         /* Insert the partial Flow object to the queue of this interface, it is dropped when the main thread can not keep up. */
+         if (ring[scope].push(f)) {
+            /* Signal the main thread that it has work that needs to be done. */
+            wake_main();
+         }
       }
    }
 
-   /* Decrease the number of ongoing threads. The last thread increases the semaphore, resulting in shutting down the main thread. */
-   pthread_mutex_lock(&q_mut);
-   if (--th_alive == 0) {
-      pthread_mutex_unlock(&q_mut);
-      sem_post(&q_empty);
-   } else {
-      pthread_mutex_unlock(&q_mut);
-   }
+   /* Decrease the number of ongoing threads. The last thread wakes up the main thread, resulting in its shutdown. */
+   input_finished();
 
    /* Lock deletion of UniRec template. */
    pthread_mutex_lock(&l_mut);
@@ -540,6 +908,7 @@ int main(int argc, char **argv)
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
    TRAP_DEFAULT_INITIALIZATION(argc, argv, *module_info);
    TRAP_REGISTER_DEFAULT_SIGNAL_HANDLER();
+   verbose = trap_get_verbose_level();
 
    while ((opt = TRAP_GETOPT(argc, argv, module_getopt_string, long_options)) != -1) {
       switch (opt) {
@@ -572,6 +941,15 @@ int main(int argc, char **argv)
          }
 
          g_router_ip = ip_get_v4_as_int(&tmp);
+         break;
+      case 'q':
+         if (sscanf(optarg, "%" SCNu32 "", &g_ring_size) != 1 || g_ring_size == 0 || g_ring_size > (1U << 30)) {
+            fprintf(stderr, "Error: Invalid value of argument -q.\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            TRAP_DEFAULT_FINALIZATION();
+            return -1;
+         }
+
          break;
       case 's':
          if (sscanf(optarg, "%" SCNu32 "", &g_cache_size) != 1 || g_cache_size == 0) {
@@ -601,12 +979,18 @@ int main(int argc, char **argv)
    pthread_attr_init(&attr);
    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
    pthread_mutex_init(&q_mut, NULL);
+   pthread_cond_init(&q_cond, NULL);
    pthread_mutex_init(&l_mut, NULL);
-   sem_init(&q_empty, 0, 0);
    ur_template_t *tmplt = NULL;
    void *out_rec = NULL;
-   unordered_map<uint64_t, vector<Flow> > flowcache;
+   FlowCache flowcache(g_free_time);
    ur_time_t t_now = 0, t_last = 0;
+   Flow batch[RING_BATCH];
+   size_t batch_cnt = 0, batch_pos = 0;
+
+   for (int i = 0; i < THREAD_CNT; i++) {
+      ring[i].init(g_ring_size);
+   }
 
    /* Create separate threads for receiving network flows from input interfaces. */
    for (uint64_t i = 0; i < THREAD_CNT; i++) {
@@ -639,89 +1023,34 @@ int main(int argc, char **argv)
 
    /* Main cycle responsible for pairing partial Flow objects, sending them to the output interface, or printing them. */
    while (true) {
-      Flow f;
-
-      /* Wait until the is a Flow object in the shared queue. */
-      sem_wait(&q_empty);
-      pthread_mutex_lock(&q_mut);
-      if (!q.empty()) {
-         /* Take the Flow object. */
-         f = q.front();
-         q.pop();
-      } else {
-         pthread_mutex_unlock(&q_mut);
-         break;
-      }
-
-      pthread_mutex_unlock(&q_mut);
-
-      /* Generate key of the partial Flow object which can be used to find similar partial Flow objects. */
-      uint64_t key = f.hashKey();
-      auto it = flowcache.find(key);
-
-      /* No similar Flow object found yet in the flowcache -> create vector for Flow objects with the same key and insert this object. */
-      if (it == flowcache.end()) {
-         flowcache.insert(make_pair<uint64_t&, vector<Flow> >(key, vector<Flow>(1,f)));
-         continue;
+      /* Take next batch of Flow objects from the queues when the current one is processed, wait if there is none. */
+      if (batch_pos == batch_cnt) {
+         batch_cnt = fetch_batch(batch);
+         batch_pos = 0;
+         if (batch_cnt == 0) {
+            break;
+         }
       }
 
-      /*
-         Some similar (with same key) partial Flow objects were found.
-         Iterate through them and attempt to pair this partial Flow object to another previously inserted Flow object.
-      */
-      bool matched = false;
-      for (auto v = it->second.begin(); v != it->second.end(); ++v) {
-         if ((*v) == f) {
-            matched = true;
-            t_now = f.getTime();
-
-            /* Complete one of the partial Flow objects with the information from the second. */
-            f.complete(*v);
-
-            /* Erase the stored object from the vector, or erase the whole vector, if it has only 1 object. */
-            if (it->second.size() == 1) {
-               flowcache.erase(it);
-            } else {
-               it->second.erase(v);
-            }
+      Flow &f = batch[batch_pos++];
 
-            /* Send the complete Flow object to the output interface. */
-            ret = f.sendToOutput(tmplt, out_rec);
-            if (ret != TRAP_E_OK) {
-               fprintf(stderr, "ERROR: Unable to send data to output interface: %s.\n", trap_last_error_msg);
-            }
+      /* Attempt to pair the partial Flow object with a stored one, it is stored if there is none. */
+      if (flowcache.pair(f)) {
+         t_now = f.getTime();
 
-            TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, break, break);
-            //cout << f << endl;
-            break;
+         /* Send the complete Flow object to the output interface. */
+         ret = f.sendToOutput(tmplt, out_rec);
+         if (ret != TRAP_E_OK) {
+            fprintf(stderr, "ERROR: Unable to send data to output interface: %s.\n", trap_last_error_msg);
          }
-      }
 
-      /* Insert the Flow object at the end of the vector in case it was not matched to any other Flow object with same key. */
-      if (!matched) {
-         it->second.push_back(f);
+         //cout << f << endl;
       }
 
-      /* Attempt to clear the flowcache of old partial Flow objects which were never paired for some reason. */
+      /* Evict old partial Flow objects which were never paired for some reason, only the old ones are visited. */
       if (flowcache.size() > g_cache_size || (t_now >= t_last && ur_timediff(t_now, t_last) >= g_check_time)) {
-         unordered_map<uint64_t, vector<Flow> > newcache;
-         for (auto it = flowcache.begin(); it != flowcache.end(); ++it) {
-            vector<Flow> newvec;
-            uint64_t key = it->first;
-            for (auto v = it->second.begin(); v != it->second.end(); ++v) {
-               ur_time_t t_flow = v->getTime();
-               if (t_flow >= t_now || (t_flow < t_now && ur_timediff(t_flow, t_now) < g_free_time)) {
-                  newvec.push_back((*v));
-               }
-            }
-
-            if (newvec.size() > 0) {
-               newcache.insert(make_pair<uint64_t&, vector<Flow> >(key, vector<Flow>(newvec)));
-            }
-         }
-
+         flowcache.expire(t_now);
          t_last = t_now;
-         flowcache = newcache;
       }
    }
 
@@ -730,9 +1059,20 @@ cleanup:
       pthread_join(th[i], NULL);      
    }
 
+   for (int i = 0; i < THREAD_CNT; i++) {
+      VERBOSE("Queue of %s: %" PRIu64 " flows, %" PRIu64 " dropped, max. occupancy %zu of %zu, %" PRIu64 " batches.\n",
+              (i == LAN) ? "LAN" : "WAN", ring[i].getPushed(), ring[i].getDropped(), ring[i].getMaxUsed(),
+              ring[i].capacity(), ring[i].getBatches());
+   }
+
+   VERBOSE("Main thread waited for flows %" PRIu64 " times.\n", q_waits);
+   VERBOSE("Flow cache: %zu flows left, %zu at most in %zu slots, %" PRIu64 " stored, %" PRIu64 " paired, %" PRIu64 " evicted in %" PRIu64 " checks.\n",
+           flowcache.size(), flowcache.getPeak(), flowcache.getCapacity(), flowcache.getStored(), flowcache.getPaired(),
+           flowcache.getEvicted(), flowcache.getExpired());
+
    pthread_mutex_destroy(&q_mut);
+   pthread_cond_destroy(&q_cond);
    pthread_mutex_destroy(&l_mut);
-   sem_destroy(&q_empty);
    TRAP_DEFAULT_FINALIZATION();
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
 
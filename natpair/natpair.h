@@ -52,6 +52,8 @@
 #include <unirec/unirec.h>
 #include <iostream>
 #include <cstdlib>
+#include <atomic>
+#include <vector>
 
 using namespace std;
 
@@ -74,6 +76,11 @@ using namespace std;
 #define DEFAULT_CHECK_TIME 600000   ///< Frequency with which the flowcache is cleared of old data (10 minutes).
 #define DEFAULT_FREE_TIME  5000     ///< Maximum time for which unpaired flows can remain in flow cache (5 minutes).
 #define DEFAULT_CACHE_SIZE 2000     ///< Number of elements in the flow cache which triggers cache cleaning.
+#define DEFAULT_RING_SIZE  65536    ///< Number of partial flows which can wait in the queue of one input interface.
+#define RING_BATCH         64       ///< Maximum number of partial flows taken from a queue at once.
+#define CACHE_LINE         64       ///< Size of the CPU cache line, used to separate data of different threads.
+#define WHEEL_SLOTS        256      ///< Number of slots of the wheel used for expiration of flows, power of 2.
+#define CACHE_INIT_SLOTS   1024     ///< Initial number of slots of the flow cache, power of 2.
 
 /**
  * \brief Holds possible directions of network flows.
@@ -92,6 +99,123 @@ enum net_scope_t {
    WAN         ///< WAN input interface.
 };
 
+/**
+ * \brief Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * Positions of the producer (tail) and the consumer (head) are kept on separate cache lines, the producer
+ * remembers the last seen head, so it reads the cache line of the consumer only when the queue seems full.
+ * The queue does not block, waiting for data must be handled by the caller.
+ */
+template <typename T>
+class SpscRing {
+public:
+   /**
+    * \brief Basic constructor, the queue can not hold any items until init() is called.
+    */
+   SpscRing() : mask(0), tail(0), head_cache(0), dropped(0), head(0), max_used(0), batches(0) {}
+
+   /**
+    * \brief Allocate space for items.
+    *
+    * \param[in] size  Minimal number of items the queue can hold, rounded up to a power of 2.
+    */
+   void init(size_t size)
+   {
+      size_t cap = 1;
+      while (cap < size) {
+         cap <<= 1;
+      }
+
+      buf.resize(cap);
+      mask = cap - 1;
+   }
+
+   /**
+    * \brief Insert an item at the end of the queue, called only by the producer.
+    *
+    * \param[in] item  Item to be copied into the queue.
+    *
+    * \return True on success, false if the queue is full and the item was dropped.
+    */
+   bool push(const T &item)
+   {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (t - head_cache >= buf.size()) {
+         head_cache = head.load(std::memory_order_acquire);
+         if (t - head_cache >= buf.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+         }
+      }
+
+      buf[t & mask] = item;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+   }
+
+   /**
+    * \brief Take up to max items from the beginning of the queue, called only by the consumer.
+    *
+    * \param[out] out  Array where the items are copied.
+    * \param[in]  max  Size of the array.
+    *
+    * \return Number of items taken, 0 if the queue is empty.
+    */
+   size_t pop(T *out, size_t max)
+   {
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t cnt = tail.load(std::memory_order_acquire) - h;
+      if (cnt == 0) {
+         return 0;
+      }
+
+      if (cnt > max_used) {
+         max_used = cnt;
+      }
+
+      if (cnt > max) {
+         cnt = max;
+      }
+
+      for (size_t i = 0; i < cnt; i++) {
+         out[i] = buf[(h + i) & mask];
+      }
+
+      head.store(h + cnt, std::memory_order_release);
+      batches++;
+      return cnt;
+   }
+
+   /**
+    * \brief Check whether the queue is empty, called only by the consumer.
+    *
+    * \return True if there is no item in the queue.
+    */
+   bool empty() const
+   {
+      return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+   }
+
+   size_t capacity() const { return buf.size(); }                                         ///< Number of items the queue can hold.
+   uint64_t getPushed() const { return tail.load(std::memory_order_relaxed); }             ///< Number of items inserted so far.
+   uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }         ///< Number of items dropped because the queue was full.
+   size_t getMaxUsed() const { return max_used; }                                          ///< Highest number of items found in the queue by the consumer.
+   uint64_t getBatches() const { return batches; }                                         ///< Number of successful pop() calls.
+
+private:
+   std::vector<T> buf;                ///< Storage of items.
+   size_t mask;                       ///< Size of the storage minus 1, used to convert positions to indexes.
+   char pad0[CACHE_LINE];
+   std::atomic<size_t> tail;          ///< Position where the next item is inserted, written by the producer.
+   size_t head_cache;                 ///< Value of head last seen by the producer.
+   std::atomic<uint64_t> dropped;     ///< Number of dropped items, written by the producer.
+   char pad1[CACHE_LINE];
+   std::atomic<size_t> head;          ///< Position of the first item in the queue, written by the consumer.
+   size_t max_used;                   ///< Highest observed number of items in the queue.
+   uint64_t batches;                  ///< Number of successful pop() calls.
+   char pad2[CACHE_LINE];
+};
+
 /**
  * \brief Class containing all necessary information about the network flow which undergone the NAT process.
  */
@@ -191,6 +315,8 @@ public:
     * \return The input stream containing textual representation of the Flow object at the end.
     */
    friend ostream& operator<<(ostream& str, const Flow &f);
+
+   friend class FlowCache;
 private:
    /**
     * \brief Set direction of the flow based on source and destination IP address of the flow.
@@ -223,3 +349,178 @@ private:
    uint8_t direction;         ///< Direction of the network flow (LAN->WAN, WAN->LAN).
    net_scope_t scope;         ///< Scope specifies on which interface was the network flow first seen.
 };
+
+class FlowCache;
+
+/**
+ * \brief Time ordered index of flows stored in the flow cache, used to find old flows without going through the whole cache.
+ *
+ * Keys of flows are stored in slots of a timing wheel by the time of the flow. Slots span a quarter of
+ * the wheel per free time, so flows are found at most one slot after they become old enough. Keys are not
+ * removed when flows are paired, an expired key only means that the cache should check flows with this key.
+ * Keys of paired flows are dropped by expiration or when they outnumber the stored flows (see retain()).
+ */
+class ExpiryWheel {
+public:
+   /**
+    * \brief Basic constructor.
+    *
+    * \param[in] free_time  Maximum time for which unpaired flows can remain in flow cache. [ms]
+    */
+   ExpiryWheel(uint64_t free_time);
+
+   /**
+    * \brief Insert key of a flow.
+    *
+    * \param[in] key   Key of the flow.
+    * \param[in] time  Time of the flow. [ms]
+    */
+   void insert(uint64_t key, uint64_t time);
+
+   /**
+    * \brief Remove keys of flows older than limit from all slots which lie completely before the limit.
+    *
+    * \param[in]     limit  Flows with time lower than limit are old. [ms]
+    * \param[in,out] keys   Vector where the keys of old flows are appended.
+    *
+    * \return True if some slots were checked, false if the limit did not reach a new slot.
+    */
+   bool expire(uint64_t limit, vector<uint64_t> &keys);
+
+   /**
+    * \brief Remove keys of flows which are no longer stored in the cache.
+    *
+    * Key is kept only if a flow with the same key and time is stored, so keys of paired flows are dropped
+    * also when other flows with the same key wait in the cache.
+    *
+    * \param[in] cache  Flow cache which owns the wheel.
+    */
+   void retain(const FlowCache &cache);
+
+   /**
+    * \brief Get number of keys in the wheel.
+    *
+    * \return Number of keys in the wheel.
+    */
+   size_t size() const { return entries; }
+
+private:
+   /**
+    * \brief Key of a flow together with its time.
+    */
+   struct entry_t {
+      uint64_t key;     ///< Key of the flow.
+      uint64_t time;    ///< Time of the flow. [ms]
+   };
+
+   vector<vector<entry_t> > slots;  ///< Slots of the wheel.
+   uint64_t slot_time;              ///< Time span of one slot. [ms]
+   uint64_t cursor;                 ///< Number of the first slot which has not been expired yet.
+   bool started;                    ///< Indicates whether the cursor was set by the first inserted flow.
+   size_t entries;                  ///< Number of keys in the wheel.
+};
+
+/**
+ * \brief Cache of partial flows which wait for pairing.
+ *
+ * Flows are stored directly in an open addressing table with linear probing, one flow per slot, free slots
+ * have direction NONE (such flows are never stored). Flows with the same key are found in the run of occupied
+ * slots which follows the home slot of the key, in the order they were stored. Removed flows are replaced
+ * by following flows of the run, so there are no deleted slots.
+ */
+class FlowCache {
+public:
+   /**
+    * \brief Basic constructor.
+    *
+    * \param[in] free_time  Maximum time for which unpaired flows can remain in flow cache. [ms]
+    */
+   FlowCache(uint64_t free_time);
+
+   /**
+    * \brief Pair the flow with a stored flow, or store it if there is none.
+    *
+    * \param[in,out] f  Partial flow, it is completed with the data of the stored flow when they are paired.
+    *
+    * \return True if the flow was paired and removed from the cache, false if it was stored.
+    */
+   bool pair(Flow &f);
+
+   /**
+    * \brief Evict flows which are in the cache for too long.
+    *
+    * Only flows older than the free time are visited, so the cost does not depend on the size of the cache.
+    *
+    * \param[in] now  Current time.
+    */
+   void expire(ur_time_t now);
+
+   /**
+    * \brief Get number of flows in the cache.
+    *
+    * \return Number of flows in the cache.
+    */
+   size_t size() const { return flows; }
+
+   /**
+    * \brief Check whether a flow with the key and time is stored in the cache.
+    *
+    * \param[in] key   Key of a flow.
+    * \param[in] time  Time of the flow. [ms]
+    *
+    * \return True if at least one flow with the key and time is stored.
+    */
+   bool contains(uint64_t key, uint64_t time) const;
+
+   size_t getPeak() const { return peak; }            ///< Highest number of flows in the cache.
+   uint64_t getStored() const { return stored; }      ///< Number of flows stored into the cache.
+   uint64_t getPaired() const { return paired; }      ///< Number of stored flows which were paired.
+   uint64_t getEvicted() const { return evicted; }    ///< Number of stored flows which were evicted.
+   uint64_t getExpired() const { return expired; }    ///< Number of expiration checks which reached new slots of the wheel.
+   size_t getCapacity() const { return slots.size(); } ///< Number of slots of the table.
+
+private:
+   /**
+    * \brief Get the home slot of a key.
+    *
+    * \param[in] key  Key of a flow.
+    *
+    * \return Index of the first slot where flows with the key can be stored.
+    */
+   size_t home(uint64_t key) const { return (key * 0x9e3779b97f4a7c15ULL) >> shift; }
+
+   /**
+    * \brief Check whether the slot contains a flow.
+    *
+    * \param[in] pos  Index of the slot.
+    *
+    * \return True if the slot contains a flow, false if it is free.
+    */
+   bool used(size_t pos) const { return slots[pos].direction != NONE; }
+
+   /**
+    * \brief Remove flow from the slot and move following flows of the run into the gap.
+    *
+    * \param[in] pos  Index of the slot.
+    */
+   void erase(size_t pos);
+
+   /**
+    * \brief Double the number of slots of the table.
+    */
+   void grow();
+
+   vector<Flow> slots;                             ///< Slots of the table.
+   size_t mask;                                    ///< Number of slots minus 1.
+   unsigned shift;                                 ///< Shift of the multiplied key giving the home slot.
+   ExpiryWheel wheel;                              ///< Keys of flows ordered by time.
+   vector<uint64_t> old_keys;                      ///< Keys of old flows found in the wheel.
+   uint64_t free_time;                             ///< Maximum time for which unpaired flows can remain in the cache. [ms]
+   size_t flows;                                   ///< Number of flows in the cache.
+   size_t peak;                                    ///< Highest number of flows in the cache.
+   uint64_t stored;                                ///< Number of flows stored into the cache.
+   uint64_t paired;                                ///< Number of stored flows which were paired.
+   uint64_t evicted;                               ///< Number of stored flows which were evicted.
+   uint64_t expired;                               ///< Number of expiration checks which reached new slots of the wheel.
+   size_t retain_limit;                            ///< Number of keys in the wheel which starts the next retain().
+};
@@ -0,0 +1,134 @@
+/**
+ * \file ring.c
+ * \brief Single-producer single-consumer ring of pointers.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "ring.h"
+
+int ring_init(ring_t *ring, uint32_t size)
+{
+   uint32_t slots = 1;
+
+   while (slots < size) {
+      slots *= 2;
+   }
+   ring->slots = calloc(slots, sizeof(void *));
+   if (ring->slots == NULL) {
+      return -1;
+   }
+   ring->mask = slots - 1;
+   ring->head = 0;
+   ring->tail = 0;
+   ring->waiting = 0;
+   ring->closed = 0;
+   pthread_mutex_init(&ring->lock, NULL);
+   pthread_cond_init(&ring->cond, NULL);
+   return 0;
+}
+
+void ring_destroy(ring_t *ring)
+{
+   pthread_mutex_destroy(&ring->lock);
+   pthread_cond_destroy(&ring->cond);
+   free(ring->slots);
+   ring->slots = NULL;
+}
+
+int ring_push(ring_t *ring, void *item)
+{
+   uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+   if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask) {
+      return -1;
+   }
+   ring->slots[tail & ring->mask] = item;
+   __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+   /* Pairs with the fence in ring_pop_wait, either the consumer sees the item or we see it waiting */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED)) {
+      pthread_mutex_lock(&ring->lock);
+      pthread_cond_signal(&ring->cond);
+      pthread_mutex_unlock(&ring->lock);
+   }
+   return 0;
+}
+
+void *ring_pop(ring_t *ring)
+{
+   uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+   void *item;
+
+   if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+      return NULL;
+   }
+   item = ring->slots[head & ring->mask];
+   __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+   return item;
+}
+
+void *ring_pop_wait(ring_t *ring)
+{
+   void *item = ring_pop(ring);
+
+   if (item != NULL) {
+      return item;
+   }
+
+   pthread_mutex_lock(&ring->lock);
+   __atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   while ((item = ring_pop(ring)) == NULL && !ring->closed) {
+      pthread_cond_wait(&ring->cond, &ring->lock);
+   }
+   __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+   pthread_mutex_unlock(&ring->lock);
+   return item;
+}
+
+void ring_close(ring_t *ring)
+{
+   pthread_mutex_lock(&ring->lock);
+   ring->closed = 1;
+   pthread_cond_broadcast(&ring->cond);
+   pthread_mutex_unlock(&ring->lock);
+}
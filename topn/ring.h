@@ -0,0 +1,116 @@
+/**
+ * \file ring.h
+ * \brief Single-producer single-consumer ring of pointers.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef _RING_
+#define _RING_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+* \brief Bounded ring of pointers passed from one producer thread to one consumer thread.
+*
+* Push and pop do not take any lock, producer and consumer synchronize only by head and tail indexes. Consumer of an empty ring can wait, it sleeps on a condition variable which is signalled by the producer only when the consumer is waiting, so the lock is taken only when one of the threads is idle.
+*/
+typedef struct ring_struct {
+   void **slots;             /*!< Array of items, its size is a power of 2. */
+   uint32_t mask;            /*!< Size of slots array - 1. */
+   char pad1[64];
+   uint32_t head;            /*!< Index of the next item to pop, written by consumer. */
+   char pad2[64];
+   uint32_t tail;            /*!< Index of the next free slot, written by producer. */
+   char pad3[64];
+   int waiting;              /*!< Consumer waits for an item. */
+   int closed;               /*!< No more items will be pushed. */
+   pthread_mutex_t lock;     /*!< Lock of condition variable. */
+   pthread_cond_t cond;      /*!< Signalled when an item is pushed to a ring with waiting consumer. */
+} ring_t;
+
+/**
+* \brief Function initializes empty ring.
+*
+* \param ring Pointer to the ring.
+* \param size Minimal number of items the ring can hold, it is rounded up to a power of 2.
+* \return 0 if OK, -1 if memory could not be allocated.
+*/
+int ring_init(ring_t *ring, uint32_t size);
+
+/**
+* \brief Function frees memory of the ring.
+*
+* \param ring Pointer to the ring.
+*/
+void ring_destroy(ring_t *ring);
+
+/**
+* \brief Function adds item to the ring, it is called by producer only.
+*
+* \param ring Pointer to the ring.
+* \param item Item, must not be NULL.
+* \return 0 if OK, -1 if the ring is full.
+*/
+int ring_push(ring_t *ring, void *item);
+
+/**
+* \brief Function removes item from the ring, it is called by consumer only.
+*
+* \param ring Pointer to the ring.
+* \return Item or NULL if the ring is empty.
+*/
+void *ring_pop(ring_t *ring);
+
+/**
+* \brief Function removes item from the ring, waiting while the ring is empty.
+*
+* \param ring Pointer to the ring.
+* \return Item or NULL if the ring is empty and closed.
+*/
+void *ring_pop_wait(ring_t *ring);
+
+/**
+* \brief Function marks the ring as closed and wakes up waiting consumer.
+*
+* \param ring Pointer to the ring.
+*/
+void ring_close(ring_t *ring);
+
+#endif /* _RING_ */
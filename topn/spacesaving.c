@@ -0,0 +1,196 @@
+/**
+ * \file spacesaving.c
+ * \brief Space-Saving summary of the heaviest IP addresses.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spacesaving.h"
+
+static uint32_t ss_hash(const ip_addr_t *key)
+{
+   uint64_t h = (key->ui64[0] ^ (key->ui64[1] * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL;
+   return (uint32_t) (h >> 32);
+}
+
+static void ss_heap_swap(ss_table_t *table, uint32_t a, uint32_t b)
+{
+   uint32_t tmp = table->heap[a];
+
+   table->heap[a] = table->heap[b];
+   table->heap[b] = tmp;
+   table->entries[table->heap[a]].heap_index = a;
+   table->entries[table->heap[b]].heap_index = b;
+}
+
+static void ss_sift_up(ss_table_t *table, uint32_t i)
+{
+   while (i > 0) {
+      uint32_t parent = (i - 1) / 2;
+      if (table->entries[table->heap[parent]].count <= table->entries[table->heap[i]].count) {
+         break;
+      }
+      ss_heap_swap(table, i, parent);
+      i = parent;
+   }
+}
+
+static void ss_sift_down(ss_table_t *table, uint32_t i)
+{
+   for (;;) {
+      uint32_t smallest = i;
+      uint32_t left = 2 * i + 1;
+      uint32_t right = left + 1;
+
+      if (left < table->size && table->entries[table->heap[left]].count < table->entries[table->heap[smallest]].count) {
+         smallest = left;
+      }
+      if (right < table->size && table->entries[table->heap[right]].count < table->entries[table->heap[smallest]].count) {
+         smallest = right;
+      }
+      if (smallest == i) {
+         break;
+      }
+      ss_heap_swap(table, i, smallest);
+      i = smallest;
+   }
+}
+
+static void ss_unlink(ss_table_t *table, uint32_t index)
+{
+   uint32_t *pos = &table->buckets[ss_hash(&table->entries[index].key) & table->bucket_mask];
+
+   while (*pos != index) {
+      pos = &table->entries[*pos].next;
+   }
+   *pos = table->entries[index].next;
+}
+
+ss_table_t *ss_init(uint32_t capacity)
+{
+   ss_table_t *table = calloc(1, sizeof(ss_table_t));
+   uint32_t buckets = 1;
+
+   if (table == NULL || capacity == 0) {
+      free(table);
+      return NULL;
+   }
+   /* At least two buckets per counter keep the chains short */
+   while (buckets < 2 * capacity) {
+      buckets *= 2;
+   }
+   table->capacity = capacity;
+   table->bucket_mask = buckets - 1;
+   table->entries = malloc(capacity * sizeof(ss_entry_t));
+   table->heap = malloc(capacity * sizeof(uint32_t));
+   table->buckets = malloc(buckets * sizeof(uint32_t));
+   if (table->entries == NULL || table->heap == NULL || table->buckets == NULL) {
+      ss_destroy(table);
+      return NULL;
+   }
+   ss_clear(table);
+   return table;
+}
+
+void ss_clear(ss_table_t *table)
+{
+   memset(table->buckets, 0xFF, (table->bucket_mask + 1) * sizeof(uint32_t));
+   table->size = 0;
+   table->total = 0;
+}
+
+void ss_destroy(ss_table_t *table)
+{
+   if (table == NULL) {
+      return;
+   }
+   free(table->entries);
+   free(table->heap);
+   free(table->buckets);
+   free(table);
+}
+
+void ss_update(ss_table_t *table, const ip_addr_t *key, uint64_t weight)
+{
+   uint32_t bucket = ss_hash(key) & table->bucket_mask;
+   uint32_t index = table->buckets[bucket];
+   ss_entry_t *entry;
+
+   table->total += weight;
+   while (index != SS_NONE) {
+      entry = &table->entries[index];
+      if (entry->key.ui64[0] == key->ui64[0] && entry->key.ui64[1] == key->ui64[1]) {
+         entry->count += weight;
+         ss_sift_down(table, entry->heap_index);
+         return;
+      }
+      index = entry->next;
+   }
+
+   if (table->size < table->capacity) {
+      index = table->size++;
+      entry = &table->entries[index];
+      entry->count = weight;
+      entry->error = 0;
+      entry->heap_index = index;
+      table->heap[index] = index;
+      ss_sift_up(table, index);
+   } else {
+      /* The smallest entry is replaced, new key inherits its count */
+      index = table->heap[0];
+      entry = &table->entries[index];
+      ss_unlink(table, index);
+      entry->error = entry->count;
+      entry->count += weight;
+      ss_sift_down(table, 0);
+   }
+   entry->key = *key;
+   entry->next = table->buckets[bucket];
+   table->buckets[bucket] = index;
+}
+
+uint64_t ss_max_error(const ss_table_t *table)
+{
+   if (table->size < table->capacity) {
+      return 0;
+   }
+   return table->entries[table->heap[0]].count;
+}
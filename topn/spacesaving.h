@@ -0,0 +1,116 @@
+/**
+ * \file spacesaving.h
+ * \brief Space-Saving summary of the heaviest IP addresses.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef _SPACESAVING_
+#define _SPACESAVING_
+
+#include <stdint.h>
+#include <unirec/unirec.h>
+
+#define SS_NONE 0xFFFFFFFF
+
+/**
+* \brief Counter of one IP address in the summary.
+*/
+typedef struct ss_entry_struct {
+   ip_addr_t key;         /*!< IP address (or network) counted by the entry. */
+   uint64_t count;        /*!< Estimated weight of the key, never lower than its real weight. */
+   uint64_t error;        /*!< Maximal overestimation of count, the real weight is at least count - error. */
+   uint32_t heap_index;   /*!< Position of the entry in the heap. */
+   uint32_t next;         /*!< Next entry in the same hash bucket, SS_NONE at the end of the chain. */
+} ss_entry_t;
+
+/**
+* \brief Space-Saving summary with fixed number of counters.
+*
+* Every key with real weight higher than total / capacity is guaranteed to be in the summary and the count of every entry is overestimated by at most the count of the smallest entry. When a new key comes and all counters are used, the smallest entry is given to the new key and its count is inherited as the error of the new key. The smallest entry is found by a binary min-heap, entries are found by their key in a chained hash table.
+*/
+typedef struct ss_table_struct {
+   ss_entry_t *entries;   /*!< Array of counters. */
+   uint32_t *heap;        /*!< Min-heap of indexes of used entries ordered by count. */
+   uint32_t *buckets;     /*!< Heads of hash chains. */
+   uint32_t bucket_mask;  /*!< Number of buckets - 1. */
+   uint32_t capacity;     /*!< Number of counters. */
+   uint32_t size;         /*!< Number of used counters. */
+   uint64_t total;        /*!< Sum of weights of all updates. */
+} ss_table_t;
+
+/**
+* \brief Function allocates summary.
+*
+* \param capacity Number of counters, error of counts is at most total weight / capacity.
+* \return Pointer to the summary, NULL if memory could not be allocated.
+*/
+ss_table_t *ss_init(uint32_t capacity);
+
+/**
+* \brief Function removes all entries of the summary.
+*
+* \param table Pointer to the summary.
+*/
+void ss_clear(ss_table_t *table);
+
+/**
+* \brief Function frees the summary.
+*
+* \param table Pointer to the summary.
+*/
+void ss_destroy(ss_table_t *table);
+
+/**
+* \brief Function adds weight to the key, replacing the smallest entry if the key is not present and the summary is full.
+*
+* \param table Pointer to the summary.
+* \param key IP address.
+* \param weight Weight added to the key (flows, packets or bytes).
+*/
+void ss_update(ss_table_t *table, const ip_addr_t *key, uint64_t weight);
+
+/**
+* \brief Function returns maximal overestimation of counts of all entries.
+*
+* \param table Pointer to the summary.
+* \return 0 if summary is not full (counts are exact), count of the smallest entry otherwise.
+*/
+uint64_t ss_max_error(const ss_table_t *table);
+
+#endif /* _SPACESAVING_ */
@@ -0,0 +1,126 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <unirec/unirec.h>
+
+#include "spacesaving.h"
+
+#define KEYS 1000
+
+static ss_entry_t *find_entry(ss_table_t *table, uint32_t key)
+{
+   ip_addr_t ip = ip_from_int(key);
+
+   for (uint32_t i = 0; i < table->size; i++) {
+      if (table->entries[i].key.ui64[0] == ip.ui64[0] && table->entries[i].key.ui64[1] == ip.ui64[1]) {
+         return &table->entries[i];
+      }
+   }
+   return NULL;
+}
+
+static void update(ss_table_t *table, uint32_t key, uint64_t weight)
+{
+   ip_addr_t ip = ip_from_int(key);
+   ss_update(table, &ip, weight);
+}
+
+static void test_exact_counts(void **state)
+{
+   ss_table_t *table = ss_init(4);
+   assert_non_null(table);
+
+   update(table, 1, 5);
+   update(table, 2, 3);
+   update(table, 1, 2);
+   assert_int_equal(table->size, 2);
+   assert_int_equal(find_entry(table, 1)->count, 7);
+   assert_int_equal(find_entry(table, 2)->count, 3);
+   assert_int_equal(find_entry(table, 1)->error, 0);
+   assert_int_equal(ss_max_error(table), 0);
+   assert_int_equal(table->total, 10);
+
+   ss_destroy(table);
+}
+
+static void test_replace_min(void **state)
+{
+   ss_table_t *table = ss_init(4);
+   assert_non_null(table);
+
+   update(table, 1, 5);
+   update(table, 2, 3);
+   update(table, 3, 7);
+   update(table, 4, 2);
+   assert_int_equal(ss_max_error(table), 2);
+
+   /* New key takes the entry of the smallest key and inherits its count as error */
+   update(table, 5, 1);
+   assert_int_equal(table->size, 4);
+   assert_null(find_entry(table, 4));
+   ss_entry_t *entry = find_entry(table, 5);
+   assert_non_null(entry);
+   assert_int_equal(entry->count, 3);
+   assert_int_equal(entry->error, 2);
+   assert_int_equal(ss_max_error(table), 3);
+
+   /* Replaced key comes again, it takes one of the two smallest entries */
+   update(table, 4, 10);
+   assert_true((find_entry(table, 2) == NULL) != (find_entry(table, 5) == NULL));
+   entry = find_entry(table, 4);
+   assert_non_null(entry);
+   assert_int_equal(entry->count, 13);
+   assert_int_equal(entry->error, 3);
+
+   ss_clear(table);
+   assert_int_equal(table->size, 0);
+   assert_int_equal(ss_max_error(table), 0);
+   ss_destroy(table);
+}
+
+static void test_heavy_keys(void **state)
+{
+   ss_table_t *table = ss_init(16);
+   uint64_t weights[KEYS] = {0};
+   assert_non_null(table);
+
+   srand(1);
+   for (int i = 0; i < 20 * KEYS; i++) {
+      /* Every fifth update goes to one of two heavy keys */
+      uint32_t key = (i % 5 == 0) ? i % 10 / 5 : 2 + rand() % (KEYS - 2);
+      uint64_t weight = 1 + rand() % 4;
+      update(table, key, weight);
+      weights[key] += weight;
+   }
+
+   /* Keys with weight above total / capacity are kept, real weight is between count - error and count */
+   for (uint32_t key = 0; key < KEYS; key++) {
+      ss_entry_t *entry = find_entry(table, key);
+      if (weights[key] > table->total / table->capacity) {
+         assert_non_null(entry);
+      }
+      if (entry) {
+         assert_true(entry->count >= weights[key]);
+         assert_true(entry->count - entry->error <= weights[key]);
+         assert_true(entry->error <= ss_max_error(table));
+      }
+   }
+   assert_true(weights[0] > table->total / table->capacity);
+   assert_true(weights[1] > table->total / table->capacity);
+
+   ss_destroy(table);
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_exact_counts),
+      cmocka_unit_test(test_replace_min),
+      cmocka_unit_test(test_heavy_keys),
+   };
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,90 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "toplist.h"
+
+#define ITEMS 1000
+#define TOP_N 10
+
+static void test_not_full(void **state)
+{
+   top_item_t top[TOP_N];
+   int size = 0;
+
+   size = top_push(top, size, TOP_N, 5, 1);
+   size = top_push(top, size, TOP_N, 0, 2);
+   size = top_push(top, size, TOP_N, 9, 3);
+   size = top_push(top, size, TOP_N, 7, 4);
+   top_sort(top, size);
+
+   /* Items with zero value are not selected */
+   assert_int_equal(size, 3);
+   assert_int_equal(top[0].index, 3);
+   assert_int_equal(top[1].index, 4);
+   assert_int_equal(top[2].index, 1);
+}
+
+static void test_truncated(void **state)
+{
+   top_item_t top[TOP_N];
+   uint64_t values[ITEMS];
+   int size = 0;
+
+   srand(1);
+   for (uint32_t i = 0; i < ITEMS; i++) {
+      values[i] = 1 + rand() % 200;
+      size = top_push(top, size, TOP_N, values[i], i);
+   }
+   top_sort(top, size);
+   assert_int_equal(size, TOP_N);
+
+   /* Items are in descending order, equal values by lower index first */
+   for (int i = 1; i < size; i++) {
+      assert_true(top[i - 1].value > top[i].value ||
+                  (top[i - 1].value == top[i].value && top[i - 1].index < top[i].index));
+   }
+   /* No item left out is ranked higher than the last selected one */
+   for (uint32_t i = 0; i < ITEMS; i++) {
+      int selected = 0;
+      for (int j = 0; j < size; j++) {
+         if (top[j].index == i) {
+            assert_int_equal(top[j].value, values[i]);
+            selected = 1;
+         }
+      }
+      if (!selected) {
+         assert_true(values[i] < top[size - 1].value ||
+                     (values[i] == top[size - 1].value && i > top[size - 1].index));
+      }
+   }
+}
+
+static void test_equal_values(void **state)
+{
+   top_item_t top[3];
+   int size = 0;
+
+   for (uint32_t i = 10; i > 0; i--) {
+      size = top_push(top, size, 3, 4, i);
+   }
+   top_sort(top, size);
+
+   assert_int_equal(size, 3);
+   assert_int_equal(top[0].index, 1);
+   assert_int_equal(top[1].index, 2);
+   assert_int_equal(top[2].index, 3);
+}
+
+int main(void)
+{
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_not_full),
+      cmocka_unit_test(test_truncated),
+      cmocka_unit_test(test_equal_values),
+   };
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}
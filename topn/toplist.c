@@ -0,0 +1,108 @@
+/**
+ * \file toplist.c
+ * \brief Selection of top N ranked items.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include "toplist.h"
+
+/* Item a is ranked lower than item b, equal values are ranked by lower index first */
+static inline int top_lower(const top_item_t *a, const top_item_t *b)
+{
+   return a->value < b->value || (a->value == b->value && a->index > b->index);
+}
+
+static void top_sift_down(top_item_t *top, int size, int i)
+{
+   top_item_t item = top[i];
+
+   while (1) {
+      int child = 2 * i + 1;
+      if (child >= size) {
+         break;
+      }
+      if (child + 1 < size && top_lower(&top[child + 1], &top[child])) {
+         child++;
+      }
+      if (!top_lower(&top[child], &item)) {
+         break;
+      }
+      top[i] = top[child];
+      i = child;
+   }
+   top[i] = item;
+}
+
+int top_push(top_item_t *top, int size, int n, uint64_t value, uint32_t index)
+{
+   top_item_t item = {value, index};
+
+   if (value == 0) {
+      return size;
+   }
+
+   if (size < n) {
+      /* Heap is not full yet, sift the item up */
+      int i = size;
+      while (i > 0 && top_lower(&item, &top[(i - 1) / 2])) {
+         top[i] = top[(i - 1) / 2];
+         i = (i - 1) / 2;
+      }
+      top[i] = item;
+      return size + 1;
+   }
+
+   /* Heap is full, item replaces the lowest one only if it is ranked higher */
+   if (top_lower(&top[0], &item)) {
+      top[0] = item;
+      top_sift_down(top, size, 0);
+   }
+   return size;
+}
+
+void top_sort(top_item_t *top, int size)
+{
+   /* Heapsort of min-heap moves the lowest items to the end */
+   for (int end = size - 1; end > 0; end--) {
+      top_item_t tmp = top[0];
+      top[0] = top[end];
+      top[end] = tmp;
+      top_sift_down(top, end, 0);
+   }
+}
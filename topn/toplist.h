@@ -0,0 +1,75 @@
+/**
+ * \file toplist.h
+ * \brief Selection of top N ranked items.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef _TOPLIST_
+#define _TOPLIST_
+
+#include <stdint.h>
+
+typedef struct top_item_struct {
+   uint64_t value;          /*!< Value the items are ranked by. */
+   uint32_t index;          /*!< Index of the ranked entity (port number or index of summary entry). */
+} top_item_t;
+
+/**
+* \brief Function offers item to the selection of top N items.
+*
+* Selected items are kept in a binary min-heap of at most N items, so selecting top N of M items costs O(M log N) and the ranked data are not reordered. Items with equal values are ranked by lower index first.
+*
+* \param top Min-heap of selected items, at least N elements long.
+* \param size Number of items currently in the heap.
+* \param n Maximal number of selected items.
+* \param value Value of the offered item, items with zero value are not selected.
+* \param index Index of the offered item.
+* \return New number of items in the heap.
+*/
+int top_push(top_item_t * top, int size, int n, uint64_t value, uint32_t index);
+
+/**
+* \brief Function sorts selected items in descending order.
+*
+* \param top Min-heap of selected items filled by top_push.
+* \param size Number of items in the heap.
+*/
+void top_sort(top_item_t * top, int size);
+
+#endif /* _TOPLIST_ */
@@ -53,22 +53,32 @@ UR_FIELDS(
    ipaddr DST_IP,
    uint16 DST_PORT,
    uint16 SRC_PORT,
-   uint8 PROTOCOL
+   uint8 PROTOCOL,
+   time TIME_FIRST,
+   time TIME_LAST,
+   uint64 TOPN_FLOWS,
+   uint64 TOPN_PACKETS,
+   uint64 TOPN_BYTES,
+   int32 TOPN_PORT,
+   uint16 PORT,
+   uint16 TOPN_RANK,
+   uint8 TOPN_TYPE,
+   uint8 TOPN_METRIC
 )
 
 /* Structure with information about module */
 trap_module_info_t *module_info = NULL;
 
 #define MODULE_BASIC_INFO(BASIC) \
-   BASIC("topn", "Module for computing various Top N statistics.", 1, 0)
+   BASIC("topn", "Module for computing various Top N statistics. Statistics are printed, or sent as UniRec records if output interface is given.", 1, -1)
 
 #define MODULE_PARAMS(PARAM) \
    PARAM('n', "top_n", "Number of entities for top N statistics.", required_argument, "uint8_t") \
    PARAM('l', "time", "Length of time interval in seconds. Statistics are calculated upon this interval.", required_argument, "uint8_t") \
    PARAM('p', "ports", "Specific ports upon which statistics will be calculated independently. Use format -p x1,x2,x3...", required_argument, "string") \
-   PARAM('m', "prefix", "Length of the prefix for IPv4 and IPv6. Use format -m x1,x2 for both or -m x1 for IPv4 only.", required_argument, "string")
+   PARAM('m', "prefix", "Length of the prefix for IPv4 and IPv6. Use format -m x1,x2 for both or -m x1 for IPv4 only.", required_argument, "string") \
+   PARAM('T', "threads", "Number of worker threads processing received records, records are processed by the receiving thread by default.", required_argument, "uint32_t")
 
-time_t time1;
 static int print_stats = 0;
 static int stop = 0;
 static int interval = 0;
@@ -76,6 +86,13 @@ static int topn = 0;
 static int *port = NULL;
 static int port_cnt = 0;
 static int port_set = -1;
+/* Index of stats of flows of every port in the set of stats, 0 if the port is not watched */
+static uint32_t port_slot[65536];
+static uint64_t prefix128[2] = {0, 0};
+static uint32_t prefix = 0;
+static int prefix_set = 0;
+static int prefix_only_v4 = -1;
+static int threads = 0;
 
 /* Handling SIGTERM and SIGINT signals */
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
@@ -83,12 +100,38 @@ TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
 int main(int argc, char **argv)
 {
    int ret;
+   trap_ifc_spec_t ifc_spec;
 
-   int array_counter = 0;
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
 
-   /* TRAP initialization */
-   TRAP_DEFAULT_INITIALIZATION(argc, argv, *module_info);
+   /* TRAP initialization, output interface is optional */
+   ret = trap_parse_params(&argc, argv, &ifc_spec);
+   if (ret != TRAP_E_OK) {
+      if (ret == TRAP_E_HELP) {
+         trap_print_help(module_info);
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         return EXIT_SUCCESS;
+      }
+      fprintf(stderr, "ERROR in parsing of parameters for TRAP: %s\n", trap_last_error_msg);
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return EXIT_FAILURE;
+   }
+
+   module_info->num_ifc_out = strlen(ifc_spec.types) - 1;
+   if (module_info->num_ifc_out > 1) {
+      fprintf(stderr, "Error: At most one output interface is allowed.\n");
+      trap_free_ifc_spec(ifc_spec);
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return EXIT_FAILURE;
+   }
+
+   ret = trap_init(module_info, ifc_spec);
+   trap_free_ifc_spec(ifc_spec);
+   if (ret != TRAP_E_OK) {
+      fprintf(stderr, "ERROR in TRAP initialization: %s\n", trap_last_error_msg);
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return EXIT_FAILURE;
+   }
 
    /* Register signal handler. */
    TRAP_REGISTER_DEFAULT_SIGNAL_HANDLER();
@@ -97,11 +140,8 @@ int main(int argc, char **argv)
 
    /* Create UniRec template */
    char *unirec_specifier = "PACKETS,BYTES,SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL";
+   char *output_specifier = "TIME_FIRST,TIME_LAST,SRC_IP,DST_IP,TOPN_FLOWS,TOPN_PACKETS,TOPN_BYTES,TOPN_PORT,SRC_PORT,DST_PORT,PORT,TOPN_RANK,PROTOCOL,TOPN_TYPE,TOPN_METRIC";
    char opt;
-   uint64_t prefix128[2] = {0, 0};
-   uint32_t prefix = 0;
-   int prefix_set = 0;
-   int prefix_only_v4 = -1;
 
    while ((opt = TRAP_GETOPT(argc, argv, module_getopt_string, long_options)) != -1) {
       switch (opt) {
@@ -143,6 +183,16 @@ int main(int argc, char **argv)
          }
          break;
 
+      case 'T':
+         threads = atoi(optarg);
+         if (threads <= 0) {
+            fprintf(stderr, "Invalid argument for parameter -T\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            TRAP_DEFAULT_FINALIZATION();
+            return EXIT_FAILURE;
+         }
+         break;
+
       default:
          fprintf(stderr, "Invalid arguments.\n");
          FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
@@ -173,220 +223,64 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
-   /* Counting Top N flows */
-   flow_t *array_of_bytes = calloc(topn, sizeof(flow_t));
-   flow_t **sorted_array_of_bytes = calloc(topn, sizeof(flow_t*));
-   flow_t *record_bytes = calloc(1, sizeof(flow_t));
-   flow_t *array_of_packets = calloc(topn, sizeof(flow_t));
-   flow_t **sorted_array_of_packets = calloc(topn, sizeof(flow_t*));
-   flow_t *record_packets = calloc(1, sizeof(flow_t));
-
-   if (array_of_bytes == NULL || sorted_array_of_bytes == NULL || record_bytes == NULL || array_of_packets == NULL || sorted_array_of_packets == NULL || record_packets == NULL) {
-      malloc_err();
-   }
-
-   flow_t **array_of_bytes_port = NULL;
-   flow_t ***sorted_array_of_bytes_port = NULL;
-   flow_t **array_of_packets_port = NULL;
-   flow_t ***sorted_array_of_packets_port = NULL;
-   int *array_counter_port = NULL;
-
-   if (port_set != -1) {
-      array_of_bytes_port = malloc(port_cnt *(sizeof(flow_t *)));
-      sorted_array_of_bytes_port = malloc(port_cnt *(sizeof(flow_t **)));
-      array_of_packets_port = malloc(port_cnt *(sizeof(flow_t *)));
-      sorted_array_of_packets_port = malloc(port_cnt *(sizeof(flow_t **)));
-      array_counter_port = malloc(port_cnt *(sizeof(int)));
-
-      if (array_of_bytes_port == NULL || sorted_array_of_bytes_port == NULL || array_of_packets_port == NULL || sorted_array_of_packets_port == NULL || array_counter_port == NULL) {
-         malloc_err();
-      }
-
-      for (int i = 0; i < port_cnt; i ++) {
-         array_of_bytes_port[i] = malloc(topn * sizeof(flow_t));
-         sorted_array_of_bytes_port[i] = malloc(topn * sizeof(flow_t*));
-         array_of_packets_port[i] = malloc(topn * sizeof(flow_t));
-         sorted_array_of_packets_port[i] = malloc(topn * sizeof(flow_t*));
-         array_counter_port[i] = 0;
-
-         if (array_of_bytes_port[i] == NULL || sorted_array_of_bytes_port[i] == NULL || array_of_packets_port[i] == NULL || sorted_array_of_packets_port[i] == NULL) {
-            malloc_err();
-         }
-      }
-   }
-
-   /* Counting top N ports */
-
-   port_t *array_of_ports = calloc(65536, sizeof(port_t));
-
-   if (array_of_ports == NULL) {
-      malloc_err();
-   }
-
-   port_t **array_of_ports_port = NULL;
-
-   if (port_set != -1) {
-      array_of_ports_port = malloc(port_cnt *(sizeof(port_t *)));
+   /* Top N entries are sent as records instead of printing them */
+   ur_template_t *out_tmplt = NULL;
 
-      if (array_of_ports_port == NULL) {
-         malloc_err();
-      }
-
-      for (int i = 0; i < port_cnt; i++) {
-         array_of_ports_port[i] = calloc(65536, sizeof(port_t));
-
-         if (array_of_ports_port[i] == NULL) {
-            malloc_err();
-         }
+   if (module_info->num_ifc_out == 1) {
+      out_tmplt = ur_create_output_template(0, output_specifier, NULL);
+      if (out_tmplt == NULL) {
+         fprintf(stderr, "Error: Invalid output UniRec specifier.\n");
+         TRAP_DEFAULT_FINALIZATION();
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         return EXIT_FAILURE;
       }
    }
 
-   /* Top N IPs */
-   fht_table_t *table_flows = fht_init(HASH_TABLE_SIZE * 4, sizeof(ip_addr_t), sizeof(ip_t), 0);      /* 32k */
-   fht_iter_t *iter_flows = fht_init_iter(table_flows);
-   fhf_table_t *table_pab = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));      /* 8k, pab = packets and bytes */
-   fhf_iter_t *iter_pab = fhf_init_iter(table_pab);
+   /* Statistics of all flows and of flows of every watched port, one set for every thread */
+   int set_cnt = threads > 0 ? threads : 1;
+   top_stats_t **sets = calloc(set_cnt, sizeof(top_stats_t *));
 
-   if (table_flows == NULL || iter_flows == NULL || table_pab == NULL || iter_pab == NULL) {
+   if (sets == NULL) {
       malloc_err();
    }
 
-   fht_table_t **table_flows_port = NULL;
-   fht_iter_t **iter_flows_port = NULL;
-   fhf_table_t **table_pab_port = NULL;
-   fhf_iter_t **iter_pab_port = NULL;
+   for (int i = 0; i < set_cnt; i++) {
+      sets[i] = stats_set_init();
 
-   if (port_set != -1) {
-      table_pab_port = malloc(port_cnt *(sizeof(fhf_table_t *)));
-      iter_pab_port = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-      table_flows_port = malloc(port_cnt *(sizeof(fht_table_t *)));
-      iter_flows_port = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-      if (table_pab_port == NULL || iter_pab_port == NULL || table_flows_port == NULL || iter_flows_port == NULL) {
+      if (sets[i] == NULL) {
          malloc_err();
       }
-
-      for (int i = 0; i < port_cnt; i++) {
-         table_pab_port[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-         iter_pab_port[i] = fhf_init_iter(table_pab_port[i]);
-         table_flows_port[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-         iter_flows_port[i] = fht_init_iter(table_flows_port[i]);
-
-         if (table_pab_port[i] == NULL || iter_pab_port[i] == NULL || table_flows_port[i] == NULL || iter_flows_port[i] == NULL) {
-            malloc_err();
-         }
-
-      }
-   }
-
-   /* Top networks */
-   fht_table_t *table_prefix_flows = fht_init(HASH_TABLE_SIZE * 2, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 16k */
-   fht_iter_t *iter_prefix_flows = fht_init_iter(table_prefix_flows);
-   fhf_table_t *table_prefix_pab = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));   /* 8k */
-   fhf_iter_t *iter_prefix_pab = fhf_init_iter(table_prefix_pab);
-
-   if (table_prefix_flows == NULL || iter_prefix_flows == NULL || table_prefix_pab == NULL || iter_prefix_pab == NULL) {
-      malloc_err();
    }
 
-   fht_table_t *table_prefix_flows_v6 = NULL;
-   fht_iter_t *iter_prefix_flows_v6 = NULL;
-   fhf_table_t *table_prefix_pab_v6 = NULL;
-   fhf_iter_t *iter_prefix_pab_v6 = NULL;
-
-   if (prefix_only_v4 == -1) {
-      table_prefix_flows_v6 = fht_init(HASH_TABLE_SIZE * 2, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 16k */
-      iter_prefix_flows_v6 = fht_init_iter(table_prefix_flows_v6);
-      table_prefix_pab_v6 = fhf_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t));   /* 8k */
-      iter_prefix_pab_v6 = fhf_init_iter(table_prefix_pab_v6);
+   /* Stats of the finished interval are reported by the reporting thread while new records are processed */
+   reporter_t reporter;
 
-      if (table_prefix_flows_v6 == NULL || iter_prefix_flows_v6 == NULL || table_prefix_pab_v6 == NULL || iter_prefix_pab_v6 == NULL) {
-         malloc_err();
-      }
+   if (reporter_start(&reporter, set_cnt, out_tmplt) == -1) {
+      fprintf(stderr, "Error: Could not start reporting thread.\n");
+      TRAP_DEFAULT_FINALIZATION();
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      return EXIT_FAILURE;
    }
 
-   fhf_table_t **table_prefix_pab_port = NULL;
-   fhf_iter_t **iter_prefix_pab_port = NULL;
-
-   fht_table_t **table_prefix_flows_port = NULL;
-   fht_iter_t **iter_prefix_flows_port = NULL;
-
-   fhf_table_t **table_prefix_pab_port_v6 = NULL;
-   fhf_iter_t **iter_prefix_pab_port_v6 = NULL;
-
-   fht_table_t **table_prefix_flows_port_v6 = NULL;
-   fht_iter_t **iter_prefix_flows_port_v6 = NULL;
-
-   if (port_set != -1) {
-      table_prefix_pab_port = malloc(port_cnt *(sizeof(fhf_table_t *)));
-      iter_prefix_pab_port = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-      table_prefix_flows_port = malloc(port_cnt *(sizeof(fht_table_t *)));
-      iter_prefix_flows_port = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-      if (table_prefix_pab_port == NULL || iter_prefix_pab_port == NULL || table_prefix_flows_port == NULL || iter_prefix_flows_port == NULL) {
-         malloc_err();
-      }
-
-      if (prefix_only_v4 == -1) {
-         table_prefix_pab_port_v6 = malloc(port_cnt *(sizeof(fhf_table_t *)));
-         iter_prefix_pab_port_v6 = malloc(port_cnt *(sizeof(fhf_iter_t *)));
-         table_prefix_flows_port_v6 = malloc(port_cnt *(sizeof(fht_table_t *)));
-         iter_prefix_flows_port_v6 = malloc(port_cnt *(sizeof(fht_iter_t *)));
-
-         if (table_prefix_pab_port_v6 == NULL || iter_prefix_pab_port_v6 == NULL || table_prefix_flows_port_v6 == NULL || iter_prefix_flows_port_v6 == NULL) {
-            malloc_err();
-         }
-      }
-
-      for (int i = 0; i < port_cnt; i++) {
-         table_prefix_pab_port[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-         iter_prefix_pab_port[i] = fhf_init_iter(table_prefix_pab_port[i]);
-         table_prefix_flows_port[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-         iter_prefix_flows_port[i] = fht_init_iter(table_prefix_flows_port[i]);
-
-         if (table_prefix_pab_port[i] == NULL || iter_prefix_pab_port[i] == NULL || table_prefix_flows_port[i] == NULL || iter_prefix_flows_port[i] == NULL) {
-            malloc_err();
-         }
+   worker_t *workers = NULL;
 
-         if (prefix_only_v4 == -1) {
-            table_prefix_pab_port_v6[i] = fhf_init(HASH_TABLE_SIZE / 2, sizeof(ip_addr_t), sizeof(ip_t));   /* 4k */
-            iter_prefix_pab_port_v6[i] = fhf_init_iter(table_prefix_pab_port_v6[i]);
-            table_prefix_flows_port_v6[i] = fht_init(HASH_TABLE_SIZE, sizeof(ip_addr_t), sizeof(ip_t), 0);   /* 8k */
-            iter_prefix_flows_port_v6[i] = fht_init_iter(table_prefix_flows_port_v6[i]);
+   if (threads > 0) {
+      workers = workers_start(sets, threads);
 
-            if (table_prefix_pab_port_v6[i] == NULL || iter_prefix_pab_port_v6[i] == NULL || table_prefix_flows_port_v6[i] == NULL || iter_prefix_flows_port_v6[i] == NULL) {
-               malloc_err();
-            }
-         }
+      if (workers == NULL) {
+         fprintf(stderr, "Error: Could not start worker threads.\n");
+         TRAP_DEFAULT_FINALIZATION();
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         return EXIT_FAILURE;
       }
    }
 
-   /* Additional code */
-   ip_addr_t masked_ip;
-   char *ip_string = malloc(INET6_ADDRSTRLEN);
-   char *ip_string2 = malloc(INET6_ADDRSTRLEN);
-   ip_t *record_ip = malloc(sizeof(ip_t));
-   ip_addr_t *key_lost = malloc(sizeof(ip_addr_t));
-   ip_t *data_lost = malloc(sizeof(ip_t));
-
-   if (ip_string == NULL || ip_string2 == NULL || record_ip == NULL || key_lost == NULL || data_lost == NULL) {
-      malloc_err();
-   }
-
-   uint64_t received_flows = 0;
-   uint64_t all_bytes = 0;
-   uint32_t average_bytes = 0;
-   uint64_t all_packets = 0;
-   uint32_t average_packets = 0;
-
-   char time_print_buff[128];
-   time_t time_print;
-
    const void *data;
    uint16_t data_size;
+   topn_record_t record;
+   ur_time_t window_start = time_now();
+   ur_time_t window_end;
 
-   seedMT(time(NULL));
-   time1 = time(NULL);
    alarm(interval);
 
    while (!stop) {
@@ -400,399 +294,64 @@ int main(int argc, char **argv)
          break;
       }
 
-      received_flows++;
-      all_bytes += ur_get(tmplt, data, F_BYTES);
-      average_bytes = all_bytes / received_flows;
-      all_packets += ur_get(tmplt, data, F_PACKETS);
-      average_packets = all_packets / received_flows;
-
-      /*if ((received_flows > 190000) && received_flows % 200000 == 0) {
-         printf("%" PRIu64 "k (%" PRIu64 "M): average bytes: %d, average packets: %d,\n", received_flows / 1000, received_flows / 1000000, average_bytes, average_packets);
-      }*/
-
-      record_ip->bytes = ur_get(tmplt, data, F_BYTES);
-      record_ip->packets = ur_get(tmplt, data, F_PACKETS);
-      record_ip->flows = 1;
-      record_ip->src_ip = ur_get(tmplt, data, F_SRC_IP);
-
-      record_bytes->max_number = ur_get(tmplt, data, F_BYTES);
-      record_bytes->src_ip = ur_get(tmplt, data, F_SRC_IP);
-      record_bytes->dst_ip = ur_get(tmplt, data, F_DST_IP);
-      record_bytes->src_port = ur_get(tmplt, data, F_SRC_PORT);
-      record_bytes->dst_port = ur_get(tmplt, data, F_DST_PORT);
-      record_bytes->protocol = ur_get(tmplt, data, F_PROTOCOL);
-
-      record_packets->max_number = ur_get(tmplt, data, F_PACKETS);
-      record_packets->src_ip = ur_get(tmplt, data, F_SRC_IP);
-      record_packets->dst_ip = ur_get(tmplt, data, F_DST_IP);
-      record_packets->src_port = ur_get(tmplt, data, F_SRC_PORT);
-      record_packets->dst_port = ur_get(tmplt, data, F_DST_PORT);
-      record_packets->protocol = ur_get(tmplt, data, F_PROTOCOL);
-
-
-      /* Prefixes */
-
-      if (prefix_set == 1) {
-         if (ip_is4(&ur_get(tmplt, data, F_SRC_IP)) == 1) {
-            masked_ip = ur_get(tmplt, data, F_SRC_IP);
-            masked_ip.ui32[2] = masked_ip.ui32[2] & prefix;
-
-            process_ip_flows(table_prefix_flows, &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-            process_ip_pab(table_prefix_pab, &masked_ip, record_ip, data, tmplt,  average_packets,  average_bytes);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-                     process_ip_flows(table_prefix_flows_port[p], &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-                     process_ip_pab(table_prefix_pab_port[p], &masked_ip, record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-                  }
-               }
-            }
-         } else if (prefix_only_v4 == -1) {
-            masked_ip = (ur_get(tmplt, data, F_SRC_IP));
-            masked_ip.ui64[0] = masked_ip.ui64[0] & prefix128[0];
-            masked_ip.ui64[1] = masked_ip.ui64[1] & prefix128[1];
-
-            process_ip_flows(table_prefix_flows_v6, &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-            process_ip_pab(table_prefix_pab_v6, &masked_ip, record_ip, data, tmplt,  average_packets,  average_bytes);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-                     process_ip_flows(table_prefix_flows_port_v6[p], &masked_ip, record_ip, key_lost, data_lost, data, tmplt);
-                     process_ip_pab(table_prefix_pab_port_v6[p], &masked_ip, record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-
-                  }
-               }
-            }
-         }
-      }
-
-      /* IPs */
-      process_ip_flows(table_flows, &ur_get(tmplt, data, F_SRC_IP), record_ip, key_lost, data_lost, data, tmplt);
-      process_ip_pab(table_pab, &ur_get(tmplt, data, F_SRC_IP), record_ip, data, tmplt,  average_packets,  average_bytes);
+      record.src_ip = ur_get(tmplt, data, F_SRC_IP);
+      record.dst_ip = ur_get(tmplt, data, F_DST_IP);
+      record.packets = ur_get(tmplt, data, F_PACKETS);
+      record.bytes = ur_get(tmplt, data, F_BYTES);
+      record.src_port = ur_get(tmplt, data, F_SRC_PORT);
+      record.dst_port = ur_get(tmplt, data, F_DST_PORT);
+      record.protocol = ur_get(tmplt, data, F_PROTOCOL);
 
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-               process_ip_flows(table_flows_port[p], &ur_get(tmplt, data, F_SRC_IP), record_ip, key_lost, data_lost, data, tmplt);
-               process_ip_pab(table_pab_port[p], &ur_get(tmplt, data, F_SRC_IP), record_ip, data, tmplt,  average_packets / 3,  average_bytes / 3);
-            }
-         }
-      }
-
-      /* Flows */
-      process_flows(array_of_bytes,  sorted_array_of_bytes, record_bytes, array_counter);
-      process_flows(array_of_packets, sorted_array_of_packets, record_packets, array_counter);
-      if (array_counter < topn) {
-         array_counter++;
-      }
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p] || record_bytes->src_port == port[p]) {
-               process_flows(array_of_bytes_port[p], sorted_array_of_bytes_port[p], record_bytes, array_counter_port[p]);
-               process_flows(array_of_packets_port[p], sorted_array_of_packets_port[p], record_packets, array_counter_port[p]);
-               if (array_counter_port[p] < topn) {
-                  array_counter_port[p]++;
-               }
-            }
-         }
-      }
-
-      /* Ports */
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].flows += 1;
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].flows += 1;
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].port = ur_get(tmplt, data, F_DST_PORT);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].port = ur_get(tmplt, data, F_SRC_PORT);
-
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-      array_of_ports[ur_get(tmplt, data, F_DST_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-      array_of_ports[ur_get(tmplt, data, F_SRC_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            if (record_bytes->dst_port == port[p]) {
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].flows += 1;
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].port = ur_get(tmplt, data, F_SRC_PORT);
-
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-               array_of_ports_port[p][ur_get(tmplt, data, F_SRC_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-            }
-
-            if (record_bytes->src_port == port[p]) {
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].flows += 1;
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].port = ur_get(tmplt, data, F_DST_PORT);
-
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].packets += ur_get(tmplt, data, F_PACKETS);
-               array_of_ports_port[p][ur_get(tmplt, data, F_DST_PORT)].bytes += ur_get(tmplt, data, F_BYTES);
-            }
-         }
+      if (workers == NULL) {
+         process_record(sets[0], &record);
+      } else {
+         workers_dispatch(workers, threads, &record);
       }
 
-      /* Printing results after time is up */
+      /* Reporting results after time is up, stats are exchanged for empty ones */
       if (print_stats == 1) {
-         time_print = time(NULL);
-         strftime(time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime (&time_print));
-         printf ("\n===================\n%s\n===================\n", time_print_buff);
-
-         print_top_flows(sorted_array_of_bytes, sorted_array_of_packets, array_counter, ip_string, ip_string2, -1);
-         array_counter = 0;
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_flows(sorted_array_of_bytes_port[p], sorted_array_of_packets_port[p], array_counter_port[p], ip_string, ip_string2, port[p]);
-               array_counter_port[p] = 0;
-            }
+         if (workers != NULL) {
+            workers_sync(workers, threads);
          }
 
-         print_top_ports(array_of_ports, -1);
-         memset(array_of_ports, 0, sizeof(port_t) * 65536);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ports(array_of_ports_port[p], port[p]);
-               memset(array_of_ports_port[p], 0, sizeof(port_t) * 65536);
-            }
-         }
-
-         print_top_ip(ip_string, table_pab, iter_pab, table_flows, iter_flows, -1, 0);
-         fhf_clear(table_pab);
-         fhf_reinit_iter(iter_pab);
-         fht_clear(table_flows);
-         fht_reinit_iter(iter_flows);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ip(ip_string, table_pab_port[p], iter_pab_port[p], table_flows_port[p], iter_flows_port[p], port[p], 0);
-               fhf_clear(table_pab_port[p]);
-               fhf_reinit_iter(iter_pab_port[p]);
-               fht_clear(table_flows_port[p]);
-               fht_reinit_iter(iter_flows_port[p]);
-            }
-         }
+         window_end = time_now();
+         reporter_submit(&reporter, sets, window_start, window_end);
+         window_start = window_end;
 
-         if (prefix_set == 1) {
-            print_top_ip(ip_string, table_prefix_pab, iter_prefix_pab, table_prefix_flows, iter_prefix_flows, -1, 1);
-            fhf_clear(table_prefix_pab);
-            fhf_reinit_iter(iter_prefix_pab);
-            fht_clear(table_prefix_flows);
-            fht_reinit_iter(iter_prefix_flows);
-
-            if (port_set != -1) {
-               for (int p = 0; p < port_cnt; p++) {
-                  print_top_ip(ip_string, table_prefix_pab_port[p], iter_prefix_pab_port[p], table_prefix_flows_port[p], iter_prefix_flows_port[p], port[p], 1);
-                  fhf_clear(table_prefix_pab_port[p]);
-                  fhf_reinit_iter(iter_prefix_pab_port[p]);
-                  fht_clear(table_prefix_flows_port[p]);
-                  fht_reinit_iter(iter_prefix_flows_port[p]);
-               }
-            }
-
-            if (prefix_only_v4 == -1) {
-               print_top_ip(ip_string, table_prefix_pab_v6, iter_prefix_pab_v6, table_prefix_flows_v6, iter_prefix_flows_v6, -1, 1);
-               fhf_clear(table_prefix_pab_v6);
-               fhf_reinit_iter(iter_prefix_pab_v6);
-               fht_clear(table_prefix_flows_v6);
-               fht_reinit_iter(iter_prefix_flows_v6);
-
-               if (port_set != -1) {
-                  for (int p = 0; p < port_cnt; p++) {
-                     print_top_ip(ip_string, table_prefix_pab_port_v6[p], iter_prefix_pab_port_v6[p], table_prefix_flows_port_v6[p], iter_prefix_flows_port_v6[p], port[p], 1);
-                     fhf_clear(table_prefix_pab_port_v6[p]);
-                     fhf_reinit_iter(iter_prefix_pab_port_v6[p]);
-                     fht_clear(table_prefix_flows_port_v6[p]);
-                     fht_reinit_iter(iter_prefix_flows_port_v6[p]);
-                  }
-               }
-            }
+         for (int i = 0; i < threads; i++) {
+            workers[i].stats = sets[i];
          }
 
          print_stats = 0;
 
-         received_flows = 0;
-         all_bytes = 0;
-         average_bytes = 0;
-         all_packets = 0;
-         average_packets = 0;
-
          alarm(interval);
-
-         seedMT(time(NULL));
-         time1 = time(NULL);
-      }
-   }
-
-   /* Printing final results after interrupt */
-
-   time_print = time(NULL);
-   strftime (time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime (&time_print));
-   printf ("\n===================\n%s\n===================\n", time_print_buff);
-
-   print_top_flows(sorted_array_of_bytes, sorted_array_of_packets, array_counter, ip_string, ip_string2, -1);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_flows(sorted_array_of_bytes_port[p], sorted_array_of_packets_port[p], array_counter_port[p], ip_string, ip_string2, port[p]);
       }
    }
 
-   print_top_ports(array_of_ports, -1);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_ports(array_of_ports_port[p], port[p]);
-      }
-   }
-
-   print_top_ip(ip_string, table_pab, iter_pab, table_flows, iter_flows, -1, 0);
-
-   if (port_set != -1) {
-      for (int p = 0; p < port_cnt; p++) {
-         print_top_ip(ip_string, table_pab_port[p], iter_pab_port[p], table_flows_port[p], iter_flows_port[p], port[p], 0);
-      }
-   }
-
-   if (prefix_set == 1) {
-      print_top_ip(ip_string, table_prefix_pab, iter_prefix_pab, table_prefix_flows, iter_prefix_flows,-1, 1);
-
-      if (port_set != -1) {
-         for (int p = 0; p < port_cnt; p++) {
-            print_top_ip(ip_string, table_prefix_pab_port[p], iter_prefix_pab_port[p], table_prefix_flows_port[p], iter_prefix_flows_port[p], port[p], 1);
-         }
-      }
-
-      if (prefix_only_v4 == -1) {
-         print_top_ip(ip_string, table_prefix_pab_v6, iter_prefix_pab_v6, table_prefix_flows_v6, iter_prefix_flows_v6, -1, 1);
-
-         if (port_set != -1) {
-            for (int p = 0; p < port_cnt; p++) {
-               print_top_ip(ip_string, table_prefix_pab_port_v6[p], iter_prefix_pab_port_v6[p], table_prefix_flows_port_v6[p], iter_prefix_flows_port_v6[p], port[p], 1);
-            }
-         }
-      }
+   /* Reporting final results after interrupt */
+   if (workers != NULL) {
+      workers_sync(workers, threads);
    }
 
+   reporter_submit(&reporter, sets, window_start, time_now());
 
    /* Cleanup */
    /* Alarm has to be cancelled before cleanup */
    alarm(0);
 
-   free(ip_string2);
-   free(ip_string);
-
-   if (port_set != -1) {
-      for (int i = 0; i < port_cnt; i++) {
-         free(sorted_array_of_bytes_port[i]);
-         free(array_of_bytes_port[i]);
-         free(sorted_array_of_packets_port[i]);
-         free(array_of_packets_port[i]);
-      }
-
-      free(array_of_bytes_port);
-      free(sorted_array_of_bytes_port);
-      free(array_of_packets_port);
-      free(sorted_array_of_packets_port);
-
-      free(array_counter_port);
-
-      free(port);
-   }
-
-   free(record_bytes);
-   free(sorted_array_of_bytes);
-   free(array_of_bytes);
-   free(record_packets);
-   free(sorted_array_of_packets);
-   free(array_of_packets);
-
-
-   free(array_of_ports);
-
-   if (port_set != -1) {
-      for (int i = 0; i < port_cnt; i++) {
-         free(array_of_ports_port[i]);
-      }
-      free(array_of_ports_port);
-   }
-
-   free(record_ip);
-
-
-   fhf_destroy(table_pab);
-   fhf_destroy_iter(iter_pab);
+   workers_stop(workers, threads);
+   reporter_stop(&reporter);
 
-   fht_destroy(table_flows);
-   fht_destroy_iter(iter_flows);
-
-   if (port_set != -1)  {
-      for (int i = 0; i < port_cnt; i++) {
-         fhf_destroy(table_pab_port[i]);
-         fhf_destroy_iter(iter_pab_port[i]);
-
-         fht_destroy(table_flows_port[i]);
-         fht_destroy_iter(iter_flows_port[i]);
-      }
-
-      free(table_pab_port);
-      free(iter_pab_port);
-
-      free(table_flows_port);
-      free(iter_flows_port);
+   if (out_tmplt != NULL) {
+      trap_send(0, "", 1);
+      ur_free_template(out_tmplt);
    }
 
-   free(key_lost);
-   free(data_lost);
-
-   if (prefix_set == 1) {
-      fht_destroy(table_prefix_flows);
-      fht_destroy_iter(iter_prefix_flows);
-
-      fhf_destroy(table_prefix_pab);
-      fhf_destroy_iter(iter_prefix_pab);
-
-      if (prefix_only_v4 == -1) {
-         fht_destroy(table_prefix_flows_v6);
-         fht_destroy_iter(iter_prefix_flows_v6);
-
-         fhf_destroy(table_prefix_pab_v6);
-         fhf_destroy_iter(iter_prefix_pab_v6);
-      }
-
-      if (port_set != -1) {
-         for (int i = 0; i < port_cnt; i++) {
-            fhf_destroy(table_prefix_pab_port[i]);
-            fhf_destroy_iter(iter_prefix_pab_port[i]);
-
-            fht_destroy(table_prefix_flows_port[i]);
-            fht_destroy_iter(iter_prefix_flows_port[i]);
-
-            if (prefix_only_v4 == -1) {
-               fhf_destroy(table_prefix_pab_port_v6[i]);
-               fhf_destroy_iter(iter_prefix_pab_port_v6[i]);
-
-               fht_destroy(table_prefix_flows_port_v6[i]);
-               fht_destroy_iter(iter_prefix_flows_port_v6[i]);
-            }
-         }
-
-         free(table_prefix_pab_port);
-         free(iter_prefix_pab_port);
-
-         free(table_prefix_flows_port);
-         free(iter_prefix_flows_port);
-
-         if (prefix_only_v4 == -1) {
-            free(table_prefix_pab_port_v6);
-            free(iter_prefix_pab_port_v6);
-
-            free(table_prefix_flows_port_v6);
-            free(iter_prefix_flows_port_v6);
-         }
-      }
+   for (int i = 0; i < set_cnt; i++) {
+      stats_set_destroy(sets[i]);
    }
+   free(sets);
+   free(port);
 
    /* Trap cleanup before exiting */
    TRAP_DEFAULT_FINALIZATION();
@@ -811,139 +370,53 @@ void sig_handler(int signal)
    print_stats = 1;
 }
 
-int get_array_index(uint32_t key, flow_t **sorted_array, size_t num) {
-   if (sorted_array[0]->max_number > key) {
-      return -1;
-   }
-
-   /**
-   * In case sorted_array has less than 4 elements, I process it manually.
-   * It's because main algorithm (see below) doesn't work well for 1, 2 and 3 members.
-   */
-
-   if (num == 1) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else {
-         return 0;
-      }
-   }
-
-   if (num == 2) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else if (sorted_array[0]->max_number < key) {
-         if (sorted_array[1]->max_number > key) {
-            return 0;
-         } else if (sorted_array[1]->max_number == key) {
-            return 0;
-         } else {
-            return 1;
-         }
-      }
-   }
-
-   if (num == 3) {
-      if (sorted_array[0]->max_number > key) {
-         return -1;
-      } else if (sorted_array[0]->max_number < key) {
-         if (sorted_array[1]->max_number > key) {
-            return 0;
-         } else if (sorted_array[1]->max_number == key) {
-            return 0;
-         } else {
-            if (sorted_array[2]->max_number > key) {
-               return 1;
-            } else if (sorted_array[2]->max_number == key) {
-               return 1;
-            } else {
-               return 2;
-            }
-         }
-      }
-   }
-
-   int first = 0;
-   int last = num -1;
-   int middle = (first + last) / 2;
-
-   while (first <= last) {
-      if (sorted_array[middle]->max_number < key) {
-         first = middle + 1;
-      } else if (sorted_array[middle]->max_number == key) {
-         while (sorted_array[middle]->max_number == key) {
-            if (middle == 0) {
-               return -1;
-            }
-            middle--;
-         }
-         return middle;
-      } else {
-         last = middle - 1;
-      }
-
-      middle = (first + last) / 2;
-   }
+ur_time_t time_now(void)
+{
+   struct timespec now;
 
-   if (first > last) {
-      if (last == -1) {
-         return -1;
-      } else if (first -1 != -1) {
-         return first -1;
-      }
-   }
-   return -1;
+   clock_gettime(CLOCK_REALTIME, &now);
+   return ur_time_from_sec_msec(now.tv_sec, now.tv_nsec / 1000000);
 }
 
-void process_flows(flow_t *array, flow_t **sorted_array, flow_t *record, int array_counter)
+void process_flows(flow_t *heap, flow_t *record, int array_counter)
 {
-   int array_index;
-
-   if (array_counter == 0) {
-      sorted_array[0] = memmove(&array[0], record, sizeof(flow_t));
-   } else if (array_counter < topn) {
-      array_index = get_array_index (record->max_number, sorted_array, array_counter);
-
-      if (array_counter == 1) {
-         if (array_index == -1) {
-            sorted_array[1] = sorted_array[0];
-            sorted_array[0] = memmove(&array[1], record, sizeof(flow_t));
-         } else {
-            sorted_array[1] = memmove(&array[1], record, sizeof(flow_t));
+   int i;
+
+   if (array_counter < topn) {
+      /* Heap is not full, new flow is added as a leaf and moved up */
+      i = array_counter;
+      while (i > 0 && heap[(i - 1) / 2].max_number > record->max_number) {
+         heap[i] = heap[(i - 1) / 2];
+         i = (i - 1) / 2;
+      }
+      heap[i] = *record;
+   } else if (record->max_number > heap[0].max_number) {
+      /* The smallest flow is replaced, new flow is moved down */
+      i = 0;
+      for (;;) {
+         int child = 2 * i + 1;
+         if (child >= topn) {
+            break;
          }
-      } else {
-         if (array_index == -1) {
-            for (int i = array_counter; i > 0; i--) {
-               sorted_array[i] = sorted_array[i-1];
-            }
-
-            sorted_array[0] = memmove(&array[array_counter], record, sizeof(flow_t));
-         } else if (array_index != -1) {
-            for (int i = array_counter; i > array_index + 1; i--) {
-               sorted_array[i] = sorted_array[i-1];
-            }
-
-            sorted_array[array_index + 1] = memmove(&array[array_counter], record, sizeof(flow_t));
-
+         if (child + 1 < topn && heap[child + 1].max_number < heap[child].max_number) {
+            child++;
          }
-      }
-   } else if (array_counter == topn) {
-      array_index = get_array_index (record->max_number, sorted_array, array_counter);
-
-      if (array_index != -1) {
-         flow_t *temp = sorted_array[0];
-
-         for (int i = 0; i < array_index; i++) {
-            sorted_array[i] = sorted_array[i + 1];
+         if (heap[child].max_number >= record->max_number) {
+            break;
          }
-
-         sorted_array[array_index] = memmove(temp, record, sizeof(flow_t));
+         heap[i] = heap[child];
+         i = child;
       }
+      heap[i] = *record;
    }
 }
 
-void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_packets, int array_counter, char *ip_string, char *ip_string2, int port_number)
+void print_top_flows(flow_t *heap_of_bytes, flow_t *heap_of_packets, int array_counter, char *ip_string, char *ip_string2, int port_number)
 {
+   /* Array sorted in ascending order is still a valid heap */
+   qsort(heap_of_bytes, array_counter, sizeof(flow_t), compare_max_number);
+   qsort(heap_of_packets, array_counter, sizeof(flow_t), compare_max_number);
+
    printf("\n");
    if (port_number == -1) {
       printf("Top flows based on transferred bytes\n");
@@ -955,11 +428,11 @@ void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_pa
 
    int y = 0;
    for (int i = array_counter-1; i >= 0; y++, i--) {
-      ip_to_str(&sorted_array_of_bytes[i]->src_ip, ip_string);
-      ip_to_str(&sorted_array_of_bytes[i]->dst_ip, ip_string2);
+      ip_to_str(&heap_of_bytes[i].src_ip, ip_string);
+      ip_to_str(&heap_of_bytes[i].dst_ip, ip_string2);
 
       printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", y + 1, ip_string, ip_string2,
-      sorted_array_of_bytes[i]->src_port, sorted_array_of_bytes[i]->dst_port, sorted_array_of_bytes[i]->protocol,sorted_array_of_bytes[i]->max_number);
+      heap_of_bytes[i].src_port, heap_of_bytes[i].dst_port, heap_of_bytes[i].protocol, heap_of_bytes[i].max_number);
    }
 
    printf("\n");
@@ -973,176 +446,381 @@ void print_top_flows(flow_t **sorted_array_of_bytes, flow_t **sorted_array_of_pa
 
    y=0;
    for (int i = array_counter-1; i >= 0; y++, i--) {
-      ip_to_str(&sorted_array_of_packets[i]->src_ip, ip_string);
-      ip_to_str(&sorted_array_of_packets[i]->dst_ip, ip_string2);
+      ip_to_str(&heap_of_packets[i].src_ip, ip_string);
+      ip_to_str(&heap_of_packets[i].dst_ip, ip_string2);
 
       printf("%d\t%s\t%s\t%d\t%d\t%d\t%u\n", y + 1, ip_string, ip_string2,
-      sorted_array_of_packets[i]->src_port, sorted_array_of_packets[i]->dst_port, sorted_array_of_packets[i]->protocol, sorted_array_of_packets[i]->max_number);
+      heap_of_packets[i].src_port, heap_of_packets[i].dst_port, heap_of_packets[i].protocol, heap_of_packets[i].max_number);
    }
 }
 
-void print_top_ports(port_t *array_of_ports, int port_number)
+void print_top_ports(const ports_t *ports, int port_number)
 {
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_flows);
-   printf("\n");
-   if (port_number == -1) {
-      printf("Top ports based on transferred flows\n");
-   } else {
-      printf("Top ports based on transferred flows who communicated the most with port %d\n", port_number);
-   }
-   printf("------------------------------------\n");
-   printf("N\tPort\tFlows\n");
+   static const char *metric_names[] = {"flows", "packets", "bytes"};
+   static const char *column_names[] = {"Flows", "Packets", "Bytes"};
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].flows == 0) {
-         break;
-      }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].flows);
+   top_item_t *top = malloc(topn * sizeof(top_item_t));
+   if (top == NULL) {
+      malloc_err();
    }
 
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_packets);
-   printf("\n");
-   if (port_number == -1) {
-      printf("Top ports based on transferred packets\n");
-   } else {
-      printf("Top ports based on transferred packets who communicated the most with port %d\n", port_number);
-   }
-   printf("------------------------------------\n");
-   printf("N\tPort\tPackets\n");
+   for (int m = 0; m < 3; m++) {
+      int size = select_top_ports(ports, m, top);
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].packets == 0) {
-         break;
+      printf("\n");
+      if (port_number == -1) {
+         printf("Top ports based on transferred %s\n", metric_names[m]);
+      } else {
+         printf("Top ports based on transferred %s who communicated the most with port %d\n", metric_names[m], port_number);
       }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].packets);
-   }
-
-   qsort (array_of_ports, 65536, sizeof(port_t), compare_bytes);
-   printf("\n");
-   if (port_number == -1) {
-      printf("Top ports based on transferred bytes\n");
-   } else {
-      printf("Top ports based on transferred bytes who communicated the most with port %d\n", port_number);
-   }
-   printf("------------------------------------\n");
-   printf("N\tPort\tBytes\n");
+      printf("------------------------------------\n");
+      printf("N\tPort\t%s\n", column_names[m]);
 
-   for (int i = 0; i < topn; i++) {
-      if (array_of_ports[i].bytes == 0) {
-         break;
+      for (int i = 0; i < size; i++) {
+         printf("%d\t%u\t%" PRIu64 "\n", i + 1, top[i].index, top[i].value);
       }
-      printf("%d\t%u\t%" PRIu64 "\n", i + 1, array_of_ports[i].port, array_of_ports[i].bytes);
    }
+   free(top);
 }
 
-void print_top_ip(char *ip_string, fhf_table_t *table_pab, fhf_iter_t *iter_pab, fht_table_t *table_flows, fht_iter_t *iter_flows, int port_number, int prefix_set)
+void print_top_ip(char *ip_string, ip_top_t **tops, int top_cnt, int port_number, int prefix_set)
 {
-   ip_t *ip_array = (void *) &(table_flows->data_field[0]);
-   int number_of_records = 0;
-
-   /* Flows */
-   while (fht_get_next_iter(iter_flows) != FHF_ITER_RET_END) {
-      ip_t *entry = (void *) &iter_flows->data_ptr[0];
-      ip_addr_t *address = (void *) &iter_flows->key_ptr[0];
+   static const char *metric_names[] = {"flows", "packets", "bytes"};
+   static const char *column_names[] = {"Flows", "Packets", "Bytes"};
+   uint32_t records = 0;
 
-      ip_array[number_of_records].flows = entry->flows;
-      ip_array[number_of_records].packets = entry->packets;
-      ip_array[number_of_records].bytes = entry->bytes;
-      ip_array[number_of_records].src_ip = address[0];
-
-      number_of_records++;
+   for (int t = 0; t < top_cnt; t++) {
+      records += tops[t]->flows->size;
    }
-
-   if (number_of_records == 0) {
+   if (records == 0) {
       return;
    }
 
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_flows_table);
-   printf("\n");
-   if (prefix_set == 0) {
-      if (port_number == -1) {
-         printf("Top IPs based on transferred flows\n");
-      } else {
-         printf("Top IPs based on transferred flows by port %d\n", port_number);
-      }
-   } else {
+   top_item_t *selected = malloc(topn * sizeof(top_item_t));
+   if (selected == NULL) {
+      malloc_err();
+   }
+
+   for (int m = 0; m < 3; m++) {
+      uint64_t max_error;
+      int size = select_top_ip(tops, top_cnt, m, selected, &max_error);
+
+      printf("\n");
       if (port_number == -1) {
-         printf("Top networks based on transferred flows\n");
+         printf("Top %s based on transferred %s\n", prefix_set == 0 ? "IPs" : "networks", metric_names[m]);
       } else {
-         printf("Top networks based on transferred flows by port %d\n", port_number);
+         printf("Top %s based on transferred %s by port %d\n", prefix_set == 0 ? "IPs" : "networks", metric_names[m], port_number);
+      }
+      printf("------------------------------------\n");
+      if (max_error > 0) {
+         printf("Counts are overestimated by at most %" PRIu64 "\n", max_error);
+      }
+      printf("N\tIP\t\t%s\n", column_names[m]);
+
+      for (int i = 0; i < size; i++) {
+         ip_to_str(&selected_ip(tops, m, &selected[i])->key, ip_string);
+         printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, selected[i].value);
       }
    }
-   printf("------------------------------------\n");
-   printf("N\tIP\t\tFlows\n");
+   free(selected);
+}
+
+/* Record of one ranked entry is cleared and filled with fields common to the whole statistic */
+static void report_record_init(reporter_t *reporter, uint8_t type, uint8_t metric, int port_number, int rank)
+{
+   void *rec = reporter->out_rec;
+
+   memset(rec, 0, ur_rec_fixlen_size(reporter->out_tmplt));
+   ur_set(reporter->out_tmplt, rec, F_TIME_FIRST, reporter->window_start);
+   ur_set(reporter->out_tmplt, rec, F_TIME_LAST, reporter->window_end);
+   ur_set(reporter->out_tmplt, rec, F_TOPN_TYPE, type);
+   ur_set(reporter->out_tmplt, rec, F_TOPN_METRIC, metric);
+   ur_set(reporter->out_tmplt, rec, F_TOPN_PORT, port_number);
+   ur_set(reporter->out_tmplt, rec, F_TOPN_RANK, rank);
+}
+
+/* Record lost by timeout is skipped, after a fatal error the module stops and no more records are sent */
+static void report_record_send(reporter_t *reporter)
+{
+   if (reporter->send_failed) {
+      return;
+   }
 
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].flows);
+   int ret = trap_send(0, reporter->out_rec, ur_rec_fixlen_size(reporter->out_tmplt));
+   TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, return, {reporter->send_failed = 1; stop = 1; return;});
+}
+
+void send_top_flows(reporter_t *reporter, flow_t *heap_of_bytes, flow_t *heap_of_packets, int array_counter, int port_number)
+{
+   flow_t *heaps[] = {heap_of_packets, heap_of_bytes};
+   void *rec = reporter->out_rec;
+
+   for (int h = 0; h < 2; h++) {
+      /* Array sorted in ascending order is still a valid heap */
+      qsort(heaps[h], array_counter, sizeof(flow_t), compare_max_number);
+
+      for (int i = array_counter - 1, rank = 1; i >= 0; i--, rank++) {
+         flow_t *flow = &heaps[h][i];
+
+         report_record_init(reporter, REPORT_FLOWS, h + 1, port_number, rank);
+         ur_set(reporter->out_tmplt, rec, F_SRC_IP, flow->src_ip);
+         ur_set(reporter->out_tmplt, rec, F_DST_IP, flow->dst_ip);
+         ur_set(reporter->out_tmplt, rec, F_SRC_PORT, flow->src_port);
+         ur_set(reporter->out_tmplt, rec, F_DST_PORT, flow->dst_port);
+         ur_set(reporter->out_tmplt, rec, F_PROTOCOL, flow->protocol);
+         ur_set(reporter->out_tmplt, rec, F_TOPN_FLOWS, 1);
+         if (h == 0) {
+            ur_set(reporter->out_tmplt, rec, F_TOPN_PACKETS, flow->max_number);
+         } else {
+            ur_set(reporter->out_tmplt, rec, F_TOPN_BYTES, flow->max_number);
+         }
+         report_record_send(reporter);
+      }
    }
+}
 
+void send_top_ports(reporter_t *reporter, const ports_t *ports, int port_number)
+{
+   void *rec = reporter->out_rec;
 
-   /* Packets */
-   ip_array = (void *) &(table_pab->data_field[0]);
-   number_of_records = 0;
+   top_item_t *top = malloc(topn * sizeof(top_item_t));
+   if (top == NULL) {
+      malloc_err();
+   }
 
-   while (fhf_get_next_iter(iter_pab) != FHF_ITER_RET_END) {
-      ip_t *entry = (ip_t *) &iter_pab->data_ptr[0];
-      ip_addr_t *address = (ip_addr_t *) &iter_pab->key_ptr[0];
+   for (int m = 0; m < 3; m++) {
+      int size = select_top_ports(ports, m, top);
 
-      ip_array[number_of_records].flows = entry->flows;
-      ip_array[number_of_records].packets = entry->packets;
-      ip_array[number_of_records].bytes = entry->bytes;
-      ip_array[number_of_records].src_ip = address[0];
+      for (int i = 0; i < size; i++) {
+         const port_t *stats = &ports->stats[top[i].index];
 
-      number_of_records++;
+         report_record_init(reporter, REPORT_PORTS, m, port_number, i + 1);
+         ur_set(reporter->out_tmplt, rec, F_PORT, top[i].index);
+         ur_set(reporter->out_tmplt, rec, F_TOPN_FLOWS, stats->flows);
+         ur_set(reporter->out_tmplt, rec, F_TOPN_PACKETS, stats->packets);
+         ur_set(reporter->out_tmplt, rec, F_TOPN_BYTES, stats->bytes);
+         report_record_send(reporter);
+      }
    }
+   free(top);
+}
 
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_packets_table);
-   printf("\n");
-   if (prefix_set == 0) {
-      if (port_number == -1) {
-         printf("Top IPs based on transferred packets\n");
+void send_top_ip(reporter_t *reporter, ip_top_t **tops, int top_cnt, int port_number, int prefix_set)
+{
+   void *rec = reporter->out_rec;
+
+   top_item_t *selected = malloc(topn * sizeof(top_item_t));
+   if (selected == NULL) {
+      malloc_err();
+   }
+
+   for (int m = 0; m < 3; m++) {
+      uint64_t max_error;
+      int size = select_top_ip(tops, top_cnt, m, selected, &max_error);
+
+      for (int i = 0; i < size; i++) {
+         report_record_init(reporter, prefix_set == 0 ? REPORT_IPS : REPORT_NETWORKS, m, port_number, i + 1);
+         ur_set(reporter->out_tmplt, rec, F_SRC_IP, selected_ip(tops, m, &selected[i])->key);
+         if (m == 0) {
+            ur_set(reporter->out_tmplt, rec, F_TOPN_FLOWS, selected[i].value);
+         } else if (m == 1) {
+            ur_set(reporter->out_tmplt, rec, F_TOPN_PACKETS, selected[i].value);
+         } else {
+            ur_set(reporter->out_tmplt, rec, F_TOPN_BYTES, selected[i].value);
+         }
+         report_record_send(reporter);
+      }
+   }
+   free(selected);
+}
+
+static int slot_port(int slot)
+{
+   return slot == 0 ? -1 : port[slot - 1];
+}
+
+void report_stats(reporter_t *reporter)
+{
+   top_stats_t **sets = reporter->sets;
+   int set_cnt = reporter->set_cnt;
+   flow_t *heap_of_bytes = malloc(topn * sizeof(flow_t));
+   flow_t *heap_of_packets = malloc(topn * sizeof(flow_t));
+   ip_top_t **tops = malloc(set_cnt * sizeof(ip_top_t *));
+
+   if (heap_of_bytes == NULL || heap_of_packets == NULL || tops == NULL) {
+      malloc_err();
+   }
+
+   /* Stats of all flows are followed by stats of every watched port */
+   for (int s = 0; s <= port_cnt; s++) {
+      int array_counter = merge_flows(sets, set_cnt, s, heap_of_bytes, heap_of_packets);
+
+      if (reporter->out_tmplt != NULL) {
+         send_top_flows(reporter, heap_of_bytes, heap_of_packets, array_counter, slot_port(s));
       } else {
-         printf("Top IPs based on transferred packets by port %d\n", port_number);
+         print_top_flows(heap_of_bytes, heap_of_packets, array_counter, reporter->ip_string, reporter->ip_string2, slot_port(s));
       }
-   } else {
-      if (port_number == -1) {
-         printf("Top networks based on transferred packets\n");
+   }
+
+   for (int s = 0; s <= port_cnt; s++) {
+      const ports_t *ports = merge_ports(sets, set_cnt, s, reporter->merged_ports);
+
+      if (reporter->out_tmplt != NULL) {
+         send_top_ports(reporter, ports, slot_port(s));
       } else {
-         printf("Top networks based on transferred packets by port %d\n", port_number);
+         print_top_ports(ports, slot_port(s));
       }
    }
-   printf("------------------------------------\n");
-   printf("N\tIP\t\tPackets\n");
 
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].packets);
+   /* Summaries of IPs, IPv4 networks and IPv6 networks */
+   for (int type = 0; type < 3; type++) {
+      if ((type > 0 && prefix_set != 1) || (type == 2 && prefix_only_v4 != -1)) {
+         break;
+      }
+
+      for (int s = 0; s <= port_cnt; s++) {
+         for (int w = 0; w < set_cnt; w++) {
+            tops[w] = type == 0 ? sets[w][s].top_ip : (type == 1 ? sets[w][s].top_prefix : sets[w][s].top_prefix_v6);
+         }
+
+         if (reporter->out_tmplt != NULL) {
+            send_top_ip(reporter, tops, set_cnt, slot_port(s), type > 0);
+         } else {
+            print_top_ip(reporter->ip_string, tops, set_cnt, slot_port(s), type > 0);
+         }
+      }
    }
 
+   free(heap_of_bytes);
+   free(heap_of_packets);
+   free(tops);
+}
 
-   /* Bytes */
-   qsort (ip_array, number_of_records, sizeof(ip_t), compare_bytes_table);
-   printf("\n");
-   if (prefix_set == 0) {
-      if (port_number == -1) {
-         printf("Top IPs based on transferred bytes\n");
-      } else {
-         printf("Top IPs based on transferred bytes by port %d\n", port_number);
+static void *reporter_thread(void *arg)
+{
+   reporter_t *reporter = (reporter_t *) arg;
+   char time_print_buff[128];
+   time_t time_print;
+
+   pthread_mutex_lock(&reporter->lock);
+   while (1) {
+      while (!reporter->pending && !reporter->stop) {
+         pthread_cond_wait(&reporter->cond, &reporter->lock);
       }
-   } else {
-      if (port_number == -1) {
-         printf("Top networks based on transferred bytes\n");
+      if (!reporter->pending) {
+         break;
+      }
+      pthread_mutex_unlock(&reporter->lock);
+
+      if (reporter->out_tmplt != NULL) {
+         report_stats(reporter);
+         trap_send_flush(0);
       } else {
-         printf("Top networks based on transferred bytes by port %d\n", port_number);
+         time_print = ur_time_get_sec(reporter->window_end);
+         strftime(time_print_buff, 128, "%Y-%m-%d %H:%M:%S", localtime (&time_print));
+         printf ("\n===================\n%s\n===================\n", time_print_buff);
+
+         report_stats(reporter);
+         fflush(stdout);
       }
+
+      for (int i = 0; i < reporter->set_cnt; i++) {
+         stats_set_clear(reporter->sets[i]);
+      }
+
+      pthread_mutex_lock(&reporter->lock);
+      reporter->pending = 0;
+      pthread_cond_broadcast(&reporter->cond);
    }
-   printf("------------------------------------\n");
-   printf("N\tIP\t\tBytes\n");
+   pthread_mutex_unlock(&reporter->lock);
+   return NULL;
+}
+
+int reporter_start(reporter_t *reporter, int set_cnt, ur_template_t *out_tmplt)
+{
+   memset(reporter, 0, sizeof(reporter_t));
+   reporter->set_cnt = set_cnt;
+   reporter->out_tmplt = out_tmplt;
+   reporter->sets = calloc(set_cnt, sizeof(top_stats_t *));
+   reporter->ip_string = malloc(INET6_ADDRSTRLEN);
+   reporter->ip_string2 = malloc(INET6_ADDRSTRLEN);
+
+   if (reporter->sets == NULL || reporter->ip_string == NULL || reporter->ip_string2 == NULL) {
+      malloc_err();
+   }
+
+   for (int i = 0; i < set_cnt; i++) {
+      reporter->sets[i] = stats_set_init();
 
-   for (int i = 0; i < topn && i < number_of_records; i++) {
-      ip_to_str(&ip_array[i].src_ip, ip_string);
-      printf("%d\t%s\t%" PRIu64 "\n", i + 1, ip_string, ip_array[i].bytes);
+      if (reporter->sets[i] == NULL) {
+         malloc_err();
+      }
+   }
+
+   /* Stats of ports of all threads are summed before reporting */
+   if (set_cnt > 1) {
+      reporter->merged_ports = calloc(1, sizeof(ports_t));
+
+      if (reporter->merged_ports == NULL) {
+         malloc_err();
+      }
+   }
+
+   if (out_tmplt != NULL) {
+      reporter->out_rec = ur_create_record(out_tmplt, 0);
+
+      if (reporter->out_rec == NULL) {
+         malloc_err();
+      }
+   }
+
+   pthread_mutex_init(&reporter->lock, NULL);
+   pthread_cond_init(&reporter->cond, NULL);
+   if (pthread_create(&reporter->thread, NULL, reporter_thread, reporter) != 0) {
+      return -1;
+   }
+   return 0;
+}
+
+void reporter_submit(reporter_t *reporter, top_stats_t **sets, ur_time_t window_start, ur_time_t window_end)
+{
+   pthread_mutex_lock(&reporter->lock);
+   while (reporter->pending) {
+      pthread_cond_wait(&reporter->cond, &reporter->lock);
+   }
+
+   for (int i = 0; i < reporter->set_cnt; i++) {
+      top_stats_t *tmp = reporter->sets[i];
+
+      reporter->sets[i] = sets[i];
+      sets[i] = tmp;
+   }
+   reporter->window_start = window_start;
+   reporter->window_end = window_end;
+   reporter->pending = 1;
+   pthread_cond_broadcast(&reporter->cond);
+   pthread_mutex_unlock(&reporter->lock);
+}
+
+void reporter_stop(reporter_t *reporter)
+{
+   pthread_mutex_lock(&reporter->lock);
+   reporter->stop = 1;
+   pthread_cond_broadcast(&reporter->cond);
+   pthread_mutex_unlock(&reporter->lock);
+   pthread_join(reporter->thread, NULL);
+
+   pthread_mutex_destroy(&reporter->lock);
+   pthread_cond_destroy(&reporter->cond);
+   for (int i = 0; i < reporter->set_cnt; i++) {
+      stats_set_destroy(reporter->sets[i]);
+   }
+   free(reporter->sets);
+   free(reporter->merged_ports);
+   free(reporter->ip_string);
+   free(reporter->ip_string2);
+   if (reporter->out_rec != NULL) {
+      ur_free_record(reporter->out_rec);
    }
 }
 
@@ -1230,11 +908,15 @@ int process_ports_args(char *optarg) {
 
       port[port_cnt] = strtol(token, &end, 10);
 
-      if (port[port_cnt] == 0 && end == token) {
+      if ((port[port_cnt] == 0 && end == token) || port[port_cnt] < 0 || port[port_cnt] > 65535) {
          return -1;
       }
 
-      port_cnt++;
+      /* Port given more times is watched only once */
+      if (port_slot[port[port_cnt]] == 0) {
+         port_slot[port[port_cnt]] = port_cnt + 1;
+         port_cnt++;
+      }
       token = strtok(NULL, ",");
    }
 
@@ -1244,155 +926,440 @@ int process_ports_args(char *optarg) {
 }
 
 
-void process_ip_flows(fht_table_t *table_flows, ip_addr_t *ip, ip_t *record, ip_addr_t *key_lost, ip_t *data_lost, const void *data, ur_template_t *tmplt)
+uint32_t ip_counters(uint32_t counters)
 {
-   ip_t *record2 = NULL;
-   uint64_t table_row;
-   uint64_t table_col_row;
-   int ret;
-   int removed = 0;
+   if (counters < (uint32_t) topn * IP_COUNTERS_PER_N) {
+      return (uint32_t) topn * IP_COUNTERS_PER_N;
+   }
+   return counters;
+}
+
+ip_top_t *ip_top_init(uint32_t counters)
+{
+   ip_top_t *top = malloc(sizeof(ip_top_t));
+
+   if (top == NULL) {
+      return NULL;
+   }
+   top->flows = ss_init(counters);
+   top->packets = ss_init(counters);
+   top->bytes = ss_init(counters);
+   if (top->flows == NULL || top->packets == NULL || top->bytes == NULL) {
+      ip_top_destroy(top);
+      return NULL;
+   }
+   return top;
+}
 
-   int random = randomMT() % FLOWS_RANDOM_MAX;
+void ip_top_clear(ip_top_t *top)
+{
+   ss_clear(top->flows);
+   ss_clear(top->packets);
+   ss_clear(top->bytes);
+}
+
+void ip_top_destroy(ip_top_t *top)
+{
+   if (top == NULL) {
+      return;
+   }
+   ss_destroy(top->flows);
+   ss_destroy(top->packets);
+   ss_destroy(top->bytes);
+   free(top);
+}
+
+void process_ip(ip_top_t *top, const ip_addr_t *ip, uint64_t packets, uint64_t bytes)
+{
+   ss_update(top->flows, ip, 1);
+   ss_update(top->packets, ip, packets);
+   ss_update(top->bytes, ip, bytes);
+}
+
+void process_port(ports_t *ports, uint16_t port_number, uint64_t packets, uint64_t bytes)
+{
+   port_t *stats = &ports->stats[port_number];
+
+   if (stats->flows == 0) {
+      ports->used[ports->used_cnt++] = port_number;
+   }
+   stats->flows += 1;
+   stats->packets += packets;
+   stats->bytes += bytes;
+}
+
+void ports_clear(ports_t *ports)
+{
+   for (uint32_t i = 0; i < ports->used_cnt; i++) {
+      memset(&ports->stats[ports->used[i]], 0, sizeof(port_t));
+   }
+   ports->used_cnt = 0;
+}
 
-   if ((record2 = fht_get_data(table_flows, ip)) == NULL) {
-      if (random < FLOWS_RANDOM) {
-         ret = fht_insert(table_flows, ip, record, key_lost, data_lost);
+void ports_merge(ports_t *dst, const ports_t *src)
+{
+   for (uint32_t i = 0; i < src->used_cnt; i++) {
+      const port_t *from = &src->stats[src->used[i]];
+      port_t *to = &dst->stats[src->used[i]];
 
-         if (ret == FHT_INSERT_LOST) {
-            table_row = (table_flows->table_rows - 1) & (table_flows->hash_function)(ip, table_flows->key_size);
-            table_col_row = table_row *FHT_TABLE_COLS;
+      if (to->flows == 0) {
+         dst->used[dst->used_cnt++] = src->used[i];
+      }
+      to->flows += from->flows;
+      to->packets += from->packets;
+      to->bytes += from->bytes;
+   }
+}
 
-            int timediff = (int) difftime(time(NULL), time1);
-            timediff = (timediff / FLOWS_TIME_INTERVAL) + 1;
+int merge_flows(top_stats_t **sets, int set_cnt, int slot, flow_t *heap_of_bytes, flow_t *heap_of_packets)
+{
+   int array_counter = 0;
 
-            for (int i = 0; i < FHT_TABLE_COLS; i++) {
-               if (((ip_t *) &(table_flows->data_field[(table_col_row + i) * table_flows->data_size]))->flows < FLOWS_MULTIPLIER * timediff && (ip_cmp(ip, ((ip_addr_t*) &(table_flows->key_field[(table_col_row + i) * table_flows->key_size]))) != 0)) {
-                  fht_remove(table_flows, ((ip_addr_t*) &(table_flows->key_field[(table_col_row + i) * table_flows->key_size])));
-                  removed = 1;
-               }
-            }
+   /* Every flow is processed by one thread, top N flows are among top N flows of threads */
+   for (int w = 0; w < set_cnt; w++) {
+      top_stats_t *stats = &sets[w][slot];
 
-            if (removed == 1) {
-               if (data_lost->flows >= FLOWS_BIG_BASE + timediff * FLOWS_BIG_MULTIPLIER) {
-                  fht_insert(table_flows, &data_lost->src_ip, data_lost, key_lost, data_lost);
-               }
-            }
+      for (int i = 0; i < stats->array_counter; i++) {
+         process_flows(heap_of_bytes, &stats->heap_of_bytes[i], array_counter);
+         process_flows(heap_of_packets, &stats->heap_of_packets[i], array_counter);
+         if (array_counter < topn) {
+            array_counter++;
          }
       }
-   } else {
-      record2->bytes += ur_get(tmplt, data, F_BYTES);
-      record2->packets += ur_get(tmplt, data, F_PACKETS);
-      record2->flows += 1;
    }
+   return array_counter;
 }
 
-void process_ip_pab(fhf_table_t *table_pab, ip_addr_t *ip, ip_t *record, const void *data, ur_template_t *tmplt, int average_packets, int average_bytes)
+const ports_t *merge_ports(top_stats_t **sets, int set_cnt, int slot, ports_t *merged_ports)
 {
-   ip_t *record2 = NULL;
-   uint64_t table_row;
-   uint64_t table_col_row;
-   int ret;
-   int removed = 0;
+   if (set_cnt == 1) {
+      return sets[0][slot].ports;
+   }
 
-   if (fhf_get_data(table_pab, ip, (void *) &record2) == FHF_FOUND) {
-      record2->bytes += ur_get(tmplt, data, F_BYTES);
-      record2->packets += ur_get(tmplt, data, F_PACKETS);
-      record2->flows += 1;
-   } else {
-      ret = fhf_insert(table_pab, ip, record);
+   ports_clear(merged_ports);
+   for (int w = 0; w < set_cnt; w++) {
+      ports_merge(merged_ports, sets[w][slot].ports);
+   }
+   return merged_ports;
+}
 
-      if (ret == FHF_INSERT_FULL) {
-         table_row = (table_pab->table_rows - 1) & (table_pab->hash_function)(ip, table_pab->key_size, (uint64_t) table_pab);
-         table_col_row = table_row *FHF_TABLE_COLS;
+int select_top_ports(const ports_t *ports, int metric, top_item_t *top)
+{
+   int size = 0;
 
-         int timediff = (int) difftime(time(NULL), time1);
-         timediff = (timediff / PAB_TIME_INTERVAL) + 1;
+   for (uint32_t i = 0; i < ports->used_cnt; i++) {
+      const port_t *stats = &ports->stats[ports->used[i]];
+      uint64_t value = metric == 0 ? stats->flows : (metric == 1 ? stats->packets : stats->bytes);
 
-         for (int i = 0; i < FHF_TABLE_COLS; i++) {
-            if (((ip_t *) &(table_pab->data_field[(table_col_row + i) *table_pab->data_size]))->packets < average_packets * (PAB_BASE + timediff * PAB_MULTIPLIER) &&
-            ((ip_t *) &(table_pab->data_field[(table_col_row + i) * table_pab->data_size]))->bytes < average_bytes * (PAB_BASE + timediff * PAB_MULTIPLIER)) {
-               fhf_remove(table_pab, ((ip_addr_t*) (&(table_pab->key_field[(table_col_row + i) * table_pab->key_size]))));
-               removed = 1;
-            }
-         }
+      size = top_push(top, size, topn, value, ports->used[i]);
+   }
+   top_sort(top, size);
+   return size;
+}
 
-         if (removed == 1) {
-            if (ur_get(tmplt, data, F_PACKETS) > average_packets * PAB_BASE || ur_get(tmplt, data, F_BYTES) > average_bytes * (PAB_BASE * 2)) {
-               fhf_insert(table_pab, ip, record);
-            }
-         }
+int select_top_ip(ip_top_t **tops, int top_cnt, int metric, top_item_t *selected, uint64_t *max_error)
+{
+   uint32_t capacity = ip_top_table(tops[0], metric)->capacity;
+   int size = 0;
+
+   *max_error = 0;
+
+   /* Summaries of threads contain different IPs, entries are indexed by number of summary and entry */
+   for (int t = 0; t < top_cnt; t++) {
+      ss_table_t *table = ip_top_table(tops[t], metric);
+
+      for (uint32_t i = 0; i < table->size; i++) {
+         size = top_push(selected, size, topn, table->entries[i].count, t * capacity + i);
+      }
+      if (ss_max_error(table) > *max_error) {
+         *max_error = ss_max_error(table);
       }
    }
+   top_sort(selected, size);
+   return size;
 }
 
-void malloc_err(void)
+ss_entry_t *selected_ip(ip_top_t **tops, int metric, const top_item_t *item)
 {
-   fprintf(stderr, "Error during memory allocation. Terminating...\n");
-   exit(EXIT_FAILURE);
+   uint32_t capacity = ip_top_table(tops[0], metric)->capacity;
+
+   return &ip_top_table(tops[item->index / capacity], metric)->entries[item->index % capacity];
 }
 
-int compare_flows(const void *a, const void *b)
+ss_table_t *ip_top_table(ip_top_t *top, int metric)
 {
-   if (((port_t *) a)->flows < ((port_t *) b)->flows) {
-      return 1;
-   } else if (((port_t *) a)->flows == ((port_t *) b)->flows) {
+   return metric == 0 ? top->flows : (metric == 1 ? top->packets : top->bytes);
+}
+
+int prefix_of(const ip_addr_t *ip, ip_addr_t *masked_ip)
+{
+   *masked_ip = *ip;
+   if (prefix_set != 1) {
       return 0;
-   } else {
-      return -1;
    }
+   if (ip_is4(ip) == 1) {
+      masked_ip->ui32[2] = masked_ip->ui32[2] & prefix;
+      return 4;
+   }
+   if (prefix_only_v4 == -1) {
+      masked_ip->ui64[0] = masked_ip->ui64[0] & prefix128[0];
+      masked_ip->ui64[1] = masked_ip->ui64[1] & prefix128[1];
+      return 6;
+   }
+   return 0;
 }
 
-int compare_packets(const void *a, const void *b)
+int stats_init(top_stats_t *stats, uint32_t counters)
 {
-   if (((port_t *) a)->packets < ((port_t *) b)->packets) {
-      return 1;
-   } else if (((port_t *) a)->packets == ((port_t *) b)->packets) {
-      return 0;
-   } else {
+   stats->heap_of_bytes = calloc(topn, sizeof(flow_t));
+   stats->heap_of_packets = calloc(topn, sizeof(flow_t));
+   stats->array_counter = 0;
+   stats->ports = calloc(1, sizeof(ports_t));
+   stats->top_ip = ip_top_init(ip_counters(counters));
+   stats->top_prefix = NULL;
+   stats->top_prefix_v6 = NULL;
+
+   if (stats->heap_of_bytes == NULL || stats->heap_of_packets == NULL || stats->ports == NULL || stats->top_ip == NULL) {
       return -1;
    }
+
+   if (prefix_set == 1) {
+      stats->top_prefix = ip_top_init(ip_counters(counters));
+
+      if (stats->top_prefix == NULL) {
+         return -1;
+      }
+
+      if (prefix_only_v4 == -1) {
+         stats->top_prefix_v6 = ip_top_init(ip_counters(counters));
+
+         if (stats->top_prefix_v6 == NULL) {
+            return -1;
+         }
+      }
+   }
+   return 0;
 }
 
-int compare_bytes(const void *a, const void *b)
+void stats_clear(top_stats_t *stats)
 {
-   if (((port_t *) a)->bytes < ((port_t *) b)->bytes) {
-      return 1;
-   } else if (((port_t *) a)->bytes == ((port_t *) b)->bytes) {
-      return 0;
-   } else {
-      return -1;
+   stats->array_counter = 0;
+   ports_clear(stats->ports);
+   ip_top_clear(stats->top_ip);
+
+   if (stats->top_prefix != NULL) {
+      ip_top_clear(stats->top_prefix);
+   }
+   if (stats->top_prefix_v6 != NULL) {
+      ip_top_clear(stats->top_prefix_v6);
    }
 }
 
-int compare_flows_table(const void *a, const void *b)
+void stats_destroy(top_stats_t *stats)
 {
-   if (((ip_t *) a)->flows < ((ip_t *) b)->flows) {
-      return 1;
-   } else if (((ip_t *) a)->flows == ((ip_t *) b)->flows) {
-      return 0;
-   } else {
-      return -1;
+   free(stats->heap_of_bytes);
+   free(stats->heap_of_packets);
+   free(stats->ports);
+   ip_top_destroy(stats->top_ip);
+   ip_top_destroy(stats->top_prefix);
+   ip_top_destroy(stats->top_prefix_v6);
+}
+
+top_stats_t *stats_set_init(void)
+{
+   top_stats_t *set = calloc(port_cnt + 1, sizeof(top_stats_t));
+
+   if (set == NULL) {
+      return NULL;
    }
+
+   for (int s = 0; s <= port_cnt; s++) {
+      if (stats_init(&set[s], s == 0 ? IP_COUNTERS : IP_COUNTERS_PORT) == -1) {
+         stats_set_destroy(set);
+         return NULL;
+      }
+   }
+   return set;
 }
 
-int compare_packets_table(const void *a, const void *b)
+void stats_set_clear(top_stats_t *set)
 {
-   if (((ip_t *) a)->packets < ((ip_t *) b)->packets) {
-      return 1;
-   } else if (((ip_t *) a)->packets == ((ip_t *) b)->packets) {
-      return 0;
-   } else {
-      return -1;
+   for (int s = 0; s <= port_cnt; s++) {
+      stats_clear(&set[s]);
    }
 }
 
-int compare_bytes_table(const void *a, const void *b)
+void stats_set_destroy(top_stats_t *set)
 {
-   if (((ip_t *) a)->bytes < ((ip_t *) b)->bytes) {
-      return 1;
-   } else if (((ip_t *) a)->bytes == ((ip_t *) b)->bytes) {
+   if (set == NULL) {
+      return;
+   }
+   for (int s = 0; s <= port_cnt; s++) {
+      stats_destroy(&set[s]);
+   }
+   free(set);
+}
+
+static void stats_add(top_stats_t *stats, const topn_record_t *record, flow_t *flow_bytes, flow_t *flow_packets, const ip_addr_t *masked_ip, int family)
+{
+   if (family == 4) {
+      process_ip(stats->top_prefix, masked_ip, record->packets, record->bytes);
+   } else if (family == 6) {
+      process_ip(stats->top_prefix_v6, masked_ip, record->packets, record->bytes);
+   }
+
+   process_ip(stats->top_ip, &record->src_ip, record->packets, record->bytes);
+
+   process_flows(stats->heap_of_bytes, flow_bytes, stats->array_counter);
+   process_flows(stats->heap_of_packets, flow_packets, stats->array_counter);
+   if (stats->array_counter < topn) {
+      stats->array_counter++;
+   }
+}
+
+void process_record(top_stats_t *set, const topn_record_t *record)
+{
+   flow_t flow_bytes = {record->bytes, record->src_ip, record->dst_ip, record->src_port, record->dst_port, record->protocol};
+   flow_t flow_packets = {record->packets, record->src_ip, record->dst_ip, record->src_port, record->dst_port, record->protocol};
+   uint32_t dst_slot = port_slot[record->dst_port];
+   uint32_t src_slot = port_slot[record->src_port];
+   ip_addr_t masked_ip;
+   int family = prefix_of(&record->src_ip, &masked_ip);
+
+   stats_add(&set[0], record, &flow_bytes, &flow_packets, &masked_ip, family);
+   process_port(set[0].ports, record->dst_port, record->packets, record->bytes);
+   process_port(set[0].ports, record->src_port, record->packets, record->bytes);
+
+   /* Flow between two watched ports counts to both of them, but only once if the ports are the same */
+   if (dst_slot != 0) {
+      stats_add(&set[dst_slot], record, &flow_bytes, &flow_packets, &masked_ip, family);
+      process_port(set[dst_slot].ports, record->src_port, record->packets, record->bytes);
+   }
+
+   if (src_slot != 0) {
+      if (src_slot != dst_slot) {
+         stats_add(&set[src_slot], record, &flow_bytes, &flow_packets, &masked_ip, family);
+      }
+      process_port(set[src_slot].ports, record->dst_port, record->packets, record->bytes);
+   }
+}
+
+static void *worker_thread(void *arg)
+{
+   worker_t *worker = (worker_t *) arg;
+   batch_t *batch;
+
+   while ((batch = ring_pop_wait(&worker->work)) != NULL) {
+      for (uint32_t i = 0; i < batch->count; i++) {
+         process_record(worker->stats, &batch->records[i]);
+      }
+      batch->count = 0;
+      ring_push(&worker->free, batch);
+   }
+   return NULL;
+}
+
+worker_t *workers_start(top_stats_t **sets, int worker_cnt)
+{
+   worker_t *workers = calloc(worker_cnt, sizeof(worker_t));
+
+   if (workers == NULL) {
+      return NULL;
+   }
+
+   for (int w = 0; w < worker_cnt; w++) {
+      worker_t *worker = &workers[w];
+
+      worker->stats = sets[w];
+      worker->batches = calloc(BATCHES_PER_WORKER, sizeof(batch_t));
+      if (worker->batches == NULL || ring_init(&worker->work, BATCHES_PER_WORKER) == -1 || ring_init(&worker->free, BATCHES_PER_WORKER) == -1) {
+         malloc_err();
+      }
+      for (int b = 0; b < BATCHES_PER_WORKER; b++) {
+         worker->spare[worker->spare_cnt++] = &worker->batches[b];
+      }
+
+      if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+         ring_destroy(&worker->work);
+         ring_destroy(&worker->free);
+         free(worker->batches);
+         workers_stop(workers, w);
+         return NULL;
+      }
+   }
+   return workers;
+}
+
+void workers_dispatch(worker_t *workers, int worker_cnt, const topn_record_t *record)
+{
+   ip_addr_t key;
+   worker_t *worker;
+
+   /* All flows of an IP or network go to the same worker, so summaries of workers do not share IPs */
+   prefix_of(&record->src_ip, &key);
+   worker = &workers[(uint32_t) (((key.ui64[0] ^ key.ui64[1]) * 0x9E3779B97F4A7C15ULL) >> 32) % worker_cnt];
+
+   if (worker->current == NULL) {
+      if (worker->spare_cnt > 0) {
+         worker->current = worker->spare[--worker->spare_cnt];
+      } else {
+         worker->current = ring_pop_wait(&worker->free);
+      }
+   }
+
+   worker->current->records[worker->current->count++] = *record;
+   if (worker->current->count == BATCH_RECORDS) {
+      ring_push(&worker->work, worker->current);
+      worker->current = NULL;
+   }
+}
+
+void workers_sync(worker_t *workers, int worker_cnt)
+{
+   for (int w = 0; w < worker_cnt; w++) {
+      if (workers[w].current != NULL) {
+         ring_push(&workers[w].work, workers[w].current);
+         workers[w].current = NULL;
+      }
+   }
+
+   /* Worker is idle when all its batches are returned */
+   for (int w = 0; w < worker_cnt; w++) {
+      while (workers[w].spare_cnt < BATCHES_PER_WORKER) {
+         workers[w].spare[workers[w].spare_cnt++] = ring_pop_wait(&workers[w].free);
+      }
+   }
+}
+
+void workers_stop(worker_t *workers, int worker_cnt)
+{
+   if (workers == NULL) {
+      return;
+   }
+
+   for (int w = 0; w < worker_cnt; w++) {
+      ring_close(&workers[w].work);
+      pthread_join(workers[w].thread, NULL);
+      ring_destroy(&workers[w].work);
+      ring_destroy(&workers[w].free);
+      free(workers[w].batches);
+   }
+   free(workers);
+}
+
+void malloc_err(void)
+{
+   fprintf(stderr, "Error during memory allocation. Terminating...\n");
+   exit(EXIT_FAILURE);
+}
+
+int compare_max_number(const void *a, const void *b)
+{
+   if (((flow_t *) a)->max_number < ((flow_t *) b)->max_number) {
+      return -1;
+   } else if (((flow_t *) a)->max_number == ((flow_t *) b)->max_number) {
       return 0;
    } else {
-      return -1;
+      return 1;
    }
 }
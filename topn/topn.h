@@ -58,26 +58,29 @@
 #include <errno.h>
 #include <unistd.h>
 #include <inttypes.h>
-#include <nemea-common.h>
+#include <arpa/inet.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
 
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
-#include "twister.h" //!< Pseudorandom number generator
+#include "spacesaving.h"
+#include "ring.h"
+#include "toplist.h"
 
-#define HASH_TABLE_SIZE 8192 
-#define FLOWS_TIME_INTERVAL 16  
-#define FLOWS_MULTIPLIER 8  
-#define FLOWS_BIG_BASE 800  
-#define FLOWS_BIG_MULTIPLIER 600 
-#define FLOWS_RANDOM_MAX 256
-#define FLOWS_RANDOM 16
-#define PAB_TIME_INTERVAL 8
-#define PAB_BASE 8
-#define PAB_MULTIPLIER 3
+#define IP_COUNTERS 8192        /*!< Number of counters of Space-Saving summary of IPs or networks for every statistic. */
+#define IP_COUNTERS_PORT 2048   /*!< Number of counters of summary of IPs or networks communicating with specific port. */
+#define IP_COUNTERS_PER_N 8     /*!< Minimal number of counters for every entity of top N statistics. */
+#define BATCH_RECORDS 1024      /*!< Number of records passed to a worker thread at once. */
+#define BATCHES_PER_WORKER 4    /*!< Number of batches of every worker, the receiving thread waits when all of them are full. */
+
+#define REPORT_FLOWS 0          /*!< TOPN_TYPE of output records of top N flows. */
+#define REPORT_PORTS 1          /*!< TOPN_TYPE of output records of top N ports. */
+#define REPORT_IPS 2            /*!< TOPN_TYPE of output records of top N IPs. */
+#define REPORT_NETWORKS 3       /*!< TOPN_TYPE of output records of top N networks. */
 
 typedef struct flow_struct {
    uint32_t max_number;     /*!< max_number represents bytes or packets. flow_t is used for flows with both packets and bytes, having single variable allows for single function that can process both packets and bytes */ 
@@ -91,80 +94,198 @@ typedef struct flow_struct {
 typedef struct port_struct {
    uint64_t packets;
    uint64_t bytes;
-   uint16_t port;     		/*!< Stats about ports are saved in big array of 65 536 ports, number of port is used as index (and so index = port number). When stats are about to be printed, qsort is used to get Topn ports - this however messes up indexes - thus additional info about port number needs to be saved */ 
    uint64_t flows; 
 } port_t;
 
-typedef struct ip_struct {
-   uint64_t flows;
+typedef struct ports_struct {
+   port_t stats[65536];     /*!< Stats about ports, number of port is used as index. */
+   uint16_t used[65536];    /*!< Ports with non-zero stats, only these are searched for top N ports and cleared. */
+   uint32_t used_cnt;       /*!< Number of ports in used array. */
+} ports_t;
+
+typedef struct ip_top_struct {
+   ss_table_t *flows;     /*!< Summary of IPs or networks with most flows. */
+   ss_table_t *packets;   /*!< Summary of IPs or networks with most packets. */
+   ss_table_t *bytes;     /*!< Summary of IPs or networks with most bytes. */
+} ip_top_t;
+
+typedef struct topn_record_struct {
+   ip_addr_t src_ip;
+   ip_addr_t dst_ip;
+   uint64_t packets;
    uint64_t bytes;
-   uint64_t packets;  
-   ip_addr_t src_ip;   /*!< Hash table is used for saving stats about IPs and networks. Similar to port_t, qsort is used and since data and key(=IP) fields in hash table are in a different memory space, info about IP needs to be saved. */  
-} ip_t;
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint8_t protocol;
+} topn_record_t;
+
+typedef struct top_stats_struct {
+   flow_t *heap_of_bytes;     /*!< Min-heap of flows with top N bytes. */
+   flow_t *heap_of_packets;   /*!< Min-heap of flows with top N packets. */
+   int array_counter;         /*!< Number of flows in both heaps. */
+   ports_t *ports;            /*!< Stats of ports. */
+   ip_top_t *top_ip;          /*!< Summaries of source IPs. */
+   ip_top_t *top_prefix;      /*!< Summaries of IPv4 networks, NULL without -m parameter. */
+   ip_top_t *top_prefix_v6;   /*!< Summaries of IPv6 networks, NULL without IPv6 prefix in -m parameter. */
+} top_stats_t;
+
+typedef struct batch_struct {
+   uint32_t count;                          /*!< Number of records in the batch. */
+   topn_record_t records[BATCH_RECORDS];
+} batch_t;
+
+typedef struct worker_struct {
+   pthread_t thread;
+   top_stats_t *stats;                      /*!< Set of stats updated only by this worker. */
+   ring_t work;                             /*!< Filled batches passed to the worker. */
+   ring_t free;                             /*!< Processed batches returned to the receiving thread. */
+   batch_t *batches;                        /*!< All batches of the worker. */
+   batch_t *current;                        /*!< Batch being filled by the receiving thread. */
+   batch_t *spare[BATCHES_PER_WORKER];      /*!< Empty batches held by the receiving thread. */
+   int spare_cnt;                           /*!< Number of batches in spare array. */
+} worker_t;
+
+typedef struct reporter_struct {
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;                     /*!< Signalled when stats are submitted or reported. */
+   top_stats_t **sets;                      /*!< Sets of stats of the reported interval, one for every thread, empty sets when idle. */
+   int set_cnt;                             /*!< Number of sets. */
+   int pending;                             /*!< Submitted stats are not reported yet. */
+   int stop;                                /*!< Reporting thread should end. */
+   int send_failed;                         /*!< Output interface failed, no more records are sent. */
+   ur_time_t window_start;                  /*!< Start of the reported interval. */
+   ur_time_t window_end;                    /*!< End of the reported interval. */
+   ports_t *merged_ports;                   /*!< Stats of ports used for summing stats of threads, NULL with one set. */
+   ur_template_t *out_tmplt;                /*!< Template of output records, NULL if stats are printed. */
+   void *out_rec;                           /*!< Output record. */
+   char *ip_string;                         /*!< Buffer for ip_to_str function. */
+   char *ip_string2;                        /*!< Buffer for ip_to_str function. */
+} reporter_t;
 
 /**
 * \brief Function sets variable which results in printing Topn stats.
 */
 void sig_handler(int signal);
 
-/**
-* \brief Function returns index where new flow record should be placed.
-*
-* This function is used to find out whether the new flow is bigger than any other flow record in a given sorted array. It uses binary search to find first smaller flow. If no smaller flow is found, -1 is returned. If smaller flow is found, then it returns index of that smaller flow.
-*
-* \param key Basically number of packets/bytes of new flow record.
-* \param sorted_array Sorted array of pointers pointing to elements of array of flow_t records.
-* \param num Number of elements in a given sorted array.
-* \return -1 if no smaller flow found, index of first smaller flow otherwise.
-*/
-int get_array_index(uint32_t key, flow_t ** sorted_array, size_t num);
-
 /**
 * \brief Function processes flows for top N flows stats - adds new big flow, removes smallest one.
 *
-* Stats about Topn flows are stored in an array of TOP_N elements of flow_t type. Having only TOP_N elements (lower memory consumption) means once full, only biggest new flows can be added and for each new flow added, smallest one in array will get removed. If Topn is 1000, linear loop through array would be slow thus binary search is used instead. Binary search means array have to sorted. If new biggest flow is added, all current elements have to be moved by 1. To avoid moving too much memory, I use array of pointers which is sorted, each pointer points to (indexes to) flow_t element in unsorted array of flow_t records.
-*
-* Function uses get_array_index function to find out if given flow is big enough to be added to array of topn flows. If array isn't full, it's added regardless. If array is full and it's big enough, it's added. During any add of new member, sorted array is moved accordingly.
+* Stats about Topn flows are stored in a binary min-heap of TOP_N elements of flow_t type. Having only TOP_N elements (lower memory consumption) means once full, only flows bigger than the smallest one (the root of the heap) can be added and the smallest one gets replaced. Adding a flow costs O(log N).
 *
-* \param array Array of flow records.
-* \param sorted_array Sorted array of pointers pointing to elements of array of flow_t records.
+* \param heap Min-heap of flow records ordered by max_number.
 * \param record Record containing info about given flow.
-* \param array_counter Number of how many members array currently contains.
+* \param array_counter Number of how many members heap currently contains.
 */
-void process_flows(flow_t * array, flow_t ** sorted_array, flow_t* record, int array_counter);
+void process_flows(flow_t * heap, flow_t* record, int array_counter);
 
 /**
 * \brief Function prints top N flows.
 *
-* \param sorted_array_of_bytes Sorted array of pointers pointing to array that contains flows with top N bytes.
-* \param sorted_array_of_packets Sorted array of pointers pointing to array that contains flows with top N packets.
-* \param array_counter Number of elements in both sorted arrays.
+* Heaps are sorted in ascending order, which keeps them valid heaps.
+*
+* \param heap_of_bytes Min-heap of flows with top N bytes.
+* \param heap_of_packets Min-heap of flows with top N packets.
+* \param array_counter Number of elements in both heaps.
 * \param ip_string Pointer for ip_to_str function.
 * \param ip_string2 Pointer for ip_to_str function.
 * \param port_number Changes text output slightly.
 */
-void print_top_flows(flow_t ** sorted_array_of_bytes, flow_t ** sorted_array_of_packets, int array_counter, char * ip_string, char *ip_string2, int port_number);
+void print_top_flows(flow_t * heap_of_bytes, flow_t * heap_of_packets, int array_counter, char * ip_string, char *ip_string2, int port_number);
 
 /**
 * \brief Function prints top N ports.
 *
-* \param array_of_ports Array containing stats of all ports.
+* Top N ports are selected from the used ports only, stats of ports are not reordered.
+*
+* \param ports Stats of all ports.
 * \param port_number Changes text output slightly.
 */
-void print_top_ports(port_t * array_of_ports, int port_number);
+void print_top_ports(const ports_t * ports, int port_number);
 
 /**
-* \brief Function prints top N ports.
+* \brief Function prints top N IPs or networks.
+*
+* Top N entries are selected from the summaries, the summaries are not modified.
 *
 * \param ip_string Pointer for ip_to_str function.
-* \param table_pab Pointer to the hash table containing IPs with most packets and bytes.
-* \param fhf_iter_t Pointer to the iterator of table_pab.
-* \param table_flows Pointer to the hash table containing IPs with most flows.
-* \param fht_iter_t Pointer to the iterator of table_flows.
+* \param tops Array of summaries of IPs or networks, one for every thread. Summaries must not contain the same IP.
+* \param top_cnt Number of summaries in tops array.
 * \param port_number Changes text output slightly.
 * \param prefix_set Changes text output slightly.
 */
-void print_top_ip(char * ip_string, fhf_table_t * table_pab, fhf_iter_t * iter_pab, fht_table_t * table_flows, fht_iter_t * iter_flows,int port_number, int prefix_set);
+void print_top_ip(char * ip_string, ip_top_t ** tops, int top_cnt, int port_number, int prefix_set);
+
+/**
+* \brief Function sends top N flows as UniRec records.
+*
+* \param reporter Reporter with output template and record.
+* \param heap_of_bytes Min-heap of flows with top N bytes.
+* \param heap_of_packets Min-heap of flows with top N packets.
+* \param array_counter Number of elements in both heaps.
+* \param port_number Watched port or -1.
+*/
+void send_top_flows(reporter_t * reporter, flow_t * heap_of_bytes, flow_t * heap_of_packets, int array_counter, int port_number);
+
+/**
+* \brief Function sends top N ports as UniRec records.
+*
+* \param reporter Reporter with output template and record.
+* \param ports Stats of all ports.
+* \param port_number Watched port or -1.
+*/
+void send_top_ports(reporter_t * reporter, const ports_t * ports, int port_number);
+
+/**
+* \brief Function sends top N IPs or networks as UniRec records.
+*
+* \param reporter Reporter with output template and record.
+* \param tops Array of summaries of IPs or networks, one for every thread.
+* \param top_cnt Number of summaries in tops array.
+* \param port_number Watched port or -1.
+* \param prefix_set 0 for IPs, 1 for networks.
+*/
+void send_top_ip(reporter_t * reporter, ip_top_t ** tops, int top_cnt, int port_number, int prefix_set);
+
+/**
+* \brief Function prints or sends all top N statistics of the reported interval.
+*
+* Stats of threads are merged, flows and IPs are selected from stats of all threads, stats of ports are summed.
+*
+* \param reporter Reporter with submitted sets of stats.
+*/
+void report_stats(reporter_t * reporter);
+
+/**
+* \brief Function starts reporting thread.
+*
+* The thread owns spare sets of stats. Submitted stats are exchanged for them, so stats are reported while the receiving thread continues with empty stats.
+*
+* \param reporter Pointer to the reporter.
+* \param set_cnt Number of sets of stats (threads).
+* \param out_tmplt Template of output records, NULL if stats are printed.
+* \return 0 if OK, -1 if thread could not be started.
+*/
+int reporter_start(reporter_t * reporter, int set_cnt, ur_template_t * out_tmplt);
+
+/**
+* \brief Function passes stats of the finished interval to the reporting thread.
+*
+* Function waits until the previous report is done and exchanges the sets of stats for the cleared ones.
+*
+* \param reporter Pointer to the reporter.
+* \param sets Array of sets of stats, replaced by empty sets.
+* \param window_start Start of the interval.
+* \param window_end End of the interval.
+*/
+void reporter_submit(reporter_t * reporter, top_stats_t ** sets, ur_time_t window_start, ur_time_t window_end);
+
+/**
+* \brief Function waits for the last report, stops reporting thread and frees its stats.
+*
+* \param reporter Pointer to the reporter.
+*/
+void reporter_stop(reporter_t * reporter);
 
 /**
 * \brief Function processes arguments for -m parameter (length of the prefixes).
@@ -181,7 +302,7 @@ int process_prefix_args(char * optarg, uint64_t *prefix128, uint32_t * prefix, i
 /**
 * \brief Function processes arguments for -p parameter (various number of ports).
 *
-* Function allocates memory for global variable int * port and fills each element with port numbers given in an optarg parameter.
+* Function allocates memory for global variable int * port and fills each element with port numbers given in an optarg parameter. Index of stats of every port is stored in port_slot table, so stats of a port are found without searching the ports.
 *
 * \param optarg String containing arguments.
 * \return 0 if OK, -1 if error occurred.
@@ -189,73 +310,257 @@ int process_prefix_args(char * optarg, uint64_t *prefix128, uint32_t * prefix, i
 int process_ports_args(char * optarg);
 
 /**
-* \brief Function processes incoming flows and manages hash table of top N IPs with most flows.
+* \brief Function returns number of counters of summary, so that every entity of top N has enough of them.
+*
+* \param counters Default number of counters.
+* \return Number of counters, at least IP_COUNTERS_PER_N * N.
+*/
+uint32_t ip_counters(uint32_t counters);
+
+/**
+* \brief Function allocates summaries of IPs or networks with most flows, packets and bytes.
 *
-* Function uses fast_hash_table from Nemea-Framework/common/, which is a fast 4-way hash table with least recently used (LRU) algorithm used to replace oldest record in a row. This is useful because we can expect that most active IPs will be able to keep themselves in a table.
+* \param counters Number of counters of every summary.
+* \return Pointer to the summaries, NULL if memory could not be allocated.
+*/
+ip_top_t *ip_top_init(uint32_t counters);
+
+/**
+* \brief Function removes all IPs from the summaries.
 *
-* When the new flow is received, function checks if it's key (IP) is already in table. If yes, it's updated (+1 flow). If not, it's added to the table, possibly replacing oldest record if a given row is full. Because real network contains a lot of flows per second and this module aims to not use too much memory, some improvements have been made - based on observation that most network traffic is small and probably won't make it to top N. First is that it uses probability sampling - so that only e.g. 1 in 10 flows will be processed. Second is that if a row is full, each member is inspected and if it's number of flow is lower than computed number that scales with time, it's removed. Computed number should be small enough to not remove any big/huge records. So IPs with small potential to appear in top N and passed probability test will be removed and row won't be full. Third improvement is that if a record is replaced by a new one and during second improvement some elements have been removed, then number of flows of replaced record is inspected. If it's bigger than computed number (which should be rather big/huge), it's returned to hash table. This is made for cases where IP with big chance to appear in top N is removed because at some time a lot of new IPs are added to the same row, despite none of them probably make it to top N.
+* \param top Pointer to the summaries.
+*/
+void ip_top_clear(ip_top_t * top);
+
+/**
+* \brief Function frees the summaries.
 *
-* \param table_flows Pointer to hash table, where records will be stored.
-* \param ip IP address, will be used as key to hash table.
-* \param record Record containing data which will be saved to hash table.
-* \param key_lost If new record removes least recentl  used one, removed key will go there.
-* \param data_lost If new record removes least recently used one, removed data will go there.
-* \param data Used for UniRec functions and macros.
-* \param tmplt Used for UniRec functions and macros.
+* \param top Pointer to the summaries.
 */
-void process_ip_flows(fht_table_t * table_flows, ip_addr_t * ip, ip_t * record, ip_addr_t * key_lost, ip_t * data_lost, const void *data, ur_template_t *tmplt);
+void ip_top_destroy(ip_top_t * top);
 
 /**
-* \brief Function processes incoming flows and manages hash table of top N IPs with most packets and bytes.
+* \brief Function adds flow of IP address to the summaries of IPs with most flows, packets and bytes.
 *
-* Function is somewhat similar to function process_ip_flows, but uses fast_hash_filter from Nemea-Framework/common/, which is a fast 8-way hash table with no replacement algorithm. Unlike processing IPs with top N flows where flows come only by 1 (+1) and thus it's difficult to predict which IP will make it to top N, processing IPs with most packets and bytes is simpler. Based on observation, biggest flow (from top N flows with most bytes stats) can be 100 000x bigger than average of all received bytes in a given time. Also usually more packets = more bytes, so I use only 1 hash table to save memory. 
+* Every summary is a Space-Saving summary with fixed number of counters. When a new IP comes and all counters are used, the IP with the smallest count is replaced and the new IP inherits its count. So counts can be overestimated, but at most by total / counters (the count of the smallest entry), and every IP with count higher than that is guaranteed to be in the summary.
 *
-* When the new flow is received, function checks if it's key (IP) is already in table. If yes, it's updated. If not, it's added to the table, if row isn't full. If row is full, each member is inspected and if it's number of packets and bytes is lower than computed number, it's removed. Computed number is based of average of received packets and bytes and scales with time. It should be small enough to not remove any big/huge records. If any records were removed, new flow is added if it's packets or bytes are bigger than some small multiplier of average.
+* \param top Pointer to the summaries.
+* \param ip IP address or network.
+* \param packets Number of packets of the flow.
+* \param bytes Number of bytes of the flow.
+*/
+void process_ip(ip_top_t * top, const ip_addr_t * ip, uint64_t packets, uint64_t bytes);
+
+/**
+* \brief Function adds flow to stats of port.
 *
-* \param table_pab Pointer to hash table, where records will be stored.
-* \param ip IP address, will be used as key to hash table.
-* \param record Record containing data which will be saved to hash table.
-* \param data Used for UniRec functions and macros.
-* \param tmplt Used for UniRec functions and macros.
-* \param average_packets Arithmetic mean of all received packets in a given time.
-* \param average_bytes Arithmetic mean of all received bytes in a given time.
+* \param ports Stats of all ports.
+* \param port_number Port of the flow.
+* \param packets Number of packets of the flow.
+* \param bytes Number of bytes of the flow.
 */
-void process_ip_pab(fhf_table_t * table_pab, ip_addr_t * ip, ip_t * record, const void *data, ur_template_t *tmplt, int average_packets, int average_bytes);
+void process_port(ports_t * ports, uint16_t port_number, uint64_t packets, uint64_t bytes);
 
 /**
-* \brief Function writes message to stderr and exits program.
+* \brief Function clears stats of used ports.
+*
+* \param ports Stats of all ports.
 */
-void malloc_err(void);
+void ports_clear(ports_t * ports);
+
+/**
+* \brief Function adds stats of ports to other stats of ports.
+*
+* \param dst Stats of ports which are increased.
+* \param src Stats of ports which are added.
+*/
+void ports_merge(ports_t * dst, const ports_t * src);
+
+/**
+* \brief Function returns current time.
+*
+* \return Current time as UniRec timestamp.
+*/
+ur_time_t time_now(void);
+
+/**
+* \brief Function selects top N flows from stats of all threads.
+*
+* \param sets Array of sets of stats, one for every thread.
+* \param set_cnt Number of sets.
+* \param slot Index of stats in the sets, 0 for all flows.
+* \param heap_of_bytes Min-heap filled with flows with top N bytes.
+* \param heap_of_packets Min-heap filled with flows with top N packets.
+* \return Number of flows in both heaps.
+*/
+int merge_flows(top_stats_t ** sets, int set_cnt, int slot, flow_t * heap_of_bytes, flow_t * heap_of_packets);
+
+/**
+* \brief Function sums stats of ports of all threads.
+*
+* \param sets Array of sets of stats, one for every thread.
+* \param set_cnt Number of sets.
+* \param slot Index of stats in the sets, 0 for all flows.
+* \param merged_ports Stats of ports used for summing, may be NULL if set_cnt is 1.
+* \return Stats of ports of the only set or merged_ports.
+*/
+const ports_t *merge_ports(top_stats_t ** sets, int set_cnt, int slot, ports_t * merged_ports);
+
+/**
+* \brief Function selects top N ports.
+*
+* \param ports Stats of ports.
+* \param metric 0 for flows, 1 for packets, 2 for bytes.
+* \param top Array of at least N items filled with ports in descending order.
+* \return Number of selected ports.
+*/
+int select_top_ports(const ports_t * ports, int metric, top_item_t * top);
+
+/**
+* \brief Function selects top N IPs or networks from summaries of all threads.
+*
+* \param tops Array of summaries, one for every thread. Summaries must not contain the same IP.
+* \param top_cnt Number of summaries in tops array.
+* \param metric 0 for flows, 1 for packets, 2 for bytes.
+* \param selected Array of at least N items filled with entries in descending order.
+* \param max_error Maximal overestimation of counts of the summaries.
+* \return Number of selected entries.
+*/
+int select_top_ip(ip_top_t ** tops, int top_cnt, int metric, top_item_t * selected, uint64_t * max_error);
+
+/**
+* \brief Function returns summary entry of item selected by select_top_ip.
+*
+* \param tops Array of summaries passed to select_top_ip.
+* \param metric Metric passed to select_top_ip.
+* \param item Selected item.
+* \return Pointer to the entry.
+*/
+ss_entry_t *selected_ip(ip_top_t ** tops, int metric, const top_item_t * item);
+
+/**
+* \brief Function returns summary of IPs or networks with most flows, packets or bytes.
+*
+* \param top Pointer to the summaries.
+* \param metric 0 for flows, 1 for packets, 2 for bytes.
+* \return Pointer to the summary.
+*/
+ss_table_t *ip_top_table(ip_top_t * top, int metric);
+
+/**
+* \brief Function masks IP address by the prefix given by -m parameter.
+*
+* \param ip IP address.
+* \param masked_ip Masked IP address, the same as ip if there is no prefix for its version.
+* \return 4 or 6 if IPv4 or IPv6 address was masked, 0 otherwise.
+*/
+int prefix_of(const ip_addr_t * ip, ip_addr_t * masked_ip);
+
+/**
+* \brief Function allocates stats of flows of all ports or of one watched port.
+*
+* \param stats Pointer to the stats.
+* \param counters Default number of counters of summaries of IPs.
+* \return 0 if OK, -1 if memory could not be allocated.
+*/
+int stats_init(top_stats_t * stats, uint32_t counters);
+
+/**
+* \brief Function clears the stats for the next interval.
+*
+* \param stats Pointer to the stats.
+*/
+void stats_clear(top_stats_t * stats);
+
+/**
+* \brief Function frees memory of the stats.
+*
+* \param stats Pointer to the stats.
+*/
+void stats_destroy(top_stats_t * stats);
+
+/**
+* \brief Function allocates set of stats of one thread.
+*
+* The set contains stats of all flows followed by stats of flows of every watched port, in order given by -p parameter.
+*
+* \return Array of port_cnt + 1 stats, NULL if memory could not be allocated.
+*/
+top_stats_t *stats_set_init(void);
+
+/**
+* \brief Function clears all stats of the set.
+*
+* \param set Set of stats.
+*/
+void stats_set_clear(top_stats_t * set);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function frees all stats of the set.
+*
+* \param set Set of stats.
+*/
+void stats_set_destroy(top_stats_t * set);
+
+/**
+* \brief Function adds record to the set of stats.
+*
+* Record is added to the stats of all flows and to the stats of its source and destination port if they are watched, the watched ports are found by port_slot table.
+*
+* \param set Set of stats.
+* \param record Received record.
+*/
+void process_record(top_stats_t * set, const topn_record_t * record);
+
+/**
+* \brief Function starts worker threads.
+*
+* Every worker updates its own set of stats, records are passed to it in batches by single-producer single-consumer rings, so no lock is taken while records are processed.
+*
+* \param sets Array of sets of stats, one for every worker.
+* \param worker_cnt Number of workers.
+* \return Array of workers, NULL if threads could not be started.
 */
-int compare_flows(const void * a, const void * b);
+worker_t *workers_start(top_stats_t ** sets, int worker_cnt);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function passes record to a worker.
+*
+* Worker is chosen by hash of source IP address masked by the prefix, so every IP and network is counted by one worker only.
+*
+* \param workers Array of workers.
+* \param worker_cnt Number of workers.
+* \param record Received record.
 */
-int compare_packets(const void * a, const void * b);
+void workers_dispatch(worker_t * workers, int worker_cnt, const topn_record_t * record);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function passes all buffered records to workers and waits until they are processed.
+*
+* Workers are idle afterwards, so their stats can be read and cleared until the next record is dispatched.
+*
+* \param workers Array of workers.
+* \param worker_cnt Number of workers.
 */
-int compare_bytes(const void * a, const void * b);
+void workers_sync(worker_t * workers, int worker_cnt);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function stops worker threads and frees them.
+*
+* \param workers Array of workers, may be NULL.
+* \param worker_cnt Number of workers.
 */
-int compare_flows_table(const void * a, const void * b);
+void workers_stop(worker_t * workers, int worker_cnt);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function writes message to stderr and exits program.
 */
-int compare_packets_table(const void * a, const void * b);
+void malloc_err(void);
 
 /**
-* \brief Function used by library function qsort().
+* \brief Function used by library function qsort(), sorts flows in ascending order.
 */
-int compare_bytes_table(const void * a, const void * b);
+int compare_max_number(const void * a, const void * b);
 
 #endif /* _TOPN_ */
 
@@ -246,22 +246,6 @@ struct ast *newExpressionDateTime(char *column, char *cmp, char *datetime)
    return (struct ast *) newast;
 }
 
-static int compareUI64(const void *p1, const void *p2)
-{
-   if ((*(uint64_t *) p1) == (*(uint64_t *) p2)) {
-      return 0;
-   } else if ((*(uint64_t *) p1) > (*(uint64_t *) p2)) {
-      return 1;
-   } else {
-      return -1;
-   }
-}
-
-static int compareI64(const void *p1, const void *p2)
-{
-   return ((*(int64_t *) p1) - (*(int64_t *) p2));
-}
-
 static int compareDouble(const void *p1, const void *p2)
 {
    double EPS = 1e-8;
@@ -273,155 +257,307 @@ static int compareDouble(const void *p1, const void *p2)
    }
 }
 
-static int compareIPs(const void *p1, const void *p2)
-{
-   return ip_cmp((const ip_addr_t *) p1, (const ip_addr_t *) p2);
-}
-
-struct ast *newExpressionArray(char *column, char *cmp, char *array)
+/**
+ * Parse one IP address or prefix (address/length) of the list and add it to the set.
+ * \return 0 on success, -1 on error.
+ */
+static int addPrefix(struct prefix_set *prefixes, char *p)
 {
-   int i;
-   struct expression_array *newast = (struct expression_array *) malloc(sizeof(struct expression_array));
-
-   /* init all arrays, one will be allocated: */
-   newast->array_values = 0;
-   newast->array_values_ip = 0;
-   newast->array_values_date = 0;
-   newast->array_values_double = 0;
-
-   newast->type = NODE_T_EXPRESSION_ARRAY;
-   newast->column = column;
-
-   int id = ur_get_id_by_name(column);
-   newast->cmp = get_op_type(cmp);
-   free(cmp);
+   ip_addr_t addr;
+   unsigned long len;
+   char *end;
+   char *slash = strchr(p, '/');
 
-   if (id == UR_E_INVALID_NAME) {
-      printf("Warning: %s is not present in input format. Corresponding rule will always evaluate false.\n", column);
-      newast->id = UR_INVALID_FIELD;
-   } else {
-      newast->id = id;
+   if (slash) {
+      *slash = 0;
    }
-   newast->field_type = ur_get_type(id);
-
-   newast->array_size = 0;
-   newast->array_values = 0;
-
-   char *p = array;
-   int strsize = strlen(array);
-   for (i = 0; i < strsize; i++) {
-      if (array[i] == ',') {
-         newast->array_size++;
-         array[i] = 0;
-      }
+   if (ip_from_str(p, &addr) == 0) {
+      printf("Error: %s could not be parsed as IP address.\n", p);
+      return -1;
    }
-   if (i != 0) {
-      newast->array_size++;
+   len = ip_is4(&addr) ? 32 : 128;
+   if (slash) {
+      unsigned long max = len;
+      len = strtoul(slash + 1, &end, 10);
+      if (end == slash + 1 || *end != 0 || len > max) {
+         printf("Error: %s/%s could not be parsed as IP prefix.\n", p, slash + 1);
+         return -1;
+      }
    }
+   return prefix_set_add(prefixes, &addr, (uint8_t) len);
+}
 
-   char is_unsigned_int = 0;
-   switch (newast->field_type) {
+/**
+ * Parse list of values into the sets of the expression according to the type of its field.
+ * Values are separated by commas or white spaces, text from '#' to the end of line is a comment.
+ * \param[in,out] expr  expression without any values, they are allocated on success
+ * \param[in] list      text of the list, it is modified
+ * \return 0 on success, -1 on error (no values are allocated).
+ */
+static int parseArrayValues(struct expression_array *expr, char *list)
+{
+   const char *separators = ", \t\r\n";
+   uint32_t capacity = 0;
+   char *p = list;
+
+   expr->array_size = 0;
+   switch (expr->field_type) {
    case UR_TYPE_UINT8:
    case UR_TYPE_UINT16:
    case UR_TYPE_UINT32:
    case UR_TYPE_UINT64:
-      is_unsigned_int = 1;
    case UR_TYPE_INT8:
    case UR_TYPE_INT16:
    case UR_TYPE_INT32:
    case UR_TYPE_INT64:
-      newast->array_values = calloc(newast->array_size, sizeof(uint64_t));
-      for (int i=0; i < newast->array_size; i++) {
-         if (is_unsigned_int == 1) {
-            if (sscanf(p, "%"SCNu64, &newast->array_values[i]) != 1) {
-               /* error */
-               printf("Error: %s could not be parsed.\n", p);
-               free(newast->array_values);
-               newast->array_values = 0;
-               goto parsing_error;
-            }
-         } else {
-            if (sscanf(p, "%"SCNi64, &newast->array_values[i]) != 1) {
-               /* error */
-               printf("Error: %s could not be parsed.\n", p);
-               free(newast->array_values);
-               newast->array_values = 0;
-               goto parsing_error;
-            }
-         }
-         p += strlen(p) + 1;
-      }
-      if (is_unsigned_int == 1) {
-         qsort(newast->array_values, newast->array_size, sizeof(uint64_t), compareUI64);
-      } else {
-         qsort(newast->array_values, newast->array_size, sizeof(uint64_t), compareI64);
+   case UR_TYPE_TIME:
+      expr->values = int_set_create(0);
+      if (!expr->values) {
+         goto memory_error;
       }
       break;
    case UR_TYPE_IP:
-      newast->array_values_ip = calloc(newast->array_size, sizeof(ip_addr_t));
-      for (int i=0; i < newast->array_size; i++) {
-         while (*p == ' ') {
-            /* skip leading spaces */
-            p++;
+      expr->prefixes = prefix_set_create(0);
+      if (!expr->prefixes) {
+         goto memory_error;
+      }
+      break;
+   case UR_TYPE_FLOAT:
+   case UR_TYPE_DOUBLE:
+      break;
+   default:
+      /* not supported */
+      printf("Type %d is not supported.\n", expr->field_type);
+      return -1;
+   }
+
+   while (*p) {
+      // skip separators and comments
+      p += strspn(p, separators);
+      if (*p == '#') {
+         p += strcspn(p, "\n");
+         continue;
+      }
+      if (*p == 0) {
+         break;
+      }
+      size_t len = strcspn(p, ", \t\r\n#");
+      char next = p[len];
+      p[len] = 0;
+
+      switch (expr->field_type) {
+      case UR_TYPE_UINT8:
+      case UR_TYPE_UINT16:
+      case UR_TYPE_UINT32:
+      case UR_TYPE_UINT64: {
+         uint64_t value;
+         if (sscanf(p, "%"SCNu64, &value) != 1) {
+            printf("Error: %s could not be parsed.\n", p);
+            goto parsing_error;
+         }
+         if (int_set_add(expr->values, value) != 0) {
+            goto memory_error;
          }
-         if (ip_from_str(p, &newast->array_values_ip[i]) == 0) {
-            /* error */
-            printf("Error: %s could not be parsed as IP address.\n", p);
-            free(newast->array_values_ip);
-            newast->array_values_ip = 0;
+         break;
+      }
+      case UR_TYPE_INT8:
+      case UR_TYPE_INT16:
+      case UR_TYPE_INT32:
+      case UR_TYPE_INT64: {
+         int64_t value;
+         if (sscanf(p, "%"SCNi64, &value) != 1) {
+            printf("Error: %s could not be parsed.\n", p);
             goto parsing_error;
          }
-         p += strlen(p) + 1;
+         if (int_set_add(expr->values, (uint64_t) value) != 0) {
+            goto memory_error;
+         }
+         break;
       }
-      qsort(newast->array_values_ip, newast->array_size, sizeof(ip_addr_t), compareIPs);
-      break;
-   case UR_TYPE_TIME:
-      newast->array_values_date = calloc(newast->array_size, sizeof(ur_time_t));
-      for (int i=0; i < newast->array_size; i++) {
-         if (ur_time_from_string(&newast->array_values_date[i], p) != 0) {
-            /* error */
+      case UR_TYPE_TIME: {
+         ur_time_t value;
+         if (ur_time_from_string(&value, p) != 0) {
             printf("Error: %s could not be loaded. Expected format: YYYY-mm-ddTHH:MM:SS.sss, (.sss is optional). Eg. 2018-06-27T19:44:41.123.\n", p);
-            free(newast->array_values_date);
-            newast->array_values_date = 0;
             goto parsing_error;
          }
-         p += strlen(p) + 1;
+         if (int_set_add(expr->values, value) != 0) {
+            goto memory_error;
+         }
+         break;
       }
-      qsort(newast->array_values_date, newast->array_size, sizeof(ur_time_t), compareUI64);
-      break;
-   case UR_TYPE_FLOAT:
-   case UR_TYPE_DOUBLE:
-      newast->array_values_double = calloc(newast->array_size, sizeof(double));
-      for (int i=0; i < newast->array_size; i++) {
-         if (sscanf(p, "%lf", &newast->array_values_double[i]) != 1) {
-            /* error */
+      case UR_TYPE_IP:
+         if (addPrefix(expr->prefixes, p) != 0) {
+            goto parsing_error;
+         }
+         break;
+      default: // UR_TYPE_FLOAT, UR_TYPE_DOUBLE
+         if (expr->array_size == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            double *values = realloc(expr->array_values_double, capacity * sizeof(double));
+            if (!values) {
+               goto memory_error;
+            }
+            expr->array_values_double = values;
+         }
+         if (sscanf(p, "%lf", &expr->array_values_double[expr->array_size]) != 1) {
             printf("Error: %s could not be parsed.\n", p);
-            free(newast->array_values_double);
-            newast->array_values_double = 0;
             goto parsing_error;
          }
-         p += strlen(p) + 1;
       }
+      expr->array_size++;
+      p[len] = next;
+      p += len;
+   }
 
-      qsort(newast->array_values_double, newast->array_size, sizeof(double), compareDouble);
-      break;
-   default:
-      /* not supported */
+   if (expr->array_values_double) {
+      qsort(expr->array_values_double, expr->array_size, sizeof(double), compareDouble);
+   }
+   return 0;
+
+memory_error:
+   printf("Error: not enough memory for the list of values.\n");
+parsing_error:
+   int_set_destroy(expr->values);
+   prefix_set_destroy(expr->prefixes);
+   free(expr->array_values_double);
+   expr->values = NULL;
+   expr->prefixes = NULL;
+   expr->array_values_double = NULL;
+   expr->array_size = 0;
+   return -1;
+}
+
+/**
+ * Read whole content of the file with a list of values.
+ * \return Allocated null-terminated content, NULL on error.
+ */
+static char *readArrayFile(const char *path)
+{
+   FILE *f = fopen(path, "r");
+   char *content = NULL;
+   size_t size = 0;
+   long len;
+
+   if (!f) {
+      printf("Error: file %s could not be opened.\n", path);
+      return NULL;
+   }
+   if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+      content = (char *) malloc(len + 1);
+      if (content) {
+         size = fread(content, 1, len, f);
+         content[size] = 0;
+      }
+   }
+   if (!content || ferror(f)) {
+      printf("Error: file %s could not be read.\n", path);
+      free(content);
+      content = NULL;
+   }
+   fclose(f);
+   return content;
+}
+
+/**
+ * Create expression to check whether the field value is in the list.
+ * \param[in] source  text of the list, or path of the file with the list
+ */
+static struct ast *newArray(char *column, char *cmp, char *source, int from_file)
+{
+   struct expression_array *newast = (struct expression_array *) calloc(1, sizeof(struct expression_array));
+   char *list;
+
+   newast->type = NODE_T_EXPRESSION_ARRAY;
+   newast->column = column;
+   newast->source = source;
+   newast->from_file = from_file;
+
+   int id = ur_get_id_by_name(column);
+   newast->cmp = get_op_type(cmp);
+   free(cmp);
+
+   if (id == UR_E_INVALID_NAME) {
+      printf("Warning: %s is not present in input format. Corresponding rule will always evaluate false.\n", column);
+      newast->id = UR_INVALID_FIELD;
+   } else {
+      newast->id = id;
+   }
+   newast->field_type = ur_get_type(id);
+
+   list = from_file ? readArrayFile(source) : strdup(source);
+   if (!list || parseArrayValues(newast, list) != 0) {
+      free(list);
       free(column);
-      free(array);
-      printf("Type %d is not supported.\n", newast->field_type);
+      free(source);
       free(newast);
       return NULL;
    }
-
-   free(array);
+   free(list);
    return (struct ast *) newast;
+}
 
-parsing_error:
-   free(column);
-   free(array);
-   free(newast);
-   return NULL;
+struct ast *newExpressionArray(char *column, char *cmp, char *array)
+{
+   return newArray(column, cmp, array, 0);
+}
+
+struct ast *newExpressionArrayFile(char *column, char *cmp, char *path)
+{
+   return newArray(column, cmp, path, 1);
+}
+
+/**
+ * Load values of the list from its file again. When the file can not be loaded,
+ * previous values are kept.
+ * \return 0 on success, -1 on error.
+ */
+static int reloadArray(struct expression_array *expr)
+{
+   struct expression_array loaded = *expr;
+   char *list = readArrayFile(expr->source);
+
+   loaded.values = NULL;
+   loaded.prefixes = NULL;
+   loaded.array_values_double = NULL;
+   if (!list || parseArrayValues(&loaded, list) != 0) {
+      free(list);
+      printf("Warning: list %s was not reloaded, previous values are used.\n", expr->source);
+      return -1;
+   }
+   free(list);
+
+   int_set_destroy(expr->values);
+   prefix_set_destroy(expr->prefixes);
+   free(expr->array_values_double);
+   *expr = loaded;
+   return 0;
+}
+
+int reloadArrays(struct ast *ast)
+{
+   int ret = 0;
+
+   if (ast == NULL) {
+      return 0;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      ret = reloadArrays(ast->l);
+      if (ast->r && reloadArrays(ast->r) != 0) {
+         ret = -1;
+      }
+      return ret;
+   case NODE_T_BRACKET:
+   case NODE_T_NEGATION:
+      return reloadArrays(((struct brack *) ast)->b);
+   case NODE_T_EXPRESSION_ARRAY:
+      if (((struct expression_array *) ast)->from_file) {
+         return reloadArray((struct expression_array *) ast);
+      }
+      return 0;
+   default:
+      return 0;
+   }
 }
 
 struct ast *newProtocol(char *cmp, char *data)
@@ -509,7 +645,7 @@ struct ast *newString(char *column, char *cmp, char *s)
    int retval;
    char errb[1024];
    errb[1023] = 0;
-   struct str *newast = (struct str *) malloc(sizeof(struct str));
+   struct str *newast = (struct str *) calloc(1, sizeof(struct str));
    newast->type = NODE_T_STRING;
    newast->column = column;
 
@@ -526,6 +662,7 @@ struct ast *newString(char *column, char *cmp, char *s)
          newast->id = UR_INVALID_FIELD;
          return (struct ast *) newast;
       }
+      matcher_compile(&newast->matcher, s, &newast->re);
       free(s);
    } else {
       newast->s = s;
@@ -685,49 +822,11 @@ void printAST(struct ast *ast)
          printf("%s", TTY_RESET);
       }
 
-      printf(" IN [");
-      if (((struct expression_array*) ast)->id != UR_INVALID_FIELD) {
-         for (int i=0; i < ((struct expression_array*) ast)->array_size; i++) {
-            switch (((struct expression_array*) ast)->field_type) {
-            case UR_TYPE_UINT8:
-            case UR_TYPE_UINT16:
-            case UR_TYPE_UINT32:
-            case UR_TYPE_UINT64:
-               printf("%"PRIu64", ", ((struct expression_array*) ast)->array_values[i]);
-               break;
-            case UR_TYPE_INT8:
-            case UR_TYPE_INT16:
-            case UR_TYPE_INT32:
-            case UR_TYPE_INT64:
-               printf("%"PRIi64", ", ((struct expression_array*) ast)->array_values[i]);
-               break;
-            case UR_TYPE_IP:
-            {
-               char ipstr[INET6_ADDRSTRLEN];
-               ip_to_str(&((struct expression_array*) ast)->array_values_ip[i], ipstr);
-               printf("%s, ", ipstr);
-               break;
-            }
-            case UR_TYPE_TIME:
-            {
-               time_t sec = ur_time_get_sec(((struct expression_array*) ast)->array_values_date[i]);
-               int msec = ur_time_get_msec(((struct expression_array*) ast)->array_values_date[i]);
-               char str[32];
-               strftime(str, 31, "%FT%T", gmtime(&sec));
-               printf("%s.%03i, ", str, msec);
-               break;
-            }
-            case UR_TYPE_FLOAT:
-            case UR_TYPE_DOUBLE:
-               printf("%lf"", ", ((struct expression_array*) ast)->array_values_double[i]);
-               break;
-            default:
-               /* not supported yet */
-               printf("Type %d is not supported.\n", ((struct expression_array*) ast)->field_type);
-            }
-         }
+      if (((struct expression_array*) ast)->from_file) {
+         printf(" IN file:\"%s\" (%"PRIu32" values)", ((struct expression_array*) ast)->source, ((struct expression_array*) ast)->array_size);
+      } else {
+         printf(" IN [%s]", ((struct expression_array*) ast)->source);
       }
-      printf("]");
 
       break;
 
@@ -880,9 +979,9 @@ void freeAST(struct ast *ast)
       break;
    case NODE_T_EXPRESSION_ARRAY:
       free(((struct expression_array *) ast)->column);
-      free(((struct expression_array *) ast)->array_values);
-      free(((struct expression_array *) ast)->array_values_ip);
-      free(((struct expression_array *) ast)->array_values_date);
+      free(((struct expression_array *) ast)->source);
+      int_set_destroy(((struct expression_array *) ast)->values);
+      prefix_set_destroy(((struct expression_array *) ast)->prefixes);
       free(((struct expression_array *) ast)->array_values_double);
       break;
    case NODE_T_PROTOCOL:
@@ -900,6 +999,7 @@ void freeAST(struct ast *ast)
       free(((struct str*) ast)->s);
       if (((struct str*) ast)->cmp == OP_RE) {
          regfree(&((struct str*) ast)->re);
+         matcher_free(&((struct str*) ast)->matcher);
       }
       ((struct str*) ast)->s = NULL;
       break;
@@ -968,7 +1068,7 @@ int compareFloating(double a, double b, cmp_op op) {
       case OP_GT:
          return a > b;
       case OP_EQ:
-         return abs(a - b) < EPS;
+         return (a - b < 0 ? b - a : a - b) < EPS;
       default:
          fprintf(stderr, "Warning: Invalid comparison operator.\n");
          return 0;
@@ -978,65 +1078,37 @@ int compareFloating(double a, double b, cmp_op op) {
 
 int compareElemInArray(void *val, struct expression_array *ast)
 {
-   void *res = NULL;
-
-   uint64_t val_u;
-   int64_t val_i;
-   float val_f;
+   double val_d;
 
    switch (ast->field_type) {
    case UR_TYPE_UINT8:
-      val_u = *((uint8_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return int_set_contains(ast->values, *((uint8_t *) val));
    case UR_TYPE_UINT16:
-      val_u = *((uint16_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return int_set_contains(ast->values, *((uint16_t *) val));
    case UR_TYPE_UINT32:
-      val_u = *((uint32_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+      return int_set_contains(ast->values, *((uint32_t *) val));
    case UR_TYPE_UINT64:
-      val_u = *((uint64_t *) val);
-      res = bsearch(&val_u, ast->array_values, ast->array_size, sizeof(uint64_t), compareUI64);
-      break;
+   case UR_TYPE_INT64:
+   case UR_TYPE_TIME:
+      return int_set_contains(ast->values, *((uint64_t *) val));
    case UR_TYPE_INT8:
-      val_i = *((uint8_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return int_set_contains(ast->values, (uint64_t) (int64_t) *((int8_t *) val));
    case UR_TYPE_INT16:
-      val_i = *((uint16_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return int_set_contains(ast->values, (uint64_t) (int64_t) *((int16_t *) val));
    case UR_TYPE_INT32:
-      val_i = *((uint32_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
-   case UR_TYPE_INT64:
-      val_i = *((uint64_t *) val);
-      res = bsearch(&val_i, ast->array_values, ast->array_size, sizeof(int64_t), compareI64);
-      break;
+      return int_set_contains(ast->values, (uint64_t) (int64_t) *((int32_t *) val));
    case UR_TYPE_IP:
-      res = bsearch(val, ast->array_values_ip, ast->array_size, sizeof(ip_addr_t), compareIPs);
-      break;
-   case UR_TYPE_TIME:
-      res = bsearch(val, ast->array_values_date, ast->array_size, sizeof(ur_time_t), compareUI64);
-      break;
+      return prefix_set_contains(ast->prefixes, (ip_addr_t *) val);
    case UR_TYPE_FLOAT:
-      val_f = *((float *) val);
-      res = bsearch(&val_f, ast->array_values_double, ast->array_size, sizeof(double), compareDouble);
-      break;
+      val_d = *((float *) val);
+      return bsearch(&val_d, ast->array_values_double, ast->array_size, sizeof(double), compareDouble) != NULL;
    case UR_TYPE_DOUBLE:
-      res = bsearch(val, ast->array_values_double, ast->array_size, sizeof(double), compareDouble);
-      break;
+      return bsearch(val, ast->array_values_double, ast->array_size, sizeof(double), compareDouble) != NULL;
    default:
       /* not supported yet */
       printf("Type %d is not supported.\n", ast->field_type);
       return 0;
    }
-
-   return (res != NULL);
 }
 
 int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
@@ -1176,17 +1248,8 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
          return is_equal == (((struct str*) ast)->cmp == OP_EQ);
       } else { // string
          if (((struct str*) ast)->cmp == OP_RE) {
-
-            memcpy(str_buffer, expr, size);
-            str_buffer[size] = '\0';
-
-            if (regexec(&((struct str*) ast)->re, str_buffer, 0, NULL, 0) == REG_NOMATCH) {
-               // string does not match regular expression
-               return 0;
-            } else {
-               // match
-               return 1;
-            }
+            // string is matched in place, it is not terminated by null byte
+            return matcher_match(&((struct str*) ast)->matcher, expr, size);
          } else {
             // boolean value - record matches filter
             // strings are the same in size & content (size comparisson necessary for zero-sized strings)
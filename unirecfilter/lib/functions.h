@@ -52,6 +52,8 @@
 #include <unirec/unirec.h>
 #include <sys/types.h>
 #include <regex.h>
+#include "sets.h"
+#include "matcher.h"
 
 #define DYN_FIELD_MAX_SIZE 1024 // Maximal size of dynamic field, longer fields will be cutted to this size
 
@@ -108,11 +110,12 @@ struct expression_array {
    node_type type;
    cmp_op cmp;
    char *column;
+   char *source;                    /* text of the list, or path of the file with the list */
+   int from_file;                   /* list is loaded from file (and reloaded on request) */
    uint32_t array_size;
-   uint64_t *array_values;
-   ip_addr_t *array_values_ip;
-   ur_time_t *array_values_date;
-   double *array_values_double;
+   struct int_set *values;          /* integers and times */
+   struct prefix_set *prefixes;     /* IP addresses and prefixes */
+   double *array_values_double;     /* sorted floating point values */
    ur_field_id_t id;
    ur_field_type_t field_type;
 };
@@ -147,6 +150,7 @@ struct str {
    char *column;
    char *s;
    regex_t re;
+   struct str_matcher matcher;
    ur_field_id_t id;
 };
 
@@ -159,11 +163,13 @@ int yylex();
 int yyparse();
 void printAST(struct ast *ast);
 int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec);
+int compareFloating(double a, double b, cmp_op op);
+int compareElemInArray(void *val, struct expression_array *ast);
+int reloadArrays(struct ast *ast);
+void ip_mask(ip_addr_t *tg_ip, ip_addr_t *mask);
 void freeAST(struct ast *tree);
 struct ast *getTree(const char *str, const char *port_number);
 void changeProtocol(struct ast **ast);
 
-char * str_buffer;
-
 #endif /* LIB_UNIREC_FUNCTIONS_H */
 
@@ -52,6 +52,7 @@
 #endif
 
 #include "functions.h"
+#include "program.h"
 #include "liburfilter.h"
 
 urfilter_t *urfilter_create(const char *filter_str, const char *ifc_identifier)
@@ -85,8 +86,40 @@ int urfilter_compile(urfilter_t *unirec_filter)
    return URFILTER_ERROR;
 }
 
-int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, const void *record)
+urfilter_t *urfilter_share(urfilter_t *source)
+{
+   urfilter_t *unirec_filter;
+
+   if (source->filter && !source->tree && urfilter_compile(source) != URFILTER_TRUE) {
+      printf("[URFilter] Syntax error in filter: %s.\n", source->filter);
+      return NULL;
+   }
+   unirec_filter = (urfilter_t *) calloc(1, sizeof(urfilter_t));
+   if (!unirec_filter) {
+      return NULL;
+   }
+   if (source->filter) {
+      unirec_filter->filter = strdup(source->filter);
+      if (!unirec_filter->filter) {
+         free(unirec_filter);
+         return NULL;
+      }
+      unirec_filter->ifc_identifier = source->ifc_identifier;
+      unirec_filter->tree = source->tree;
+      unirec_filter->tree_shared = 1;
+   }
+   unirec_filter->options = source->options;
+   return unirec_filter;
+}
+
+/**
+ * Compile filter if it was not compiled yet and get its program for the template.
+ * \param[out] prog program for the template, NULL if the filter is empty
+ * \return URFILTER_TRUE on success, URFILTER_ERROR on syntax error.
+ */
+static int get_program(urfilter_t *unirec_filter, const ur_template_t *template, struct program **prog)
 {
+   *prog = NULL;
    if (!unirec_filter->tree) {
       if (unirec_filter->filter) {
          if (urfilter_compile(unirec_filter) != URFILTER_TRUE) {
@@ -98,27 +131,157 @@ int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, con
          return URFILTER_ERROR;
       }
    }
-   
+
    // empty filter means always TRUE
    if (!unirec_filter->filter) {
       return URFILTER_TRUE;
    }
-   
-   if (unirec_filter->tree) {
-      return evalAST((struct ast *) unirec_filter->tree, template, record);
+
+   *prog = (struct program *) unirec_filter->program;
+   if (!*prog || !program_check(*prog, template)) {
+      // lower the tree for offsets of fields in the new template, statistics of the old program are kept
+      struct program *prev = *prog;
+      *prog = program_build((struct ast *) unirec_filter->tree, template, unirec_filter->options, prev);
+      program_free(prev);
+      unirec_filter->program = *prog;
+      if (!*prog) {
+         printf("[URFilter] Unable to compile filter rule. Not enough memory.\n");
+         return URFILTER_ERROR;
+      }
+   }
+   return URFILTER_TRUE;
+}
+
+int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, const void *record)
+{
+   struct program *prog;
+
+   if (get_program(unirec_filter, template, &prog) != URFILTER_TRUE) {
+      return URFILTER_ERROR;
+   }
+   if (!prog) {
+      return URFILTER_TRUE;
+   }
+   return program_eval(prog, record);
+}
+
+int urfilter_match_batch(urfilter_t *unirec_filter, const ur_template_t *template, const void *records[], size_t n, uint64_t *out_bitmap)
+{
+   struct program *prog;
+   int matched;
+
+   if (get_program(unirec_filter, template, &prog) != URFILTER_TRUE) {
+      return URFILTER_ERROR;
+   }
+   if (!prog) {
+      // every record matches
+      memset(out_bitmap, 0xFF, (n / 64) * sizeof(uint64_t));
+      if (n % 64) {
+         out_bitmap[n / 64] = (1ULL << (n % 64)) - 1;
+      }
+      return n;
+   }
+   matched = program_eval_batch(prog, records, n, out_bitmap);
+   if (matched < 0) {
+      printf("[URFilter] Unable to match records. Not enough memory.\n");
+      return URFILTER_ERROR;
+   }
+   return matched;
+}
+
+int urfilter_set_options(urfilter_t *unirec_filter, unsigned int options)
+{
+   if (options & ~(URFILTER_PROFILE | URFILTER_ADAPTIVE)) {
+      return URFILTER_ERROR;
+   }
+   unirec_filter->options = options;
+   // program is built again with the options on the next match
+   program_free((struct program *) unirec_filter->program);
+   unirec_filter->program = NULL;
+   return URFILTER_TRUE;
+}
+
+void urfilter_print_stats(urfilter_t *unirec_filter)
+{
+   printf("[URFilter] Statistics of filter %s:\n", unirec_filter->filter ? unirec_filter->filter : "(empty)");
+   if (unirec_filter->program) {
+      program_print_stats((struct program *) unirec_filter->program);
+   } else {
+      printf("No records were matched.\n");
+   }
+}
+
+int urfilter_reload(urfilter_t *unirec_filter)
+{
+   if (!unirec_filter->tree || unirec_filter->tree_shared) {
+      // lists are loaded when the filter is compiled, shared lists by the owner of the tree
+      return URFILTER_TRUE;
+   }
+   if (reloadArrays((struct ast *) unirec_filter->tree) != 0) {
+      printf("[URFilter] Unable to reload some lists of filter: %s.\n", unirec_filter->filter);
+      return URFILTER_ERROR;
+   }
+   return URFILTER_TRUE;
+}
+
+urfilter_group_t *urfilter_group_create(urfilter_t **filters, size_t count)
+{
+   urfilter_group_t *group = (urfilter_group_t *) calloc(1, sizeof(urfilter_group_t));
+   if (!group) {
+      return NULL;
+   }
+   group->count = count;
+   group->filters = (urfilter_t **) malloc((count + 1) * sizeof(urfilter_t *));
+   group->programs = (void **) calloc(count + 1, sizeof(void *));
+   if (!group->filters || !group->programs) {
+      urfilter_group_destroy(group);
+      return NULL;
+   }
+   memcpy(group->filters, filters, count * sizeof(urfilter_t *));
+   return group;
+}
+
+int urfilter_group_match(urfilter_group_t *group, const ur_template_t *template, const void *record, uint64_t *out_bitmap)
+{
+   struct program_group *shared = (struct program_group *) group->shared;
+   struct program **programs = (struct program **) group->programs;
+
+   for (size_t i = 0; i < group->count; i++) {
+      if (get_program(group->filters[i], template, &programs[i]) != URFILTER_TRUE) {
+         return URFILTER_ERROR;
+      }
+   }
+   if (!shared || !program_group_check(shared, (const struct program *const *) programs)) {
+      // some program was built again, e.g. for a new template
+      program_group_free(shared);
+      shared = program_group_build((const struct program *const *) programs, group->count);
+      group->shared = shared;
+      if (!shared) {
+         printf("[URFilter] Unable to compile group of filters. Not enough memory.\n");
+         return URFILTER_ERROR;
+      }
    }
+   return program_group_eval(shared, record, out_bitmap);
+}
 
-   printf("[URFilter] Trying to match UniRec to uninitalized filter. Returning FALSE.\n");
-   return URFILTER_FALSE;
+void urfilter_group_destroy(urfilter_group_t *group)
+{
+   if (group) {
+      program_group_free((struct program_group *) group->shared);
+      free(group->filters);
+      free(group->programs);
+      free(group);
+   }
 }
 
 void urfilter_destroy(urfilter_t *object)
 {
    if (object) {
       free(object->filter);
-      if (object->tree) {
+      if (object->tree && !object->tree_shared) {
          freeAST((struct ast *) object->tree);
       }
+      program_free((struct program *) object->program);
       free(object);
    }
 }
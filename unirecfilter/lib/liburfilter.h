@@ -55,12 +55,30 @@
 #define URFILTER_FALSE 0
 #define URFILTER_ERROR (-1)
 
+/* Options of filter */
+#define URFILTER_PROFILE  0x01   /**< count evaluations, true results and time of every comparison */
+#define URFILTER_ADAPTIVE 0x02   /**< reorder comparisons by their selectivity observed on sampled records */
+
 typedef struct urfilter_s {
    char *filter;
    void *tree;
    const char *ifc_identifier;
+   void *program; /**< tree compiled for the last matched template */
+   unsigned int options; /**< URFILTER_PROFILE, URFILTER_ADAPTIVE */
+   int tree_shared; /**< tree belongs to another filter, see urfilter_share() */
 } urfilter_t;
 
+/**
+ * Group of filters matched together on the same records, e.g. filters of several output interfaces.
+ * Comparisons which are equal in more filters (e.g. SRC_IP in [10.0.0.0/8]) are evaluated once per record.
+ */
+typedef struct urfilter_group_s {
+   urfilter_t **filters; /**< filters of the group, they are not owned by the group */
+   size_t count; /**< number of filters */
+   void **programs; /**< programs of the filters for the matched template */
+   void *shared; /**< comparisons shared by the programs */
+} urfilter_group_t;
+
 /**
  *
  * \param[in] ifc_identifier Identification of TRAP IFC where the filter is used.
@@ -75,11 +93,72 @@ urfilter_t *urfilter_create(const char *filter_str, const char *ifc_identifier);
 int urfilter_compile(urfilter_t *unirec_filter);
 
 /**
- *
+ * Create filter which uses the tree of source filter, e.g. a copy of the filter for another thread.
+ * The source filter is compiled if it was not compiled yet, so the new filter is never parsed again.
+ * The tree is read-only during matching, only programs for templates are built for every filter separately,
+ * so the filters can be matched in different threads. The source filter has to exist until the new
+ * filter is destroyed, lists of values given by file are reloaded by urfilter_reload() of the source.
+ * \return Pointer to the new filter, NULL on syntax error or if memory could not be allocated.
+ */
+urfilter_t *urfilter_share(urfilter_t *source);
+
+/**
+ * Filter is compiled into a program for the template of the record on the first call
+ * and again whenever the template changes.
  * \return Result of condition eval: URFILTER_TRUE/URFILTER_FALSE. URFILTER_ERROR on syntax error.
  */
 int urfilter_match(urfilter_t *unirec_filter, const ur_template_t *template, const void *record);
 
+/**
+ * Match a batch of records of the same template, every comparison of the filter is evaluated
+ * for all records at once.
+ * \param[in] records array of n records
+ * \param[out] out_bitmap selection bitmap of (n + 63) / 64 words, bit (i % 64) of word (i / 64) is set if records[i] matches.
+ * \return Count of matching records. URFILTER_ERROR on syntax error.
+ */
+int urfilter_match_batch(urfilter_t *unirec_filter, const ur_template_t *template, const void *records[], size_t n, uint64_t *out_bitmap);
+
+/**
+ * Set options of filter evaluation. Comparisons are always ordered by their estimated cost,
+ * with URFILTER_ADAPTIVE also by their selectivity measured on every 64th record.
+ * Statistics of the filter are reset.
+ * \param[in] options bitwise OR of URFILTER_PROFILE and URFILTER_ADAPTIVE, 0 to disable both
+ * \return URFILTER_TRUE on success and URFILTER_ERROR on unknown option.
+ */
+int urfilter_set_options(urfilter_t *unirec_filter, unsigned int options);
+
+/**
+ * Print number of evaluations, true results and time of every comparison of the filter
+ * for the last matched template, in order of evaluation. Counters are updated with URFILTER_PROFILE only.
+ */
+void urfilter_print_stats(urfilter_t *unirec_filter);
+
+/**
+ * Load lists of values given by file (e.g. SRC_IP in file:"/path") again, the rest of
+ * the filter is not compiled again. When a list can not be loaded, its previous values are kept.
+ * Filters sharing the tree (urfilter_share()) see the new values, for them the call does nothing.
+ * \return URFILTER_TRUE on success and URFILTER_ERROR if some list could not be loaded.
+ */
+int urfilter_reload(urfilter_t *unirec_filter);
+
 void urfilter_destroy(urfilter_t *object);
 
+/**
+ * Create group of filters to be matched together. The filters are not copied, they have to
+ * exist until the group is destroyed, and the group has to be created again when a filter is replaced.
+ * \param[in] filters array of count filters, the array itself is copied
+ * \return Pointer to the group, NULL if memory could not be allocated.
+ */
+urfilter_group_t *urfilter_group_create(urfilter_t **filters, size_t count);
+
+/**
+ * Match record with all filters of the group, the result is the same as of urfilter_match()
+ * with every filter. The group is not thread-safe, results of comparisons are cached in it.
+ * \param[out] out_bitmap (count + 63) / 64 words, bit (i % 64) of word (i / 64) is set if the record matches filter i.
+ * \return Count of matching filters. URFILTER_ERROR on syntax error.
+ */
+int urfilter_group_match(urfilter_group_t *group, const ur_template_t *template, const void *record, uint64_t *out_bitmap);
+
+void urfilter_group_destroy(urfilter_group_t *group);
+
 #endif /* LIBUNIRECFILTER_H */
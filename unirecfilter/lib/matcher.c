@@ -0,0 +1,953 @@
+/**
+ * \file matcher.c
+ * \brief Matcher of regular expressions on strings of given length
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "matcher.h"
+
+/* Types of nodes of parsed expression */
+enum {
+   RE_EMPTY,      /* empty string */
+   RE_SET,        /* one byte of set */
+   RE_BOL,        /* start of string */
+   RE_EOL,        /* end of string */
+   RE_CONCAT,
+   RE_ALT,
+   RE_REPEAT      /* left node repeated min to max times, max < 0 means unlimited */
+};
+
+struct re_node {
+   uint8_t type;
+   int min, max;
+   int left, right;
+   int set;       /* SET: index of set of bytes */
+};
+
+struct byte_set {
+   uint64_t bits[4];
+};
+
+/* Parser of expression into tree of nodes, nodes and sets are allocated for the longest pattern */
+struct re_parser {
+   const char *p;          /* current position in pattern */
+   int depth;              /* number of open groups */
+   struct re_node *nodes;
+   int node_count;
+   int node_capacity;
+   struct byte_set *sets;
+   int set_count;
+   int set_capacity;
+};
+
+/* Types of states of nondeterministic automaton */
+enum {
+   NFA_MATCH,     /* expression matches */
+   NFA_SET,       /* reads byte of set and continues to out */
+   NFA_SPLIT,     /* continues to both out and out1 */
+   NFA_BOL,       /* continues to out at start of string */
+   NFA_EOL        /* continues to out at end of string */
+};
+
+struct nfa_state {
+   uint8_t type;
+   int out, out1;
+   int set;
+};
+
+struct nfa {
+   struct nfa_state *states;
+   int count;
+};
+
+static inline int set_has(const struct byte_set *set, int byte)
+{
+   return (set->bits[byte >> 6] >> (byte & 63)) & 1;
+}
+
+static inline void set_add(struct byte_set *set, int byte)
+{
+   set->bits[byte >> 6] |= 1ULL << (byte & 63);
+}
+
+/* ---------------------------------------------------------------- */
+
+static int new_node(struct re_parser *ps, uint8_t type, int left, int right)
+{
+   if (ps->node_count == ps->node_capacity) {
+      return -1;
+   }
+   struct re_node *node = &ps->nodes[ps->node_count];
+   memset(node, 0, sizeof(*node));
+   node->type = type;
+   node->left = left;
+   node->right = right;
+   return ps->node_count++;
+}
+
+static int new_set_node(struct re_parser *ps, const struct byte_set *set)
+{
+   if (ps->set_count == ps->set_capacity) {
+      return -1;
+   }
+   int node = new_node(ps, RE_SET, -1, -1);
+   if (node >= 0) {
+      ps->sets[ps->set_count] = *set;
+      ps->nodes[node].set = ps->set_count++;
+   }
+   return node;
+}
+
+/**
+ * Add bytes of character class given by name (e.g. "alpha:]") to set, bytes are classified as in C locale.
+ * \return Length of the name including ":]", -1 if the class is not known.
+ */
+static int add_class(struct byte_set *set, const char *name)
+{
+   static const struct {
+      const char *name;
+      int (*is)(int);
+   } classes[] = {
+      {"alpha:]", isalpha}, {"digit:]", isdigit}, {"alnum:]", isalnum}, {"upper:]", isupper},
+      {"lower:]", islower}, {"space:]", isspace}, {"blank:]", isblank}, {"punct:]", ispunct},
+      {"print:]", isprint}, {"graph:]", isgraph}, {"cntrl:]", iscntrl}, {"xdigit:]", isxdigit},
+   };
+
+   for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+      size_t len = strlen(classes[i].name);
+      if (strncmp(name, classes[i].name, len) == 0) {
+         for (int b = 0; b < 128; b++) {
+            if (classes[i].is(b)) {
+               set_add(set, b);
+            }
+         }
+         return len;
+      }
+   }
+   return -1;
+}
+
+/**
+ * Parse bracket expression, the opening bracket is already read.
+ */
+static int parse_bracket(struct re_parser *ps)
+{
+   struct byte_set set;
+   int negate = 0;
+   int first = 1;
+
+   memset(&set, 0, sizeof(set));
+   if (*ps->p == '^') {
+      negate = 1;
+      ps->p++;
+   }
+   // closing bracket at the first position is an ordinary character
+   while (first || *ps->p != ']') {
+      const char *p = ps->p;
+      first = 0;
+      if (!*p) {
+         return -1;
+      }
+      if (p[0] == '[' && p[1] == ':') {
+         int len = add_class(&set, p + 2);
+         if (len < 0) {
+            return -1;
+         }
+         ps->p += 2 + len;
+         continue;
+      }
+      if (p[0] == '[' && (p[1] == '=' || p[1] == '.')) {
+         // equivalence classes and collating symbols are not supported
+         return -1;
+      }
+      int lo = (unsigned char) p[0];
+      if (p[1] == '-' && p[2] && p[2] != ']') {
+         int hi = (unsigned char) p[2];
+         if (p[2] == '[' || hi < lo) {
+            return -1;
+         }
+         for (int b = lo; b <= hi; b++) {
+            set_add(&set, b);
+         }
+         ps->p += 3;
+      } else {
+         set_add(&set, lo);
+         ps->p++;
+      }
+   }
+   ps->p++;
+
+   if (negate) {
+      for (int i = 0; i < 4; i++) {
+         set.bits[i] = ~set.bits[i];
+      }
+   }
+   return new_set_node(ps, &set);
+}
+
+static int parse_alt(struct re_parser *ps);
+
+static int parse_atom(struct re_parser *ps)
+{
+   struct byte_set set;
+   int node;
+   unsigned char c = *ps->p++;
+
+   memset(&set, 0, sizeof(set));
+   switch (c) {
+   case '(':
+      ps->depth++;
+      node = parse_alt(ps);
+      if (node < 0 || *ps->p != ')') {
+         return -1;
+      }
+      ps->p++;
+      ps->depth--;
+      return node;
+   case '[':
+      return parse_bracket(ps);
+   case '.':
+      // any byte except null byte
+      memset(&set, 0xFF, sizeof(set));
+      set.bits[0] &= ~1ULL;
+      return new_set_node(ps, &set);
+   case '^':
+      return new_node(ps, RE_BOL, -1, -1);
+   case '$':
+      return new_node(ps, RE_EOL, -1, -1);
+   case '\\':
+      c = *ps->p++;
+      if (!c || !strchr(".[]()*+?{}|^$\\", c)) {
+         // back-references and GNU extensions are not supported
+         return -1;
+      }
+      break;
+   case '*':
+   case '+':
+   case '?':
+   case '{':
+      // nothing to repeat
+      return -1;
+   default:
+      break;
+   }
+   set_add(&set, c);
+   return new_set_node(ps, &set);
+}
+
+/**
+ * Parse bounds of interval {min}, {min,} or {min,max}, the opening brace is already read.
+ */
+static int parse_interval(struct re_parser *ps, int *min, int *max)
+{
+   char *end;
+
+   if (!isdigit((unsigned char) *ps->p)) {
+      return -1;
+   }
+   *min = strtol(ps->p, &end, 10);
+   *max = *min;
+   if (*end == ',') {
+      end++;
+      *max = -1;
+      if (isdigit((unsigned char) *end)) {
+         *max = strtol(end, &end, 10);
+      }
+   }
+   if (*end != '}' || *min > RE_DUP_MAX || *max > RE_DUP_MAX || (*max >= 0 && *max < *min)) {
+      return -1;
+   }
+   ps->p = end + 1;
+   return 0;
+}
+
+/**
+ * Check whether node contains start or end of string assertion.
+ */
+static int has_anchor(const struct re_parser *ps, int node)
+{
+   const struct re_node *n = &ps->nodes[node];
+
+   switch (n->type) {
+   case RE_BOL:
+   case RE_EOL:
+      return 1;
+   case RE_CONCAT:
+   case RE_ALT:
+      return has_anchor(ps, n->left) || has_anchor(ps, n->right);
+   case RE_REPEAT:
+      return has_anchor(ps, n->left);
+   default:
+      return 0;
+   }
+}
+
+static int parse_piece(struct re_parser *ps)
+{
+   int node = parse_atom(ps);
+
+   while (node >= 0 && *ps->p && strchr("*+?{", *ps->p)) {
+      int min = 0, max = -1;
+      char c = *ps->p++;
+      // repeated anchors are left to regexec, so that the results stay the same as before
+      if (has_anchor(ps, node)) {
+         return -1;
+      }
+      if (c == '+') {
+         min = 1;
+      } else if (c == '?') {
+         max = 1;
+      } else if (c == '{' && parse_interval(ps, &min, &max) != 0) {
+         return -1;
+      }
+      node = new_node(ps, RE_REPEAT, node, -1);
+      if (node >= 0) {
+         ps->nodes[node].min = min;
+         ps->nodes[node].max = max;
+      }
+   }
+   return node;
+}
+
+static int parse_concat(struct re_parser *ps)
+{
+   int node = new_node(ps, RE_EMPTY, -1, -1);
+
+   // closing parenthesis without opening one is an ordinary character
+   while (node >= 0 && *ps->p && *ps->p != '|' && !(*ps->p == ')' && ps->depth > 0)) {
+      int piece = parse_piece(ps);
+      if (piece < 0) {
+         return -1;
+      }
+      node = new_node(ps, RE_CONCAT, node, piece);
+   }
+   return node;
+}
+
+static int parse_alt(struct re_parser *ps)
+{
+   int node = parse_concat(ps);
+
+   while (node >= 0 && *ps->p == '|') {
+      ps->p++;
+      int right = parse_concat(ps);
+      if (right < 0) {
+         return -1;
+      }
+      node = new_node(ps, RE_ALT, node, right);
+   }
+   return node;
+}
+
+/* ---------------------------------------------------------------- */
+
+/**
+ * Append literal of concatenation to the literal.
+ * \return 0 on success, -1 if the node is not a literal.
+ */
+static int collect_literal(const struct re_parser *ps, int node, struct matcher_literal *literal)
+{
+   const struct re_node *n = &ps->nodes[node];
+   const struct byte_set *set;
+   int byte = -1;
+
+   switch (n->type) {
+   case RE_EMPTY:
+      return 0;
+   case RE_CONCAT:
+      if (collect_literal(ps, n->left, literal) != 0) {
+         return -1;
+      }
+      return collect_literal(ps, n->right, literal);
+   case RE_BOL:
+      if (literal->len > 0 || literal->anchor) {
+         return -1;
+      }
+      literal->anchor |= MATCHER_ANCHOR_START;
+      return 0;
+   case RE_EOL:
+      if (literal->anchor & MATCHER_ANCHOR_END) {
+         return -1;
+      }
+      literal->anchor |= MATCHER_ANCHOR_END;
+      return 0;
+   case RE_SET:
+      set = &ps->sets[n->set];
+      for (int b = 0; b < 256; b++) {
+         if (set_has(set, b)) {
+            if (byte >= 0) {
+               return -1;
+            }
+            byte = b;
+         }
+      }
+      if (byte < 0 || (literal->anchor & MATCHER_ANCHOR_END)) {
+         return -1;
+      }
+      literal->s[literal->len++] = byte;
+      return 0;
+   default:
+      return -1;
+   }
+}
+
+/**
+ * Get branches of alternation.
+ * \return Number of branches, -1 if there are more than MATCHER_MAX_LITERALS.
+ */
+static int collect_branches(const struct re_parser *ps, int node, int *branches, int count)
+{
+   const struct re_node *n = &ps->nodes[node];
+
+   if (n->type == RE_ALT) {
+      count = collect_branches(ps, n->left, branches, count);
+      return count < 0 ? -1 : collect_branches(ps, n->right, branches, count);
+   }
+   if (count == MATCHER_MAX_LITERALS) {
+      return -1;
+   }
+   branches[count] = node;
+   return count + 1;
+}
+
+static void free_literals(struct str_matcher *matcher)
+{
+   for (uint32_t i = 0; i < matcher->literal_count; i++) {
+      free(matcher->literals[i].s);
+   }
+   matcher->literal_count = 0;
+}
+
+/**
+ * Compile expression as list of literals.
+ * \return 0 on success, -1 if the expression is not alternation of a few literals.
+ */
+static int compile_literals(struct str_matcher *matcher, const struct re_parser *ps, int root, size_t max_len)
+{
+   int branches[MATCHER_MAX_LITERALS];
+   int count = collect_branches(ps, root, branches, 0);
+
+   if (count < 0) {
+      return -1;
+   }
+   for (int i = 0; i < count; i++) {
+      struct matcher_literal *literal = &matcher->literals[i];
+      literal->s = (char *) malloc(max_len + 1);
+      literal->len = 0;
+      literal->anchor = 0;
+      matcher->literal_count++;
+      if (!literal->s || collect_literal(ps, branches[i], literal) != 0) {
+         free_literals(matcher);
+         return -1;
+      }
+   }
+   matcher->kind = MATCHER_LITERALS;
+   return 0;
+}
+
+/* ---------------------------------------------------------------- */
+
+static int nfa_add(struct nfa *nfa, uint8_t type, int out, int out1, int set)
+{
+   if (nfa->count == MATCHER_MAX_NFA_STATES) {
+      return -1;
+   }
+   nfa->states[nfa->count].type = type;
+   nfa->states[nfa->count].out = out;
+   nfa->states[nfa->count].out1 = out1;
+   nfa->states[nfa->count].set = set;
+   return nfa->count++;
+}
+
+/**
+ * Add states of node to automaton, they are created backwards from the state following the node.
+ * \param[in] next state following the node
+ * \return The first state of node, -1 if there are too many states.
+ */
+static int emit(struct nfa *nfa, const struct re_parser *ps, int node, int next)
+{
+   const struct re_node *n = &ps->nodes[node];
+   int start;
+
+   if (next < 0) {
+      return -1;
+   }
+   switch (n->type) {
+   case RE_EMPTY:
+      return next;
+   case RE_SET:
+      return nfa_add(nfa, NFA_SET, next, -1, n->set);
+   case RE_BOL:
+      return nfa_add(nfa, NFA_BOL, next, -1, -1);
+   case RE_EOL:
+      return nfa_add(nfa, NFA_EOL, next, -1, -1);
+   case RE_CONCAT:
+      return emit(nfa, ps, n->left, emit(nfa, ps, n->right, next));
+   case RE_ALT: {
+      int left = emit(nfa, ps, n->left, next);
+      int right = emit(nfa, ps, n->right, next);
+      return left < 0 || right < 0 ? -1 : nfa_add(nfa, NFA_SPLIT, left, right, -1);
+   }
+   case RE_REPEAT:
+      if (n->max < 0) {
+         // loop, split state enters the node again or leaves it
+         int loop = nfa_add(nfa, NFA_SPLIT, -1, next, -1);
+         start = loop < 0 ? -1 : emit(nfa, ps, n->left, loop);
+         if (start < 0) {
+            return -1;
+         }
+         nfa->states[loop].out = start;
+         next = loop;
+      } else {
+         // optional repetitions, skipping one skips all the following
+         int end = next;
+         for (int i = n->min; i < n->max; i++) {
+            start = emit(nfa, ps, n->left, next);
+            next = start < 0 ? -1 : nfa_add(nfa, NFA_SPLIT, start, end, -1);
+         }
+      }
+      for (int i = 0; i < n->min; i++) {
+         next = emit(nfa, ps, n->left, next);
+      }
+      return next;
+   default:
+      return -1;
+   }
+}
+
+/* Builder of deterministic automaton by subset construction */
+struct dfa_builder {
+   const struct nfa *nfa;
+   const struct byte_set *sets;
+   int words;              /* number of words of bitmap of NFA states */
+   uint64_t *keys;         /* bitmaps of NFA states of DFA states */
+   uint32_t *table;        /* hash table of DFA state index + 1, 0 is free slot */
+   uint32_t table_mask;
+   int *stack;
+   uint64_t *visited;
+};
+
+/**
+ * Compute states of NFA reachable from seeds without reading a byte. Only states
+ * which read a byte, end of string assertions and the match state are kept in key.
+ */
+static void closure(struct dfa_builder *b, const int *seeds, int count, int allow_bol, int allow_eol, uint64_t *key)
+{
+   int top = 0;
+
+   memset(b->visited, 0, b->words * sizeof(uint64_t));
+   memset(key, 0, b->words * sizeof(uint64_t));
+   for (int i = 0; i < count; i++) {
+      b->stack[top++] = seeds[i];
+   }
+   while (top > 0) {
+      int s = b->stack[--top];
+      const struct nfa_state *state = &b->nfa->states[s];
+      if (b->visited[s >> 6] & (1ULL << (s & 63))) {
+         continue;
+      }
+      b->visited[s >> 6] |= 1ULL << (s & 63);
+      switch (state->type) {
+      case NFA_MATCH:
+      case NFA_SET:
+         key[s >> 6] |= 1ULL << (s & 63);
+         break;
+      case NFA_EOL:
+         key[s >> 6] |= 1ULL << (s & 63);
+         if (allow_eol) {
+            b->stack[top++] = state->out;
+         }
+         break;
+      case NFA_BOL:
+         if (allow_bol) {
+            b->stack[top++] = state->out;
+         }
+         break;
+      case NFA_SPLIT:
+         b->stack[top++] = state->out;
+         b->stack[top++] = state->out1;
+         break;
+      }
+   }
+}
+
+static uint32_t key_hash(const uint64_t *key, int words)
+{
+   uint64_t h = 0;
+   for (int i = 0; i < words; i++) {
+      h = (h ^ key[i]) * 0x9E3779B97F4A7C15ULL;
+   }
+   return h >> 32;
+}
+
+/**
+ * Get flags of DFA state with given set of NFA states.
+ */
+static uint8_t state_flags(struct dfa_builder *b, const uint64_t *key, int initial, uint64_t *tmp)
+{
+   uint8_t flags = 0;
+   int count = 0;
+   int empty = 1;
+
+   // state 0 of NFA is the match state
+   if (key[0] & 1) {
+      return MATCHER_ACCEPT;
+   }
+   for (int s = 0; s < b->nfa->count; s++) {
+      if (key[s >> 6] & (1ULL << (s & 63))) {
+         empty = 0;
+         if (b->nfa->states[s].type == NFA_EOL) {
+            b->stack[b->nfa->count * 2 + count++] = s;
+         }
+      }
+   }
+   if (empty) {
+      return MATCHER_DEAD;
+   }
+   if (count) {
+      // seeds are stored behind the part of stack used by closure
+      closure(b, b->stack + b->nfa->count * 2, count, initial, 1, tmp);
+      if (tmp[0] & 1) {
+         flags |= MATCHER_ACCEPT_END;
+      }
+   }
+   return flags;
+}
+
+/**
+ * Compute classes of bytes which are in the same sets, so that they have the same transitions.
+ */
+static void compute_classes(struct str_matcher *matcher, const struct byte_set *sets, int set_count)
+{
+   int map[256][2];
+
+   memset(matcher->classes, 0, sizeof(matcher->classes));
+   matcher->class_count = 1;
+   for (int i = 0; i < set_count; i++) {
+      int count = 0;
+      memset(map, 0xFF, sizeof(map));
+      for (int b = 0; b < 256; b++) {
+         int *class = &map[matcher->classes[b]][set_has(&sets[i], b)];
+         if (*class < 0) {
+            *class = count++;
+         }
+         matcher->classes[b] = *class;
+      }
+      matcher->class_count = count;
+   }
+}
+
+/**
+ * Find DFA state with given set of NFA states, or add it.
+ * \return Index of the state, -1 if there are too many states.
+ */
+static int find_state(struct str_matcher *matcher, struct dfa_builder *b, const uint64_t *key, uint64_t *tmp)
+{
+   uint32_t i = key_hash(key, b->words) & b->table_mask;
+
+   for (; b->table[i]; i = (i + 1) & b->table_mask) {
+      if (memcmp(b->keys + (b->table[i] - 1) * b->words, key, b->words * sizeof(uint64_t)) == 0) {
+         return b->table[i] - 1;
+      }
+   }
+   if (matcher->state_count == MATCHER_MAX_DFA_STATES) {
+      return -1;
+   }
+   int state = matcher->state_count++;
+   memcpy(b->keys + state * b->words, key, b->words * sizeof(uint64_t));
+   matcher->flags[state] = state_flags(b, key, 0, tmp);
+   b->table[i] = state + 1;
+   return state;
+}
+
+/**
+ * Build deterministic automaton which searches for the expression anywhere in string.
+ * \return 0 on success, -1 if the automaton would be too large or memory could not be allocated.
+ */
+static int build_dfa(struct str_matcher *matcher, const struct nfa *nfa, int start, const struct byte_set *sets, int set_count)
+{
+   struct dfa_builder b;
+   int rep[256];
+   int ret = -1;
+
+   compute_classes(matcher, sets, set_count);
+   for (int c = 255; c >= 0; c--) {
+      rep[matcher->classes[c]] = c;
+   }
+
+   memset(&b, 0, sizeof(b));
+   b.nfa = nfa;
+   b.sets = sets;
+   b.words = (nfa->count + 63) / 64;
+   b.table_mask = 2 * MATCHER_MAX_DFA_STATES - 1;
+   b.keys = (uint64_t *) malloc((MATCHER_MAX_DFA_STATES + 2) * b.words * sizeof(uint64_t));
+   b.table = (uint32_t *) calloc(b.table_mask + 1, sizeof(uint32_t));
+   b.stack = (int *) malloc(3 * nfa->count * sizeof(int) + sizeof(int));
+   b.visited = (uint64_t *) malloc(b.words * sizeof(uint64_t));
+   matcher->next = (uint32_t *) malloc(MATCHER_MAX_DFA_STATES * matcher->class_count * sizeof(uint32_t));
+   matcher->flags = (uint8_t *) malloc(MATCHER_MAX_DFA_STATES);
+   if (!b.keys || !b.table || !b.stack || !b.visited || !matcher->next || !matcher->flags) {
+      goto cleanup;
+   }
+   // two keys behind the states are used as temporary ones
+   uint64_t *key = b.keys + MATCHER_MAX_DFA_STATES * b.words;
+   uint64_t *tmp = key + b.words;
+
+   // initial state is the only one where start of string matches, it is not in hash table
+   closure(&b, &start, 1, 1, 0, b.keys);
+   matcher->flags[0] = state_flags(&b, b.keys, 1, tmp);
+   matcher->state_count = 1;
+
+   for (uint32_t i = 0; i < matcher->state_count; i++) {
+      uint32_t *next = matcher->next + i * matcher->class_count;
+      if (matcher->flags[i] & (MATCHER_ACCEPT | MATCHER_DEAD)) {
+         // matching stops in this state
+         for (uint32_t c = 0; c < matcher->class_count; c++) {
+            next[c] = i;
+         }
+         continue;
+      }
+      for (uint32_t c = 0; c < matcher->class_count; c++) {
+         const uint64_t *state_key = b.keys + i * b.words;
+         int count = 0;
+         for (int s = 0; s < nfa->count; s++) {
+            if ((state_key[s >> 6] & (1ULL << (s & 63))) && nfa->states[s].type == NFA_SET &&
+                set_has(&sets[nfa->states[s].set], rep[c])) {
+               b.stack[2 * nfa->count + count++] = nfa->states[s].out;
+            }
+         }
+         // expression may start at any position
+         b.stack[2 * nfa->count + count++] = start;
+         closure(&b, b.stack + 2 * nfa->count, count, 0, 0, key);
+         int state = find_state(matcher, &b, key, tmp);
+         if (state < 0) {
+            goto cleanup;
+         }
+         next[c] = state;
+      }
+   }
+   // transitions are stored as offsets of rows with flags which stop matching in the lowest bits
+   for (uint32_t i = 0; i < matcher->state_count * matcher->class_count; i++) {
+      uint32_t state = matcher->next[i];
+      matcher->next[i] = (state * matcher->class_count) << 2 | (matcher->flags[state] & (MATCHER_ACCEPT | MATCHER_DEAD));
+   }
+   uint32_t *shrunk = (uint32_t *) realloc(matcher->next, matcher->state_count * matcher->class_count * sizeof(uint32_t));
+   if (shrunk) {
+      matcher->next = shrunk;
+   }
+   ret = 0;
+
+cleanup:
+   free(b.keys);
+   free(b.table);
+   free(b.stack);
+   free(b.visited);
+   if (ret != 0) {
+      free(matcher->next);
+      free(matcher->flags);
+      matcher->next = NULL;
+      matcher->flags = NULL;
+      matcher->state_count = 0;
+   }
+   return ret;
+}
+
+/**
+ * Compile expression into deterministic automaton.
+ * \return 0 on success, -1 if the automaton would be too large or memory could not be allocated.
+ */
+static int compile_dfa(struct str_matcher *matcher, const struct re_parser *ps, int root)
+{
+   struct nfa nfa;
+   int ret = -1;
+
+   nfa.count = 0;
+   nfa.states = (struct nfa_state *) malloc(MATCHER_MAX_NFA_STATES * sizeof(struct nfa_state));
+   if (!nfa.states) {
+      return -1;
+   }
+   int match = nfa_add(&nfa, NFA_MATCH, -1, -1, -1);
+   int start = emit(&nfa, ps, root, match);
+   if (start >= 0 && build_dfa(matcher, &nfa, start, ps->sets, ps->set_count) == 0) {
+      matcher->kind = MATCHER_DFA;
+      ret = 0;
+   }
+   free(nfa.states);
+   return ret;
+}
+
+/* ---------------------------------------------------------------- */
+
+/**
+ * \brief Compile regular expression into matcher.
+ * When the expression can not be compiled into literals or automaton, the matcher uses
+ * the given regex_t, so it has to be valid while the matcher is used.
+ * \param[out] matcher  matcher to initialize
+ * \param[in] pattern   POSIX extended regular expression
+ * \param[in] re        the expression compiled by regcomp() with REG_EXTENDED flag
+ */
+void matcher_compile(struct str_matcher *matcher, const char *pattern, const regex_t *re)
+{
+   struct re_parser ps;
+   size_t len = strlen(pattern);
+
+   memset(matcher, 0, sizeof(*matcher));
+   matcher->kind = MATCHER_REGEX;
+   matcher->re = re;
+   matcher->pattern = strdup(pattern);
+
+   memset(&ps, 0, sizeof(ps));
+   ps.p = pattern;
+   ps.node_capacity = 4 * len + 4;
+   ps.set_capacity = len + 1;
+   ps.nodes = (struct re_node *) malloc(ps.node_capacity * sizeof(struct re_node));
+   ps.sets = (struct byte_set *) malloc(ps.set_capacity * sizeof(struct byte_set));
+   if (ps.nodes && ps.sets) {
+      int root = parse_alt(&ps);
+      if (root >= 0 && *ps.p == 0 && compile_literals(matcher, &ps, root, len) != 0) {
+         compile_dfa(matcher, &ps, root);
+      }
+   }
+   free(ps.nodes);
+   free(ps.sets);
+}
+
+static int literal_match(const struct matcher_literal *literal, const char *s, size_t len)
+{
+   const char *p, *last;
+
+   if (literal->len > len) {
+      return 0;
+   }
+   switch (literal->anchor) {
+   case MATCHER_ANCHOR_START | MATCHER_ANCHOR_END:
+      return literal->len == len && memcmp(s, literal->s, len) == 0;
+   case MATCHER_ANCHOR_START:
+      return memcmp(s, literal->s, literal->len) == 0;
+   case MATCHER_ANCHOR_END:
+      return memcmp(s + len - literal->len, literal->s, literal->len) == 0;
+   default:
+      if (literal->len == 0) {
+         return 1;
+      }
+      // candidates are found by the first byte
+      last = s + len - literal->len;
+      for (p = s; p <= last && (p = (const char *) memchr(p, literal->s[0], last - p + 1)) != NULL; p++) {
+         if (memcmp(p + 1, literal->s + 1, literal->len - 1) == 0) {
+            return 1;
+         }
+      }
+      return 0;
+   }
+}
+
+static int dfa_match(const struct str_matcher *matcher, const char *s, size_t len)
+{
+   const unsigned char *p = (const unsigned char *) s;
+   const unsigned char *end = p + len;
+   uint32_t row = 0;
+   uint32_t next;
+
+   if (matcher->flags[0] & (MATCHER_ACCEPT | MATCHER_DEAD)) {
+      return matcher->flags[0] & MATCHER_ACCEPT;
+   }
+   while (p < end) {
+      next = matcher->next[row + matcher->classes[*p++]];
+      if (next & (MATCHER_ACCEPT | MATCHER_DEAD)) {
+         return next & MATCHER_ACCEPT;
+      }
+      row = next >> 2;
+   }
+   return (matcher->flags[row / matcher->class_count] & MATCHER_ACCEPT_END) != 0;
+}
+
+static int regex_match(const regex_t *re, const char *s, size_t len)
+{
+#ifdef REG_STARTEND
+   regmatch_t match;
+   match.rm_so = 0;
+   match.rm_eo = len;
+   return regexec(re, s, 1, &match, REG_STARTEND) == 0;
+#else
+   char buffer[len + 1];
+   memcpy(buffer, s, len);
+   buffer[len] = '\0';
+   return regexec(re, buffer, 0, NULL, 0) == 0;
+#endif
+}
+
+/**
+ * \brief Check whether the string contains match of the expression.
+ * \param[in] matcher compiled expression
+ * \param[in] s       string, it does not need to be terminated by null byte
+ * \param[in] len     length of the string
+ * \return 1 if the expression matches, 0 otherwise.
+ */
+int matcher_match(const struct str_matcher *matcher, const char *s, size_t len)
+{
+   switch (matcher->kind) {
+   case MATCHER_LITERALS:
+      for (uint32_t i = 0; i < matcher->literal_count; i++) {
+         if (literal_match(&matcher->literals[i], s, len)) {
+            return 1;
+         }
+      }
+      return 0;
+   case MATCHER_DFA:
+      return dfa_match(matcher, s, len);
+   default:
+      return regex_match(matcher->re, s, len);
+   }
+}
+
+void matcher_free(struct str_matcher *matcher)
+{
+   free_literals(matcher);
+   free(matcher->next);
+   free(matcher->flags);
+   free(matcher->pattern);
+   matcher->next = NULL;
+   matcher->flags = NULL;
+   matcher->pattern = NULL;
+}
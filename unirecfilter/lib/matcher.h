@@ -0,0 +1,106 @@
+/**
+ * \file matcher.h
+ * \brief Matcher of regular expressions on strings of given length
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_MATCHER_H
+#define LIB_UNIREC_MATCHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <regex.h>
+
+/*
+ * POSIX extended regular expression is compiled into one of:
+ * - list of literals, if the expression is alternation of a few strings, optionally anchored
+ *   (e.g. "^www\.", "\.com$|\.net$"), they are compared by memcmp or searched by memchr,
+ * - deterministic automaton over classes of equivalent bytes, which reads every byte of
+ *   the string once and stops as soon as the result is known,
+ * - the regex_t itself, if the expression uses a construct not supported by the automaton
+ *   (back-references, equivalence classes, ...) or the automaton would be too large.
+ * Matching does not allocate memory, does not copy the string (it does not need to be
+ * terminated by null byte) and does not modify the matcher, so it is thread-safe.
+ */
+
+#define MATCHER_MAX_LITERALS   4       // longer alternations are matched by automaton
+#define MATCHER_MAX_NFA_STATES 4096    // limit of size of nondeterministic automaton
+#define MATCHER_MAX_DFA_STATES 2048    // limit of number of states of deterministic automaton
+
+typedef enum {
+   MATCHER_LITERALS,
+   MATCHER_DFA,
+   MATCHER_REGEX
+} matcher_kind;
+
+/* Flags of literal */
+#define MATCHER_ANCHOR_START 0x01   // literal has to be at the start of string
+#define MATCHER_ANCHOR_END   0x02   // literal has to be at the end of string
+
+struct matcher_literal {
+   char *s;
+   uint32_t len;
+   uint8_t anchor;      /* MATCHER_ANCHOR_* flags */
+};
+
+/* Flags of automaton states */
+#define MATCHER_ACCEPT     0x01     // expression matches, the rest of string does not matter
+#define MATCHER_DEAD       0x02     // expression can not match anymore
+#define MATCHER_ACCEPT_END 0x04     // expression matches if the string ends here
+
+struct str_matcher {
+   matcher_kind kind;
+   uint32_t literal_count;
+   struct matcher_literal literals[MATCHER_MAX_LITERALS];
+   uint8_t classes[256];   /* DFA: class of every byte value */
+   uint32_t class_count;
+   uint32_t state_count;   /* DFA: number of states, state 0 is the initial one */
+   uint32_t *next;         /* DFA: transition in next[state * class_count + class] is offset of row of the next
+                                   state shifted left by 2, with its MATCHER_ACCEPT and MATCHER_DEAD flags */
+   uint8_t *flags;         /* DFA: MATCHER_ACCEPT, MATCHER_DEAD, MATCHER_ACCEPT_END of every state */
+   const regex_t *re;      /* REGEX: compiled expression */
+   char *pattern;          /* source of the expression, to find equal matchers */
+};
+
+void matcher_compile(struct str_matcher *matcher, const char *pattern, const regex_t *re);
+int matcher_match(const struct str_matcher *matcher, const char *s, size_t len);
+void matcher_free(struct str_matcher *matcher);
+
+#endif /* LIB_UNIREC_MATCHER_H */
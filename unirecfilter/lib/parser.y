@@ -11,6 +11,7 @@
     struct ast *newExpressionFP(char *column, char *cmp, double number);
     struct ast *newExpressionDateTime(char *column, char *cmp, char *datetime);
     struct ast *newExpressionArray(char *column, char *cmp, char *array);
+    struct ast *newExpressionArrayFile(char *column, char *cmp, char *path);
     struct ast *newIP(char *column, char *cmp, char *ip);
     struct ast *newIPNET(char *column, char *cmp, char *ipAddr);
     struct ast *newString(char *column, char *cmp, char *s);
@@ -41,6 +42,7 @@
 %token <string> IP
 %token <string> DATETIME
 %token <string> ARRAY
+%token <string> ARRAY_FILE
 %token <string> STRING
 %token <string> NET
 %token AND OR
@@ -72,6 +74,7 @@ exp:
     | COLUMN CMP DATETIME { $$ = newExpressionDateTime($1, $2, $3); }
     | COLUMN EQ DATETIME { $$ = newExpressionDateTime($1, $2, $3); }
     | COLUMN CMP ARRAY { $$ = newExpressionArray($1, $2, $3); if ($$ == NULL) {YYERROR;}}
+    | COLUMN CMP ARRAY_FILE { $$ = newExpressionArrayFile($1, $2, $3); if ($$ == NULL) {YYERROR;}}
     | PROTOCOL CMP UNSIGNED { $$ = newExpression(strdup("PROTOCOL"), $2, $3, 0); }
     | PROTOCOL EQ UNSIGNED { $$ = newExpression(strdup("PROTOCOL"), $2, $3, 0); }
     | PROTOCOL EQ PROTO_NAME { $$ = (struct ast *) newProtocol($2, $3); }
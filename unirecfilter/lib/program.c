@@ -0,0 +1,1448 @@
+/**
+ * \file program.c
+ * \brief Filter compiled into a linear program of comparisons with jumps
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <arpa/inet.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "program.h"
+
+#define SIGN_BIT 0x8000000000000000ULL
+#define BATCH_BLOCK 64         // number of records evaluated at once, one bit of uint64_t for every record
+#define BATCH_LOCAL_INSNS 128  // longer programs allocate bitmaps for batch evaluation on heap
+
+/* Number of the last built program */
+static uint64_t last_program_id = 0;
+
+/**
+ * Get offset of field in template.
+ *
+ * \param[in] tmplt template of records
+ * \param[in] id    field ID
+ * \return Offset of the field, UR_INVALID_OFFSET if the field is not present in the template.
+ */
+static inline uint16_t field_offset(const ur_template_t *tmplt, ur_field_id_t id)
+{
+   return id >= 0 && ur_is_present(tmplt, id) ? tmplt->offset[id] : UR_INVALID_OFFSET;
+}
+
+/**
+ * Register field used by the program, so that change of its offset is detected by program_check().
+ *
+ * \param[in,out] prog  program being built, fields array has to be large enough
+ * \param[in] tmplt     template of records
+ * \param[in] id        field ID
+ * \return Offset of the field, UR_INVALID_OFFSET if the field is not present in the template.
+ */
+static uint16_t use_field(struct program *prog, const ur_template_t *tmplt, ur_field_id_t id)
+{
+   uint16_t offset = field_offset(tmplt, id);
+
+   for (uint32_t i = 0; i < prog->field_count; i++) {
+      if (prog->fields[i].id == id) {
+         return offset;
+      }
+   }
+   prog->fields[prog->field_count].id = id;
+   prog->fields[prog->field_count].offset = offset;
+   prog->field_count++;
+   return offset;
+}
+
+/**
+ * Get number of comparisons of subtree.
+ */
+static uint32_t subtree_size(struct ast *ast)
+{
+   if (!ast) {
+      return 1;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      if (ast->operator == OP_NOP) {
+         return subtree_size(ast->l);
+      } else if (ast->operator == OP_AND || ast->operator == OP_OR) {
+         return subtree_size(ast->l) + subtree_size(ast->r);
+      }
+      return 1;
+   case NODE_T_BRACKET:
+   case NODE_T_NEGATION:
+      return subtree_size(((struct brack *) ast)->b);
+   default:
+      return 1;
+   }
+}
+
+/**
+ * Get the largest difference of two values of integer with given number of bits.
+ */
+static inline uint64_t domain_span(int bits)
+{
+   return bits == 64 ? UINT64_MAX : (1ULL << bits) - 1;
+}
+
+/**
+ * Convert comparison with a number into check whether the value is in range
+ * (or is not in range when negated). The range is limited to values of the field type,
+ * so that it can be checked on values truncated to the type width.
+ * Comparison which is never true is expressed as negated range of all values.
+ *
+ * \param[in] cmp     comparison operator
+ * \param[in] number  number compared with, bits of int64_t for signed comparison
+ * \param[in] is_signed compare signed values
+ * \param[in] bits    width of the field type
+ * \param[out] lo     the lowest value of range
+ * \param[out] span   difference of the highest and the lowest value of range
+ * \return 1 if the range is negated, 0 otherwise.
+ */
+static uint8_t make_range(cmp_op cmp, uint64_t number, int is_signed, int bits, uint64_t *lo, uint64_t *span)
+{
+   // Signed values are biased to unsigned ones, so that the range is computed once
+   uint64_t bias = is_signed ? SIGN_BIT : 0;
+   uint64_t n = number ^ bias;
+   uint64_t min = is_signed ? SIGN_BIT - (domain_span(bits) >> 1) - 1 : 0;
+   uint64_t max = min + domain_span(bits);
+   uint64_t low = min, hi = max;
+   uint8_t negate = 0, empty = 0;
+
+   switch (cmp) {
+   case OP_NE:
+      negate = 1;
+      // fall through
+   case OP_EQ:
+      low = hi = n;
+      break;
+   case OP_LT:
+      if (n == 0) {
+         empty = 1;
+      } else {
+         hi = n - 1;
+      }
+      break;
+   case OP_LE:
+      hi = n;
+      break;
+   case OP_GT:
+      if (n == UINT64_MAX) {
+         empty = 1;
+      } else {
+         low = n + 1;
+      }
+      break;
+   case OP_GE:
+      low = n;
+      break;
+   default:
+      fprintf(stderr, "Warning: Invalid comparison operator.\n");
+      empty = 1;
+      break;
+   }
+   if (low < min) {
+      low = min;
+   }
+   if (hi > max) {
+      hi = max;
+   }
+   if (empty || low > hi) {
+      negate = !negate;
+      low = min;
+      hi = max;
+   }
+   // Difference of biased values is the same as difference of original ones
+   *lo = low ^ bias;
+   *span = hi - low;
+   return negate;
+}
+
+/**
+ * Convert comparison operator into flags of comparison results satisfying it.
+ */
+static uint8_t cmp_results(cmp_op cmp)
+{
+   switch (cmp) {
+   case OP_EQ:
+      return CMP_RESULT_EQUAL;
+   case OP_NE:
+      return CMP_RESULT_LOWER | CMP_RESULT_HIGHER | CMP_RESULT_OTHER;
+   case OP_LT:
+      return CMP_RESULT_LOWER | CMP_RESULT_OTHER;
+   case OP_LE:
+      return CMP_RESULT_LOWER | CMP_RESULT_EQUAL;
+   case OP_GT:
+      return CMP_RESULT_HIGHER | CMP_RESULT_OTHER;
+   case OP_GE:
+      return CMP_RESULT_EQUAL | CMP_RESULT_HIGHER;
+   default:
+      return 0;
+   }
+}
+
+static void lower_expression(struct program *prog, struct expression *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   int bits;
+
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   switch (ur_get_type(expr->id)) {
+   case UR_TYPE_UINT8:
+      insn->op = INSN_RANGE_U8;
+      bits = 8;
+      break;
+   case UR_TYPE_UINT16:
+      insn->op = INSN_RANGE_U16;
+      bits = 16;
+      break;
+   case UR_TYPE_UINT32:
+      insn->op = INSN_RANGE_U32;
+      bits = 32;
+      break;
+   case UR_TYPE_UINT64:
+      insn->op = INSN_RANGE_U64;
+      bits = 64;
+      break;
+   case UR_TYPE_INT8:
+      insn->op = INSN_RANGE_I8;
+      bits = 8;
+      break;
+   case UR_TYPE_INT16:
+      insn->op = INSN_RANGE_I16;
+      bits = 16;
+      break;
+   case UR_TYPE_INT32:
+      insn->op = INSN_RANGE_I32;
+      bits = 32;
+      break;
+   case UR_TYPE_INT64:
+      insn->op = INSN_RANGE_I64;
+      bits = 64;
+      break;
+   default:
+      insn->op = INSN_FALSE;
+      return;
+   }
+   insn->result = make_range(expr->cmp, (uint64_t) expr->number, insn->op >= INSN_RANGE_I8, bits,
+                             &insn->arg.range.lo, &insn->arg.range.span);
+   if (insn->arg.range.span == domain_span(bits)) {
+      // every value of the type is in range
+      insn->op = insn->result ? INSN_FALSE : INSN_TRUE;
+   }
+}
+
+static void lower_datetime(struct program *prog, struct expression_datetime *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   insn->result = make_range(expr->cmp, expr->date, 0, 64, &insn->arg.range.lo, &insn->arg.range.span);
+   if (insn->arg.range.span == UINT64_MAX) {
+      insn->op = insn->result ? INSN_FALSE : INSN_TRUE;
+   } else {
+      insn->op = INSN_RANGE_U64;
+   }
+}
+
+static void lower_fp(struct program *prog, struct expression_fp *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   insn->op = ur_get_type(expr->id) == UR_TYPE_FLOAT ? INSN_CMP_FLOAT : INSN_CMP_DOUBLE;
+   insn->arg.fp.value = expr->number;
+   insn->arg.fp.cmp = expr->cmp;
+}
+
+static void lower_array(struct program *prog, struct expression_array *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   insn->op = INSN_IN;
+   insn->arg.array = expr;
+}
+
+/**
+ * Set comparison of IPv4 address masked by netmask, values are in host byte order.
+ */
+static void set_net4(struct insn *insn, cmp_op cmp, uint32_t addr, uint32_t mask)
+{
+   uint64_t lo, span;
+
+   insn->op = INSN_CMP_NET4;
+   insn->result = make_range(cmp, addr, 0, 32, &lo, &span);
+   insn->arg.net4.lo = lo;
+   insn->arg.net4.span = span;
+   insn->arg.net4.mask = mask;
+   insn->arg.net4.other = (cmp_results(cmp) & CMP_RESULT_OTHER) != 0;
+}
+
+static void lower_ip(struct program *prog, struct ip *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   if (ip_is4(&expr->ipAddr) && (expr->cmp == OP_EQ || expr->cmp == OP_NE)) {
+      // IPv6 address is never equal to IPv4 one, so only the equality can be checked as IPv4 network
+      set_net4(insn, expr->cmp, ntohl(expr->ipAddr.ui32[2]), 0xFFFFFFFF);
+   } else {
+      insn->op = INSN_CMP_IP;
+      insn->result = cmp_results(expr->cmp) & ~CMP_RESULT_OTHER;
+      insn->arg.ip = expr->ipAddr;
+   }
+}
+
+static void lower_net(struct program *prog, struct ipnet *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   if (ip_is4(&expr->ipAddr)) {
+      set_net4(insn, expr->cmp, ntohl(expr->ipAddr.ui32[2]), ntohl(expr->ipMask.ui32[2]));
+   } else {
+      insn->op = INSN_CMP_NET;
+      insn->result = cmp_results(expr->cmp);
+      insn->arg.net = expr;
+   }
+}
+
+static void lower_string(struct program *prog, struct str *expr, const ur_template_t *tmplt, struct insn *insn)
+{
+   if (expr->id == UR_INVALID_FIELD || (insn->offset = use_field(prog, tmplt, expr->id)) == UR_INVALID_OFFSET) {
+      return;
+   }
+   // Any operator except equality means inequality
+   insn->result = expr->cmp != OP_EQ;
+   if (ur_get_type(expr->id) == UR_TYPE_CHAR) {
+      if (strlen(expr->s) != 1) {
+         insn->op = insn->result ? INSN_TRUE : INSN_FALSE;
+      } else {
+         insn->op = INSN_CHAR;
+         insn->arg.c = expr->s[0];
+      }
+   } else if (expr->cmp == OP_RE) {
+      insn->op = INSN_STR_RE;
+      insn->arg.matcher = &expr->matcher;
+   } else {
+      insn->op = INSN_STR_EQ;
+      insn->arg.str.s = expr->s;
+      insn->arg.str.len = strlen(expr->s);
+   }
+}
+
+/* Types of nodes of plan */
+#define PLAN_LEAF 0
+#define PLAN_AND  1
+#define PLAN_OR   2
+
+/*
+ * Node of evaluation plan. Filter tree is converted into plan with negations pushed
+ * down to comparisons and nested operators of the same type merged, so that constant
+ * and redundant comparisons can be removed and operands reordered before lowering.
+ */
+struct plan {
+   uint8_t type;              /* PLAN_LEAF, PLAN_AND or PLAN_OR */
+   uint8_t negate;            /* LEAF: result of comparison is negated */
+   uint32_t size;             /* number of instructions of subtree */
+   uint32_t count;            /* AND, OR: number of operands */
+   struct plan **children;    /* AND, OR: operands */
+   struct insn insn;          /* LEAF: comparison, jump targets are not set */
+   const struct ast *node;    /* LEAF: node of filter tree the comparison comes from */
+   double cost;               /* estimated cost of evaluation of subtree */
+   double p;                  /* estimated probability that subtree is true */
+};
+
+static void plan_free(struct plan *plan)
+{
+   if (plan) {
+      for (uint32_t i = 0; i < plan->count; i++) {
+         plan_free(plan->children[i]);
+      }
+      free(plan->children);
+      free(plan);
+   }
+}
+
+static inline int plan_is_const(const struct plan *plan, int value)
+{
+   return plan->type == PLAN_LEAF && plan->insn.op == (value ? INSN_TRUE : INSN_FALSE);
+}
+
+/**
+ * Turn node into constant leaf, its operands are freed.
+ */
+static void plan_set_const(struct plan *plan, int value)
+{
+   for (uint32_t i = 0; i < plan->count; i++) {
+      plan_free(plan->children[i]);
+   }
+   free(plan->children);
+   memset(plan, 0, sizeof(*plan));
+   plan->type = PLAN_LEAF;
+   plan->insn.op = value ? INSN_TRUE : INSN_FALSE;
+   plan->size = 1;
+   plan->p = value;
+}
+
+/**
+ * Get estimated cost of evaluation of instruction, comparison of integer is the unit.
+ */
+static double insn_cost(const struct insn *insn)
+{
+   switch (insn->op) {
+   case INSN_FALSE:
+   case INSN_TRUE:
+      return 0;
+   case INSN_CMP_FLOAT:
+   case INSN_CMP_DOUBLE:
+   case INSN_CMP_NET4:
+      return 2;
+   case INSN_CMP_IP:
+   case INSN_CMP_NET:
+      return 4;
+   case INSN_IN:
+      return 8;
+   case INSN_STR_EQ:
+      return 4 + insn->arg.str.len / 16.0;
+   case INSN_STR_RE:
+      switch (insn->arg.matcher->kind) {
+      case MATCHER_LITERALS:
+         return 4 + 4 * insn->arg.matcher->literal_count;
+      case MATCHER_DFA:
+         return 20;
+      default:
+         return 100;
+      }
+   default:
+      return 1;
+   }
+}
+
+/**
+ * Estimate probability that comparison is true. Selectivity observed on sampled records
+ * by the previous program is used if there is enough samples, 1/2 otherwise.
+ */
+static double leaf_probability(const struct plan *leaf, const struct program *prev)
+{
+   if (leaf->insn.op == INSN_TRUE || leaf->insn.op == INSN_FALSE) {
+      return leaf->insn.op == INSN_TRUE;
+   }
+   if (prev && prev->stats) {
+      for (uint32_t i = 0; i < prev->count; i++) {
+         const struct insn_stats *stats = &prev->stats->insns[i];
+         if (stats->node == leaf->node && stats->sampled >= PROG_MIN_SAMPLES) {
+            // observed probability of comparison without negation
+            double p = (stats->sampled_hits + 1.0) / (stats->sampled + 2.0);
+            return leaf->negate ? 1 - p : p;
+         }
+      }
+   }
+   return 0.5;
+}
+
+/**
+ * Add operand to AND or OR node, operands of nested node of the same type are merged.
+ * \return 0 on success, -1 if memory could not be allocated (operand is freed).
+ */
+static int plan_add(struct plan *plan, struct plan *child)
+{
+   if (child->type == plan->type) {
+      for (uint32_t i = 0; i < child->count; i++) {
+         if (plan_add(plan, child->children[i]) != 0) {
+            // operands added so far belong to plan now
+            child->count -= i + 1;
+            memmove(child->children, child->children + i + 1, child->count * sizeof(struct plan *));
+            plan_free(child);
+            return -1;
+         }
+      }
+      free(child->children);
+      free(child);
+      return 0;
+   }
+   struct plan **children = (struct plan **) realloc(plan->children, (plan->count + 1) * sizeof(struct plan *));
+   if (!children) {
+      plan_free(child);
+      return -1;
+   }
+   plan->children = children;
+   plan->children[plan->count++] = child;
+   return 0;
+}
+
+/**
+ * Turn AND node into constant false (OR node into true) while its operands are being filtered.
+ * \param[in] kept  number of operands kept so far at the start of children
+ * \param[in] next  index of the first operand not processed yet
+ */
+static void plan_absorb(struct plan *plan, uint32_t kept, uint32_t next)
+{
+   memmove(plan->children + kept, plan->children + next, (plan->count - next) * sizeof(struct plan *));
+   plan->count = kept + plan->count - next;
+   plan_set_const(plan, plan->type == PLAN_OR);
+}
+
+/**
+ * Remove constant and repeated operands of AND or OR node, order the rest by their
+ * cost and probability and estimate cost and probability of the node.
+ * Operand of AND is evaluated only if all previous ones are true, so operands
+ * are ordered by cost / P(false) (by cost / P(true) for OR).
+ * \return The node, or its only operand (the node is freed then).
+ */
+static struct plan *plan_finish(struct plan *plan)
+{
+   // neutral value is removed, the other one decides the result
+   int neutral = plan->type == PLAN_AND;
+   uint32_t count = 0;
+
+   for (uint32_t i = 0; i < plan->count; i++) {
+      struct plan *child = plan->children[i];
+      int keep = 1;
+
+      if (plan_is_const(child, !neutral)) {
+         plan_absorb(plan, count, i);
+         return plan;
+      }
+      if (plan_is_const(child, neutral)) {
+         keep = 0;
+      } else if (child->type == PLAN_LEAF) {
+         for (uint32_t j = 0; j < count; j++) {
+            struct plan *prev = plan->children[j];
+            if (prev->type == PLAN_LEAF && memcmp(&prev->insn, &child->insn, sizeof(struct insn)) == 0) {
+               if (prev->negate != child->negate) {
+                  // x && !x, x || !x
+                  plan_absorb(plan, count, i);
+                  return plan;
+               }
+               keep = 0;
+               break;
+            }
+         }
+      }
+      if (keep) {
+         plan->children[count++] = child;
+      } else {
+         plan_free(child);
+      }
+   }
+   plan->count = count;
+
+   if (count == 0) {
+      plan_set_const(plan, neutral);
+      return plan;
+   } else if (count == 1) {
+      struct plan *child = plan->children[0];
+      free(plan->children);
+      free(plan);
+      return child;
+   }
+
+   // stable insertion sort by rank, order given by user is kept for equal operands
+   for (uint32_t i = 1; i < count; i++) {
+      struct plan *child = plan->children[i];
+      double rank = child->cost / ((neutral ? 1 - child->p : child->p) + 1e-9);
+      uint32_t j = i;
+      while (j > 0) {
+         struct plan *prev = plan->children[j - 1];
+         if (prev->cost / ((neutral ? 1 - prev->p : prev->p) + 1e-9) <= rank) {
+            break;
+         }
+         plan->children[j] = prev;
+         j--;
+      }
+      plan->children[j] = child;
+   }
+
+   // probability that evaluation continues with the next operand
+   double reach = 1;
+   plan->cost = 0;
+   plan->size = 0;
+   for (uint32_t i = 0; i < count; i++) {
+      plan->cost += reach * plan->children[i]->cost;
+      plan->size += plan->children[i]->size;
+      reach *= neutral ? plan->children[i]->p : 1 - plan->children[i]->p;
+   }
+   plan->p = neutral ? reach : 1 - reach;
+   return plan;
+}
+
+/**
+ * Convert subtree into plan.
+ *
+ * \param[in,out] prog program being built
+ * \param[in] ast      subtree
+ * \param[in] tmplt    template of records
+ * \param[in] negate   subtree is negated
+ * \param[in] prev     previous program of the tree with statistics of comparisons, may be NULL
+ * \return Plan of subtree, NULL if memory could not be allocated.
+ */
+static struct plan *plan_build(struct program *prog, struct ast *ast, const ur_template_t *tmplt, int negate, const struct program *prev)
+{
+   struct plan *plan;
+
+   if (ast) {
+      switch (ast->type) {
+      case NODE_T_AST:
+         if (ast->operator == OP_NOP) {
+            return plan_build(prog, ast->l, tmplt, negate, prev);
+         } else if (ast->operator == OP_AND || ast->operator == OP_OR) {
+            // negated AND is OR of negated operands and vice versa
+            struct plan *l, *r;
+            plan = (struct plan *) calloc(1, sizeof(struct plan));
+            if (!plan) {
+               return NULL;
+            }
+            plan->type = (ast->operator == OP_AND) != negate ? PLAN_AND : PLAN_OR;
+            if (!(l = plan_build(prog, ast->l, tmplt, negate, prev)) || plan_add(plan, l) != 0 ||
+                !(r = plan_build(prog, ast->r, tmplt, negate, prev)) || plan_add(plan, r) != 0) {
+               plan_free(plan);
+               return NULL;
+            }
+            return plan_finish(plan);
+         }
+         fprintf(stderr, "Warning: Unknown operator in NODE_T_AST.\n");
+         break;
+      case NODE_T_BRACKET:
+         return plan_build(prog, ((struct brack *) ast)->b, tmplt, negate, prev);
+      case NODE_T_NEGATION:
+         return plan_build(prog, ((struct brack *) ast)->b, tmplt, !negate, prev);
+      default:
+         break;
+      }
+   }
+
+   plan = (struct plan *) calloc(1, sizeof(struct plan));
+   if (!plan) {
+      return NULL;
+   }
+   plan->type = PLAN_LEAF;
+   plan->size = 1;
+   plan->node = ast;
+   plan->negate = negate;
+   plan->insn.op = INSN_FALSE;
+   if (ast) {
+      switch (ast->type) {
+      case NODE_T_EXPRESSION:
+         lower_expression(prog, (struct expression *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_EXPRESSION_FP:
+         lower_fp(prog, (struct expression_fp *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_EXPRESSION_DATETIME:
+         lower_datetime(prog, (struct expression_datetime *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_EXPRESSION_ARRAY:
+         lower_array(prog, (struct expression_array *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_IP:
+         lower_ip(prog, (struct ip *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_NET:
+         lower_net(prog, (struct ipnet *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_STRING:
+         lower_string(prog, (struct str *) ast, tmplt, &plan->insn);
+         break;
+      case NODE_T_AST:
+         break;
+      default:
+         fprintf(stderr, "Warning: Unknown node type.\n");
+         break;
+      }
+   }
+   if (plan->insn.op == INSN_TRUE || plan->insn.op == INSN_FALSE) {
+      // constant comparison is folded with its negation
+      plan_set_const(plan, (plan->insn.op == INSN_TRUE) != negate);
+      return plan;
+   }
+   plan->cost = insn_cost(&plan->insn);
+   plan->p = leaf_probability(plan, prev);
+   return plan;
+}
+
+/**
+ * Lower plan into instructions starting at given position.
+ *
+ * \param[in,out] prog program being built
+ * \param[in] plan     plan of subtree
+ * \param[in] pos      index of the first instruction of the subtree
+ * \param[in] jt       target of jump when subtree is true
+ * \param[in] jf       target of jump when subtree is false
+ * \return Index of instruction following the subtree.
+ */
+static uint32_t lower(struct program *prog, const struct plan *plan, uint32_t pos, uint32_t jt, uint32_t jf)
+{
+   if (plan->type == PLAN_LEAF) {
+      struct insn *insn = &prog->insns[pos];
+      *insn = plan->insn;
+      // negation just swaps the jump targets
+      insn->jt = plan->negate ? jf : jt;
+      insn->jf = plan->negate ? jt : jf;
+      if (prog->stats) {
+         prog->stats->insns[pos].node = plan->node;
+         prog->stats->insns[pos].negate = plan->negate;
+      }
+      return pos + 1;
+   }
+   for (uint32_t i = 0; i + 1 < plan->count; i++) {
+      uint32_t next = pos + plan->children[i]->size;
+      if (plan->type == PLAN_AND) {
+         // Next operand is evaluated only if this one is true
+         pos = lower(prog, plan->children[i], pos, next, jf);
+      } else {
+         // Next operand is evaluated only if this one is false
+         pos = lower(prog, plan->children[i], pos, jt, next);
+      }
+   }
+   return lower(prog, plan->children[plan->count - 1], pos, jt, jf);
+}
+
+/**
+ * Copy statistics of comparisons from previous program of the same tree.
+ * Counters of sampled records are halved, so that recent records have more weight.
+ */
+static void copy_stats(struct program *prog, const struct program *prev)
+{
+   prog->stats->records = prev->stats->records;
+   prog->stats->samples = prev->stats->samples / 2;
+   for (uint32_t i = 0; i < prog->count; i++) {
+      struct insn_stats *stats = &prog->stats->insns[i];
+      for (uint32_t j = 0; j < prev->count; j++) {
+         const struct insn_stats *old = &prev->stats->insns[j];
+         if (stats->node && old->node == stats->node) {
+            stats->evals = old->evals;
+            stats->hits = old->hits;
+            stats->ns = old->ns;
+            stats->sampled = old->sampled / 2;
+            stats->sampled_hits = old->sampled_hits / 2;
+            break;
+         }
+      }
+   }
+}
+
+/**
+ * \brief Lower abstract syntax tree into program for records of given template.
+ * Constant and repeated comparisons are removed and operands of AND and OR
+ * are reordered, so that cheap and decisive comparisons are evaluated first.
+ * \param[in] ast     abstract syntax tree of filter
+ * \param[in] tmplt   template of records the program will be evaluated on
+ * \param[in] options PROG_PROFILE, PROG_ADAPTIVE or 0
+ * \param[in] prev    previous program of the tree, its statistics are kept and used to order comparisons, may be NULL
+ * \return Pointer to the program, NULL if memory could not be allocated.
+ */
+struct program *program_build(struct ast *ast, const ur_template_t *tmplt, unsigned int options, const struct program *prev)
+{
+   struct plan *plan;
+   struct program *prog = (struct program *) calloc(1, sizeof(struct program));
+   if (!prog) {
+      return NULL;
+   }
+   prog->id = __sync_add_and_fetch(&last_program_id, 1);
+   prog->tmplt = tmplt;
+   prog->static_size = tmplt->static_size;
+   prog->options = options;
+   // Every comparison uses at most one field
+   prog->fields = (struct prog_field *) calloc(subtree_size(ast), sizeof(struct prog_field));
+   if (!prog->fields) {
+      program_free(prog);
+      return NULL;
+   }
+
+   plan = plan_build(prog, ast, tmplt, 0, prev);
+   if (!plan) {
+      program_free(prog);
+      return NULL;
+   }
+   prog->count = plan->size;
+   prog->insns = (struct insn *) calloc(prog->count, sizeof(struct insn));
+   if (options) {
+      prog->stats = (struct prog_stats *) calloc(1, sizeof(struct prog_stats) + prog->count * sizeof(struct insn_stats));
+   }
+   if (!prog->insns || (options && !prog->stats)) {
+      plan_free(plan);
+      program_free(prog);
+      return NULL;
+   }
+
+   lower(prog, plan, 0, PROG_ACCEPT(prog), PROG_REJECT(prog));
+   plan_free(plan);
+   if (prog->stats && prev && prev->stats) {
+      copy_stats(prog, prev);
+   }
+   return prog;
+}
+
+/**
+ * \brief Check whether the program was built for given template.
+ * Template is identified by its address and offsets of fields used by the program,
+ * so a template freed and created again at the same address with different fields is detected.
+ * \param[in] prog  program
+ * \param[in] tmplt template of records
+ * \return 1 if the program can be evaluated on records of the template, 0 if it has to be built again
+ * (also when it should be reordered by observed selectivity).
+ */
+int program_check(const struct program *prog, const ur_template_t *tmplt)
+{
+   if (prog->tmplt != tmplt || prog->static_size != tmplt->static_size) {
+      return 0;
+   }
+   if (prog->stats && prog->stats->reorder) {
+      // enough records were sampled to order comparisons by their selectivity
+      return 0;
+   }
+   for (uint32_t i = 0; i < prog->field_count; i++) {
+      if (field_offset(tmplt, prog->fields[i].id) != prog->fields[i].offset) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/**
+ * Check whether value is in range of instruction, negated if set so.
+ */
+static inline int in_range(const struct insn *insn, uint64_t value)
+{
+   return (value - insn->arg.range.lo <= insn->arg.range.span) ^ insn->result;
+}
+
+/**
+ * Get result of comparison of IP addresses as the CMP_RESULT_* flag.
+ */
+#define CMP_RESULT(cmp_res) ((cmp_res) < 0 ? CMP_RESULT_LOWER : ((cmp_res) == 0 ? CMP_RESULT_EQUAL : CMP_RESULT_HIGHER))
+
+/**
+ * Evaluate one instruction on record.
+ */
+static inline int eval_insn(const struct program *prog, const struct insn *insn, const char *rec)
+{
+   const char *field = rec + insn->offset;
+
+   switch (insn->op) {
+   case INSN_FALSE:
+      return 0;
+   case INSN_TRUE:
+      return 1;
+   case INSN_RANGE_U8:
+      return in_range(insn, *(const uint8_t *) field);
+   case INSN_RANGE_U16:
+      return in_range(insn, *(const uint16_t *) field);
+   case INSN_RANGE_U32:
+      return in_range(insn, *(const uint32_t *) field);
+   case INSN_RANGE_U64:
+      return in_range(insn, *(const uint64_t *) field);
+   case INSN_RANGE_I8:
+      return in_range(insn, (int64_t) *(const int8_t *) field);
+   case INSN_RANGE_I16:
+      return in_range(insn, (int64_t) *(const int16_t *) field);
+   case INSN_RANGE_I32:
+      return in_range(insn, (int64_t) *(const int32_t *) field);
+   case INSN_RANGE_I64:
+      return in_range(insn, *(const int64_t *) field);
+   case INSN_CMP_FLOAT:
+      return compareFloating(*(const float *) field, insn->arg.fp.value, insn->arg.fp.cmp);
+   case INSN_CMP_DOUBLE:
+      return compareFloating(*(const double *) field, insn->arg.fp.value, insn->arg.fp.cmp);
+   case INSN_CMP_IP: {
+      int cmp_res = ip_cmp((const ip_addr_t *) field, &insn->arg.ip);
+      return (insn->result & CMP_RESULT(cmp_res)) != 0;
+   }
+   case INSN_CMP_NET4: {
+      const ip_addr_t *ip = (const ip_addr_t *) field;
+      if (!ip_is4(ip)) {
+         return insn->arg.net4.other;
+      }
+      return ((uint32_t) ((ntohl(ip->ui32[2]) & insn->arg.net4.mask) - insn->arg.net4.lo) <= insn->arg.net4.span) ^ insn->result;
+   }
+   case INSN_CMP_NET: {
+      ip_addr_t ip = *(const ip_addr_t *) field;
+      if (ip_is4(&ip)) {
+         return (insn->result & CMP_RESULT_OTHER) != 0;
+      }
+      ip_mask(&ip, (ip_addr_t *) &insn->arg.net->ipMask);
+      int cmp_res = ip_cmp(&ip, &insn->arg.net->ipAddr);
+      return (insn->result & CMP_RESULT(cmp_res)) != 0;
+   }
+   case INSN_IN:
+      return compareElemInArray((void *) field, insn->arg.array);
+   case INSN_CHAR:
+      return (*field == insn->arg.c) ^ insn->result;
+   case INSN_STR_EQ: {
+      // Variable length field is referenced by (offset, length) header in fixed-length part
+      const uint16_t *header = (const uint16_t *) field;
+      return (header[1] == insn->arg.str.len &&
+              memcmp(rec + prog->static_size + header[0], insn->arg.str.s, header[1]) == 0) ^ insn->result;
+   }
+   case INSN_STR_RE: {
+      const uint16_t *header = (const uint16_t *) field;
+      return matcher_match(insn->arg.matcher, rec + prog->static_size + header[0], header[1]);
+   }
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Get monotonic time in nanoseconds.
+ */
+static inline uint64_t now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Evaluate every instruction on sampled record to observe selectivity of comparisons.
+ */
+static void sample(const struct program *prog, const char *rec)
+{
+   struct prog_stats *stats = prog->stats;
+
+   for (uint32_t i = 0; i < prog->count; i++) {
+      stats->insns[i].sampled++;
+      stats->insns[i].sampled_hits += eval_insn(prog, &prog->insns[i], rec);
+   }
+   stats->samples++;
+   if (stats->samples % PROG_REORDER_SAMPLES == 0) {
+      stats->reorder = 1;
+   }
+}
+
+/**
+ * Evaluate program on record and update its statistics.
+ */
+static int eval_counted(const struct program *prog, const char *rec)
+{
+   struct prog_stats *stats = prog->stats;
+   uint32_t pc = 0;
+
+   stats->records++;
+   if ((prog->options & PROG_ADAPTIVE) && stats->records % PROG_SAMPLE_RATE == 0) {
+      sample(prog, rec);
+   }
+   if (prog->options & PROG_PROFILE) {
+      uint64_t start = now_ns();
+      while (pc < prog->count) {
+         const struct insn *insn = &prog->insns[pc];
+         struct insn_stats *insn_stats = &stats->insns[pc];
+         int res = eval_insn(prog, insn, rec);
+         uint64_t end = now_ns();
+         insn_stats->evals++;
+         insn_stats->hits += res;
+         insn_stats->ns += end - start;
+         start = end;
+         pc = res ? insn->jt : insn->jf;
+      }
+   } else {
+      while (pc < prog->count) {
+         const struct insn *insn = &prog->insns[pc];
+         pc = eval_insn(prog, insn, rec) ? insn->jt : insn->jf;
+      }
+   }
+   return pc == PROG_ACCEPT(prog);
+}
+
+/**
+ * \brief Evaluate program on record.
+ * \param[in] prog program built for the template of the record
+ * \param[in] rec  record
+ * \return 1 if the record matches the filter, 0 otherwise.
+ */
+int program_eval(const struct program *prog, const void *rec)
+{
+   uint32_t pc = 0;
+
+   if (prog->stats) {
+      return eval_counted(prog, (const char *) rec);
+   }
+   // Jumps lead always forward, so the loop ends after at most count steps
+   while (pc < prog->count) {
+      const struct insn *insn = &prog->insns[pc];
+      pc = eval_insn(prog, insn, (const char *) rec) ? insn->jt : insn->jf;
+   }
+   return pc == PROG_ACCEPT(prog);
+}
+
+/**
+ * Get bitmap of values of column which are in range, i.e. value - lo <= span.
+ *
+ * \param[in] col  values of one field of records of block
+ * \param[in] cnt  number of values
+ * \param[in] lo   the lowest value of range
+ * \param[in] span difference of the highest and the lowest value of range
+ * \return Bitmap with bit i set if col[i] is in range.
+ */
+static uint64_t range_bits32(const uint32_t *col, int cnt, uint32_t lo, uint32_t span)
+{
+   uint64_t bits = 0;
+   int i = 0;
+
+#ifdef __SSE2__
+   // Unsigned comparison is done as signed one of values with flipped sign bit
+   const __m128i bias = _mm_set1_epi32(0x80000000);
+   const __m128i vlo = _mm_set1_epi32(lo);
+   const __m128i vspan = _mm_set1_epi32(span ^ 0x80000000);
+   for (; i + 4 <= cnt; i += 4) {
+      __m128i diff = _mm_xor_si128(_mm_sub_epi32(_mm_loadu_si128((const __m128i *) (col + i)), vlo), bias);
+      int out = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(diff, vspan)));
+      bits |= (uint64_t) (~out & 0xF) << i;
+   }
+#endif
+   for (; i < cnt; i++) {
+      bits |= (uint64_t) (col[i] - lo <= span) << i;
+   }
+   return bits;
+}
+
+/**
+ * Get bitmap of values of column which are in range, 64 bit variant of range_bits32().
+ */
+static uint64_t range_bits64(const uint64_t *col, int cnt, uint64_t lo, uint64_t span)
+{
+   uint64_t bits = 0;
+   int i = 0;
+
+#ifdef __SSE2__
+   // SSE2 has no 64 bit comparison, it is composed of comparisons of 32 bit halves
+   const __m128i bias = _mm_set1_epi32(0x80000000);
+   const __m128i vlo = _mm_set1_epi64x(lo);
+   const __m128i vspan = _mm_set1_epi64x(span);
+   const __m128i bspan = _mm_xor_si128(vspan, bias);
+   for (; i + 2 <= cnt; i += 2) {
+      __m128i diff = _mm_sub_epi64(_mm_loadu_si128((const __m128i *) (col + i)), vlo);
+      __m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(diff, bias), bspan);
+      __m128i eq = _mm_cmpeq_epi32(diff, vspan);
+      // higher half is greater, or it is equal and the lower half is greater
+      __m128i gt64 = _mm_or_si128(_mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1)),
+                                  _mm_and_si128(_mm_shuffle_epi32(eq, _MM_SHUFFLE(3, 3, 1, 1)),
+                                                _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0))));
+      int out = _mm_movemask_pd(_mm_castsi128_pd(gt64));
+      bits |= (uint64_t) (~out & 0x3) << i;
+   }
+#endif
+   for (; i < cnt; i++) {
+      bits |= (uint64_t) (col[i] - lo <= span) << i;
+   }
+   return bits;
+}
+
+/* Load field of given type from every record of block into column */
+#define GATHER(col, type, recs, cnt, offset) \
+   for (int i = 0; i < (cnt); i++) { \
+      (col)[i] = *(const type *) ((recs)[i] + (offset)); \
+   }
+
+/**
+ * Evaluate one instruction on block of records.
+ *
+ * \param[in] prog   program
+ * \param[in] insn   instruction
+ * \param[in] recs   records of block
+ * \param[in] cnt    number of records, at most BATCH_BLOCK
+ * \param[in] active bitmap of records the instruction is evaluated for
+ * \return Bitmap of records the instruction is true for, bits of records not set in active are undefined.
+ */
+static uint64_t eval_insn_block(const struct program *prog, const struct insn *insn, const char *const *recs, int cnt, uint64_t active)
+{
+   uint64_t bits = 0;
+   uint64_t negate = insn->result ? UINT64_MAX : 0;
+   union {
+      uint32_t u32[BATCH_BLOCK];
+      uint64_t u64[BATCH_BLOCK];
+   } col;
+
+   switch (insn->op) {
+   case INSN_FALSE:
+      return 0;
+   case INSN_TRUE:
+      return UINT64_MAX;
+   // Fixed-length fields are loaded into column and compared at once
+   case INSN_RANGE_U8:
+      GATHER(col.u32, uint8_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_U16:
+      GATHER(col.u32, uint16_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_U32:
+      GATHER(col.u32, uint32_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_I8:
+      GATHER(col.u32, int8_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_I16:
+      GATHER(col.u32, int16_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_I32:
+      GATHER(col.u32, int32_t, recs, cnt, insn->offset);
+      return range_bits32(col.u32, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_RANGE_U64:
+   case INSN_RANGE_I64:
+      GATHER(col.u64, uint64_t, recs, cnt, insn->offset);
+      return range_bits64(col.u64, cnt, insn->arg.range.lo, insn->arg.range.span) ^ negate;
+   case INSN_CMP_NET4: {
+      uint64_t is4 = 0;
+      for (int i = 0; i < cnt; i++) {
+         const ip_addr_t *ip = (const ip_addr_t *) (recs[i] + insn->offset);
+         col.u32[i] = ntohl(ip->ui32[2]) & insn->arg.net4.mask;
+         is4 |= (uint64_t) ip_is4(ip) << i;
+      }
+      bits = range_bits32(col.u32, cnt, insn->arg.net4.lo, insn->arg.net4.span) ^ negate;
+      return (bits & is4) | (insn->arg.net4.other ? ~is4 : 0);
+   }
+   default:
+      // Other comparisons are evaluated record by record, only for active records
+      while (active) {
+         int i = __builtin_ctzll(active);
+         bits |= (uint64_t) eval_insn(prog, insn, recs[i]) << i;
+         active &= active - 1;
+      }
+      return bits;
+   }
+}
+
+/**
+ * \brief Evaluate program on batch of records.
+ * Records are processed in blocks, every instruction is evaluated for all records
+ * of block that reach it, so fixed-length fields can be compared by SIMD instructions.
+ * \param[in] prog     program built for the template of the records
+ * \param[in] records  array of records
+ * \param[in] n        number of records
+ * \param[out] bitmap  selection bitmap, bit i % 64 of word i / 64 is set if records[i] matches, (n + 63) / 64 words
+ * \return Number of matching records, -1 if memory could not be allocated.
+ */
+int program_eval_batch(const struct program *prog, const void *const *records, size_t n, uint64_t *bitmap)
+{
+   uint64_t local[BATCH_LOCAL_INSNS + 2];
+   uint64_t *reach = local;
+   int matched = 0;
+
+   if (prog->count > BATCH_LOCAL_INSNS) {
+      reach = (uint64_t *) malloc((prog->count + 2) * sizeof(uint64_t));
+      if (!reach) {
+         return -1;
+      }
+   }
+   for (size_t start = 0; start < n; start += BATCH_BLOCK) {
+      const char *const *recs = (const char *const *) records + start;
+      int cnt = n - start < BATCH_BLOCK ? n - start : BATCH_BLOCK;
+
+      // reach[pc] is bitmap of records of block the evaluation jumped to instruction pc for
+      memset(reach, 0, (prog->count + 2) * sizeof(uint64_t));
+      reach[0] = cnt == 64 ? UINT64_MAX : (1ULL << cnt) - 1;
+      if (prog->stats) {
+         // the first record of block is sampled when the sampling period is crossed
+         uint64_t records = prog->stats->records;
+         prog->stats->records += cnt;
+         if ((prog->options & PROG_ADAPTIVE) && records / PROG_SAMPLE_RATE != prog->stats->records / PROG_SAMPLE_RATE) {
+            sample(prog, recs[0]);
+         }
+      }
+      for (uint32_t pc = 0; pc < prog->count; pc++) {
+         const struct insn *insn = &prog->insns[pc];
+         if (!reach[pc]) {
+            continue;
+         }
+         if (prog->options & PROG_PROFILE) {
+            uint64_t start = now_ns();
+            uint64_t bits = eval_insn_block(prog, insn, recs, cnt, reach[pc]);
+            prog->stats->insns[pc].ns += now_ns() - start;
+            prog->stats->insns[pc].evals += __builtin_popcountll(reach[pc]);
+            prog->stats->insns[pc].hits += __builtin_popcountll(reach[pc] & bits);
+            reach[insn->jt] |= reach[pc] & bits;
+            reach[insn->jf] |= reach[pc] & ~bits;
+            continue;
+         }
+         uint64_t bits = eval_insn_block(prog, insn, recs, cnt, reach[pc]);
+         reach[insn->jt] |= reach[pc] & bits;
+         reach[insn->jf] |= reach[pc] & ~bits;
+      }
+      bitmap[start / BATCH_BLOCK] = reach[PROG_ACCEPT(prog)];
+      matched += __builtin_popcountll(reach[PROG_ACCEPT(prog)]);
+   }
+
+   if (reach != local) {
+      free(reach);
+   }
+   return matched;
+}
+
+/**
+ * Check whether two instructions, possibly of different programs, have the same result on every record.
+ * Values referenced by pointers are compared, since every filter has its own tree.
+ */
+static int insn_equal(const struct insn *a, const struct insn *b)
+{
+   if (a->op != b->op || a->result != b->result || a->offset != b->offset) {
+      return 0;
+   }
+   switch (a->op) {
+   case INSN_FALSE:
+   case INSN_TRUE:
+      return 1;
+   case INSN_CMP_FLOAT:
+   case INSN_CMP_DOUBLE:
+      return a->arg.fp.value == b->arg.fp.value && a->arg.fp.cmp == b->arg.fp.cmp;
+   case INSN_CMP_IP:
+      return memcmp(&a->arg.ip, &b->arg.ip, sizeof(ip_addr_t)) == 0;
+   case INSN_CMP_NET4:
+      return a->arg.net4.mask == b->arg.net4.mask && a->arg.net4.lo == b->arg.net4.lo &&
+             a->arg.net4.span == b->arg.net4.span && a->arg.net4.other == b->arg.net4.other;
+   case INSN_CMP_NET:
+      return memcmp(&a->arg.net->ipAddr, &b->arg.net->ipAddr, sizeof(ip_addr_t)) == 0 &&
+             memcmp(&a->arg.net->ipMask, &b->arg.net->ipMask, sizeof(ip_addr_t)) == 0;
+   case INSN_IN:
+      // lists loaded from the same file are equal as long as they are reloaded together
+      return a->arg.array == b->arg.array ||
+             (a->arg.array->field_type == b->arg.array->field_type && a->arg.array->from_file == b->arg.array->from_file &&
+              a->arg.array->source && b->arg.array->source && strcmp(a->arg.array->source, b->arg.array->source) == 0);
+   case INSN_CHAR:
+      return a->arg.c == b->arg.c;
+   case INSN_STR_EQ:
+      return a->arg.str.len == b->arg.str.len && memcmp(a->arg.str.s, b->arg.str.s, a->arg.str.len) == 0;
+   case INSN_STR_RE:
+      return a->arg.matcher->pattern && b->arg.matcher->pattern && strcmp(a->arg.matcher->pattern, b->arg.matcher->pattern) == 0;
+   default:
+      return a->arg.range.lo == b->arg.range.lo && a->arg.range.span == b->arg.range.span;
+   }
+}
+
+/**
+ * \brief Build group of programs sharing their equal comparisons.
+ * Programs have to be built for the same template and they are not owned by the group,
+ * the group has to be built again when any of them is built again (see program_group_check()).
+ * \param[in] programs array of programs, NULL for empty filter
+ * \param[in] count    number of programs
+ * \return Pointer to the group, NULL if memory could not be allocated.
+ */
+struct program_group *program_group_build(const struct program *const *programs, uint32_t count)
+{
+   const struct insn **distinct;
+   uint32_t total = 0;
+   struct program_group *group = (struct program_group *) calloc(1, sizeof(struct program_group));
+   if (!group) {
+      return NULL;
+   }
+   group->count = count;
+   group->programs = (const struct program **) calloc(count, sizeof(struct program *));
+   group->ids = (uint64_t *) calloc(count, sizeof(uint64_t));
+   group->shared = (uint32_t **) calloc(count, sizeof(uint32_t *));
+   if (!group->programs || !group->ids || !group->shared) {
+      program_group_free(group);
+      return NULL;
+   }
+   for (uint32_t i = 0; i < count; i++) {
+      group->programs[i] = programs[i];
+      if (programs[i]) {
+         group->ids[i] = programs[i]->id;
+         total += programs[i]->count;
+      }
+   }
+
+   // Instructions are compared with the first instruction of every distinct comparison found so far
+   distinct = (const struct insn **) malloc((total + 1) * sizeof(struct insn *));
+   if (!distinct) {
+      program_group_free(group);
+      return NULL;
+   }
+   for (uint32_t i = 0; i < count; i++) {
+      const struct program *prog = programs[i];
+      if (!prog) {
+         continue;
+      }
+      group->shared[i] = (uint32_t *) malloc((prog->count + 1) * sizeof(uint32_t));
+      if (!group->shared[i]) {
+         free(distinct);
+         program_group_free(group);
+         return NULL;
+      }
+      for (uint32_t pc = 0; pc < prog->count; pc++) {
+         uint32_t j;
+         for (j = 0; j < group->shared_count; j++) {
+            if (insn_equal(&prog->insns[pc], distinct[j])) {
+               break;
+            }
+         }
+         if (j == group->shared_count) {
+            distinct[group->shared_count++] = &prog->insns[pc];
+         }
+         group->shared[i][pc] = j;
+      }
+   }
+   free(distinct);
+
+   // Epoch 0 is never used, so that all results are unknown at the beginning
+   group->cache = (uint32_t *) calloc(group->shared_count + 1, sizeof(uint32_t));
+   if (!group->cache) {
+      program_group_free(group);
+      return NULL;
+   }
+   return group;
+}
+
+/**
+ * \brief Check whether the group was built for given programs.
+ * \param[in] group    group of programs
+ * \param[in] programs current programs of the filters, in the same order as when the group was built
+ * \return 1 if the group can be used, 0 if it has to be built again.
+ */
+int program_group_check(const struct program_group *group, const struct program *const *programs)
+{
+   for (uint32_t i = 0; i < group->count; i++) {
+      if (programs[i] ? group->ids[i] != programs[i]->id : group->programs[i] != NULL) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/**
+ * \brief Evaluate all programs of the group on record.
+ * Results of comparisons are cached in the group, so the group can not be evaluated
+ * by more threads at the same time.
+ * \param[in] group  group of programs built for the template of the record
+ * \param[in] rec    record
+ * \param[out] bitmap (count + 63) / 64 words, bit (i % 64) of word (i / 64) is set if program i matches
+ * \return Number of matching programs.
+ */
+int program_group_eval(struct program_group *group, const void *rec, uint64_t *bitmap)
+{
+   int matched = 0;
+
+   // Results cached for previous records are recognized by their epoch
+   group->epoch += 2;
+   if (group->epoch == 0) {
+      memset(group->cache, 0, group->shared_count * sizeof(uint32_t));
+      group->epoch = 2;
+   }
+   memset(bitmap, 0, (group->count + 63) / 64 * sizeof(uint64_t));
+
+   for (uint32_t i = 0; i < group->count; i++) {
+      const struct program *prog = group->programs[i];
+      int result;
+
+      if (!prog) {
+         result = 1;
+      } else if (prog->stats) {
+         result = program_eval(prog, rec);
+      } else {
+         const uint32_t *shared = group->shared[i];
+         uint32_t pc = 0;
+         while (pc < prog->count) {
+            const struct insn *insn = &prog->insns[pc];
+            uint32_t *cached = &group->cache[shared[pc]];
+            int res;
+            if ((*cached & ~1U) == group->epoch) {
+               res = *cached & 1;
+            } else {
+               res = eval_insn(prog, insn, (const char *) rec);
+               *cached = group->epoch | res;
+            }
+            pc = res ? insn->jt : insn->jf;
+         }
+         result = pc == PROG_ACCEPT(prog);
+      }
+      if (result) {
+         bitmap[i / 64] |= 1ULL << (i % 64);
+         matched++;
+      }
+   }
+   return matched;
+}
+
+void program_group_free(struct program_group *group)
+{
+   if (group) {
+      if (group->shared) {
+         for (uint32_t i = 0; i < group->count; i++) {
+            free(group->shared[i]);
+         }
+      }
+      free(group->shared);
+      free(group->programs);
+      free(group->ids);
+      free(group->cache);
+      free(group);
+   }
+}
+
+/**
+ * \brief Print statistics of comparisons of the program in order of their evaluation.
+ */
+void program_print_stats(const struct program *prog)
+{
+   if (!prog->stats) {
+      printf("No statistics, profiling is not enabled.\n");
+      return;
+   }
+   printf("Records: %"PRIu64", sampled: %"PRIu64"\n", prog->stats->records, prog->stats->samples);
+   printf("%5s %12s %12s %12s %9s  %s\n", "insn", "evaluated", "true", "time [ns]", "ns/eval", "comparison");
+   for (uint32_t i = 0; i < prog->count; i++) {
+      const struct insn_stats *stats = &prog->stats->insns[i];
+      printf("%5"PRIu32" %12"PRIu64" %12"PRIu64" %12"PRIu64" %9.1f  ", i, stats->evals, stats->hits, stats->ns,
+             stats->evals ? (double) stats->ns / stats->evals : 0.0);
+      if (!stats->node) {
+         printf("%s", prog->insns[i].op == INSN_TRUE ? "TRUE" : "FALSE");
+      } else {
+         // true count is of comparison without the negation
+         printf("%s", stats->negate ? "!" : "");
+         printAST((struct ast *) stats->node);
+      }
+      printf("\n");
+   }
+}
+
+void program_free(struct program *prog)
+{
+   if (prog) {
+      free(prog->insns);
+      free(prog->fields);
+      free(prog->stats);
+      free(prog);
+   }
+}
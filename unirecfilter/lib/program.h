@@ -0,0 +1,187 @@
+/**
+ * \file program.h
+ * \brief Filter compiled into a linear program of comparisons with jumps
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_PROGRAM_H
+#define LIB_UNIREC_PROGRAM_H
+
+#include <unirec/unirec.h>
+
+#include "functions.h"
+
+/*
+ * Filter tree is lowered into an array of instructions for every input template.
+ * Every instruction is one comparison of a record field with precomputed offset
+ * and two jump targets: the next instruction when the comparison is true and when
+ * it is false. Jumps lead always forward, logical operators are expressed only by
+ * the jump targets (negation just swaps them), so evaluation stops as soon as the
+ * result is known. Jump to PROG_ACCEPT(prog) means the record matches the filter,
+ * jump to PROG_REJECT(prog) means it does not. Operands of logical operators are
+ * evaluated in order of their estimated cost, not in order given by user.
+ */
+
+/* Operations of instructions, every field type has its own one */
+typedef enum {
+   INSN_FALSE,       /* constant result, e.g. field is missing in template */
+   INSN_TRUE,
+   INSN_RANGE_U8,    /* unsigned integer is (not) in range */
+   INSN_RANGE_U16,
+   INSN_RANGE_U32,
+   INSN_RANGE_U64,
+   INSN_RANGE_I8,    /* signed integer is (not) in range */
+   INSN_RANGE_I16,
+   INSN_RANGE_I32,
+   INSN_RANGE_I64,
+   INSN_CMP_FLOAT,
+   INSN_CMP_DOUBLE,
+   INSN_CMP_IP,      /* IP address compared with given one */
+   INSN_CMP_NET4,    /* IPv4 address masked and checked to be (not) in range */
+   INSN_CMP_NET,     /* IP address masked and compared with given IPv6 network */
+   INSN_IN,          /* field value is in given array */
+   INSN_CHAR,        /* char is (not) equal to given one */
+   INSN_STR_EQ,      /* variable length field is (not) equal to given string */
+   INSN_STR_RE       /* variable length field matches regular expression */
+} insn_op;
+
+/* Flags of results of IP comparison, instruction is true if flag of the comparison result is set */
+#define CMP_RESULT_LOWER   0x01  // value in record is lower than the given one
+#define CMP_RESULT_EQUAL   0x02  // values are equal
+#define CMP_RESULT_HIGHER  0x04  // value in record is higher than the given one
+#define CMP_RESULT_OTHER   0x08  // IP versions of the addresses differ
+
+/* Instruction of the program */
+struct insn {
+   uint8_t op;       /* insn_op */
+   uint8_t result;   /* RANGE, NET4, CHAR and STR: negate the comparison, IP and NET: CMP_RESULT_* flags */
+   uint16_t offset;  /* offset of fixed-length field, offset of (offset, length) header of variable length field */
+   uint32_t jt;      /* index of next instruction when comparison is true */
+   uint32_t jf;      /* index of next instruction when comparison is false */
+   union {
+      struct { uint64_t lo, span; } range;       /* value - lo <= span (computed modulo 2^64) */
+      struct { double value; cmp_op cmp; } fp;
+      struct { uint32_t mask, lo, span; uint8_t other; } net4;  /* range of masked address in host byte order, result for IPv6 */
+      ip_addr_t ip;
+      const struct ipnet *net;
+      struct expression_array *array;
+      struct { const char *s; uint32_t len; } str;
+      const struct str_matcher *matcher;
+      char c;
+   } arg;
+};
+
+/* Field used by the program and its offset in the template the program was built for */
+struct prog_field {
+   ur_field_id_t id;
+   uint16_t offset;  /* UR_INVALID_OFFSET if field is not present */
+};
+
+/* Options of program */
+#define PROG_PROFILE  0x01    /* count evaluations, true results and time of every instruction */
+#define PROG_ADAPTIVE 0x02    /* reorder comparisons by their selectivity observed on sampled records */
+
+#define PROG_SAMPLE_RATE     64     /* every 64th record is sampled by all instructions in adaptive mode */
+#define PROG_REORDER_SAMPLES 1024   /* program is reordered after every 1024 samples */
+#define PROG_MIN_SAMPLES     64     /* selectivity observed on fewer samples is not used */
+
+/* Counters of instruction, they are kept across rebuilds of the program by the node of the tree */
+struct insn_stats {
+   const struct ast *node;    /* leaf of the tree the instruction comes from, NULL for constant */
+   uint8_t negate;            /* comparison of the node is negated */
+   uint64_t evals;            /* number of evaluations */
+   uint64_t hits;             /* number of evaluations with true result */
+   uint64_t ns;               /* time of evaluations in nanoseconds */
+   uint64_t sampled;          /* number of sampled records */
+   uint64_t sampled_hits;     /* number of sampled records the comparison was true for */
+};
+
+struct prog_stats {
+   uint64_t records;          /* number of evaluated records */
+   uint64_t samples;          /* number of sampled records, halved when program is reordered */
+   int reorder;               /* program should be built again with observed selectivity */
+   struct insn_stats insns[]; /* counters of every instruction */
+};
+
+struct program {
+   uint64_t id;                  /* unique number of the program, a rebuilt program gets a new one */
+   const ur_template_t *tmplt;   /* template the program was built for */
+   uint16_t static_size;         /* size of fixed-length part of records of the template */
+   uint32_t count;               /* number of instructions */
+   struct insn *insns;
+   uint32_t field_count;         /* number of distinct fields used by the program */
+   struct prog_field *fields;
+   unsigned int options;         /* PROG_PROFILE, PROG_ADAPTIVE */
+   struct prog_stats *stats;     /* NULL if no option is set */
+};
+
+#define PROG_ACCEPT(prog) ((prog)->count)
+#define PROG_REJECT(prog) ((prog)->count + 1)
+
+/*
+ * Programs of several filters evaluated on the same records (e.g. filters of all output
+ * interfaces) share their comparisons. Equal comparisons of different filters are found
+ * when the group is built, and every one is evaluated at most once per record, its result
+ * is cached and used by the other programs. Programs keep their own jumps, so each of them
+ * still stops as soon as its result is known. Programs with statistics (profiling or
+ * adaptive order) are evaluated separately to keep their counters exact.
+ */
+struct program_group {
+   uint32_t count;                  /* number of programs */
+   const struct program **programs; /* programs of the group, NULL means empty filter (always true) */
+   uint64_t *ids;                   /* ids of the programs the group was built for */
+   uint32_t **shared;               /* index of shared comparison of every instruction of every program */
+   uint32_t shared_count;           /* number of distinct comparisons */
+   uint32_t *cache;                 /* result of every comparison (lowest bit) with epoch of the record it belongs to */
+   uint32_t epoch;                  /* epoch of the current record, shifted left by one */
+};
+
+struct program_group *program_group_build(const struct program *const *programs, uint32_t count);
+int program_group_check(const struct program_group *group, const struct program *const *programs);
+int program_group_eval(struct program_group *group, const void *rec, uint64_t *bitmap);
+void program_group_free(struct program_group *group);
+
+struct program *program_build(struct ast *ast, const ur_template_t *tmplt, unsigned int options, const struct program *prev);
+int program_check(const struct program *prog, const ur_template_t *tmplt);
+int program_eval(const struct program *prog, const void *rec);
+int program_eval_batch(const struct program *prog, const void *const *records, size_t n, uint64_t *bitmap);
+void program_print_stats(const struct program *prog);
+void program_free(struct program *prog);
+
+#endif /* LIB_UNIREC_PROGRAM_H */
@@ -0,0 +1,275 @@
+/**
+ * \file sets.c
+ * \brief Hash set of integers and set of IP prefixes used by the in operator
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include "sets.h"
+
+#define SET_MIN_SLOTS 16
+
+/**
+ * Get number of slots for expected number of values, at most a half of slots is used.
+ */
+static uint64_t slots_for(size_t expected)
+{
+   uint64_t slots = SET_MIN_SLOTS;
+   while (slots < 2 * (uint64_t) expected) {
+      slots *= 2;
+   }
+   return slots;
+}
+
+/* ---------------------------------------------------------------- */
+
+struct int_set *int_set_create(size_t expected)
+{
+   struct int_set *set = (struct int_set *) calloc(1, sizeof(struct int_set));
+   if (!set) {
+      return NULL;
+   }
+   uint64_t slots = slots_for(expected);
+   set->slots = (uint64_t *) malloc(slots * sizeof(uint64_t));
+   if (!set->slots) {
+      free(set);
+      return NULL;
+   }
+   memset(set->slots, 0xFF, slots * sizeof(uint64_t));
+   set->mask = slots - 1;
+   return set;
+}
+
+/**
+ * Insert value into slots, value must not be SET_EMPTY_SLOT.
+ * \return 1 if the value was inserted, 0 if it was present.
+ */
+static int int_set_insert(uint64_t *slots, uint64_t mask, uint64_t value)
+{
+   for (uint64_t i = set_hash(value) & mask; ; i = (i + 1) & mask) {
+      if (slots[i] == value) {
+         return 0;
+      }
+      if (slots[i] == SET_EMPTY_SLOT) {
+         slots[i] = value;
+         return 1;
+      }
+   }
+}
+
+/**
+ * \brief Add value to the set.
+ * \return 0 on success, -1 if memory could not be allocated.
+ */
+int int_set_add(struct int_set *set, uint64_t value)
+{
+   if (value == SET_EMPTY_SLOT) {
+      set->has_empty = 1;
+      return 0;
+   }
+   if (2 * (set->count + 1) > set->mask + 1) {
+      uint64_t slots = 2 * (set->mask + 1);
+      uint64_t *grown = (uint64_t *) malloc(slots * sizeof(uint64_t));
+      if (!grown) {
+         return -1;
+      }
+      memset(grown, 0xFF, slots * sizeof(uint64_t));
+      for (uint64_t i = 0; i <= set->mask; i++) {
+         if (set->slots[i] != SET_EMPTY_SLOT) {
+            int_set_insert(grown, slots - 1, set->slots[i]);
+         }
+      }
+      free(set->slots);
+      set->slots = grown;
+      set->mask = slots - 1;
+   }
+   set->count += int_set_insert(set->slots, set->mask, value);
+   return 0;
+}
+
+void int_set_destroy(struct int_set *set)
+{
+   if (set) {
+      free(set->slots);
+      free(set);
+   }
+}
+
+/* ---------------------------------------------------------------- */
+
+/**
+ * Mask address to prefix of given length, IPv4 address keeps its IPv4 form.
+ */
+static inline void prefix_mask(ip_addr_t *addr, uint8_t len)
+{
+   if (ip_is4(addr)) {
+      addr->ui32[2] &= len ? htonl(0xFFFFFFFFU << (32 - len)) : 0;
+   } else {
+      addr->ui64[0] &= len >= 64 ? UINT64_MAX : (len ? htobe64(UINT64_MAX << (64 - len)) : 0);
+      addr->ui64[1] &= len <= 64 ? 0 : htobe64(UINT64_MAX << (128 - len));
+   }
+}
+
+static inline uint64_t prefix_hash(const ip_addr_t *addr, uint8_t len)
+{
+   return set_hash(addr->ui64[0] ^ set_hash(addr->ui64[1] + len));
+}
+
+/**
+ * Find slot of the prefix or the free slot where it belongs.
+ */
+static inline struct prefix_entry *prefix_find(struct prefix_entry *slots, uint64_t mask, const ip_addr_t *addr, uint8_t len)
+{
+   for (uint64_t i = prefix_hash(addr, len) & mask; ; i = (i + 1) & mask) {
+      struct prefix_entry *entry = &slots[i];
+      if (!entry->used || (entry->len == len && entry->addr.ui64[0] == addr->ui64[0] && entry->addr.ui64[1] == addr->ui64[1])) {
+         return entry;
+      }
+   }
+}
+
+struct prefix_set *prefix_set_create(size_t expected)
+{
+   struct prefix_set *set = (struct prefix_set *) calloc(1, sizeof(struct prefix_set));
+   if (!set) {
+      return NULL;
+   }
+   uint64_t slots = slots_for(expected);
+   set->slots = (struct prefix_entry *) calloc(slots, sizeof(struct prefix_entry));
+   if (!set->slots) {
+      free(set);
+      return NULL;
+   }
+   set->mask = slots - 1;
+   return set;
+}
+
+/**
+ * Insert prefix length into array of distinct lengths sorted descending.
+ */
+static void add_length(uint8_t *lengths, uint8_t *count, uint8_t len)
+{
+   int i = 0;
+   while (i < *count && lengths[i] > len) {
+      i++;
+   }
+   if (i < *count && lengths[i] == len) {
+      return;
+   }
+   memmove(lengths + i + 1, lengths + i, *count - i);
+   lengths[i] = len;
+   (*count)++;
+}
+
+/**
+ * \brief Add prefix to the set.
+ * \param[in] addr address of the prefix, it does not need to be masked
+ * \param[in] len  length of the prefix, at most 32 for IPv4 and 128 for IPv6 address
+ * \return 0 on success, -1 if memory could not be allocated.
+ */
+int prefix_set_add(struct prefix_set *set, const ip_addr_t *addr, uint8_t len)
+{
+   ip_addr_t key = *addr;
+   struct prefix_entry *entry;
+
+   prefix_mask(&key, len);
+   if (2 * (set->count + 1) > set->mask + 1) {
+      uint64_t slots = 2 * (set->mask + 1);
+      struct prefix_entry *grown = (struct prefix_entry *) calloc(slots, sizeof(struct prefix_entry));
+      if (!grown) {
+         return -1;
+      }
+      for (uint64_t i = 0; i <= set->mask; i++) {
+         if (set->slots[i].used) {
+            *prefix_find(grown, slots - 1, &set->slots[i].addr, set->slots[i].len) = set->slots[i];
+         }
+      }
+      free(set->slots);
+      set->slots = grown;
+      set->mask = slots - 1;
+   }
+
+   entry = prefix_find(set->slots, set->mask, &key, len);
+   if (!entry->used) {
+      entry->addr = key;
+      entry->len = len;
+      entry->used = 1;
+      set->count++;
+      if (ip_is4(&key)) {
+         add_length(set->lengths4, &set->count4, len);
+      } else {
+         add_length(set->lengths6, &set->count6, len);
+      }
+   }
+   return 0;
+}
+
+/**
+ * \brief Check whether the IP address belongs to any prefix of the set.
+ */
+int prefix_set_contains(const struct prefix_set *set, const ip_addr_t *ip)
+{
+   const uint8_t *lengths = set->lengths6;
+   int count = set->count6;
+
+   if (ip_is4(ip)) {
+      lengths = set->lengths4;
+      count = set->count4;
+   }
+   for (int i = 0; i < count; i++) {
+      ip_addr_t key = *ip;
+      prefix_mask(&key, lengths[i]);
+      if (prefix_find(set->slots, set->mask, &key, lengths[i])->used) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+void prefix_set_destroy(struct prefix_set *set)
+{
+   if (set) {
+      free(set->slots);
+      free(set);
+   }
+}
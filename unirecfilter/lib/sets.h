@@ -0,0 +1,122 @@
+/**
+ * \file sets.h
+ * \brief Hash set of integers and set of IP prefixes used by the in operator
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LIB_UNIREC_SETS_H
+#define LIB_UNIREC_SETS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unirec/unirec.h>
+
+#define SET_EMPTY_SLOT UINT64_MAX  // marks free slot of int_set, the value itself is stored in has_empty
+
+/* Hash set of 64 bit values (integers of any width and times), open addressing with linear probing */
+struct int_set {
+   uint64_t *slots;
+   uint64_t mask;       /* number of slots - 1, number of slots is power of 2 */
+   size_t count;        /* number of values in slots */
+   int has_empty;       /* set contains SET_EMPTY_SLOT value */
+};
+
+/* Entry of prefix_set */
+struct prefix_entry {
+   ip_addr_t addr;      /* masked address */
+   uint8_t len;         /* prefix length */
+   uint8_t used;
+};
+
+/*
+ * Set of IPv4 and IPv6 prefixes (addresses are prefixes of full length).
+ * All prefixes are stored in one hash table keyed by masked address and prefix length,
+ * address is looked up once for every distinct prefix length, the longest first.
+ */
+struct prefix_set {
+   struct prefix_entry *slots;
+   uint64_t mask;
+   size_t count;
+   uint8_t lengths4[33];   /* distinct prefix lengths of IPv4 prefixes, descending */
+   uint8_t count4;
+   uint8_t lengths6[129];  /* distinct prefix lengths of IPv6 prefixes, descending */
+   uint8_t count6;
+};
+
+/**
+ * Mix bits of 64 bit value (finalizer of MurmurHash3).
+ */
+static inline uint64_t set_hash(uint64_t x)
+{
+   x ^= x >> 33;
+   x *= 0xff51afd7ed558ccdULL;
+   x ^= x >> 33;
+   x *= 0xc4ceb9fe1a85ec53ULL;
+   x ^= x >> 33;
+   return x;
+}
+
+/**
+ * Check whether the set contains value.
+ */
+static inline int int_set_contains(const struct int_set *set, uint64_t value)
+{
+   if (value == SET_EMPTY_SLOT) {
+      return set->has_empty;
+   }
+   for (uint64_t i = set_hash(value) & set->mask; ; i = (i + 1) & set->mask) {
+      if (set->slots[i] == value) {
+         return 1;
+      }
+      if (set->slots[i] == SET_EMPTY_SLOT) {
+         return 0;
+      }
+   }
+}
+
+struct int_set *int_set_create(size_t expected);
+int int_set_add(struct int_set *set, uint64_t value);
+void int_set_destroy(struct int_set *set);
+
+struct prefix_set *prefix_set_create(size_t expected);
+int prefix_set_add(struct prefix_set *set, const ip_addr_t *addr, uint8_t len);
+int prefix_set_contains(const struct prefix_set *set, const ip_addr_t *ip);
+void prefix_set_destroy(struct prefix_set *set);
+
+#endif /* LIB_UNIREC_SETS_H */
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <unirec/unirec.h>
 
@@ -74,6 +76,87 @@ static void test_array_ip4(void **state)
    ur_free_template(tmplt);
 }
 
+static void test_array_prefix(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("SRC_IP in [10.0.0.0/8, 192.168.1.1, 2001:db8::/32]", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+
+   ip_from_str("10.20.30.40", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("11.0.0.1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   ip_from_str("2001:db8::1", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("192.168.1.2", fv);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_array_file(void **state)
+{
+   int result;
+   char path[] = "/tmp/test_liburfilter_XXXXXX";
+   int fd = mkstemp(path);
+   assert_true(fd >= 0);
+   FILE *f = fdopen(fd, "w");
+   fprintf(f, "# ports\n80, 443\n8080\n");
+   fclose(f);
+
+   char filter[128];
+   snprintf(filter, sizeof(filter), "DST_PORT in file:\"%s\"", path);
+   urfilter_t *urf = urfilter_create(filter, "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+
+   *((uint16_t *) fv) = 8080;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   // list is replaced on reload
+   f = fopen(path, "w");
+   fprintf(f, "22\n");
+   fclose(f);
+   assert_int_equal(urfilter_reload(urf), URFILTER_TRUE);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+   *((uint16_t *) fv) = 22;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   // invalid list keeps previous values
+   f = fopen(path, "w");
+   fprintf(f, "ssh\n");
+   fclose(f);
+   assert_int_equal(urfilter_reload(urf), URFILTER_ERROR);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   urfilter_destroy(urf);
+   unlink(path);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
 static void test_array_double(void **state)
 {
    int result;
@@ -164,6 +247,232 @@ static void test_array_complexfree(void **state)
    urfilter_destroy(urf);
 }
 
+static void test_logic_template_change(void **state)
+{
+   int result;
+   urfilter_t *urf = urfilter_create("(DST_PORT == 80 || DST_PORT >= 8000) && !(SRC_IP == 10.0.0.1)", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   uint16_t *port = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+   void *ip = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP"));
+
+   ip_from_str("10.0.0.2", ip);
+   *port = 80;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   *port = 443;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   *port = 8080;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   ip_from_str("10.0.0.1", ip);
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+
+   // filter has to be compiled again for different offsets, comparison of missing SRC_IP is false
+   tmplt = ur_create_template("DST_PORT,PROTOCOL,SCALE", NULL);
+   rec = ur_create_record(tmplt, 0);
+   port = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+   *port = 80;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 1);
+
+   *port = 443;
+   result = urfilter_match(urf, tmplt, rec);
+   assert_int_equal(result, 0);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_match_batch(void **state)
+{
+   int result;
+   const void *recs[100];
+   uint64_t bitmap[2];
+   urfilter_t *urf = urfilter_create("SRC_IP == 10.0.0.0/24 && (DST_PORT < 10 || TIME >= 2020-04-09T01:02:21)", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT,TIME", NULL);
+   char *data = calloc(100, ur_rec_fixlen_size(tmplt));
+   ur_time_t border;
+   ur_time_from_string(&border, "2020-04-09T01:02:21");
+   for (int i = 0; i < 100; i++) {
+      void *rec = data + i * ur_rec_fixlen_size(tmplt);
+      ip_from_str(i % 2 ? "10.0.0.1" : "10.0.1.1", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+      *((uint16_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"))) = i;
+      *((ur_time_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("TIME"))) = i < 90 ? border - 1 : border;
+      recs[i] = rec;
+   }
+
+   result = urfilter_match_batch(urf, tmplt, recs, 100, bitmap);
+   // odd records with port below 10 or of the last ten
+   assert_int_equal(result, 10);
+   for (int i = 0; i < 100; i++) {
+      int expected = (i % 2) && (i < 10 || i >= 90);
+      assert_int_equal((bitmap[i / 64] >> (i % 64)) & 1, expected);
+      assert_int_equal(urfilter_match(urf, tmplt, recs[i]), expected);
+   }
+
+   urfilter_destroy(urf);
+
+   free(data);
+   ur_free_template(tmplt);
+}
+
+static void test_options(void **state)
+{
+   // repeated, contradictory and missing-field comparisons are folded, the rest is reordered
+   urfilter_t *urf = urfilter_create("(DST_PORT == 80 || DST_PORT == 80 || SRC_PORT == 1) && !(SRC_IP == 10.0.0.1 && !(SRC_IP == 10.0.0.1)) && !(PACKETS > 5 && DST_PORT > 100)", "testifc0");
+   assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+   assert_int_equal(urfilter_set_options(urf, 0x80), URFILTER_ERROR);
+   assert_int_equal(urfilter_set_options(urf, URFILTER_PROFILE | URFILTER_ADAPTIVE), URFILTER_TRUE);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   void *fv = ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"));
+   ip_from_str("10.0.0.1", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+
+   // enough records for the comparisons to be reordered by sampling
+   for (int i = 0; i < 200000; i++) {
+      *((uint16_t *) fv) = i % 7 ? 443 : 80;
+      assert_int_equal(urfilter_match(urf, tmplt, rec), i % 7 == 0);
+   }
+   urfilter_print_stats(urf);
+
+   urfilter_destroy(urf);
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_regex(void **state)
+{
+   const char *filters[] = {
+      "HOST =~ \"\\.example\\.com$\"",           // literal
+      "HOST =~ \"^www[0-9]+\\.(example|test)\\.\"",  // automaton
+      "HOST =~ \"(www)\\1\"",                      // back-reference, regexec
+   };
+   const char *hosts[] = {"www1.example.com", "www.example.org", "wwwwww.test.com", ""};
+   const int expected[][4] = {{1, 0, 0, 0}, {1, 0, 0, 0}, {0, 0, 1, 0}};
+
+   ur_template_t *tmplt = ur_create_template("DST_PORT,HOST", NULL);
+   void *rec = ur_create_record(tmplt, 64);
+
+   for (int i = 0; i < 3; i++) {
+      urfilter_t *urf = urfilter_create(filters[i], "testifc0");
+      assert_int_equal(urfilter_compile(urf), URFILTER_TRUE);
+      for (int j = 0; j < 4; j++) {
+         ur_set_string(tmplt, rec, ur_get_id_by_name("HOST"), hosts[j]);
+         assert_int_equal(urfilter_match(urf, tmplt, rec), expected[i][j]);
+      }
+      urfilter_destroy(urf);
+   }
+
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_group(void **state)
+{
+   const char *filters[] = {
+      "SRC_IP == 10.0.0.0/8 && DST_PORT == 80",
+      "SRC_IP == 10.0.0.0/8 && DST_PORT in [22, 80, 443]",
+      "!(SRC_IP == 10.0.0.0/8) || DST_PORT in [22, 80, 443]",
+      "DST_PORT == 80",
+   };
+   urfilter_t *urfs[4];
+   uint64_t bitmap;
+
+   for (int i = 0; i < 4; i++) {
+      urfs[i] = urfilter_create(filters[i], "testifc0");
+   }
+   urfilter_group_t *group = urfilter_group_create(urfs, 4);
+   assert_non_null(group);
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   for (int port = 20; port < 500; port++) {
+      ip_from_str(port % 3 ? "10.1.2.3" : "192.168.0.1", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+      *((uint16_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"))) = port;
+      int matched = urfilter_group_match(group, tmplt, rec, &bitmap);
+      int expected = 0;
+      for (int i = 0; i < 4; i++) {
+         int result = urfilter_match(urfs[i], tmplt, rec);
+         assert_int_equal((bitmap >> i) & 1, result);
+         expected += result;
+      }
+      assert_int_equal(matched, expected);
+   }
+
+   urfilter_group_destroy(group);
+   for (int i = 0; i < 4; i++) {
+      urfilter_destroy(urfs[i]);
+   }
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
+static void test_share(void **state)
+{
+   char path[] = "/tmp/test_liburfilter_XXXXXX";
+   int fd = mkstemp(path);
+   assert_true(fd >= 0);
+   FILE *f = fdopen(fd, "w");
+   fprintf(f, "80, 443\n");
+   fclose(f);
+
+   char filter[128];
+   snprintf(filter, sizeof(filter), "SRC_IP == 10.0.0.0/8 && DST_PORT in file:\"%s\"", path);
+   urfilter_t *urf = urfilter_create(filter, "testifc0");
+   urfilter_t *copies[2];
+   for (int i = 0; i < 2; i++) {
+      copies[i] = urfilter_share(urf);
+      assert_non_null(copies[i]);
+      assert_ptr_equal(copies[i]->tree, urf->tree);
+   }
+
+   ur_template_t *tmplt = ur_create_template("SRC_IP,DST_PORT", NULL);
+   void *rec = ur_create_record(tmplt, 0);
+   ip_from_str("10.1.2.3", ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("SRC_IP")));
+   *((uint16_t *) ur_get_ptr_by_id(tmplt, rec, ur_get_id_by_name("DST_PORT"))) = 443;
+   for (int i = 0; i < 2; i++) {
+      assert_int_equal(urfilter_match(copies[i], tmplt, rec), 1);
+   }
+
+   // lists reloaded by the owner of the tree are used by all copies
+   f = fopen(path, "w");
+   fprintf(f, "22\n");
+   fclose(f);
+   assert_int_equal(urfilter_reload(urf), URFILTER_TRUE);
+   for (int i = 0; i < 2; i++) {
+      assert_int_equal(urfilter_match(copies[i], tmplt, rec), 0);
+      urfilter_destroy(copies[i]);
+   }
+   assert_int_equal(urfilter_match(urf, tmplt, rec), 0);
+
+   // syntax error is reported when the copy is created
+   urfilter_t *bad = urfilter_create("DST_PORT ==", "testifc0");
+   assert_null(urfilter_share(bad));
+   urfilter_destroy(bad);
+
+   urfilter_destroy(urf);
+   unlink(path);
+   ur_free_record(rec);
+   ur_free_template(tmplt);
+}
+
 int main(void)
 {
    ur_define_field("SRC_IP", UR_TYPE_IP);
@@ -171,17 +480,26 @@ int main(void)
    ur_define_field("SCALE", UR_TYPE_DOUBLE);
    ur_define_field("TIME", UR_TYPE_TIME);
    ur_define_field("PROTOCOL", UR_TYPE_UINT8);
+   ur_define_field("HOST", UR_TYPE_STRING);
 
    const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_create_destroy),
       cmocka_unit_test(test_checkipandport),
       cmocka_unit_test(test_array),
       cmocka_unit_test(test_array_ip4),
+      cmocka_unit_test(test_array_prefix),
+      cmocka_unit_test(test_array_file),
       cmocka_unit_test(test_array_double),
       cmocka_unit_test(test_array_time),
       cmocka_unit_test(test_array_missingfield),
       cmocka_unit_test(test_array_badtypes),
       cmocka_unit_test(test_array_complexfree),
+      cmocka_unit_test(test_logic_template_change),
+      cmocka_unit_test(test_match_batch),
+      cmocka_unit_test(test_options),
+      cmocka_unit_test(test_regex),
+      cmocka_unit_test(test_group),
+      cmocka_unit_test(test_share),
    };
    return cmocka_run_group_tests(tests, NULL, NULL);
 }
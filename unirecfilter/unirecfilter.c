@@ -50,10 +50,13 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
@@ -80,6 +83,11 @@ trap_module_info_t *module_info = NULL;
   PARAM('n', "no_eof", "Don't send 'EOF message' at the end.", no_argument, "none") \
   PARAM('f', "file", "Read template and filter from file.", required_argument, "string") \
   PARAM('c', "cut", "Quit after N records are received.", required_argument, "int32") \
+  PARAM('a', "adaptive", "Reorder comparisons of filter by their selectivity observed on sampled records.", no_argument, "none") \
+  PARAM('p', "profile", "Print number of evaluations, true results and time of every comparison of filter at the end.", no_argument, "none") \
+  PARAM('t', "flush_timeout", "Send buffered records at least every T milliseconds, 0 sends every record immediately. (Default: autoflush timeout of output interface)", required_argument, "int32") \
+  PARAM('T', "threads", "Evaluate filters by N worker threads, records are received and sent by other threads. (Default: 0, filters are evaluated by the main thread)", required_argument, "int32") \
+  PARAM('R', "relaxed_order", "Records processed by worker threads may be sent in different order than received, workers send them without waiting for each other.", no_argument, "none")
 
 static int stop = 0;               // Flag to interrupt process
 static int send_eof = 1;           // Flag to enable EOF
@@ -88,9 +96,12 @@ int verbose;                       // Verbosity level
 
 unsigned int num_records = 0;      // Number of records received (total of all inputs)
 unsigned int max_num_records = 0;  // Exit after this number of records is received
-unsigned int max_num_ifaces = 32;  // Maximum number of output interfaces
-
-char *str_buffer = NULL;           // Auxiliary buffer for evalAST()
+unsigned int max_num_ifaces = MAX_OUTPUTS;  // Maximum number of output interfaces
+unsigned int filter_options = 0;   // Options of filters (URFILTER_PROFILE, URFILTER_ADAPTIVE)
+int flush_timeout = -1;            // Autoflush timeout of output interfaces in ms, 0 flushes every record, -1 keeps default
+int threads = 0;                   // Number of filter worker threads, 0 evaluates filters in the main thread
+int relaxed_order = 0;             // Flag to send records of worker threads in any order
+urfilter_group_t *filter_group = NULL; // Filters of all output interfaces matched together, NULL for one output
 
 // Function to handle SIGTERM and SIGINT signals (used to stop the module)
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
@@ -390,6 +401,7 @@ float, double, ipaddr, string, bytes\n");
          fprintf(stderr, "Error: Insufficient memory available: create_templates: create filter.\n");
          return 1;
       }
+      urfilter_set_options(output_specifiers[i]->filter, filter_options);
 
       // Calculate maximum needed memory for dynamic fields
       ur_field_id_t field_id = UR_ITER_BEGIN;
@@ -407,6 +419,702 @@ float, double, ipaddr, string, bytes\n");
    return 0;
 }
 
+// Create plans of copying fields from input records to output records
+int create_copy_plans(int n_outputs, const ur_template_t *in_tmplt, struct unirec_output_t **output_specifiers)
+{
+   int i;
+
+   for (i = 0; i < n_outputs; i++) {
+      struct unirec_output_t *out = output_specifiers[i];
+      ur_field_id_t id;
+      int rec_ind = 0;
+
+      free(out->copy_steps);
+      free(out->copy_var_ids);
+      out->copy_step_count = 0;
+      out->copy_var_count = 0;
+      out->copy_steps = (struct copy_step *) malloc((out->out_tmplt->count + 1) * sizeof(struct copy_step));
+      out->copy_var_ids = (ur_field_id_t *) malloc((out->out_tmplt->count + 1) * sizeof(ur_field_id_t));
+      if (!out->copy_steps || !out->copy_var_ids) {
+         fprintf(stderr, "Error: Insufficient memory available: copy plan.\n");
+         return 1;
+      }
+
+      // Templates with the same fields in the same order have the same layout of records
+      out->copy_whole = (in_tmplt->count == out->out_tmplt->count);
+      while ((id = ur_iter_fields_record_order(out->out_tmplt, rec_ind)) != UR_ITER_END) {
+         if (ur_iter_fields_record_order(in_tmplt, rec_ind++) != id) {
+            out->copy_whole = 0;
+         }
+         // Fields missing in input template keep their default value
+         if (!ur_is_present(in_tmplt, id)) {
+            continue;
+         }
+         if (ur_is_dynamic(id)) {
+            out->copy_var_ids[out->copy_var_count++] = id;
+            continue;
+         }
+         struct copy_step *step = &out->copy_steps[out->copy_step_count];
+         if (out->copy_step_count > 0 &&
+             step[-1].in_offset + step[-1].size == in_tmplt->offset[id] &&
+             step[-1].out_offset + step[-1].size == out->out_tmplt->offset[id]) {
+            // Field follows the previous one in both records
+            step[-1].size += ur_get_size(id);
+         } else {
+            step->in_offset = in_tmplt->offset[id];
+            step->out_offset = out->out_tmplt->offset[id];
+            step->size = ur_get_size(id);
+            out->copy_step_count++;
+         }
+      }
+      if (verbose >= 0) {
+         printf("VERBOSE: Interface %d copies %d block(s) of static fields and %d dynamic field(s)%s\n", i,
+                out->copy_step_count, out->copy_var_count, out->copy_whole ? ", input records are sent unchanged" : "");
+      }
+   }
+   return 0;
+}
+
+// Group filters of all output interfaces, so that their equal comparisons are evaluated once per record
+int create_filter_group(int n_outputs, struct unirec_output_t **output_specifiers)
+{
+   urfilter_t *filters[MAX_OUTPUTS];
+   int i;
+
+   urfilter_group_destroy(filter_group);
+   filter_group = NULL;
+   if (n_outputs < 2) {
+      return 0;
+   }
+   for (i = 0; i < n_outputs; i++) {
+      filters[i] = output_specifiers[i]->filter;
+   }
+   filter_group = urfilter_group_create(filters, n_outputs);
+   if (!filter_group) {
+      fprintf(stderr, "Error: Insufficient memory available: filter group.\n");
+      return 1;
+   }
+   return 0;
+}
+
+// Load filters again after SIGUSR1
+int reload_filters(int from, char *filename, char **port_numbers, int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt)
+{
+   int i;
+
+   if (from == 1) {
+      printf("\nReloading filter...\n\n");
+      printf("New filter:\n");
+
+      if (get_filter_from_file(filename, output_specifiers, n_outputs) != 0
+         || create_templates(n_outputs, port_numbers, output_specifiers) != 0
+         || create_copy_plans(n_outputs, in_tmplt, output_specifiers) != 0
+         || create_filter_group(n_outputs, output_specifiers) != 0) {
+            return 1;
+      }
+   } else {
+      // Filter from command line does not change, only lists of values given by file are loaded again
+      printf("\nReloading lists of filter...\n\n");
+      for (i = 0; i < n_outputs; i++) {
+         urfilter_reload(output_specifiers[i]->filter);
+      }
+   }
+   return 0;
+}
+
+// Copy fields of input record to output record of interface
+int copy_fields(const ur_template_t *in_tmplt, const void *in_rec, struct unirec_output_t *output_specifier, void *out_rec)
+{
+   int i;
+
+   for (i = 0; i < output_specifier->copy_step_count; i++) {
+      const struct copy_step *step = &output_specifier->copy_steps[i];
+      memcpy((char *) out_rec + step->out_offset, (const char *) in_rec + step->in_offset, step->size);
+   }
+   for (i = 0; i < output_specifier->copy_var_count; i++) {
+      ur_field_id_t id = output_specifier->copy_var_ids[i];
+      int size = ur_get_var_len(in_tmplt, in_rec, id);
+      // Check size of dynamic field and if longer than maximum size then cut it
+      if (size > DYN_FIELD_MAX_SIZE) {
+         size = DYN_FIELD_MAX_SIZE;
+      }
+      if (ur_set_var(output_specifier->out_tmplt, out_rec, id, ur_get_ptr_by_id(in_tmplt, in_rec, id), size) != UR_OK) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+// Time elapsed since start in ns
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec - start->tv_nsec;
+}
+
+// Append batch to queue, or insert it in order of sequence numbers, pipeline has to be locked
+static void batch_queue_push(struct batch_queue *q, struct batch *batch, int ordered)
+{
+   struct batch **pos = &q->head;
+
+   if (ordered) {
+      while (*pos && (*pos)->seq < batch->seq) {
+         pos = &(*pos)->next;
+      }
+   } else if (q->tail) {
+      pos = &q->tail->next;
+   }
+   batch->next = *pos;
+   *pos = batch;
+   if (!batch->next) {
+      q->tail = batch;
+   }
+   q->count++;
+   if (q->count > q->max_count) {
+      q->max_count = q->count;
+   }
+   q->pushes++;
+   q->depth_sum += q->count;
+   pthread_cond_signal(&q->cond);
+}
+
+// Remove the first batch from queue, pipeline has to be locked
+static struct batch *batch_queue_pop(struct batch_queue *q)
+{
+   struct batch *batch = q->head;
+
+   if (batch) {
+      q->head = batch->next;
+      if (!q->head) {
+         q->tail = NULL;
+      }
+      q->count--;
+   }
+   return batch;
+}
+
+// Append record to output records of interface
+static int batch_output_append(struct batch_output *out, const void *rec, uint16_t size)
+{
+   if (out->size + size > out->capacity) {
+      size_t capacity = out->capacity ? out->capacity * 2 : BATCH_DATA_SIZE;
+      while (capacity < out->size + size) {
+         capacity *= 2;
+      }
+      char *data = (char *) realloc(out->data, capacity);
+      if (!data) {
+         return 1;
+      }
+      out->data = data;
+      out->capacity = capacity;
+   }
+   memcpy(out->data + out->size, rec, size);
+   out->size += size;
+   out->sizes[out->count++] = size;
+   return 0;
+}
+
+// Create filters and output records of worker, called by the main thread when workers are idle
+int worker_create_filters(struct worker *w)
+{
+   struct pipeline *p = w->pipeline;
+   int i;
+
+   worker_free_filters(w, 0);
+   for (i = 0; i < p->n_outputs; i++) {
+      struct unirec_output_t *out = p->output_specifiers[i];
+      // Filter is parsed here only once, the parser is not reentrant and workers share its tree with lists of values
+      w->filters[i] = urfilter_share(out->filter);
+      if (!w->filters[i]) {
+         fprintf(stderr, "Error: Filter of output interface %d could not be compiled.\n", i);
+         return 1;
+      }
+      w->out_recs[i] = ur_create_record(out->out_tmplt, UR_MAX_SIZE);
+      if (!w->out_recs[i]) {
+         fprintf(stderr, "Error: Insufficient memory available: worker filters.\n");
+         return 1;
+      }
+      // Output record keeps default values of fields missing in input template
+      memcpy(w->out_recs[i], out->out_rec, ur_rec_size(out->out_tmplt, out->out_rec));
+   }
+   if (p->n_outputs > 1) {
+      w->group = urfilter_group_create(w->filters, p->n_outputs);
+      if (!w->group) {
+         fprintf(stderr, "Error: Insufficient memory available: filter group.\n");
+         return 1;
+      }
+   }
+   return 0;
+}
+
+// Free filters and output records of worker
+void worker_free_filters(struct worker *w, int print_stats)
+{
+   int i;
+
+   urfilter_group_destroy(w->group);
+   w->group = NULL;
+   for (i = 0; i < w->pipeline->n_outputs; i++) {
+      if (w->filters[i] && print_stats && (filter_options & URFILTER_PROFILE)) {
+         printf("Output interface %d, worker %d: ", i, (int) (w - w->pipeline->workers));
+         urfilter_print_stats(w->filters[i]);
+      }
+      urfilter_destroy(w->filters[i]);
+      w->filters[i] = NULL;
+      ur_free_record(w->out_recs[i]);
+      w->out_recs[i] = NULL;
+   }
+}
+
+// Evaluate filters on records of batch and create output records
+static int process_batch(struct worker *w, struct batch *batch)
+{
+   struct pipeline *p = w->pipeline;
+   const ur_template_t *in_tmplt = p->in_tmplt;
+   const char *in_rec = batch->data;
+   uint64_t matched_ifcs = 0;
+   int matched = 0;
+   int ret;
+   int i, r;
+
+   for (i = 0; i < p->n_outputs; i++) {
+      batch->outputs[i].count = 0;
+      batch->outputs[i].size = 0;
+   }
+   for (r = 0; r < batch->count; in_rec += batch->sizes[r++]) {
+      uint16_t in_rec_size = batch->sizes[r];
+      if (w->group) {
+         matched = urfilter_group_match(w->group, in_tmplt, in_rec, &matched_ifcs);
+      }
+      for (i = 0; i < p->n_outputs; i++) {
+         struct unirec_output_t *out = p->output_specifiers[i];
+         if (w->group) {
+            ret = matched == URFILTER_ERROR ? URFILTER_ERROR : (int) ((matched_ifcs >> i) & 1);
+         } else {
+            ret = urfilter_match(w->filters[i], in_tmplt, in_rec);
+         }
+         if (ret == URFILTER_ERROR) {
+            return 1;
+         } else if (ret != URFILTER_TRUE) {
+            if (verbose >= 1) {
+               printf("ADVANCED VERBOSE: Record %u declined on interface %d\n", batch->first_record + r, i);
+            }
+            continue;
+         }
+         if (verbose >= 1) {
+            printf("ADVANCED VERBOSE: Record %u accepted on interface %d\n", batch->first_record + r, i);
+         }
+         if (out->copy_whole && in_rec_size - ur_rec_fixlen_size(in_tmplt) <= DYN_FIELD_MAX_SIZE) {
+            // Output template is the same and no dynamic field has to be cut
+            ret = batch_output_append(&batch->outputs[i], in_rec, in_rec_size);
+         } else {
+            // Copy fields present in input template, missing ones keep default value
+            if (copy_fields(in_tmplt, in_rec, out, w->out_recs[i]) != 0) {
+               fprintf(stderr, "Error: failed to copy data to output.)\n");
+               return 1;
+            }
+            ret = batch_output_append(&batch->outputs[i], w->out_recs[i], ur_rec_size(out->out_tmplt, w->out_recs[i]));
+         }
+         if (ret != 0) {
+            fprintf(stderr, "Error: Insufficient memory available: batch output.\n");
+            return 1;
+         }
+      }
+   }
+   return 0;
+}
+
+// Send output records of batch to output interfaces
+static void send_batch(struct pipeline *p, struct batch *batch)
+{
+   int i, r;
+   int ret;
+
+   for (i = 0; i < p->n_outputs && !stop; i++) {
+      const struct batch_output *out = &batch->outputs[i];
+      const char *rec = out->data;
+      uint64_t sent = 0;
+
+      if (!out->count) {
+         continue;
+      }
+      // Workers in relaxed order send whole batches, so records of one batch stay together
+      if (!p->ordered) {
+         pthread_mutex_lock(&p->send_locks[i]);
+      }
+      for (r = 0; r < out->count; rec += out->sizes[r++]) {
+         ret = trap_send(i, rec, out->sizes[r]);
+         // Otherwise libtrap sends buffered records when the buffer is full or autoflush timeout expires
+         if (flush_timeout == 0) {
+            trap_send_flush(i);
+         }
+         // Handle possible errors
+         TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, {stop=1; break;});
+         sent++;
+      }
+      if (!p->ordered) {
+         pthread_mutex_unlock(&p->send_locks[i]);
+      }
+      __sync_fetch_and_add(&p->output_specifiers[i]->sent, sent);
+   }
+}
+
+// Return batch to reader, pipeline has to be locked
+static void release_batch(struct pipeline *p, struct batch *batch)
+{
+   batch->count = 0;
+   batch->size = 0;
+   batch_queue_push(&p->free_batches, batch, 0);
+}
+
+// Filter worker thread, processes batches until pipeline is finished
+static void *worker_thread(void *arg)
+{
+   struct worker *w = (struct worker *) arg;
+   struct pipeline *p = w->pipeline;
+   struct batch *batch;
+   struct timespec wait_start;
+
+   while (1) {
+      pthread_mutex_lock(&p->lock);
+      if (!p->work.head && !p->finish) {
+         clock_gettime(CLOCK_MONOTONIC, &wait_start);
+         while (!p->work.head && !p->finish) {
+            pthread_cond_wait(&p->work.cond, &p->lock);
+         }
+         p->work.wait_ns += elapsed_ns(&wait_start);
+      }
+      batch = batch_queue_pop(&p->work);
+      pthread_mutex_unlock(&p->lock);
+      if (!batch) {
+         break;
+      }
+
+      // Batch goes on even after error, so that the pipeline can be emptied
+      if (process_batch(w, batch) != 0) {
+         stop = 1;
+      }
+      w->batches++;
+      if (p->ordered) {
+         pthread_mutex_lock(&p->lock);
+         batch_queue_push(&p->done, batch, 1);
+         pthread_mutex_unlock(&p->lock);
+      } else {
+         send_batch(p, batch);
+         pthread_mutex_lock(&p->lock);
+         release_batch(p, batch);
+         pthread_mutex_unlock(&p->lock);
+      }
+   }
+   return NULL;
+}
+
+// Sender thread, sends processed batches in order of their sequence numbers
+static void *sender_thread(void *arg)
+{
+   struct pipeline *p = (struct pipeline *) arg;
+   struct batch *batch;
+   struct timespec wait_start;
+
+   while (1) {
+      pthread_mutex_lock(&p->lock);
+      if ((!p->done.head || p->done.head->seq != p->send_seq) && !p->finish) {
+         clock_gettime(CLOCK_MONOTONIC, &wait_start);
+         while ((!p->done.head || p->done.head->seq != p->send_seq) && !p->finish) {
+            pthread_cond_wait(&p->done.cond, &p->lock);
+         }
+         p->done.wait_ns += elapsed_ns(&wait_start);
+      }
+      batch = NULL;
+      if (p->done.head && p->done.head->seq == p->send_seq) {
+         batch = batch_queue_pop(&p->done);
+         p->send_seq++;
+      }
+      pthread_mutex_unlock(&p->lock);
+      if (!batch) {
+         break;
+      }
+
+      send_batch(p, batch);
+      pthread_mutex_lock(&p->lock);
+      release_batch(p, batch);
+      pthread_mutex_unlock(&p->lock);
+   }
+   return NULL;
+}
+
+// Get empty batch, wait until some is returned by workers or sender
+static struct batch *get_free_batch(struct pipeline *p)
+{
+   struct batch *batch;
+   struct timespec wait_start;
+
+   pthread_mutex_lock(&p->lock);
+   if (!p->free_batches.head) {
+      clock_gettime(CLOCK_MONOTONIC, &wait_start);
+      while (!p->free_batches.head) {
+         pthread_cond_wait(&p->free_batches.cond, &p->lock);
+      }
+      p->free_batches.wait_ns += elapsed_ns(&wait_start);
+   }
+   batch = batch_queue_pop(&p->free_batches);
+   pthread_mutex_unlock(&p->lock);
+   return batch;
+}
+
+// Pass filled batch to workers, empty batch is returned to free batches
+static void submit_batch(struct pipeline *p, struct batch *batch)
+{
+   if (!batch) {
+      return;
+   }
+   pthread_mutex_lock(&p->lock);
+   if (batch->count) {
+      batch->seq = p->next_seq++;
+      batch_queue_push(&p->work, batch, 0);
+   } else {
+      batch_queue_push(&p->free_batches, batch, 0);
+   }
+   pthread_mutex_unlock(&p->lock);
+}
+
+// Wait until all batches are processed and sent, reader must not hold any batch
+static void drain_pipeline(struct pipeline *p)
+{
+   pthread_mutex_lock(&p->lock);
+   while (p->free_batches.count < p->batch_count) {
+      pthread_cond_wait(&p->free_batches.cond, &p->lock);
+   }
+   pthread_mutex_unlock(&p->lock);
+}
+
+// Initialize pipeline and start its threads
+int pipeline_init(struct pipeline *p, int worker_count, int ordered, int n_outputs, struct unirec_output_t **output_specifiers, char **port_numbers, const ur_template_t *in_tmplt)
+{
+   int i;
+
+   memset(p, 0, sizeof(*p));
+   pthread_mutex_init(&p->lock, NULL);
+   pthread_cond_init(&p->free_batches.cond, NULL);
+   pthread_cond_init(&p->work.cond, NULL);
+   pthread_cond_init(&p->done.cond, NULL);
+   for (i = 0; i < n_outputs; i++) {
+      pthread_mutex_init(&p->send_locks[i], NULL);
+   }
+   p->ordered = ordered;
+   p->n_outputs = n_outputs;
+   p->output_specifiers = output_specifiers;
+   p->port_numbers = port_numbers;
+   p->in_tmplt = in_tmplt;
+
+   // Reader fills one batch, sender sends one and the rest waits for workers or is processed
+   p->batch_count = worker_count * BATCHES_PER_WORKER + 2;
+   p->batches = (struct batch *) calloc(p->batch_count, sizeof(struct batch));
+   p->workers = (struct worker *) calloc(worker_count, sizeof(struct worker));
+   if (!p->batches || !p->workers) {
+      fprintf(stderr, "Error: Insufficient memory available: pipeline.\n");
+      pipeline_free(p);
+      return 1;
+   }
+   for (i = 0; i < p->batch_count; i++) {
+      p->batches[i].data = (char *) malloc(BATCH_DATA_SIZE);
+      p->batches[i].outputs = (struct batch_output *) calloc(n_outputs, sizeof(struct batch_output));
+      if (!p->batches[i].data || !p->batches[i].outputs) {
+         fprintf(stderr, "Error: Insufficient memory available: pipeline batches.\n");
+         pipeline_free(p);
+         return 1;
+      }
+      batch_queue_push(&p->free_batches, &p->batches[i], 0);
+   }
+
+   for (i = 0; i < worker_count; i++) {
+      p->workers[i].pipeline = p;
+      p->worker_count++;
+      if (worker_create_filters(&p->workers[i]) != 0) {
+         pipeline_free(p);
+         return 1;
+      }
+   }
+   for (i = 0; i < worker_count; i++) {
+      if (pthread_create(&p->workers[i].thread, NULL, worker_thread, &p->workers[i]) != 0) {
+         fprintf(stderr, "Error: Filter worker thread could not be started.\n");
+         pipeline_free(p);
+         return 1;
+      }
+      p->started++;
+   }
+   if (ordered) {
+      if (pthread_create(&p->sender, NULL, sender_thread, p) != 0) {
+         fprintf(stderr, "Error: Sender thread could not be started.\n");
+         pipeline_free(p);
+         return 1;
+      }
+      p->sender_started = 1;
+   }
+   return 0;
+}
+
+// Receive records and pass them to filter workers in batches
+void pipeline_run(struct pipeline *p, ur_template_t **in_tmplt, const void *in_rec, uint16_t in_rec_size, int from, char *filename)
+{
+   struct batch *batch = get_free_batch(p);
+   int ret;
+   int i;
+
+   // Records which did not fill a batch are passed to workers after the timeout
+   if (trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, BATCH_TIMEOUT) != TRAP_E_OK) {
+      fprintf(stderr, "Warning: timeout of input interface could not be set.\n");
+   }
+
+   while (!stop) {
+      // The first record should be already loaded, store it first,
+      // then load another one at the end of the loop
+      if (batch->count == BATCH_RECORDS || batch->size + in_rec_size > BATCH_DATA_SIZE) {
+         submit_batch(p, batch);
+         batch = get_free_batch(p);
+      }
+      if (!batch->count) {
+         batch->first_record = num_records;
+      }
+      memcpy(batch->data + batch->size, in_rec, in_rec_size);
+      batch->size += in_rec_size;
+      batch->sizes[batch->count++] = in_rec_size;
+
+      // SIGUSR1 has been sent, reload filter when all records received so far are processed
+      if (reload_filter == 1) {
+         submit_batch(p, batch);
+         drain_pipeline(p);
+         batch = get_free_batch(p);
+         // Filters of workers use trees of the filters being replaced
+         for (i = 0; i < p->worker_count; i++) {
+            worker_free_filters(&p->workers[i], 0);
+         }
+         if (reload_filters(from, filename, p->port_numbers, p->n_outputs, p->output_specifiers, *in_tmplt) != 0) {
+            stop = 1;
+         }
+         for (i = 0; i < p->worker_count && !stop; i++) {
+            if (worker_create_filters(&p->workers[i]) != 0) {
+               stop = 1;
+            }
+         }
+         reload_filter = 0;
+      }
+      // Quit if maximum number of records has been reached
+      num_records++;
+      if (max_num_records && max_num_records == num_records) {
+         break;
+      }
+
+      // Receive data from input interface, pass waiting records to workers when no data are available
+      while ((ret = trap_recv(0, &in_rec, &in_rec_size)) == TRAP_E_TIMEOUT && !stop) {
+         if (batch->count) {
+            submit_batch(p, batch);
+            batch = get_free_batch(p);
+         }
+      }
+      TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, break, break);
+      // Records of previous format have to be processed before the template changes
+      if (ret == TRAP_E_FORMAT_CHANGED) {
+         const char *spec = NULL;
+         uint8_t data_fmt;
+
+         submit_batch(p, batch);
+         drain_pipeline(p);
+         batch = get_free_batch(p);
+         if (trap_get_data_fmt(TRAPIFC_INPUT, 0, &data_fmt, &spec) != TRAP_E_OK) {
+            fprintf(stderr, "Data format was not loaded.\n");
+            break;
+         }
+         *in_tmplt = ur_define_fields_and_update_template(spec, *in_tmplt);
+         if (!*in_tmplt) {
+            fprintf(stderr, "Template could not be edited.\n");
+            break;
+         }
+         p->in_tmplt = *in_tmplt;
+         // Offsets of fields in input records changed
+         if (create_copy_plans(p->n_outputs, *in_tmplt, p->output_specifiers) != 0) {
+            break;
+         }
+      }
+      // Check size of received data
+      if (in_rec_size < ur_rec_fixlen_size(*in_tmplt)) {
+         if (in_rec_size <= 1) {
+            break;   // End of data (used for testing purposes)
+         } else {
+            fprintf(stderr,
+               "Error: data with wrong size received (expected size: >= %hu, received size: %hu)\n",
+               ur_rec_fixlen_size(*in_tmplt),
+               in_rec_size);
+            break;
+         }
+      }
+   }
+   submit_batch(p, batch);
+   drain_pipeline(p);
+}
+
+// Stop threads of pipeline and free it
+void pipeline_free(struct pipeline *p)
+{
+   int i;
+
+   pthread_mutex_lock(&p->lock);
+   p->finish = 1;
+   pthread_cond_broadcast(&p->work.cond);
+   pthread_cond_broadcast(&p->done.cond);
+   pthread_mutex_unlock(&p->lock);
+   for (i = 0; i < p->started; i++) {
+      pthread_join(p->workers[i].thread, NULL);
+   }
+   if (p->sender_started) {
+      pthread_join(p->sender, NULL);
+   }
+
+   for (i = 0; i < p->worker_count; i++) {
+      worker_free_filters(&p->workers[i], 1);
+   }
+   for (i = 0; p->batches && i < p->batch_count; i++) {
+      int j;
+      for (j = 0; p->batches[i].outputs && j < p->n_outputs; j++) {
+         free(p->batches[i].outputs[j].data);
+      }
+      free(p->batches[i].outputs);
+      free(p->batches[i].data);
+   }
+   free(p->batches);
+   free(p->workers);
+   for (i = 0; i < p->n_outputs; i++) {
+      pthread_mutex_destroy(&p->send_locks[i]);
+   }
+   pthread_cond_destroy(&p->free_batches.cond);
+   pthread_cond_destroy(&p->work.cond);
+   pthread_cond_destroy(&p->done.cond);
+   pthread_mutex_destroy(&p->lock);
+}
+
+// Print depths of queues of pipeline and waiting times of its stages
+void pipeline_print_stats(const struct pipeline *p)
+{
+   const struct batch_queue *work = &p->work;
+   const struct batch_queue *done = &p->done;
+   int i;
+
+   printf("VERBOSE: Pipeline processed %" PRIu64 " batches, %.1f records per batch\n",
+          work->pushes, work->pushes ? (double) num_records / work->pushes : 0.0);
+   printf("VERBOSE: Work queue: average depth %.2f, maximum %d of %d batches, workers waited %.3f s\n",
+          work->pushes ? (double) work->depth_sum / work->pushes : 0.0, work->max_count, p->batch_count,
+          work->wait_ns / 1e9);
+   if (p->ordered) {
+      printf("VERBOSE: Send queue: average depth %.2f, maximum %d batches, sender waited %.3f s\n",
+             done->pushes ? (double) done->depth_sum / done->pushes : 0.0, done->max_count, done->wait_ns / 1e9);
+   }
+   printf("VERBOSE: Reader waited %.3f s for free batches\n", p->free_batches.wait_ns / 1e9);
+   for (i = 0; i < p->worker_count; i++) {
+      printf("VERBOSE: Worker %d processed %" PRIu64 " batches\n", i, p->workers[i].batches);
+   }
+}
+
 int main(int argc, char **argv)
 {
    struct unirec_output_t **output_specifiers = NULL; // filters and output specifiers
@@ -424,6 +1132,9 @@ int main(int argc, char **argv)
    int from = 0; // 0 - template and filter from CMD, 1 - from file
    int n_outputs;
    trap_ifc_spec_t ifc_spec;
+   struct timespec start_time, end_time;
+   uint64_t matched_ifcs = 0; // Bitmap of output interfaces the record matches in filter group
+   int matched = 0;
 
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
 
@@ -482,6 +1193,33 @@ int main(int argc, char **argv)
          max_num_records = nb;
          break;
       }
+      case 'a': // Adaptive order of comparisons
+         filter_options |= URFILTER_ADAPTIVE;
+         break;
+      case 'p': // Profiling of filters
+         filter_options |= URFILTER_PROFILE;
+         break;
+      case 't': // Flushing of output interfaces
+         flush_timeout = atoi(optarg);
+         if (flush_timeout < 0) {
+            fprintf(stderr, "Error: Parameter of -t option must be >= 0.\n");
+            TRAP_DEFAULT_FINALIZATION();
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return 1;
+         }
+         break;
+      case 'T': // Filter worker threads
+         threads = atoi(optarg);
+         if (threads < 0) {
+            fprintf(stderr, "Error: Parameter of -T option must be >= 0.\n");
+            TRAP_DEFAULT_FINALIZATION();
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return 1;
+         }
+         break;
+      case 'R': // Relaxed order of records sent by filter workers
+         relaxed_order = 1;
+         break;
       default:
          fprintf(stderr, "Error: Invalid arguments.\n");
          TRAP_DEFAULT_FINALIZATION();
@@ -515,8 +1253,8 @@ int main(int argc, char **argv)
       return 1;
    }
    // Number of output interfaces exceeds TRAP limit
-   if (n_outputs > 32) {
-      fprintf(stderr, "Error: More than 32 interfaces is not allowed by TRAP library.\n");
+   if (n_outputs > MAX_OUTPUTS) {
+      fprintf(stderr, "Error: More than %d interfaces is not allowed by TRAP library.\n", MAX_OUTPUTS);
       TRAP_DEFAULT_FINALIZATION();
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
       return 1;
@@ -559,6 +1297,15 @@ int main(int argc, char **argv)
       return 1;
    }
 
+   // Records are buffered and sent when the buffer is full or autoflush timeout expires
+   if (flush_timeout > 0) {
+      for (i = 0; i < n_outputs; i++) {
+         if (trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, (uint64_t) flush_timeout * 1000) != TRAP_E_OK) {
+            fprintf(stderr, "Warning: autoflush timeout of interface %d could not be set.\n", i);
+         }
+      }
+   }
+
    // Create input template
    if (trap_set_required_fmt(0, TRAP_FMT_UNIREC, "") != TRAP_E_OK) {
       fprintf(stderr, "ERROR in setting TRAP format: %s\n", trap_last_error_msg);
@@ -665,10 +1412,8 @@ int main(int argc, char **argv)
       return ret;
    }
 
-   // Allocate auxiliary buffer for evalAST()
-   str_buffer = (char *) malloc(65536 * sizeof(char)); // No string in unirec can be longer than 64kB
-   if (!str_buffer) {
-      fprintf(stderr, "Error: Not enough memory for string buffer.\n");
+   if (create_copy_plans(n_outputs, in_tmplt, output_specifiers) != 0
+      || create_filter_group(n_outputs, output_specifiers) != 0) {
       stop = 1;
    }
 
@@ -681,6 +1426,19 @@ int main(int argc, char **argv)
    if (verbose >= 0) {
          printf("VERBOSE: Main loop started\n");
    }
+   clock_gettime(CLOCK_MONOTONIC, &start_time);
+   // Filters are evaluated by worker threads, records are received and sent in batches
+   if (threads > 0) {
+      struct pipeline pipeline;
+      if (!stop && pipeline_init(&pipeline, threads, !relaxed_order, n_outputs, output_specifiers, port_numbers, in_tmplt) == 0) {
+         pipeline_run(&pipeline, &in_tmplt, in_rec, in_rec_size, from, filename);
+         if (verbose >= 0) {
+            pipeline_print_stats(&pipeline);
+         }
+         pipeline_free(&pipeline);
+      }
+      goto cleanup;
+   }
    // Main loop
    // Copy data from input to output
    while (!stop) {
@@ -688,8 +1446,15 @@ int main(int argc, char **argv)
       // then load another one at the end of the loop 
 
       // PROCESS THE DATA
+      if (filter_group) {
+         matched = urfilter_group_match(filter_group, in_tmplt, in_rec, &matched_ifcs);
+      }
       for (i = 0; i < n_outputs; i++) {
-         ret = urfilter_match(output_specifiers[i]->filter, in_tmplt, in_rec);
+         if (filter_group) {
+            ret = matched == URFILTER_ERROR ? URFILTER_ERROR : (int) ((matched_ifcs >> i) & 1);
+         } else {
+            ret = urfilter_match(output_specifiers[i]->filter, in_tmplt, in_rec);
+         }
          if (ret == URFILTER_ERROR) {
             stop = 1;
             break;
@@ -697,40 +1462,24 @@ int main(int argc, char **argv)
             if (verbose >= 1) {
                printf("ADVANCED VERBOSE: Record %u accepted on interface %d\n", num_records, i);
             }
-            //Iterate over all output fields; if the field is present in input template, copy it to output record
-            // If missing, set null
-            void *ptr1 = NULL, *ptr2 = NULL;
-            ur_field_id_t id = 0;
-            int rec_ind = 0;
-            while ((id = ur_iter_fields_record_order(output_specifiers[i]->out_tmplt, rec_ind++)) != UR_ITER_END) {
-               if (ur_is_present(in_tmplt, id)) {
-                  if (!ur_is_dynamic(id)) { //static field
-                     ptr1 = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     ptr2 = ur_get_ptr_by_id(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id);
-                     //copy the data
-                     if ((ptr1 != NULL) && (ptr2 != NULL)) {
-                        memcpy(ptr2, ptr1, ur_get_size(id));
-                     }
-                  } else { //dynamic field
-                     char *in_ptr = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     int size = ur_get_var_len(in_tmplt, in_rec, id);
-                     // Check size of dynamic field and if longer than maximum size then cut it
-                     if (size > DYN_FIELD_MAX_SIZE) {
-                        size = DYN_FIELD_MAX_SIZE;
-                     }
-                     //copy the data
-                     if (ur_set_var(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id, in_ptr, size) != UR_OK) {
-                        fprintf(stderr, "Error: failed to copy data to output.)\n");
-                        goto cleanup;
-                     }
-                  }
+            if (output_specifiers[i]->copy_whole && in_rec_size - ur_rec_fixlen_size(in_tmplt) <= DYN_FIELD_MAX_SIZE) {
+               // Output template is the same and no dynamic field has to be cut
+               ret = trap_send(i, in_rec, in_rec_size);
+            } else {
+               // Copy fields present in input template, missing ones keep default value
+               if (copy_fields(in_tmplt, in_rec, output_specifiers[i], output_specifiers[i]->out_rec) != 0) {
+                  fprintf(stderr, "Error: failed to copy data to output.)\n");
+                  goto cleanup;
                }
+               ret = trap_send(i, output_specifiers[i]->out_rec, ur_rec_size(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec));
+            }
+            // Otherwise libtrap sends buffered records when the buffer is full or autoflush timeout expires
+            if (flush_timeout == 0) {
+               trap_send_flush(i);
             }
-            // Send record to corresponding interface
-            ret = trap_send(i, output_specifiers[i]->out_rec, ur_rec_size(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec));
-            trap_send_flush(i);
             // Handle possible errors
             TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, {stop=1; break;});
+            output_specifiers[i]->sent++;
          } else {
             if (verbose >= 1) {
                printf("ADVANCED VERBOSE: Record %u declined on interface %d\n", num_records, i);
@@ -739,12 +1488,8 @@ int main(int argc, char **argv)
       }
       // SIGUSR1 has been sent, reload filter
       if (reload_filter == 1) {
-         printf("\nReloading filter...\n\n");
-         printf("New filter:\n");
-
-         if (get_filter_from_file(filename, output_specifiers, n_outputs) != 0
-            || create_templates(n_outputs, port_numbers, output_specifiers) != 0) {
-               stop = 1;
+         if (reload_filters(from, filename, port_numbers, n_outputs, output_specifiers, in_tmplt) != 0) {
+            stop = 1;
          }
          reload_filter = 0;
       }
@@ -757,6 +1502,10 @@ int main(int argc, char **argv)
       // Receive data from any input interface, wait until data are available
       ret = TRAP_RECEIVE(0, in_rec, in_rec_size, in_tmplt);
       TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
+      // Offsets of fields in input records changed
+      if (ret == TRAP_E_FORMAT_CHANGED && create_copy_plans(n_outputs, in_tmplt, output_specifiers) != 0) {
+         break;
+      }
       // Check size of received data
       if (in_rec_size < ur_rec_fixlen_size(in_tmplt)) {
          if (in_rec_size <= 1) {
@@ -774,9 +1523,18 @@ int main(int argc, char **argv)
    // ***** Cleanup *****
 cleanup:
    if (verbose >= 0) {
+      clock_gettime(CLOCK_MONOTONIC, &end_time);
+      double duration = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+      if (duration <= 0) {
+         duration = 1e-9;
+      }
+      printf("VERBOSE: Received %u records, %.0f records/s\n", num_records, num_records / duration);
+      for (i = 0; i < n_outputs; i++) {
+         printf("VERBOSE: Interface %d sent %" PRIu64 " records, %.0f records/s\n",
+                i, output_specifiers[i]->sent, output_specifiers[i]->sent / duration);
+      }
       printf("VERBOSE: Cleanup...\n");
    }
-   free(str_buffer);
 
    if (send_eof == 1) {
       for (i = 0; i < n_outputs; i++) {
@@ -792,8 +1550,14 @@ cleanup:
    ur_free_template(in_tmplt);
    free(req_format);
 
+   urfilter_group_destroy(filter_group);
    for (i = 0; i < n_outputs; i++) {
       if (output_specifiers[i]->filter != NULL) {
+         // Filters of worker threads printed their own statistics
+         if ((filter_options & URFILTER_PROFILE) && threads == 0) {
+            printf("Output interface %d: ", i);
+            urfilter_print_stats(output_specifiers[i]->filter);
+         }
          urfilter_destroy(output_specifiers[i]->filter);
          output_specifiers[i]->filter = NULL;
       }
@@ -809,6 +1573,8 @@ cleanup:
          free(output_specifiers[i]->filter_str);
          output_specifiers[i]->filter_str = NULL;
       }
+      free(output_specifiers[i]->copy_steps);
+      free(output_specifiers[i]->copy_var_ids);
       ur_free_record(output_specifiers[i]->out_rec);
       ur_free_template(output_specifiers[i]->out_tmplt);
       free(output_specifiers[i]);
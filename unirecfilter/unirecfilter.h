@@ -48,14 +48,25 @@
 #include <unirec/unirec.h>
 #include <sys/types.h>
 #include <regex.h>
+#include <pthread.h>
 #include <liburfilter.h>
 
 #define DYN_FIELD_MAX_SIZE 1024 // Maximal size of dynamic field, longer fields will be cutted to this size
+#define BATCH_RECORDS 256 // Maximal number of records in batch passed to filter worker
+#define BATCH_DATA_SIZE (1 << 17) // Size of buffer of received records in batch, has to be larger than any record
+#define BATCH_TIMEOUT 100000 // Partially filled batch is passed to workers when no record comes for this time (in us)
+#define BATCHES_PER_WORKER 4 // Number of batches allocated for each filter worker
+#define MAX_OUTPUTS 32 // Maximal number of output interfaces allowed by TRAP library
 
 #define SET_NULL(field_id, tmpl, data) \
 memset(ur_get_ptr_by_id(tmpl, data, field_id), 0, ur_get_size(field_id));
 
-extern char * str_buffer;
+/* Copying of static fields, which are adjacent in both input and output record */
+struct copy_step {
+   uint16_t in_offset; /**< offset of the first field in input record */
+   uint16_t out_offset; /**< offset of the first field in output record */
+   uint16_t size; /**< size of all fields */
+};
 
 /* Structure with information for each output interface */
 struct unirec_output_t {
@@ -65,6 +76,81 @@ struct unirec_output_t {
    urfilter_t *filter; /**< filter structure */
    ur_template_t *out_tmplt; /**< unirec output template */
    void *out_rec; /**< message to be sent */
+   struct copy_step *copy_steps; /**< copying of static fields present in input template */
+   int copy_step_count; /**< number of copy steps */
+   ur_field_id_t *copy_var_ids; /**< dynamic fields present in input template, in output record order */
+   int copy_var_count; /**< number of dynamic fields to copy */
+   int copy_whole; /**< input and output templates have the same fields, input record can be sent as it is */
+   uint64_t sent; /**< number of records sent */
+};
+
+/* Output records of one interface produced from batch */
+struct batch_output {
+   char *data; /**< output records stored one after another */
+   size_t size; /**< used size of data */
+   size_t capacity; /**< allocated size of data */
+   int count; /**< number of output records */
+   uint16_t sizes[BATCH_RECORDS]; /**< sizes of output records */
+};
+
+/* Batch of received records processed by one filter worker */
+struct batch {
+   struct batch *next; /**< next batch in queue */
+   uint64_t seq; /**< sequence number, batches are sent in this order unless relaxed order is used */
+   unsigned int first_record; /**< number of the first record of batch */
+   int count; /**< number of records */
+   char *data; /**< received records stored one after another */
+   size_t size; /**< used size of data */
+   uint16_t sizes[BATCH_RECORDS]; /**< sizes of records */
+   struct batch_output *outputs; /**< output records of every output interface */
+};
+
+/* Queue of batches between two stages of pipeline with statistics of its depth */
+struct batch_queue {
+   struct batch *head; /**< the oldest batch (batch with the lowest sequence number in send queue) */
+   struct batch *tail; /**< the newest batch */
+   int count; /**< number of batches in queue */
+   int max_count; /**< maximal number of batches in queue */
+   uint64_t pushes; /**< number of pushed batches */
+   uint64_t depth_sum; /**< sum of queue depths after every push */
+   uint64_t wait_ns; /**< time the consumers waited for a batch (in ns) */
+   pthread_cond_t cond; /**< signaled when batch is pushed */
+};
+
+struct pipeline;
+
+/* Filter worker thread with its own copy of filters and output records */
+struct worker {
+   pthread_t thread; /**< worker thread */
+   struct pipeline *pipeline; /**< pipeline of worker */
+   urfilter_t *filters[MAX_OUTPUTS]; /**< filters of all output interfaces */
+   urfilter_group_t *group; /**< group of filters, NULL for one output interface */
+   void *out_recs[MAX_OUTPUTS]; /**< output records of all output interfaces */
+   uint64_t batches; /**< number of processed batches */
+};
+
+/* Reader, filter workers and sender connected by queues of batches */
+struct pipeline {
+   pthread_mutex_t lock; /**< lock of queues */
+   struct batch_queue free_batches; /**< batches ready to be filled by reader */
+   struct batch_queue work; /**< received batches waiting for a worker */
+   struct batch_queue done; /**< processed batches waiting for sender, ordered by sequence number */
+   struct batch *batches; /**< all batches */
+   int batch_count; /**< number of batches */
+   struct worker *workers; /**< filter workers */
+   int worker_count; /**< number of filter workers */
+   int ordered; /**< records are sent in input order by sender thread, otherwise workers send them */
+   int started; /**< number of started worker threads */
+   pthread_t sender; /**< sender thread */
+   int sender_started; /**< sender thread was started */
+   int finish; /**< flag to end workers and sender when queues are empty */
+   uint64_t next_seq; /**< sequence number of the next batch passed to workers */
+   uint64_t send_seq; /**< sequence number of the next batch to send */
+   const ur_template_t *in_tmplt; /**< template of input records, changed only when pipeline is empty */
+   int n_outputs; /**< number of output interfaces */
+   struct unirec_output_t **output_specifiers; /**< output interfaces */
+   char **port_numbers; /**< output interface numbers used in filters */
+   pthread_mutex_t send_locks[MAX_OUTPUTS]; /**< locks of output interfaces for workers sending in relaxed order */
 };
 
 /** \brief search for character delimiter in string
@@ -122,5 +208,93 @@ int get_filter_from_file(char *filename, struct unirec_output_t **output_specifi
  * \return 0 on success, non-zero on fail
  */
 int create_templates(int n_outputs, char **port_numbers, struct unirec_output_t **output_specifiers);
+
+/** \brief Create plans of copying fields from input records to output records
+ * Fields present in both templates are found once, adjacent static fields are copied by one memcpy.
+ * Has to be called again when input or output template changes.
+ * \param[in] n_outputs number of output interfaces
+ * \param[in] in_tmplt template of input records
+ * \param[in] output_specifiers array of output specifiers
+ * \return 0 on success, 1 if memory could not be allocated
+ */
+int create_copy_plans(int n_outputs, const ur_template_t *in_tmplt, struct unirec_output_t **output_specifiers);
+
+/** \brief Group filters of all output interfaces
+ * Creates filter group, so that comparisons equal in more filters are evaluated once per record.
+ * Has to be called again when filters are created again. No group is created for one output interface.
+ * \param[in] n_outputs number of output interfaces
+ * \param[in] output_specifiers array of output specifiers
+ * \return 0 on success, 1 if memory could not be allocated
+ */
+int create_filter_group(int n_outputs, struct unirec_output_t **output_specifiers);
+
+/** \brief Load filters again after SIGUSR1
+ * Filters and output templates are loaded from file again, filters given on command line only load their lists again.
+ * \param[in] from 0 - filter from command line, 1 - from file
+ * \param[in] filename path of file with configuration
+ * \param[in] port_numbers array with port numbers
+ * \param[in] n_outputs number of output interfaces
+ * \param[in] output_specifiers array of output specifiers
+ * \param[in] in_tmplt template of input records
+ * \return 0 on success, 1 if filters could not be loaded
+ */
+int reload_filters(int from, char *filename, char **port_numbers, int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt);
+
+/** \brief Copy fields of input record to output record of interface
+ * \param[in] in_tmplt template of input records
+ * \param[in] in_rec input record
+ * \param[in] output_specifier output interface with copy plan
+ * \param[out] out_rec output record of interface with default values of missing fields
+ * \return 0 on success, 1 if dynamic field could not be set
+ */
+int copy_fields(const ur_template_t *in_tmplt, const void *in_rec, struct unirec_output_t *output_specifier, void *out_rec);
+
+/** \brief Create filters and output records of worker
+ * Every worker has its own filters, because filters change their state during evaluation.
+ * Filters of worker are created again when filters of output interfaces change.
+ * \param[in] w filter worker
+ * \return 0 on success, 1 if memory could not be allocated
+ */
+int worker_create_filters(struct worker *w);
+
+/** \brief Free filters and output records of worker
+ * \param[in] w filter worker
+ * \param[in] print_stats print statistics of filters when profiling is enabled
+ */
+void worker_free_filters(struct worker *w, int print_stats);
+
+/** \brief Initialize pipeline and start its threads
+ * \param[out] p pipeline
+ * \param[in] worker_count number of filter workers
+ * \param[in] ordered send records in input order, otherwise workers send records as soon as their batch is processed
+ * \param[in] n_outputs number of output interfaces
+ * \param[in] output_specifiers array of output specifiers
+ * \param[in] port_numbers array with port numbers
+ * \param[in] in_tmplt template of input records
+ * \return 0 on success, 1 on error
+ */
+int pipeline_init(struct pipeline *p, int worker_count, int ordered, int n_outputs, struct unirec_output_t **output_specifiers, char **port_numbers, const ur_template_t *in_tmplt);
+
+/** \brief Receive records and pass them to filter workers in batches
+ * Returns when all records are received, processed and sent. Pipeline is emptied before
+ * the input template or filters are changed.
+ * \param[in] p pipeline
+ * \param[in,out] in_tmplt template of input records, updated when format of input changes
+ * \param[in] in_rec the first record, already received
+ * \param[in] in_rec_size size of the first record
+ * \param[in] from 0 - filter from command line, 1 - from file
+ * \param[in] filename path of file with configuration
+ */
+void pipeline_run(struct pipeline *p, ur_template_t **in_tmplt, const void *in_rec, uint16_t in_rec_size, int from, char *filename);
+
+/** \brief Stop threads of pipeline and free it
+ * \param[in] p pipeline
+ */
+void pipeline_free(struct pipeline *p);
+
+/** \brief Print depths of queues of pipeline and waiting times of its stages
+ * \param[in] p pipeline
+ */
+void pipeline_print_stats(const struct pipeline *p);
 #endif
 